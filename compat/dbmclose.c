@@ -26,11 +26,9 @@
 void
 dbm_close (DBM *dbm)
 {
+  _gdbm_result_free (dbm->file, dbm->_dbm_memory.dptr);
+  free (dbm->_dbm_fetch_val);
   gdbm_close (dbm->file);
   close (dbm->dirfd);
-  if (dbm->_dbm_memory.dptr)
-    free (dbm->_dbm_memory.dptr);
-  if (dbm->_dbm_fetch_val)
-    free (dbm->_dbm_fetch_val);
   free (dbm);
 }
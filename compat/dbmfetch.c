@@ -21,22 +21,63 @@
 #include "ndbm.h"
 #include "gdbmdefs.h"
 
+/* Make sure the fetch buffer of DBM can hold SIZE bytes. */
+static int
+fetch_buffer_grow (DBM *dbm, size_t size)
+{
+  size_t n = dbm->_dbm_fetch_size;
+  char *p;
+
+  if (n >= size && n > 0)
+    return 0;
+  if (n == 0)
+    n = 64;
+  while (n < size)
+    {
+      if ((size_t) -1 / 2 < n)
+	{
+	  n = size;
+	  break;
+	}
+      n *= 2;
+    }
+  p = realloc (dbm->_dbm_fetch_val, n);
+  if (!p)
+    {
+      gdbm_set_errno (dbm->file, GDBM_MALLOC_ERROR, FALSE);
+      return -1;
+    }
+  dbm->_dbm_fetch_val = p;
+  dbm->_dbm_fetch_size = n;
+  return 0;
+}
+
 /* NDBM Look up a given KEY and return the information associated with that
-   KEY. The pointer in the structure that is  returned is a pointer to
-   dynamically allocated memory block.  */
+   KEY. The returned pointer refers to a buffer kept in DBM, which remains
+   valid until the next call to dbm_fetch or dbm_close.  */
 
 datum
 dbm_fetch (DBM *dbm, datum key)
 {
   datum  ret_val;		/* The return value. */
+  size_t size;
 
-  /* Free previous dynamic memory, do actual call, and save pointer to new
-     memory. */
-  ret_val = gdbm_fetch (dbm->file, key);
-  if (dbm->_dbm_fetch_val != NULL)
-    free (dbm->_dbm_fetch_val);
-  dbm->_dbm_fetch_val = ret_val.dptr;
+  ret_val.dptr = NULL;
+  ret_val.dsize = 0;
+  if (fetch_buffer_grow (dbm, 0) == 0)
+    {
+      int rc = gdbm_fetch_into (dbm->file, key, dbm->_dbm_fetch_val,
+				dbm->_dbm_fetch_size, &size);
+      if (rc && gdbm_errno == GDBM_BUFFER_TOO_SMALL
+	  && fetch_buffer_grow (dbm, size) == 0)
+	rc = gdbm_fetch_into (dbm->file, key, dbm->_dbm_fetch_val,
+			      dbm->_dbm_fetch_size, &size);
+      if (rc == 0)
+	{
+	  ret_val.dptr = dbm->_dbm_fetch_val;
+	  ret_val.dsize = size;
+	}
+    }
   __gdbm_error_to_ndbm (dbm);
-  /* Return the new value. */
   return ret_val;
 }
@@ -34,8 +34,7 @@ dbm_firstkey (DBM *dbm)
   /* Free previous dynamic memory, do actual call, and save pointer to new
      memory. */
   ret_val = gdbm_firstkey (dbm->file);
-  if (dbm->_dbm_memory.dptr != NULL)
-    free (dbm->_dbm_memory.dptr);
+  _gdbm_result_free (dbm->file, dbm->_dbm_memory.dptr);
   dbm->_dbm_memory = ret_val;
   __gdbm_error_to_ndbm (dbm);
   /* Return the new value. */
@@ -57,8 +56,7 @@ dbm_nextkey (DBM *dbm)
 
   /* Call gdbm nextkey with the old value. After that, free the old value. */
   ret_val = gdbm_nextkey (dbm->file, dbm->_dbm_memory);
-  if (dbm->_dbm_memory.dptr != NULL)
-    free (dbm->_dbm_memory.dptr);
+  _gdbm_result_free (dbm->file, dbm->_dbm_memory.dptr);
   dbm->_dbm_memory = ret_val;
   __gdbm_error_to_ndbm (dbm);
   /* Return the new value. */
@@ -37,7 +37,8 @@ typedef struct
   GDBM_FILE file;         /* Actual gdbm file (held in the .pag file */
   int dirfd;              /* Descriptor of the .dir file */
   datum _dbm_memory;      /* Keeps the last returned key */
-  char *_dbm_fetch_val;   /* Keeps the dptr of the last fetched datum */
+  char *_dbm_fetch_val;   /* Buffer for the last fetched datum */
+  size_t _dbm_fetch_size; /* Size of _dbm_fetch_val */
   gdbm_error _dbm_errno;  /* Error code from the last failed call */
 } DBM;
 
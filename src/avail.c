@@ -88,13 +88,19 @@ gdbm_avail_block_validate (GDBM_FILE dbf, avail_block *avblk, size_t size)
   return 0;
 }
 
+int
+gdbm_bucket_avail_table_valid_p (GDBM_FILE dbf, hash_bucket *bucket)
+{
+  return bucket->av_count >= 0
+         && bucket->av_count <= BUCKET_AVAIL
+         && gdbm_avail_table_valid_p (dbf, bucket->bucket_avail,
+				      bucket->av_count);
+}
+
 int
 gdbm_bucket_avail_table_validate (GDBM_FILE dbf, hash_bucket *bucket)
 {
-  if (!(bucket->av_count >= 0
-	&& bucket->av_count <= BUCKET_AVAIL
-	&& gdbm_avail_table_valid_p (dbf, bucket->bucket_avail,
-				     bucket->av_count)))
+  if (!gdbm_bucket_avail_table_valid_p (dbf, bucket))
     {
       GDBM_SET_ERRNO (dbf, GDBM_BAD_AVAIL, TRUE);
       return -1;
@@ -0,0 +1,653 @@
+/* avindex.c - In-memory index of available file space. */
+
+/* This file is part of GDBM, the GNU data base manager.
+   Copyright (C) 2025 Free Software Foundation, Inc.
+
+   GDBM is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3, or (at your option)
+   any later version.
+
+   GDBM is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with GDBM. If not, see <http://www.gnu.org/licenses/>.   */
+
+#include "autoconf.h"
+#include "gdbmdefs.h"
+
+/*
+ * When the avail index is enabled (GDBM_SETAVAILINDEX), the header avail
+ * table and the whole stack of avail blocks are loaded into memory on
+ * first allocation or release of file space.  The on-disk structures are
+ * left intact, and the blocks that hold the stack stay reserved.
+ *
+ * Each free area is represented by a node linked into two treaps: one
+ * ordered by size (ties broken by address) and one ordered by address.
+ * The former serves best-fit allocation, the latter is used to coalesce
+ * adjacent areas on release.  Both operations take O(log n).
+ *
+ * Whenever the index has changed, _gdbm_end_update writes it back before
+ * the header: the largest areas go to the header avail table, the rest
+ * is packed into fully populated avail blocks.  The new blocks never
+ * overlap the old ones, which are released only then, so that the file
+ * always has a valid record of its free space.  On gdbm_sync and
+ * gdbm_close the index is also discarded and will be reloaded when
+ * needed.
+ */
+
+enum
+  {
+    AVIDX_SIZE,      /* Tree ordered by size, then by address */
+    AVIDX_ADR,       /* Tree ordered by address */
+    AVIDX_MAX
+  };
+
+typedef struct avail_node avail_node;
+
+struct avail_node
+{
+  avail_elem av;                    /* Free area */
+  unsigned prio;                    /* Treap priority */
+  avail_node *link[AVIDX_MAX][2];   /* Left and right subtrees */
+};
+
+struct avail_index
+{
+  avail_node *root[AVIDX_MAX];      /* Tree roots */
+  size_t count;                     /* Number of nodes */
+  unsigned seed;                    /* Priority generator state */
+  off_t *stack;                     /* Addresses of the avail blocks */
+  size_t nstack;                    /* Number of avail blocks */
+  size_t stack_max;                 /* Capacity of STACK */
+  int changed;                      /* Changed since last written */
+};
+
+static int
+node_cmp (int t, avail_node const *a, avail_node const *b)
+{
+  if (t == AVIDX_SIZE)
+    {
+      if (a->av.av_size < b->av.av_size)
+	return -1;
+      if (a->av.av_size > b->av.av_size)
+	return 1;
+    }
+  if (a->av.av_adr < b->av.av_adr)
+    return -1;
+  if (a->av.av_adr > b->av.av_adr)
+    return 1;
+  return 0;
+}
+
+/* Split the tree ROOT into nodes less than KEY (*L) and the rest (*R). */
+static void
+treap_split (int t, avail_node *root, avail_node const *key,
+	     avail_node **l, avail_node **r)
+{
+  if (!root)
+    *l = *r = NULL;
+  else if (node_cmp (t, root, key) < 0)
+    {
+      treap_split (t, root->link[t][1], key, &root->link[t][1], r);
+      *l = root;
+    }
+  else
+    {
+      treap_split (t, root->link[t][0], key, l, &root->link[t][0]);
+      *r = root;
+    }
+}
+
+/* Merge trees L and R.  All nodes in L are less than those in R. */
+static avail_node *
+treap_merge (int t, avail_node *l, avail_node *r)
+{
+  if (!l)
+    return r;
+  if (!r)
+    return l;
+  if (l->prio > r->prio)
+    {
+      l->link[t][1] = treap_merge (t, l->link[t][1], r);
+      return l;
+    }
+  r->link[t][0] = treap_merge (t, l, r->link[t][0]);
+  return r;
+}
+
+static avail_node *
+treap_insert (int t, avail_node *root, avail_node *node)
+{
+  if (!root)
+    return node;
+  if (node->prio > root->prio)
+    {
+      treap_split (t, root, node, &node->link[t][0], &node->link[t][1]);
+      return node;
+    }
+  if (node_cmp (t, node, root) < 0)
+    root->link[t][0] = treap_insert (t, root->link[t][0], node);
+  else
+    root->link[t][1] = treap_insert (t, root->link[t][1], node);
+  return root;
+}
+
+static avail_node *
+treap_remove (int t, avail_node *root, avail_node *node)
+{
+  if (root == node)
+    return treap_merge (t, node->link[t][0], node->link[t][1]);
+  if (node_cmp (t, node, root) < 0)
+    root->link[t][0] = treap_remove (t, root->link[t][0], node);
+  else
+    root->link[t][1] = treap_remove (t, root->link[t][1], node);
+  return root;
+}
+
+static void
+treap_free (avail_node *root)
+{
+  while (root)
+    {
+      avail_node *next = root->link[AVIDX_ADR][1];
+      treap_free (root->link[AVIDX_ADR][0]);
+      free (root);
+      root = next;
+    }
+}
+
+static void
+index_link (struct avail_index *idx, avail_node *node)
+{
+  int t;
+
+  /* Linear congruential generator is good enough for treap priorities. */
+  idx->seed = idx->seed * 1103515245 + 12345;
+  node->prio = idx->seed;
+  for (t = 0; t < AVIDX_MAX; t++)
+    {
+      node->link[t][0] = node->link[t][1] = NULL;
+      idx->root[t] = treap_insert (t, idx->root[t], node);
+    }
+  idx->count++;
+}
+
+static void
+index_unlink (struct avail_index *idx, avail_node *node)
+{
+  int t;
+
+  for (t = 0; t < AVIDX_MAX; t++)
+    idx->root[t] = treap_remove (t, idx->root[t], node);
+  idx->count--;
+}
+
+/* Return the node with the greatest address less than ADR. */
+static avail_node *
+index_prev (struct avail_index *idx, off_t adr)
+{
+  avail_node *node = idx->root[AVIDX_ADR], *res = NULL;
+
+  while (node)
+    {
+      if (node->av.av_adr < adr)
+	{
+	  res = node;
+	  node = node->link[AVIDX_ADR][1];
+	}
+      else
+	node = node->link[AVIDX_ADR][0];
+    }
+  return res;
+}
+
+/* Return the node with the smallest address not less than ADR. */
+static avail_node *
+index_next (struct avail_index *idx, off_t adr)
+{
+  avail_node *node = idx->root[AVIDX_ADR], *res = NULL;
+
+  while (node)
+    {
+      if (node->av.av_adr >= adr)
+	{
+	  res = node;
+	  node = node->link[AVIDX_ADR][0];
+	}
+      else
+	node = node->link[AVIDX_ADR][1];
+    }
+  return res;
+}
+
+/* Return the smallest node whose size is at least SIZE. */
+static avail_node *
+index_best_fit (struct avail_index *idx, int size)
+{
+  avail_node *node = idx->root[AVIDX_SIZE], *res = NULL;
+
+  while (node)
+    {
+      if (node->av.av_size >= size)
+	{
+	  res = node;
+	  node = node->link[AVIDX_SIZE][0];
+	}
+      else
+	node = node->link[AVIDX_SIZE][1];
+    }
+  return res;
+}
+
+/* Add the area ELEM to the index, merging it with adjacent areas. */
+static int
+index_put (GDBM_FILE dbf, struct avail_index *idx, avail_elem elem)
+{
+  avail_node *node;
+
+  if (elem.av_size <= IGNORE_SIZE)
+    return 0;
+
+  if ((node = index_prev (idx, elem.av_adr)) != NULL)
+    {
+      if (node->av.av_adr + node->av.av_size > elem.av_adr)
+	{
+	  GDBM_SET_ERRNO (dbf, GDBM_BAD_AVAIL, TRUE);
+	  return -1;
+	}
+      if (node->av.av_adr + node->av.av_size == elem.av_adr
+	  && node->av.av_size <= INT_MAX - elem.av_size)
+	{
+	  /* Right adjacent */
+	  index_unlink (idx, node);
+	  elem.av_adr = node->av.av_adr;
+	  elem.av_size += node->av.av_size;
+	  free (node);
+	}
+    }
+
+  if ((node = index_next (idx, elem.av_adr)) != NULL)
+    {
+      if (elem.av_adr + elem.av_size > node->av.av_adr)
+	{
+	  GDBM_SET_ERRNO (dbf, GDBM_BAD_AVAIL, TRUE);
+	  return -1;
+	}
+      if (elem.av_adr + elem.av_size == node->av.av_adr
+	  && node->av.av_size <= INT_MAX - elem.av_size)
+	{
+	  /* Left adjacent */
+	  index_unlink (idx, node);
+	  elem.av_size += node->av.av_size;
+	  free (node);
+	}
+    }
+
+  node = malloc (sizeof (*node));
+  if (!node)
+    {
+      GDBM_SET_ERRNO (dbf, GDBM_MALLOC_ERROR, FALSE);
+      return -1;
+    }
+  node->av = elem;
+  index_link (idx, node);
+  return 0;
+}
+
+/* Add the avail block at ADR to the stack of IDX. */
+static int
+stack_push (GDBM_FILE dbf, struct avail_index *idx, off_t adr)
+{
+  if (idx->nstack == idx->stack_max)
+    {
+      size_t n = idx->stack_max ? 2 * idx->stack_max : 16;
+      off_t *p = realloc (idx->stack, n * sizeof (idx->stack[0]));
+
+      if (!p)
+	{
+	  GDBM_SET_ERRNO (dbf, GDBM_MALLOC_ERROR, FALSE);
+	  return -1;
+	}
+      idx->stack = p;
+      idx->stack_max = n;
+    }
+  idx->stack[idx->nstack++] = adr;
+  return 0;
+}
+
+/* Size of an avail block in the avail stack. */
+static inline size_t
+avail_stack_block_size (GDBM_FILE dbf)
+{
+  return (((size_t)dbf->avail->size * sizeof (avail_elem)) >> 1)
+	  + sizeof (avail_block);
+}
+
+struct load_closure
+{
+  GDBM_FILE dbf;
+  struct avail_index *idx;
+  int rc;
+};
+
+static int
+load_block (avail_block *blk, off_t off, void *data)
+{
+  struct load_closure *clos = data;
+  int i;
+
+  for (i = 0; i < blk->count; i++)
+    if (index_put (clos->dbf, clos->idx, blk->av_table[i]))
+      {
+	clos->rc = -1;
+	return 1;
+      }
+
+  if (off && stack_push (clos->dbf, clos->idx, off))
+    {
+      clos->rc = -1;
+      return 1;
+    }
+  return 0;
+}
+
+/* Load the header avail table and the avail stack into the index. */
+static struct avail_index *
+avail_index_load (GDBM_FILE dbf)
+{
+  struct load_closure clos;
+
+  clos.dbf = dbf;
+  clos.idx = calloc (1, sizeof (*clos.idx));
+  if (!clos.idx)
+    {
+      GDBM_SET_ERRNO (dbf, GDBM_MALLOC_ERROR, FALSE);
+      return NULL;
+    }
+  clos.idx->seed = 1;
+  clos.rc = 0;
+
+  if (gdbm_avail_traverse (dbf, load_block, &clos) || clos.rc)
+    {
+      treap_free (clos.idx->root[AVIDX_ADR]);
+      free (clos.idx->stack);
+      free (clos.idx);
+      return NULL;
+    }
+
+  return clos.idx;
+}
+
+static inline struct avail_index *
+avail_index (GDBM_FILE dbf)
+{
+  if (!dbf->avail_index)
+    dbf->avail_index = avail_index_load (dbf);
+  return dbf->avail_index;
+}
+
+/* Get from the index an area of at least SIZE bytes and store it in
+   *RET.  If no such area exists, extend the one adjoining the end of
+   file or allocate new blocks at the end of file. */
+int
+_gdbm_avail_index_get (GDBM_FILE dbf, int size, avail_elem *ret)
+{
+  struct avail_index *idx;
+  avail_node *node;
+  avail_elem elem;
+
+  if ((idx = avail_index (dbf)) == NULL)
+    return -1;
+
+  node = index_best_fit (idx, size);
+  if (!node)
+    {
+      node = index_prev (idx, dbf->header->next_block);
+      if (node && node->av.av_adr + node->av.av_size != dbf->header->next_block)
+	node = NULL;
+    }
+
+  if (node)
+    {
+      index_unlink (idx, node);
+      elem = node->av;
+      free (node);
+    }
+  else
+    avail_elem_init (&elem, 0, 0);
+
+  if (elem.av_size < size)
+    {
+      avail_elem blk = _gdbm_get_block (size - elem.av_size, dbf);
+      if (elem.av_size == 0)
+	elem = blk;
+      else
+	elem.av_size += blk.av_size;
+    }
+
+  idx->changed = TRUE;
+  dbf->header_changed = TRUE;
+  *ret = elem;
+  return 0;
+}
+
+/* Take from the index the area that starts at ADR, if it is at least
+   SIZE bytes long or ends at the end of the allocated part of the file,
+   and store it in *RET.  If there is no such area,
+   set the size of *RET to 0. */
+int
+_gdbm_avail_index_take (GDBM_FILE dbf, off_t adr, int size, avail_elem *ret)
+{
+  struct avail_index *idx;
+  avail_node *node;
+
+  if ((idx = avail_index (dbf)) == NULL)
+    return -1;
+
+  node = index_next (idx, adr);
+  if (node && node->av.av_adr == adr
+      && (node->av.av_size >= size
+	  || node->av.av_adr + node->av.av_size == dbf->header->next_block))
+    {
+      index_unlink (idx, node);
+      *ret = node->av;
+      free (node);
+      idx->changed = TRUE;
+      dbf->header_changed = TRUE;
+    }
+  else
+    avail_elem_init (ret, 0, 0);
+  return 0;
+}
+
+/* Return the area ELEM to the index. */
+int
+_gdbm_avail_index_put (GDBM_FILE dbf, avail_elem elem)
+{
+  struct avail_index *idx;
+
+  if ((idx = avail_index (dbf)) == NULL)
+    return -1;
+  idx->changed = TRUE;
+  dbf->header_changed = TRUE;
+  return index_put (dbf, idx, elem);
+}
+
+/* Store the areas from the tree ROOT in ascending order in TAB. */
+static size_t
+index_collect (avail_node *root, avail_elem *tab, size_t n)
+{
+  while (root)
+    {
+      n = index_collect (root->link[AVIDX_SIZE][0], tab, n);
+      tab[n++] = root->av;
+      root = root->link[AVIDX_SIZE][1];
+    }
+  return n;
+}
+
+/* Write the index back to the header avail table and to a new avail
+   stack, and release the blocks of the old one. */
+static int
+avail_index_write (GDBM_FILE dbf, struct avail_index *idx)
+{
+  size_t blksize, blkcap, hdrcap;
+  off_t *blocks = NULL;
+  size_t nblk = 0, nblk_max = 0;
+  avail_elem *tab = NULL;
+  avail_block *blk = NULL;
+  size_t n, i, k;
+  int rc = -1;
+
+  blksize = avail_stack_block_size (dbf);
+  blkcap = (blksize - sizeof (avail_block)) / sizeof (avail_elem) + 1;
+  hdrcap = dbf->avail->size;
+
+  /* Reserve space for as many avail blocks as needed, counting the
+     blocks of the old stack, which become free. */
+  while (idx->count + idx->nstack > hdrcap + nblk * blkcap)
+    {
+      avail_node *node;
+      avail_elem elem;
+
+      if (nblk == nblk_max)
+	{
+	  off_t *p;
+
+	  nblk_max = nblk_max ? 2 * nblk_max : 16;
+	  p = realloc (blocks, nblk_max * sizeof (blocks[0]));
+	  if (!p)
+	    {
+	      GDBM_SET_ERRNO (dbf, GDBM_MALLOC_ERROR, FALSE);
+	      goto end;
+	    }
+	  blocks = p;
+	}
+
+      if ((node = index_best_fit (idx, blksize)) != NULL)
+	{
+	  index_unlink (idx, node);
+	  elem = node->av;
+	  free (node);
+	}
+      else
+	elem = _gdbm_get_block (blksize, dbf);
+
+      blocks[nblk++] = elem.av_adr;
+      elem.av_adr += blksize;
+      elem.av_size -= blksize;
+      if (index_put (dbf, idx, elem))
+	goto end;
+    }
+
+  /* The old stack is no longer needed once the header is written. */
+  for (i = 0; i < idx->nstack; i++)
+    {
+      avail_elem elem;
+
+      avail_elem_init (&elem, blksize, idx->stack[i]);
+      if (index_put (dbf, idx, elem))
+	goto end;
+    }
+  idx->nstack = 0;
+
+  /* Collect the areas in ascending order of size. */
+  n = idx->count;
+  if (n)
+    {
+      tab = malloc (n * sizeof (tab[0]));
+      if (!tab)
+	{
+	  GDBM_SET_ERRNO (dbf, GDBM_MALLOC_ERROR, FALSE);
+	  goto end;
+	}
+      index_collect (idx->root[AVIDX_SIZE], tab, 0);
+    }
+
+  /* The largest areas go to the header table. */
+  k = n < hdrcap ? n : hdrcap;
+  n -= k;
+  if (k)
+    memcpy (dbf->avail->av_table, tab + n, k * sizeof (tab[0]));
+  dbf->avail->count = k;
+  dbf->avail->next_block = 0;
+
+  /* The rest is spread evenly over the avail blocks, the smallest
+     areas going to the bottom of the stack. */
+  if (nblk)
+    {
+      blk = calloc (1, blksize);
+      if (!blk)
+	{
+	  GDBM_SET_ERRNO (dbf, GDBM_MALLOC_ERROR, FALSE);
+	  goto end;
+	}
+    }
+
+  for (i = k = 0; i < nblk; i++)
+    {
+      size_t cnt = (n - k + nblk - i - 1) / (nblk - i);
+
+      blk->size = dbf->avail->size;
+      blk->count = cnt;
+      blk->next_block = dbf->avail->next_block;
+      memcpy (blk->av_table, tab + k, cnt * sizeof (tab[0]));
+      k += cnt;
+      if (_gdbm_write_at (dbf, blocks[i], blk, blksize))
+	goto end;
+      dbf->avail->next_block = blocks[i];
+    }
+
+  /* The new blocks form the stack now. */
+  free (idx->stack);
+  idx->stack = blocks;
+  idx->nstack = idx->stack_max = nblk;
+  blocks = NULL;
+  idx->changed = FALSE;
+  dbf->header_changed = TRUE;
+  rc = 0;
+ end:
+  free (blk);
+  free (tab);
+  free (blocks);
+  return rc;
+}
+
+/* Write the index back, if it has changed since it was last written.
+   Called before the header is written. */
+int
+_gdbm_avail_index_flush (GDBM_FILE dbf)
+{
+  struct avail_index *idx = dbf->avail_index;
+
+  if (!idx || !idx->changed)
+    return 0;
+  return avail_index_write (dbf, idx);
+}
+
+/* Write the index back and discard it. */
+int
+_gdbm_avail_index_save (GDBM_FILE dbf)
+{
+  int rc = _gdbm_avail_index_flush (dbf);
+
+  _gdbm_avail_index_free (dbf);
+  return rc;
+}
+
+/* Discard the index without writing it back. */
+void
+_gdbm_avail_index_free (GDBM_FILE dbf)
+{
+  if (dbf->avail_index)
+    {
+      treap_free (dbf->avail_index->root[AVIDX_ADR]);
+      free (dbf->avail_index->stack);
+      free (dbf->avail_index);
+      dbf->avail_index = NULL;
+    }
+}
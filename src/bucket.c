@@ -20,9 +20,9 @@
 #include "gdbmdefs.h"
 #include <stdint.h>
 #include <limits.h>
-
-#define GDBM_MAX_DIR_SIZE INT32_MAX
-#define GDBM_MAX_DIR_HALF (GDBM_MAX_DIR_SIZE / 2)
+#if HAVE_MMAP
+# include <sys/mman.h>
+#endif
 
 /* Initializing a new hash buckets sets all bucket entries to -1 hash value. */
 void
@@ -42,6 +42,75 @@ _gdbm_new_bucket (GDBM_FILE dbf, hash_bucket *bucket, int bits)
     bucket->h_table[index].hash_value = -1;
 }
 
+/* Find a slot for a new element with hash value HASH_VAL in BUCKET and
+   return its location.  With Robin Hood placement, the new element goes
+   before the first element of its probe sequence which is closer to
+   its own home slot, and the rest of the cluster is shifted by one slot
+   to make room for it.  The hash_value of the returned slot is -1.
+   Return -1 if BUCKET is full. */
+int
+_gdbm_bucket_slot (GDBM_FILE dbf, hash_bucket *bucket, int hash_val)
+{
+  int bucket_elems = dbf->header->bucket_elems;
+  int loc, start, end, dist;
+
+  loc = start = hash_val % bucket_elems;
+  for (dist = 0; bucket->h_table[loc].hash_value != -1; dist++)
+    {
+      if (gdbm_robin_hood_p (dbf)
+	  && bucket_element_distance (dbf, bucket, loc) < dist)
+	break;
+      loc = (loc + 1) % bucket_elems;
+      if (loc == start)
+	return -1;
+    }
+
+  if (bucket->h_table[loc].hash_value != -1)
+    {
+      /* Find the end of the cluster and shift the elements. */
+      end = loc;
+      do
+	{
+	  end = (end + 1) % bucket_elems;
+	  if (end == loc)
+	    return -1;
+	}
+      while (bucket->h_table[end].hash_value != -1);
+
+      while (end != loc)
+	{
+	  int prev = (end + bucket_elems - 1) % bucket_elems;
+	  bucket->h_table[end] = bucket->h_table[prev];
+	  end = prev;
+	}
+      bucket->h_table[loc].hash_value = -1;
+    }
+  return loc;
+}
+
+/* Shared cache pool locking.  All operations on the cache of a database
+   attached to a pool are serialized by its cache mutex, because other
+   databases of the pool may evict elements from it. */
+#if HAVE_PTHREAD_H
+# define CACHE_LOCK(dbf)						\
+  do									\
+    {									\
+      if ((dbf)->cache_pool)						\
+	pthread_mutex_lock (&(dbf)->cache_mutex);			\
+    }									\
+  while (0)
+# define CACHE_UNLOCK(dbf)						\
+  do									\
+    {									\
+      if ((dbf)->cache_pool)						\
+	pthread_mutex_unlock (&(dbf)->cache_mutex);			\
+    }									\
+  while (0)
+#else
+# define CACHE_LOCK(dbf)
+# define CACHE_UNLOCK(dbf)
+#endif
+
 /* Bucket cache table functions */
 
 /* Hash an off_t word into an index of width NBITS. */
@@ -137,6 +206,247 @@ lru_unlink_elem (GDBM_FILE dbf, cache_elem *elem)
   elem->ca_prev = elem->ca_next = NULL;
 }
 
+/* Size of a cache element for DBF, in bytes. */
+#define CACHE_ELEM_SIZE(dbf) \
+  (sizeof (cache_elem) - sizeof (hash_bucket) + (dbf)->bucket_mem_size)
+
+/* Minimal number of elements kept in cache, no matter what the memory
+   budget is.  Splitting a bucket requires three of them. */
+#define CACHE_MIN_ELEMS 4
+
+/* Return the number of bytes used by the bucket cache, data caches and
+   the directory of DBF. */
+static inline size_t
+cache_mem_usage (GDBM_FILE dbf)
+{
+  return dbf->cache_mem
+         + dbf->cache_size * sizeof (dbf->cache[0])
+         + _gdbm_dir_mem_size (dbf);
+}
+
+/* Return true if allocating EXTRA more bytes would exceed the memory
+   budget of DBF or that of the cache pool it is attached to. */
+static inline int
+cache_mem_exceeded (GDBM_FILE dbf, size_t extra)
+{
+  if (dbf->cache_mem_max != 0
+      && cache_mem_usage (dbf) + extra > dbf->cache_mem_max)
+    return 1;
+  if (dbf->cache_pool
+      && __atomic_load_n (&dbf->cache_pool->mem, __ATOMIC_RELAXED) + extra
+           > dbf->cache_pool->mem_max)
+    return 1;
+  return 0;
+}
+
+/* Account for N bytes allocated (cache_mem_add) or freed (cache_mem_sub)
+   by the cache of DBF. */
+static inline void
+cache_mem_add (GDBM_FILE dbf, size_t n)
+{
+  dbf->cache_mem += n;
+  if (dbf->cache_pool)
+    __atomic_fetch_add (&dbf->cache_pool->mem, n, __ATOMIC_RELAXED);
+}
+
+static inline void
+cache_mem_sub (GDBM_FILE dbf, size_t n)
+{
+  dbf->cache_mem -= n;
+  if (dbf->cache_pool)
+    __atomic_fetch_sub (&dbf->cache_pool->mem, n, __ATOMIC_RELAXED);
+}
+
+/* Return the next value of the cache pool clock. */
+static inline unsigned long
+cache_tick (GDBM_FILE dbf)
+{
+  if (dbf->cache_pool)
+    return __atomic_fetch_add (&dbf->cache_pool->tick, 1, __ATOMIC_RELAXED);
+  return 0;
+}
+
+/*
+ * Cache slabs.
+ *
+ * Slabs with unused elements are kept in the cache_slab_partial list and
+ * the ones with all elements in use in cache_slab_full.  Elements are
+ * allocated from the first partial slab, so that the memory is reused
+ * before new slabs are created.  A slab is freed as soon as all its
+ * elements are released.
+ */
+
+/* Size of a regular slab. */
+#define CACHE_SLAB_SIZE (64*1024)
+/* Size of a slab allocated from huge pages. */
+#define CACHE_SLAB_HUGE_SIZE (2*1024*1024)
+/* Alignment of the first element in slab. */
+#define CACHE_SLAB_ALIGN 64
+#define CACHE_SLAB_HDR_SIZE \
+  ((sizeof (cache_slab) + CACHE_SLAB_ALIGN - 1) & ~(CACHE_SLAB_ALIGN - 1))
+/* Elements are aligned on this boundary. */
+#define CACHE_ELEM_ALIGN 16
+
+#define CACHE_SLAB_ELEM(slab, n) \
+  ((cache_elem *)((char*)(slab) + CACHE_SLAB_HDR_SIZE + (n) * (slab)->stride))
+
+#if HAVE_MMAP && defined (MAP_ANONYMOUS) && defined (MADV_HUGEPAGE)
+# define CACHE_HUGEPAGES 1
+
+/* Allocate a slab of SIZE bytes aligned on a SIZE boundary, so that it
+   can be backed by a transparent huge page. */
+static void *
+slab_huge_alloc (size_t size)
+{
+  char *p, *q;
+
+  p = mmap (NULL, 2 * size, PROT_READ | PROT_WRITE,
+	    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (p == MAP_FAILED)
+    return NULL;
+  q = (char *) (((uintptr_t) p + size - 1) & ~(uintptr_t) (size - 1));
+  if (q > p)
+    munmap (p, q - p);
+  munmap (q + size, p + size - q);
+  /* Failure is harmless: regular pages will be used. */
+  madvise (q, size, MADV_HUGEPAGE);
+  return q;
+}
+#else
+# define CACHE_HUGEPAGES 0
+#endif
+
+static inline void
+slab_link (cache_slab **head, cache_slab *slab)
+{
+  slab->prev = NULL;
+  slab->next = *head;
+  if (*head)
+    (*head)->prev = slab;
+  *head = slab;
+}
+
+static inline void
+slab_unlink (cache_slab **head, cache_slab *slab)
+{
+  if (slab->prev)
+    slab->prev->next = slab->next;
+  else
+    *head = slab->next;
+  if (slab->next)
+    slab->next->prev = slab->prev;
+}
+
+static inline int
+slab_full_p (cache_slab *slab)
+{
+  return slab->free == NULL && slab->nfresh == slab->nelem;
+}
+
+/* Create new slab for cache elements of DBF and link it to the list of
+   partial slabs. */
+static cache_slab *
+cache_slab_new (GDBM_FILE dbf)
+{
+  cache_slab *slab = NULL;
+  size_t stride = (CACHE_ELEM_SIZE (dbf) + CACHE_ELEM_ALIGN - 1)
+		    & ~(CACHE_ELEM_ALIGN - 1);
+  size_t size;
+  int mapped = 0;
+
+#if CACHE_HUGEPAGES
+  if (dbf->cache_hugepages
+      && CACHE_SLAB_HDR_SIZE + stride <= CACHE_SLAB_HUGE_SIZE)
+    {
+      size = CACHE_SLAB_HUGE_SIZE;
+      if ((slab = slab_huge_alloc (size)) != NULL)
+	mapped = 1;
+    }
+#endif
+  if (!slab)
+    {
+      size = CACHE_SLAB_SIZE;
+      if (size < CACHE_SLAB_HDR_SIZE + stride)
+	size = CACHE_SLAB_HDR_SIZE + stride;
+      slab = calloc (1, size);
+      if (!slab)
+	return NULL;
+    }
+
+  slab->free = NULL;
+  slab->stride = stride;
+  slab->nelem = (size - CACHE_SLAB_HDR_SIZE) / stride;
+  slab->nfresh = 0;
+  slab->used = 0;
+  slab->size = size;
+  slab->mapped = mapped;
+  slab_link (&dbf->cache_slab_partial, slab);
+  return slab;
+}
+
+static void
+cache_slab_destroy (cache_slab *slab)
+{
+#if CACHE_HUGEPAGES
+  if (slab->mapped)
+    {
+      munmap (slab, slab->size);
+      return;
+    }
+#endif
+  free (slab);
+}
+
+/* Allocate a zero-initialized cache element from a slab. */
+static cache_elem *
+cache_slab_alloc (GDBM_FILE dbf)
+{
+  cache_slab *slab = dbf->cache_slab_partial;
+  cache_elem *elem;
+
+  if (!slab && (slab = cache_slab_new (dbf)) == NULL)
+    return NULL;
+
+  if (slab->free)
+    {
+      elem = slab->free;
+      slab->free = elem->ca_next;
+      memset (elem, 0, slab->stride);
+    }
+  else
+    /* Never used elements are zeroed by calloc or mmap. */
+    elem = CACHE_SLAB_ELEM (slab, slab->nfresh++);
+  elem->ca_slab = slab;
+  slab->used++;
+
+  if (slab_full_p (slab))
+    {
+      slab_unlink (&dbf->cache_slab_partial, slab);
+      slab_link (&dbf->cache_slab_full, slab);
+    }
+  return elem;
+}
+
+/* Return the element ELEM to its slab. */
+static void
+cache_slab_release (GDBM_FILE dbf, cache_elem *elem)
+{
+  cache_slab *slab = elem->ca_slab;
+
+  if (slab_full_p (slab))
+    {
+      slab_unlink (&dbf->cache_slab_full, slab);
+      slab_link (&dbf->cache_slab_partial, slab);
+    }
+  elem->ca_next = slab->free;
+  slab->free = elem;
+  if (--slab->used == 0)
+    {
+      slab_unlink (&dbf->cache_slab_partial, slab);
+      cache_slab_destroy (slab);
+    }
+}
+
 /* Creates and returns new cache element for DBF.  The element is initialized,
    but not linked to the LRU list.
    Return NULL on error.
@@ -153,13 +463,11 @@ cache_elem_new (GDBM_FILE dbf, off_t adr)
     }
   else
     {
-      elem = calloc (1,
-		     sizeof (*elem) -
-		     sizeof (elem->ca_bucket[0]) +
-		     dbf->header->bucket_size);
+      elem = cache_slab_alloc (dbf);
 
       if (!elem)
 	return NULL;
+      cache_mem_add (dbf, CACHE_ELEM_SIZE (dbf));
     }
 
   elem->ca_adr = adr;
@@ -169,11 +477,24 @@ cache_elem_new (GDBM_FILE dbf, off_t adr)
 
   elem->ca_prev = elem->ca_next = elem->ca_coll = NULL;
   elem->ca_hits = 0;
+  elem->ca_size = -1;
   
   return elem;
 }
 
-/* Frees element ELEM.  Unlinks it from the cache tree and LRU list. */
+/* Release the memory used by ELEM, which must not be linked anywhere. */
+static void
+cache_elem_destroy (GDBM_FILE dbf, cache_elem *elem)
+{
+  cache_mem_sub (dbf, CACHE_ELEM_SIZE (dbf) + elem->ca_data.dsize);
+  free (elem->ca_data.dptr);
+  cache_slab_release (dbf, elem);
+}
+
+/* Frees element ELEM.  Unlinks it from the cache tree and LRU list.
+   The element is retained in the list of available elements, unless
+   this would exceed the memory budget or DBF is attached to a cache
+   pool. */
 static void
 cache_elem_free (GDBM_FILE dbf, cache_elem *elem)
 {
@@ -182,8 +503,6 @@ cache_elem_free (GDBM_FILE dbf, cache_elem *elem)
   
   lru_unlink_elem (dbf, elem);
 
-  elem->ca_next = dbf->cache_avail;
-  dbf->cache_avail = elem;
   dbf->cache_num--;
 
   pp = &dbf->cache[h];
@@ -195,7 +514,15 @@ cache_elem_free (GDBM_FILE dbf, cache_elem *elem)
 	  break;
 	}
       pp = &(*pp)->ca_coll;
-    }      
+    }
+
+  if (dbf->cache_pool || cache_mem_exceeded (dbf, 0))
+    cache_elem_destroy (dbf, elem);
+  else
+    {
+      elem->ca_next = dbf->cache_avail;
+      dbf->cache_avail = elem;
+    }
 }
 
 /* Free the least recently used cache entry. */
@@ -211,7 +538,7 @@ cache_lru_free (GDBM_FILE dbf)
   cache_elem_free (dbf, last);
   return 0;
 }
-
+
 /*
  * Round up V to the next highest power of 2 and compute log2 of
  * it using De Brujin sequences.
@@ -285,6 +612,128 @@ cache_tab_resize (GDBM_FILE dbf, int bits)
   return 0;
 }
 
+/* Automatic cache sizing.
+
+   The hit ratio is measured over a window of CACHE_WINDOW accesses.  At
+   the end of each window, the cache table is doubled if the ratio of
+   misses exceeds 1/CACHE_GROW_RATIO, the cache is full and the memory
+   budget permits it.  It is halved if the ratio of misses is below
+   1/CACHE_SHRINK_RATIO and less than a quarter of the cache elements
+   have been requested during the window. */
+
+#define CACHE_WINDOW(dbf) \
+  ((dbf)->cache_size < 128 ? 256 : 2 * (dbf)->cache_size)
+#define CACHE_GROW_RATIO   32
+#define CACHE_SHRINK_RATIO 256
+#define CACHE_MIN_BITS     4
+
+static int
+cache_auto_adjust (GDBM_FILE dbf)
+{
+  int bits = dbf->cache_bits;
+  size_t misses;
+
+  if (dbf->cache_win_access < CACHE_WINDOW (dbf))
+    return 0;
+
+  misses = dbf->cache_win_access - dbf->cache_win_hits;
+  if (misses * CACHE_GROW_RATIO > dbf->cache_win_access)
+    {
+      if (dbf->cache_num == dbf->cache_size
+	  && bits < dbf->header->dir_bits
+	  && !cache_mem_exceeded (dbf,
+				  dbf->cache_size * sizeof (dbf->cache[0])
+				  + CACHE_ELEM_SIZE (dbf)))
+	bits++;
+    }
+  else if (misses * CACHE_SHRINK_RATIO < dbf->cache_win_access
+	   && dbf->cache_win_touched < dbf->cache_size / 4
+	   && bits > CACHE_MIN_BITS)
+    bits--;
+
+  /* Start new window */
+  dbf->cache_win++;
+  dbf->cache_win_access = 0;
+  dbf->cache_win_hits = 0;
+  dbf->cache_win_touched = 0;
+
+  if (bits != dbf->cache_bits)
+    return cache_tab_resize (dbf, bits);
+  return 0;
+}
+
+/* Return true if the least recently used element of P, another
+   database of the cache pool, can be evicted.  P is locked by the
+   caller.
+
+   Between the calls to its cache functions, the thread using P keeps
+   pointers to its current bucket and to the data of its elements that
+   were looked up during the ongoing call.  Such elements are idle only
+   when P is not in use.  Changed buckets are not evicted either:
+   writing them requires file I/O on P. */
+static int
+cache_pool_idle_p (GDBM_FILE p)
+{
+  cache_elem *elem = p->cache_lru;
+
+  return p->cache_num > CACHE_MIN_ELEMS
+         && elem != p->cache_mru
+         && !elem->ca_changed
+         && elem->ca_tick < __atomic_load_n (&p->pool_call_tick,
+					     __ATOMIC_RELAXED);
+}
+
+/*
+ * Select the database to evict a cache element from, in order to make
+ * room for a new element in the cache of DBF.  The least recently used
+ * element among DBF and the other databases attached to the pool whose
+ * least recently used element is idle is chosen.  Another database is
+ * returned locked, and must be unlocked by the caller after evicting
+ * the element.  Databases locked by other threads are skipped.
+ * Return NULL if nothing can be evicted.
+ */
+static GDBM_FILE
+cache_pool_victim (GDBM_FILE dbf)
+{
+  gdbm_cache_pool *pool = dbf->cache_pool;
+  GDBM_FILE p, victim = NULL;
+
+  if (dbf->cache_num >= CACHE_MIN_ELEMS)
+    victim = dbf;
+  if (!pool)
+    return victim;
+
+#if HAVE_PTHREAD_H
+  pthread_mutex_lock (&pool->mutex);
+#endif
+  for (p = pool->dbf_head; p; p = p->pool_next)
+    {
+      if (p == dbf)
+	continue;
+#if HAVE_PTHREAD_H
+      if (pthread_mutex_trylock (&p->cache_mutex))
+	continue;
+#endif
+      if (cache_pool_idle_p (p)
+	  && (!victim || p->cache_lru->ca_tick < victim->cache_lru->ca_tick))
+	{
+#if HAVE_PTHREAD_H
+	  if (victim && victim != dbf)
+	    pthread_mutex_unlock (&victim->cache_mutex);
+#endif
+	  victim = p;
+	}
+#if HAVE_PTHREAD_H
+      else
+	pthread_mutex_unlock (&p->cache_mutex);
+#endif
+    }
+#if HAVE_PTHREAD_H
+  pthread_mutex_unlock (&pool->mutex);
+#endif
+  return victim;
+}
+
 enum
   {
     cache_found,
@@ -297,8 +746,16 @@ cache_lookup (GDBM_FILE dbf, off_t adr, cache_elem *ref, cache_elem **ret_elem)
 {
   int rc;
   cache_elem **elp, *elem;
+
+  /*
+   * Adjust the cache size only when the requested bucket is going to
+   * become current.  Otherwise, the REF element could get evicted.
+   */
+  if (ref == NULL && dbf->cache_auto && cache_auto_adjust (dbf))
+    return cache_failure;
   
   dbf->cache_access_count++;
+  dbf->cache_win_access++;
 
   elp = cache_tab_lookup_slot (dbf, adr);
   
@@ -306,35 +763,60 @@ cache_lookup (GDBM_FILE dbf, off_t adr, cache_elem *ref, cache_elem **ret_elem)
     {
       elem = *elp;
       elem->ca_hits++;
+      elem->ca_tick = cache_tick (dbf);
       dbf->cache_hits++;
+      dbf->cache_win_hits++;
+      if (elem->ca_win != dbf->cache_win)
+	{
+	  elem->ca_win = dbf->cache_win;
+	  dbf->cache_win_touched++;
+	}
       lru_unlink_elem (dbf, elem);
       rc = cache_found;
     }
-  else if ((elem = cache_elem_new (dbf, adr)) == NULL)
-    return cache_failure;
   else
     {
-      rc = cache_new;
-
-      if (dbf->cache_num == dbf->cache_size)
+      GDBM_FILE victim;
+      
+      /*
+       * Make room for the new element: evict least recently used
+       * elements while the cache is full or the memory budget is
+       * exceeded.
+       */
+      if (dbf->cache_num > 0 && dbf->cache_num >= dbf->cache_size)
+	{
+	  if (cache_lru_free (dbf))
+	    return cache_failure;
+	}
+      while (cache_mem_exceeded (dbf,
+				 dbf->cache_avail ? 0 : CACHE_ELEM_SIZE (dbf))
+	     && (victim = cache_pool_victim (dbf)) != NULL)
 	{
-	  if (dbf->cache_auto && dbf->cache_bits < dbf->header->dir_bits &&
-	      cache_tab_resize (dbf, dbf->cache_bits + 1) == 0)
+	  if (victim == dbf)
 	    {
-	      /* Table has been reallocated, recompute the slot. */
-	      elp = cache_tab_lookup_slot (dbf, adr);
+	      if (cache_lru_free (dbf))
+		return cache_failure;
 	    }
-	  else if (cache_lru_free (dbf))
+	  else
 	    {
-	      rc = cache_failure;
+	      cache_elem_free (victim, victim->cache_lru);
+	      CACHE_UNLOCK (victim);
 	    }
 	}
+
+      if ((elem = cache_elem_new (dbf, adr)) == NULL)
+	return cache_failure;
+
+      elem->ca_tick = cache_tick (dbf);
+      elem->ca_win = dbf->cache_win;
+      dbf->cache_win_touched++;
       
-      if (rc == cache_new)
-	{
-	  *elp = elem;
-	  dbf->cache_num++;
-	}
+      /* Eviction could have altered the collision chain: recompute the
+	 slot. */
+      elp = cache_tab_lookup_slot (dbf, adr);
+      *elp = elem;
+      dbf->cache_num++;
+      rc = cache_new;
     }
 
   /*
@@ -347,11 +829,206 @@ cache_lookup (GDBM_FILE dbf, off_t adr, cache_elem *ref, cache_elem **ret_elem)
     _gdbm_cache_flush (dbf);
   
   lru_link_elem (dbf, elem, ref);
-  if (rc != cache_failure)
-    *ret_elem = elem;
+  *ret_elem = elem;
   return rc;
 }
-
+
+/* Compact bucket encoding (see the comment to COMPACT_BUCKET_HDR_SIZE
+   in gdbmdefs.h). */
+
+/* Return the size of the compact encoding of ELEM. */
+static int
+compact_elem_size (GDBM_FILE dbf, bucket_element const *elem)
+{
+  int size = sizeof (elem->hash_value)
+             + varint_size (elem->key_size)
+             + varint_size (elem->data_size);
+
+  if (bucket_element_inline_p (dbf, elem))
+    size += elem->key_size + elem->data_size;
+  else
+    size += gdbm_key_start_len (dbf, elem->key_size)
+            + varint_size (elem->data_pointer);
+  return size;
+}
+
+/* Return the size of the compact encoding of BUCKET. */
+static int
+compact_bucket_size (GDBM_FILE dbf, hash_bucket const *bucket)
+{
+  int size = COMPACT_BUCKET_HDR_SIZE (dbf);
+  int i;
+
+  for (i = 0; i < dbf->header->bucket_elems; i++)
+    if (bucket->h_table[i].hash_value != -1)
+      size += compact_elem_size (dbf, &bucket->h_table[i]);
+  return size;
+}
+
+/* Encode BUCKET into BUF, which is header->bucket_size bytes long.
+   Return the number of bytes used, or -1 if the encoding doesn't fit. */
+int
+_gdbm_bucket_encode (GDBM_FILE dbf, hash_bucket const *bucket, char *buf)
+{
+  unsigned char *map = (unsigned char *) buf + offsetof (hash_bucket, h_table);
+  unsigned char *p = (unsigned char *) buf + COMPACT_BUCKET_HDR_SIZE (dbf);
+  unsigned char *end = (unsigned char *) buf + dbf->header->bucket_size;
+  int i;
+
+  memset (buf, 0, dbf->header->bucket_size);
+  memcpy (buf, bucket, offsetof (hash_bucket, h_table));
+  for (i = 0; i < dbf->header->bucket_elems; i++)
+    {
+      bucket_element const *elem = &bucket->h_table[i];
+
+      if (elem->hash_value == -1)
+	continue;
+      if (end - p < compact_elem_size (dbf, elem))
+	return -1;
+
+      map[i / 8] |= 1 << (i % 8);
+      memcpy (p, &elem->hash_value, sizeof (elem->hash_value));
+      p += sizeof (elem->hash_value);
+      p = varint_put (p, elem->key_size);
+      p = varint_put (p, elem->data_size);
+      if (bucket_element_inline_p (dbf, elem))
+	{
+	  bucket_element_inline_get (elem, (char *) p);
+	  p += elem->key_size + elem->data_size;
+	}
+      else
+	{
+	  int n = gdbm_key_start_len (dbf, elem->key_size);
+
+	  memcpy (p, elem->key_start, n);
+	  p += n;
+	  p = varint_put (p, elem->data_pointer);
+	}
+    }
+  return p - (unsigned char *) buf;
+}
+
+/* Decode the compact bucket image BUF into BUCKET.  Return the number
+   of bytes used, or -1 if the image is malformed. */
+static int
+compact_decode (GDBM_FILE dbf, char const *buf, hash_bucket *bucket)
+{
+  unsigned char const *map =
+    (unsigned char const *) buf + offsetof (hash_bucket, h_table);
+  unsigned char const *p =
+    (unsigned char const *) buf + COMPACT_BUCKET_HDR_SIZE (dbf);
+  unsigned char const *end =
+    (unsigned char const *) buf + dbf->header->bucket_size;
+  int i, count = 0;
+
+  memcpy (bucket, buf, offsetof (hash_bucket, h_table));
+  for (i = 0; i < dbf->header->bucket_elems; i++)
+    {
+      bucket_element *elem = &bucket->h_table[i];
+      uintmax_t n;
+
+      if (!(map[i / 8] & (1 << (i % 8))))
+	{
+	  elem->hash_value = -1;
+	  continue;
+	}
+
+      if (end - p < sizeof (elem->hash_value))
+	return -1;
+      memcpy (&elem->hash_value, p, sizeof (elem->hash_value));
+      p += sizeof (elem->hash_value);
+      if (elem->hash_value < 0)
+	return -1;
+      if ((p = varint_get (p, end, INT_MAX, &n)) == NULL)
+	return -1;
+      elem->key_size = n;
+      if ((p = varint_get (p, end, INT_MAX, &n)) == NULL)
+	return -1;
+      elem->data_size = n;
+
+      memset (elem->key_start, 0, SMALL);
+      if (bucket_element_inline_p (dbf, elem))
+	{
+	  datum key, content;
+
+	  if (end - p < elem->key_size + elem->data_size)
+	    return -1;
+	  key.dptr = (char *) p;
+	  key.dsize = elem->key_size;
+	  content.dptr = (char *) p + key.dsize;
+	  content.dsize = elem->data_size;
+	  bucket_element_inline_set (elem, key, content);
+	  p += key.dsize + content.dsize;
+	}
+      else
+	{
+	  int len = gdbm_key_start_len (dbf, elem->key_size);
+
+	  if (end - p < len)
+	    return -1;
+	  memcpy (elem->key_start, p, len);
+	  p += len;
+	  if ((p = varint_get (p, end, OFF_T_MAX, &n)) == NULL)
+	    return -1;
+	  elem->data_pointer = n;
+	}
+      count++;
+    }
+
+  if (count != bucket->count)
+    return -1;
+  return p - (unsigned char const *) buf;
+}
+
+/* Return true if the current bucket has no room for a new element (if
+   NEW_SLOT is true) or for NEED more bytes of its compact encoding. */
+static int
+bucket_full_p (GDBM_FILE dbf, int new_slot, int need)
+{
+  cache_elem *elem = dbf->cache_mru;
+
+  if (new_slot && elem->ca_bucket->count == dbf->header->bucket_elems)
+    return 1;
+  if (!gdbm_compact_buckets_p (dbf))
+    return 0;
+  /* ca_size is an upper bound: recompute it before giving up. */
+  if (elem->ca_size == -1 || elem->ca_size + need > dbf->header->bucket_size)
+    elem->ca_size = compact_bucket_size (dbf, elem->ca_bucket);
+  return elem->ca_size + need > dbf->header->bucket_size;
+}
+
+/* Return true if the header fields of BUCKET are consistent. */
+static inline int
+bucket_header_valid_p (GDBM_FILE dbf, hash_bucket *bucket)
+{
+  return bucket->count >= 0
+         && bucket->count <= dbf->header->bucket_elems
+         && bucket->bucket_bits >= 0
+         && bucket->bucket_bits <= dbf->header->dir_bits;
+}
+
+/* Decode the bucket image BUF, as read from the disk, into BUCKET and
+   validate it.  Unless the buckets of DBF are compact, BUF is copied to
+   BUCKET (the two may coincide).  Return GDBM_NO_ERROR on success, or the
+   error code describing the problem.  The state of DBF is not changed, so
+   that several threads can decode buckets at once. */
+int
+_gdbm_bucket_decode (GDBM_FILE dbf, char const *buf, hash_bucket *bucket)
+{
+  if (gdbm_compact_buckets_p (dbf))
+    {
+      if (compact_decode (dbf, buf, bucket) == -1)
+	return GDBM_BAD_BUCKET;
+    }
+  else if ((char const *) bucket != buf)
+    memcpy (bucket, buf, dbf->header->bucket_size);
+  if (!bucket_header_valid_p (dbf, bucket))
+    return GDBM_BAD_BUCKET;
+  if (!gdbm_bucket_avail_table_valid_p (dbf, bucket))
+    return GDBM_BAD_AVAIL;
+  return GDBM_NO_ERROR;
+}
+
 /*
  * Find a bucket for DBF that is pointed to by the bucket directory from
  * location DIR_INDEX.   The bucket cache is first checked to see if it
@@ -364,8 +1041,8 @@ cache_lookup (GDBM_FILE dbf, off_t adr, cache_elem *ref, cache_elem **ret_elem)
  *
  * On error, the current bucket remains unchanged.
  */
-int
-_gdbm_get_bucket (GDBM_FILE dbf, int dir_index)
+static int
+get_bucket (GDBM_FILE dbf, int dir_index)
 {
   int rc;
   off_t bucket_adr;	/* The address of the correct hash bucket.  */
@@ -382,7 +1059,7 @@ _gdbm_get_bucket (GDBM_FILE dbf, int dir_index)
   
   /* Initial set up. */
   dbf->bucket_dir = dir_index;
-  bucket_adr = dbf->dir[dir_index];
+  bucket_adr = gdbm_dir_entry (dbf, dir_index);
 
   switch (cache_lookup (dbf, bucket_adr, NULL, &elem))
     {
@@ -390,6 +1067,24 @@ _gdbm_get_bucket (GDBM_FILE dbf, int dir_index)
       break;
       
     case cache_new:
+      /* Look up the shared cache first */
+      if (dbf->shm_cache
+	  && _gdbm_shm_cache_get (dbf, bucket_adr, elem->ca_bucket) == 0)
+	{
+	  bucket = elem->ca_bucket;
+	  if (bucket_header_valid_p (dbf, bucket)
+	      && gdbm_bucket_avail_table_validate (dbf, bucket) == 0)
+	    {
+	      dbf->shm_hits++;
+	      elem->ca_adr = bucket_adr;
+	      elem->ca_data.elem_loc = -1;
+	      elem->ca_changed = FALSE;
+	      break;
+	    }
+	  /* Invalid image: fall back to reading from disk. */
+	  gdbm_clear_error (dbf);
+	}
+      
       /* Position the file pointer */
       file_pos = gdbm_file_seek (dbf, bucket_adr, SEEK_SET);
       if (file_pos != bucket_adr)
@@ -401,7 +1096,10 @@ _gdbm_get_bucket (GDBM_FILE dbf, int dir_index)
 	}
 
       /* Read the bucket. */
-      rc = _gdbm_full_read (dbf, elem->ca_bucket, dbf->header->bucket_size);
+      rc = _gdbm_full_read (dbf,
+			    dbf->bucket_buf ? (void*) dbf->bucket_buf
+			                    : (void*) elem->ca_bucket,
+			    dbf->header->bucket_size);
       if (rc)
 	{
 	  GDBM_DEBUG (GDBM_DEBUG_ERR,
@@ -415,10 +1113,15 @@ _gdbm_get_bucket (GDBM_FILE dbf, int dir_index)
 
       /* Validate the bucket */
       bucket = elem->ca_bucket;
-      if (!(bucket->count >= 0
-	    && bucket->count <= dbf->header->bucket_elems
-	    && bucket->bucket_bits >= 0
-	    && bucket->bucket_bits <= dbf->header->dir_bits))
+      if (dbf->bucket_buf
+	  && (elem->ca_size = compact_decode (dbf, dbf->bucket_buf,
+					      bucket)) == -1)
+	{
+	  GDBM_SET_ERRNO (dbf, GDBM_BAD_BUCKET, TRUE);
+	  cache_elem_free (dbf, elem);
+	  return -1;
+	}
+      if (!bucket_header_valid_p (dbf, bucket))
 	{
 	  GDBM_SET_ERRNO (dbf, GDBM_BAD_BUCKET, TRUE);
 	  cache_elem_free (dbf, elem);
@@ -435,6 +1138,9 @@ _gdbm_get_bucket (GDBM_FILE dbf, int dir_index)
       elem->ca_adr = bucket_adr;
       elem->ca_data.elem_loc = -1;
       elem->ca_changed = FALSE;
+
+      if (dbf->shm_cache)
+	_gdbm_shm_cache_put (dbf, bucket_adr, bucket);
       
       break;
       
@@ -445,15 +1151,29 @@ _gdbm_get_bucket (GDBM_FILE dbf, int dir_index)
   return 0;
 }
 
-/* Split the current bucket.  This includes moving all items in the bucket to
-   a new bucket.  This doesn't require any disk reads because all hash values
-   are stored in the buckets.  Splitting the current bucket may require
-   doubling the size of the hash directory.  */
 int
-_gdbm_split_bucket (GDBM_FILE dbf, int next_insert)
+_gdbm_get_bucket (GDBM_FILE dbf, int dir_index)
 {
-  off_t        old_adr[GDBM_HASH_BITS];  /* Address of the old directories. */
-  int          old_size[GDBM_HASH_BITS]; /* Size of the old directories. */
+  int rc;
+
+  CACHE_LOCK (dbf);
+  rc = get_bucket (dbf, dir_index);
+  CACHE_UNLOCK (dbf);
+  return rc;
+}
+
+/* Split the current bucket, until the bucket the element NEXT_INSERT goes
+   to has room for a new element and for NEED more bytes of its compact
+   encoding.  This includes moving all items in the bucket to a new bucket.  This
+   doesn't require any disk reads because all hash values are stored in
+   the buckets.  Splitting the current bucket may require doubling the
+   size of the hash directory, or deepening one of its segments.  */
+static int
+split_bucket (GDBM_FILE dbf, bucket_element const *next_insert, int need)
+{
+  off_t        old_adr[GDBM_HASH_BITS];  /* Address of the old directories
+					    or segment tables. */
+  off_t        old_size[GDBM_HASH_BITS]; /* Their sizes. */
   int	       old_count;	/* Number of old directories. */
 
   int          index;		/* Used in array indexing. */
@@ -461,7 +1181,7 @@ _gdbm_split_bucket (GDBM_FILE dbf, int next_insert)
   
   /* No directories are yet old. */
   old_count = 0;
-  while (dbf->bucket->count == dbf->header->bucket_elems)
+  while (bucket_full_p (dbf, TRUE, need))
     {
       int          new_bits;	/* The number of bits for the new buckets. */
       cache_elem  *newcache[2]; /* Location in the cache for the buckets. */
@@ -521,21 +1241,42 @@ _gdbm_split_bucket (GDBM_FILE dbf, int next_insert)
 	}
       _gdbm_new_bucket (dbf, newcache[1]->ca_bucket, new_bits);
 
-      /* Double the directory size if necessary. */
-      if (dbf->header->dir_bits == dbf->bucket->bucket_bits)
+      /* Double the directory size if necessary.  A segmented directory
+	 is deepened only where the bucket is. */
+      if (gdbm_segdir_p (dbf))
+	{
+	  if (dbf->header->dir_bits == dbf->bucket->bucket_bits)
+	    {
+	      if (new_bits > GDBM_LARGE_DIR_BITS)
+		{
+		  GDBM_SET_ERRNO (dbf, GDBM_DIR_OVERFLOW, TRUE);
+		  _gdbm_fatal (dbf, _("directory overflow"));
+		  return -1;
+		}
+	      dbf->header->dir_bits = new_bits;
+	      dbf->header_changed = TRUE;
+	      dbf->bucket_dir *= 2;
+	    }
+	  if (_gdbm_segdir_deepen (dbf, dbf->bucket_dir, new_bits,
+				   old_adr, old_size, &old_count))
+	    return -1;
+	}
+      else if (dbf->header->dir_bits == dbf->bucket->bucket_bits)
 	{
 	  off_t       *new_dir;		/* Pointer to the new directory. */
-	  int          dir_size;	/* Size of the new directory. */
+	  size_t       dir_size;	/* Size of the new directory. */
 	  off_t        dir_adr; 	/* Address of the new directory. */
 	  
-	  if (dbf->header->dir_size >= GDBM_MAX_DIR_HALF)
+	  if (gdbm_large_p (dbf)
+	      ? new_bits > GDBM_LARGE_DIR_BITS
+	      : dbf->header->dir_size >= GDBM_MAX_DIR_HALF)
 	    {
 	      GDBM_SET_ERRNO (dbf, GDBM_DIR_OVERFLOW, TRUE);
 	      _gdbm_fatal (dbf, _("directory overflow"));
 	      return -1;
 	    }
-	  dir_size = dbf->header->dir_size * 2;
-	  dir_adr  = _gdbm_alloc (dbf, dir_size);
+	  dir_size = GDBM_DIR_SIZE (dbf) * 2;
+	  dir_adr  = _gdbm_alloc_large (dbf, dir_size);
 	  if (dir_adr == 0)
 	    return -1;
 	  new_dir = malloc (dir_size);
@@ -555,8 +1296,8 @@ _gdbm_split_bucket (GDBM_FILE dbf, int next_insert)
 	  /* Update header. */
 	  old_adr[old_count] = dbf->header->dir;
 	  dbf->header->dir = dir_adr;
-	  old_size[old_count] = dbf->header->dir_size;
-	  dbf->header->dir_size = dir_size;
+	  old_size[old_count] = GDBM_DIR_SIZE (dbf);
+	  dbf->header->dir_size *= 2;
 	  dbf->header->dir_bits = new_bits;
 	  old_count++;
 	  
@@ -573,7 +1314,10 @@ _gdbm_split_bucket (GDBM_FILE dbf, int next_insert)
 	  bucket_element *old_el = &dbf->bucket->h_table[index];
 	  hash_bucket *bucket;
 	  int elem_loc;
-	  
+
+	  /* Compact buckets are split before all slots are occupied. */
+	  if (old_el->hash_value == -1)
+	    continue;
 	  if (old_el->hash_value < 0)
 	    {
 	      GDBM_SET_ERRNO (dbf, GDBM_BAD_BUCKET, TRUE);
@@ -581,10 +1325,8 @@ _gdbm_split_bucket (GDBM_FILE dbf, int next_insert)
 	    }
 
 	  bucket =
-	    newcache[(old_el->hash_value >> (GDBM_HASH_BITS - new_bits)) & 1]->ca_bucket;
-	  elem_loc = old_el->hash_value % dbf->header->bucket_elems;
-	  while (bucket->h_table[elem_loc].hash_value != -1)
-	    elem_loc = (elem_loc + 1) % dbf->header->bucket_elems;
+	    newcache[bucket_element_dir_index (dbf, old_el, new_bits) & 1]->ca_bucket;
+	  elem_loc = _gdbm_bucket_slot (dbf, bucket, old_el->hash_value);
 	  bucket->h_table[elem_loc] = *old_el;
 	  bucket->count++;
 	}
@@ -624,18 +1366,16 @@ _gdbm_split_bucket (GDBM_FILE dbf, int next_insert)
       dir_end = (dir_start1 + 1) << (dbf->header->dir_bits - new_bits);
       dir_start1 = dir_start1 << (dbf->header->dir_bits - new_bits);
       dir_start0 = dir_start1 - (dir_end - dir_start1);
-      for (index = dir_start0; index < dir_start1; index++)
-	dbf->dir[index] = adr_0;
-      for (index = dir_start1; index < dir_end; index++)
-	dbf->dir[index] = adr_1;
+      _gdbm_dir_set (dbf, dir_start0, dir_start1, adr_0);
+      _gdbm_dir_set (dbf, dir_start1, dir_end, adr_1);
       
       /* Set changed flags. */
       newcache[0]->ca_changed = TRUE;
       newcache[1]->ca_changed = TRUE;
-      dbf->directory_changed = TRUE;
       
       /* Update the cache! */
-      dbf->bucket_dir = _gdbm_bucket_dir (dbf, next_insert);
+      dbf->bucket_dir = bucket_element_dir_index (dbf, next_insert,
+						  dbf->header->dir_bits);
       
       /* Invalidate old cache entry. */
       avail_elem_init (&old_bucket,
@@ -644,7 +1384,7 @@ _gdbm_split_bucket (GDBM_FILE dbf, int next_insert)
       cache_elem_free (dbf, dbf->cache_mru);
       
       /* Set dbf->bucket to the proper bucket. */
-      if (dbf->dir[dbf->bucket_dir] != adr_0)
+      if (gdbm_dir_entry (dbf, dbf->bucket_dir) != adr_0)
 	{
 	  cache_elem *t = newcache[0];
 	  newcache[0] = newcache[1];
@@ -662,12 +1402,63 @@ _gdbm_split_bucket (GDBM_FILE dbf, int next_insert)
 
   /* Get rid of old directories. */
   for (index = 0; index < old_count; index++)
-    if (_gdbm_free (dbf, old_adr[index], old_size[index]))
+    if (_gdbm_free_large (dbf, old_adr[index], old_size[index]))
       return -1;
 
   return 0;
 }
 
+/* Make room in the current bucket for the element NEWEL, which is to
+   replace the element at *ELEM_LOC, or to be added to the bucket if
+   *ELEM_LOC is -1.  The bucket is split if necessary, in which case
+   *ELEM_LOC is updated to the location of the element in the new
+   current bucket. */
+int
+_gdbm_bucket_reserve (GDBM_FILE dbf, int *elem_loc,
+		      bucket_element const *newel)
+{
+  int need = 0;
+  int rc = 0;
+
+  if (gdbm_compact_buckets_p (dbf))
+    {
+      need = compact_elem_size (dbf, newel);
+      if (*elem_loc != -1)
+	need -= compact_elem_size (dbf, &dbf->bucket->h_table[*elem_loc]);
+    }
+
+  CACHE_LOCK (dbf);
+  if (bucket_full_p (dbf, *elem_loc == -1, need))
+    {
+      bucket_element old;
+
+      if (*elem_loc != -1)
+	old = dbf->bucket->h_table[*elem_loc];
+      rc = split_bucket (dbf, newel, need);
+      if (rc == 0 && *elem_loc != -1)
+	{
+	  /* Find the element in the new bucket. */
+	  int loc, start;
+
+	  loc = start = old.hash_value % dbf->header->bucket_elems;
+	  while (memcmp (&dbf->bucket->h_table[loc], &old, sizeof (old)))
+	    {
+	      loc = (loc + 1) % dbf->header->bucket_elems;
+	      if (loc == start)
+		{
+		  GDBM_SET_ERRNO (dbf, GDBM_BAD_HASH_TABLE, TRUE);
+		  rc = -1;
+		  break;
+		}
+	    }
+	  *elem_loc = loc;
+	}
+    }
+  if (rc == 0 && dbf->cache_mru->ca_size != -1)
+    dbf->cache_mru->ca_size += need;
+  CACHE_UNLOCK (dbf);
+  return rc;
+}
 
 /* The only place where a bucket is written.  CA_ENTRY is the
    cache entry containing the bucket to be written. */
@@ -685,7 +1476,19 @@ _gdbm_write_bucket (GDBM_FILE dbf, cache_elem *ca_entry)
       _gdbm_fatal (dbf, _("lseek error"));
       return -1;
     }
-  rc = _gdbm_full_write (dbf, ca_entry->ca_bucket, dbf->header->bucket_size);
+  if (dbf->bucket_buf)
+    {
+      ca_entry->ca_size = _gdbm_bucket_encode (dbf, ca_entry->ca_bucket,
+					       dbf->bucket_buf);
+      if (ca_entry->ca_size == -1)
+	{
+	  GDBM_SET_ERRNO (dbf, GDBM_BAD_BUCKET, TRUE);
+	  return -1;
+	}
+      rc = _gdbm_full_write (dbf, dbf->bucket_buf, dbf->header->bucket_size);
+    }
+  else
+    rc = _gdbm_full_write (dbf, ca_entry->ca_bucket, dbf->header->bucket_size);
   if (rc)
     {
       GDBM_DEBUG (GDBM_DEBUG_STORE|GDBM_DEBUG_ERR,
@@ -711,6 +1514,7 @@ _gdbm_cache_init (GDBM_FILE dbf, size_t size)
 {
   int bits;
   int cache_auto;
+  int rc;
   
   if (size == GDBM_CACHE_AUTO)
     {
@@ -730,7 +1534,10 @@ _gdbm_cache_init (GDBM_FILE dbf, size_t size)
 
   dbf->cache_auto = cache_auto;
 
-  return cache_tab_resize (dbf, bits);
+  CACHE_LOCK (dbf);
+  rc = cache_tab_resize (dbf, bits);
+  CACHE_UNLOCK (dbf);
+  return rc;
 }
 
 /* Free the bucket cache */
@@ -739,6 +1546,7 @@ _gdbm_cache_free (GDBM_FILE dbf)
 {
   cache_elem *elem;
 
+  CACHE_LOCK (dbf);
   while (dbf->cache_lru)
     cache_elem_free (dbf, dbf->cache_lru);
   free (dbf->cache);
@@ -746,9 +1554,48 @@ _gdbm_cache_free (GDBM_FILE dbf)
   while ((elem = dbf->cache_avail) != NULL)
     {
       dbf->cache_avail = elem->ca_next;
-      free (elem->ca_data.dptr);
-      free (elem);
+      cache_elem_destroy (dbf, elem);
     }
+  CACHE_UNLOCK (dbf);
+}
+
+/* Set the memory budget for the bucket cache, data caches and directory
+   of DBF to SIZE bytes (0 means unlimited).  Evict cache elements as
+   necessary to fit into the new budget. */
+int
+_gdbm_cache_set_mem (GDBM_FILE dbf, size_t size)
+{
+  cache_elem *elem;
+  int rc = 0;
+
+  dbf->cache_mem_max = size;
+  if (size == 0)
+    return 0;
+
+  CACHE_LOCK (dbf);
+  while ((elem = dbf->cache_avail) != NULL)
+    {
+      dbf->cache_avail = elem->ca_next;
+      cache_elem_destroy (dbf, elem);
+    }
+  
+  while (dbf->cache_num > CACHE_MIN_ELEMS
+	 && dbf->cache_mem_max != 0
+	 && cache_mem_usage (dbf) > dbf->cache_mem_max)
+    {
+      if ((rc = cache_lru_free (dbf)) != 0)
+	break;
+    }
+  CACHE_UNLOCK (dbf);
+  return rc;
+}
+
+/* Return the number of bytes currently used by the bucket cache, data
+   caches and directory of DBF. */
+size_t
+_gdbm_cache_mem_usage (GDBM_FILE dbf)
+{
+  return cache_mem_usage (dbf);
 }
 
 /*
@@ -760,12 +1607,59 @@ int
 _gdbm_cache_flush (GDBM_FILE dbf)
 {
   cache_elem *elem;
+  int rc = 0;
+
+  CACHE_LOCK (dbf);
   for (elem = dbf->cache_mru; elem && elem->ca_changed; elem = elem->ca_next)
     {
-      if (_gdbm_write_bucket (dbf, elem))
-	return -1;
+      if ((rc = _gdbm_write_bucket (dbf, elem)) != 0)
+	break;
     }
-  return 0;
+  CACHE_UNLOCK (dbf);
+  return rc;
+}
+
+/* Account for the change of the size of the data cache of the current
+   bucket from OLDSIZE to NEWSIZE bytes. */
+void
+_gdbm_cache_data_resized (GDBM_FILE dbf, size_t oldsize, size_t newsize)
+{
+  CACHE_LOCK (dbf);
+  cache_mem_sub (dbf, oldsize);
+  cache_mem_add (dbf, newsize);
+  CACHE_UNLOCK (dbf);
+}
+
+/* Move the bucket cache of NEW_DBF to DBF, freeing the old cache of the
+   latter.  Used when the database file gets replaced by its reorganized
+   copy. */
+void
+_gdbm_cache_transfer (GDBM_FILE dbf, GDBM_FILE new_dbf)
+{
+  cache_elem *elem;
+  
+  _gdbm_cache_free (dbf);
+
+  CACHE_LOCK (dbf);
+  dbf->cache_bits        = new_dbf->cache_bits;  
+  dbf->cache_size        = new_dbf->cache_size;  
+  dbf->cache_num         = new_dbf->cache_num;   
+  dbf->cache             = new_dbf->cache;   
+  dbf->cache_mru         = new_dbf->cache_mru;   
+  dbf->cache_lru         = new_dbf->cache_lru;   
+  dbf->cache_avail       = new_dbf->cache_avail;
+  dbf->cache_slab_partial = new_dbf->cache_slab_partial;
+  dbf->cache_slab_full   = new_dbf->cache_slab_full;
+  dbf->cache_mem         = 0;
+  cache_mem_add (dbf, new_dbf->cache_mem);
+  for (elem = dbf->cache_mru; elem; elem = elem->ca_next)
+    elem->ca_tick = 0;
+  CACHE_UNLOCK (dbf);
+  
+  new_dbf->cache = NULL;
+  new_dbf->cache_mru = new_dbf->cache_lru = new_dbf->cache_avail = NULL;
+  new_dbf->cache_slab_partial = new_dbf->cache_slab_full = NULL;
+  new_dbf->cache_num = 0;
 }
 
 
@@ -781,6 +1675,7 @@ gdbm_get_cache_stats (GDBM_FILE dbf,
     *access_count = dbf->cache_access_count;
   if (cache_hits)
     *cache_hits = dbf->cache_hits;
+  CACHE_LOCK (dbf);
   if (cache_count)
     *cache_count = dbf->cache_num;
   if (bstat)
@@ -797,4 +1692,158 @@ gdbm_get_cache_stats (GDBM_FILE dbf,
 	  bstat[i].hits = elem->ca_hits;
 	}
     }
+  CACHE_UNLOCK (dbf);
+}
+
+/* Shared cache pools */
+
+gdbm_cache_pool *
+gdbm_cache_pool_create (size_t size)
+{
+  gdbm_cache_pool *pool;
+  if (size == 0)
+    {
+      GDBM_SET_ERRNO (NULL, GDBM_OPT_BADVAL, FALSE);
+      return NULL;
+    }
+  
+  pool = calloc (1, sizeof (*pool));
+  if (!pool)
+    {
+      GDBM_SET_ERRNO (NULL, GDBM_MALLOC_ERROR, FALSE);
+      return NULL;
+    }
+
+#if HAVE_PTHREAD_H
+  if (pthread_mutex_init (&pool->mutex, NULL))
+    {
+      free (pool);
+      GDBM_SET_ERRNO (NULL, GDBM_MALLOC_ERROR, FALSE);
+      return NULL;
+    }
+#endif
+  
+  pool->refcount = 1;
+  pool->mem_max = size;
+  return pool;
+}
+
+static void
+cache_pool_unref (gdbm_cache_pool *pool)
+{
+  int destroy;
+  
+#if HAVE_PTHREAD_H
+  pthread_mutex_lock (&pool->mutex);
+#endif
+  destroy = --pool->refcount == 0;
+#if HAVE_PTHREAD_H
+  pthread_mutex_unlock (&pool->mutex);
+#endif
+  if (destroy)
+    {
+#if HAVE_PTHREAD_H
+      pthread_mutex_destroy (&pool->mutex);
+#endif
+      free (pool);
+    }
+}
+
+void
+gdbm_cache_pool_destroy (gdbm_cache_pool *pool)
+{
+  if (pool)
+    cache_pool_unref (pool);
+}
+
+size_t
+gdbm_cache_pool_usage (gdbm_cache_pool *pool)
+{
+  return __atomic_load_n (&pool->mem, __ATOMIC_RELAXED);
+}
+
+/* Attach DBF to the cache POOL.  The cache of DBF is flushed and freed
+   first. */
+int
+_gdbm_cache_pool_attach (GDBM_FILE dbf, gdbm_cache_pool *pool)
+{
+  cache_elem *elem;
+
+  if (_gdbm_cache_flush (dbf))
+    return -1;
+  while (dbf->cache_lru)
+    cache_elem_free (dbf, dbf->cache_lru);
+  while ((elem = dbf->cache_avail) != NULL)
+    {
+      dbf->cache_avail = elem->ca_next;
+      cache_elem_destroy (dbf, elem);
+    }
+
+#if HAVE_PTHREAD_H
+  {
+    pthread_mutexattr_t attr;
+    int rc;
+
+    /* The mutex must be recursive, since cache functions that lock it
+       call each other. */
+    if ((rc = pthread_mutexattr_init (&attr)) == 0)
+      {
+	if ((rc = pthread_mutexattr_settype (&attr,
+					     PTHREAD_MUTEX_RECURSIVE)) == 0)
+	  rc = pthread_mutex_init (&dbf->cache_mutex, &attr);
+	pthread_mutexattr_destroy (&attr);
+      }
+    if (rc)
+      {
+	errno = rc;
+	GDBM_SET_ERRNO (dbf, GDBM_MALLOC_ERROR, FALSE);
+	return -1;
+      }
+  }
+  pthread_mutex_lock (&pool->mutex);
+#endif
+  pool->refcount++;
+  dbf->pool_prev = NULL;
+  dbf->pool_next = pool->dbf_head;
+  if (pool->dbf_head)
+    pool->dbf_head->pool_prev = dbf;
+  pool->dbf_head = dbf;
+  dbf->cache_pool = pool;
+  /* Cache pool implies automatic table sizing. */
+  dbf->cache_auto = TRUE;
+#if HAVE_PTHREAD_H
+  pthread_mutex_unlock (&pool->mutex);
+#endif
+  return 0;
+}
+
+/* Detach DBF from its cache pool.  The cache of DBF must have been
+   freed. */
+void
+_gdbm_cache_pool_detach (GDBM_FILE dbf)
+{
+  gdbm_cache_pool *pool = dbf->cache_pool;
+
+  if (!pool)
+    return;
+#if HAVE_PTHREAD_H
+  pthread_mutex_lock (&pool->mutex);
+#endif
+  if (dbf->pool_prev)
+    dbf->pool_prev->pool_next = dbf->pool_next;
+  else
+    pool->dbf_head = dbf->pool_next;
+  if (dbf->pool_next)
+    dbf->pool_next->pool_prev = dbf->pool_prev;
+  dbf->pool_prev = dbf->pool_next = NULL;
+  dbf->cache_pool = NULL;
+#if HAVE_PTHREAD_H
+  pthread_mutex_unlock (&pool->mutex);
+  /* Wait for another database that might have selected DBF as victim
+     before it was removed from the list. */
+  pthread_mutex_lock (&dbf->cache_mutex);
+  pthread_mutex_unlock (&dbf->cache_mutex);
+  pthread_mutex_destroy (&dbf->cache_mutex);
+#endif
+  cache_pool_unref (pool);
 }
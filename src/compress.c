@@ -0,0 +1,380 @@
+/* compress.c - Compression of record data. */
+
+/* This file is part of GDBM, the GNU data base manager.
+   Copyright (C) 2025 Free Software Foundation, Inc.
+
+   GDBM is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3, or (at your option)
+   any later version.
+
+   GDBM is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with GDBM. If not, see <http://www.gnu.org/licenses/>.   */
+
+/* Include system configuration before all else. */
+#include "autoconf.h"
+
+#include "gdbmdefs.h"
+
+/*
+ * The codec is a byte-oriented LZ77 variant.  The compressed data are
+ * a sequence of tokens.  The high nibble of a token byte is the number
+ * of literals that follow it, and the low nibble is the length of the
+ * match that follows the literals, minus LZ_MIN_MATCH.  The value 15 in
+ * either nibble means that the length continues in the following bytes,
+ * each of which is added to it, up to and including the first byte
+ * other than 255.  Extra literal length bytes come before the literals,
+ * and extra match length bytes after the match offset.  The offset is
+ * two bytes, least significant first, counted back from the current
+ * output position.  The last token has no match: decoding stops as soon
+ * as the expected number of bytes has been produced.
+ */
+
+/* Minimal length of a match. */
+#define LZ_MIN_MATCH 4
+/* Maximal distance to a match. */
+#define LZ_MAX_OFFSET 0xffff
+/* Number of bits in the index of the match table. */
+#define LZ_HASH_BITS 12
+
+static inline unsigned
+lz_hash (unsigned char const *p)
+{
+  uint32_t v;
+
+  memcpy (&v, p, sizeof (v));
+  return (v * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+/* Store the length N, whose first part has been stored in a token
+   nibble, at P, not going past END.  Return the pointer past it, or
+   NULL if it doesn't fit. */
+static unsigned char *
+lz_put_length (unsigned char *p, unsigned char *end, size_t n)
+{
+  if (n < 15)
+    return p;
+  n -= 15;
+  for (;;)
+    {
+      if (p == end)
+	return NULL;
+      if (n < 255)
+	break;
+      *p++ = 255;
+      n -= 255;
+    }
+  *p++ = n;
+  return p;
+}
+
+/* Read the continuation of the length *PN from P, not looking past END.
+   The length must not exceed MAX.  Return the pointer past it, or NULL
+   if it is malformed. */
+static unsigned char const *
+lz_get_length (unsigned char const *p, unsigned char const *end,
+	       size_t max, size_t *pn)
+{
+  size_t n = *pn;
+  unsigned char c;
+
+  if (n == 15)
+    {
+      do
+	{
+	  if (p == end)
+	    return NULL;
+	  c = *p++;
+	  n += c;
+	  if (n > max)
+	    return NULL;
+	}
+      while (c == 255);
+    }
+  *pn = n;
+  return p;
+}
+
+/* Emit a token with LEN literals from LIT, followed by a match of MLEN
+   bytes at the distance OFF (unless MLEN is 0), at P, not going past
+   END.  Return the pointer past it, or NULL if it doesn't fit. */
+static unsigned char *
+lz_put_token (unsigned char *p, unsigned char *end,
+	      unsigned char const *lit, size_t len, size_t off, size_t mlen)
+{
+  size_t m = mlen ? mlen - LZ_MIN_MATCH : 0;
+
+  if (p == end)
+    return NULL;
+  *p++ = ((len < 15 ? len : 15) << 4) | (m < 15 ? m : 15);
+  if ((p = lz_put_length (p, end, len)) == NULL
+      || (size_t) (end - p) < len)
+    return NULL;
+  memcpy (p, lit, len);
+  p += len;
+  if (mlen)
+    {
+      if (end - p < 2)
+	return NULL;
+      *p++ = off & 0xff;
+      *p++ = off >> 8;
+      p = lz_put_length (p, end, m);
+    }
+  return p;
+}
+
+/* Compress LEN bytes from SRC into DST, which has room for SIZE bytes.
+   Return the size of the compressed data, or 0 if they don't fit. */
+size_t
+_gdbm_lz_compress (unsigned char const *src, size_t len,
+		   unsigned char *dst, size_t size)
+{
+  /* Positions of the recently seen sequences, plus one. */
+  size_t table[1 << LZ_HASH_BITS];
+  unsigned char *p = dst, *end = dst + size;
+  size_t pos = 0, anchor = 0;
+
+  memset (table, 0, sizeof (table));
+  while (pos + LZ_MIN_MATCH <= len)
+    {
+      unsigned h = lz_hash (src + pos);
+      size_t cand = table[h];
+
+      table[h] = pos + 1;
+      if (cand > 0 && pos - (cand - 1) <= LZ_MAX_OFFSET
+	  && memcmp (src + cand - 1, src + pos, LZ_MIN_MATCH) == 0)
+	{
+	  size_t ref = cand - 1;
+	  size_t mlen = LZ_MIN_MATCH;
+
+	  while (pos + mlen < len && src[ref + mlen] == src[pos + mlen])
+	    mlen++;
+	  p = lz_put_token (p, end, src + anchor, pos - anchor, pos - ref,
+			    mlen);
+	  if (!p)
+	    return 0;
+	  pos += mlen;
+	  anchor = pos;
+	}
+      else
+	pos++;
+    }
+  p = lz_put_token (p, end, src + anchor, len - anchor, 0, 0);
+  if (!p)
+    return 0;
+  return p - dst;
+}
+
+/* Decompress LEN bytes from SRC into DST, which must receive exactly
+   SIZE bytes.  Bytes that follow the compressed data are ignored.
+   Return 0 on success and -1 if the data are malformed. */
+int
+_gdbm_lz_decompress (unsigned char const *src, size_t len,
+		     unsigned char *dst, size_t size)
+{
+  unsigned char const *end = src + len;
+  size_t pos = 0;
+
+  for (;;)
+    {
+      unsigned char token;
+      size_t n, off;
+
+      if (src == end)
+	return -1;
+      token = *src++;
+
+      /* Literals */
+      n = token >> 4;
+      if ((src = lz_get_length (src, end, size - pos, &n)) == NULL
+	  || n > size - pos || n > (size_t) (end - src))
+	return -1;
+      memcpy (dst + pos, src, n);
+      src += n;
+      pos += n;
+      if (pos == size)
+	return 0;
+
+      /* Match */
+      if (end - src < 2)
+	return -1;
+      off = src[0] | (src[1] << 8);
+      src += 2;
+      if (off == 0 || off > pos)
+	return -1;
+      n = token & 0xf;
+      if ((src = lz_get_length (src, end, size - pos, &n)) == NULL)
+	return -1;
+      n += LZ_MIN_MATCH;
+      if (n > size - pos)
+	return -1;
+      if (off >= n)
+	memcpy (dst + pos, dst + pos - off, n);
+      else
+	{
+	  /* Overlapping match: copy byte by byte. */
+	  size_t i;
+
+	  for (i = 0; i < n; i++)
+	    dst[pos + i] = dst[pos + i - off];
+	}
+      pos += n;
+    }
+}
+
+/* Make sure the encoding buffer of DBF has room for SIZE bytes. */
+static int
+value_buf_reserve (GDBM_FILE dbf, size_t size)
+{
+  if (size > dbf->value_buf_size)
+    {
+      char *p = realloc (dbf->value_buf, size);
+
+      if (!p)
+	{
+	  GDBM_SET_ERRNO (dbf, GDBM_MALLOC_ERROR, FALSE);
+	  return -1;
+	}
+      dbf->value_buf = p;
+      dbf->value_buf_size = size;
+    }
+  return 0;
+}
+
+/* If the data CONTENT are to be stored in DBF in encoded form, encode
+   them and make CONTENT point to the result.  It is kept in a buffer,
+   which remains valid until the next call.
+
+   In databases with compressed records, the data are compressed if
+   that makes them shorter.  Otherwise they are stored as is, with a
+   tag byte.  In databases with shared data, long enough data are then
+   replaced by a reference to their shared value (see dedup.c).  Return
+   0 on success and -1 on error. */
+int
+_gdbm_encode_data (GDBM_FILE dbf, datum *content)
+{
+  size_t len = content->dsize;
+  size_t min, hdr, n = 0;
+  unsigned char *p;
+
+  if (!gdbm_data_encoded_p (dbf, len))
+    return 0;
+  min = dbf->xheader->encode_min;
+  if (len > INT_MAX - 1)
+    {
+      GDBM_SET_ERRNO (dbf, GDBM_MALFORMED_DATA, FALSE);
+      return -1;
+    }
+  if (value_buf_reserve (dbf, len + 1))
+    return -1;
+  p = (unsigned char *) dbf->value_buf;
+
+  /* Compressed data are worth keeping only if they are shorter than
+     the raw data. */
+  if (gdbm_compressed_p (dbf))
+    {
+      *p = GDBM_VALUE_LZ;
+      hdr = varint_put (p + 1, len) - p;
+      n = _gdbm_lz_compress ((unsigned char *) content->dptr, len, p + hdr,
+			     len - hdr);
+      if (n > 0)
+	{
+	  n += hdr;
+	  /* Data shorter than encode_min would be taken for raw ones. */
+	  if (n < min)
+	    {
+	      memset (p + n, 0, min - n);
+	      n = min;
+	    }
+	}
+    }
+  if (n == 0 || n >= len)
+    {
+      *p = GDBM_VALUE_RAW;
+      memcpy (p + 1, content->dptr, len);
+      n = len + 1;
+    }
+  content->dptr = dbf->value_buf;
+  content->dsize = n;
+
+  if (gdbm_dedup_p (dbf) && len >= GDBM_DEDUP_THRESHOLD)
+    return _gdbm_dedup_store (dbf, content);
+  return 0;
+}
+
+/* Decode the data of the record held in DATA_CA.  Its data_size member
+   is the size of the stored form, and is updated to that of the
+   decoded data.  Return 0 on success and -1 on error. */
+int
+_gdbm_decode_data (GDBM_FILE dbf, data_cache_elem *data_ca)
+{
+  unsigned char *p = (unsigned char *) data_ca->dptr + data_ca->key_size;
+  unsigned char const *end;
+  unsigned char const *q;
+  uintmax_t n;
+  size_t len, dsize;
+
+  if (*p == GDBM_VALUE_REF && gdbm_dedup_p (dbf))
+    {
+      /* Replace the reference with the shared value, which is never a
+	 reference itself. */
+      if (_gdbm_dedup_read (dbf, data_ca))
+	return -1;
+      p = (unsigned char *) data_ca->dptr + data_ca->key_size;
+      if (*p == GDBM_VALUE_REF)
+	{
+	  GDBM_SET_ERRNO (dbf, GDBM_BAD_HASH_ENTRY, TRUE);
+	  return -1;
+	}
+    }
+  end = p + data_ca->data_size;
+
+  switch (*p)
+    {
+    case GDBM_VALUE_RAW:
+      data_ca->data_size--;
+      memmove (p, p + 1, data_ca->data_size);
+      return 0;
+
+    case GDBM_VALUE_LZ:
+      q = varint_get (p + 1, end, INT_MAX - data_ca->key_size, &n);
+      if (q == NULL)
+	break;
+
+      /* Move the compressed data out of the way. */
+      len = end - q;
+      if (value_buf_reserve (dbf, len))
+	return -1;
+      memcpy (dbf->value_buf, q, len);
+
+      dsize = data_ca->key_size + n;
+      if (dsize > data_ca->dsize)
+	{
+	  char *buf = realloc (data_ca->dptr, dsize);
+
+	  if (!buf)
+	    {
+	      GDBM_SET_ERRNO (dbf, GDBM_MALLOC_ERROR, FALSE);
+	      return -1;
+	    }
+	  _gdbm_cache_data_resized (dbf, data_ca->dsize, dsize);
+	  data_ca->dptr = buf;
+	  data_ca->dsize = dsize;
+	}
+      if (_gdbm_lz_decompress ((unsigned char *) dbf->value_buf, len,
+			       (unsigned char *) data_ca->dptr
+			         + data_ca->key_size,
+			       n))
+	break;
+      data_ca->data_size = n;
+      return 0;
+    }
+
+  GDBM_SET_ERRNO (dbf, GDBM_BAD_HASH_ENTRY, TRUE);
+  return -1;
+}
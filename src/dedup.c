@@ -0,0 +1,518 @@
+/* dedup.c - Sharing of identical record data. */
+
+/* This file is part of GDBM, the GNU data base manager.
+   Copyright (C) 2025 Free Software Foundation, Inc.
+
+   GDBM is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3, or (at your option)
+   any later version.
+
+   GDBM is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with GDBM. If not, see <http://www.gnu.org/licenses/>.   */
+
+#include "autoconf.h"
+#include "gdbmdefs.h"
+
+/*
+ * In databases with the GDBM_FEATURE_DEDUP feature, data of
+ * GDBM_DEDUP_THRESHOLD bytes or more are stored apart from their keys,
+ * as shared values.  A shared value is a gdbm_shared_value header
+ * followed by the value in encoded form.  The record itself holds a
+ * GDBM_VALUE_REF reference to it.  Identical values are stored once
+ * and the header keeps the number of references to them.  The value is
+ * freed when the last reference is gone.
+ *
+ * Shared values are found by their 64-bit hash in the dedup index, an
+ * open-addressing hash table of (hash, address) pairs.  A hash match
+ * is confirmed by comparing the values themselves.  Like the avail
+ * index, the dedup index is loaded into memory when first needed, and
+ * its file space is released at that moment, so that a database that
+ * hasn't been properly closed has no stale index.  It is written back
+ * by gdbm_sync and gdbm_close.
+ *
+ * A reference count must never be lower than the number of references
+ * on disk, or else the value could be freed while still in use.  A new
+ * reference is therefore counted before the bucket that holds it is
+ * written, whereas references dropped by an update are only remembered
+ * in the index, and their counts are decremented by _gdbm_end_update
+ * once the buckets and the header have been written.  If the program
+ * terminates in between, the value is merely never freed.
+ */
+
+struct dedup_entry
+{
+  uint64_t hash;       /* Hash of the value. */
+  off_t adr;           /* Address of the shared value; 0 if unused. */
+};
+
+struct dedup_index
+{
+  struct dedup_entry *tab;   /* Hash table */
+  size_t size;               /* Its size (a power of 2) */
+  size_t count;              /* Number of entries in use */
+  off_t *release;            /* Values whose references were dropped */
+  size_t nrelease;           /* Number of entries in RELEASE */
+  size_t release_max;        /* Capacity of RELEASE */
+};
+
+/* Read the header of the shared value at ADR into HDR and check it. */
+static int
+value_header_read (GDBM_FILE dbf, off_t adr, gdbm_shared_value *hdr)
+{
+  if (_gdbm_read_at (dbf, adr, hdr, sizeof (*hdr)))
+    return -1;
+  if (hdr->refcount == 0 || hdr->size <= 0
+      || !off_t_sum_ok (adr, sizeof (*hdr) + hdr->size))
+    {
+      GDBM_SET_ERRNO (dbf, GDBM_BAD_HASH_ENTRY, TRUE);
+      return -1;
+    }
+  return 0;
+}
+
+/* Insert the entry (HASH, ADR) into IDX, growing it if necessary. */
+static int
+index_insert (GDBM_FILE dbf, struct dedup_index *idx, uint64_t hash,
+	      off_t adr)
+{
+  size_t i;
+
+  if (2 * (idx->count + 1) > idx->size)
+    {
+      size_t size = idx->size ? 2 * idx->size : 64;
+      struct dedup_entry *tab = calloc (size, sizeof (tab[0]));
+
+      if (!tab)
+	{
+	  GDBM_SET_ERRNO (dbf, GDBM_MALLOC_ERROR, FALSE);
+	  return -1;
+	}
+      for (i = 0; i < idx->size; i++)
+	if (idx->tab[i].adr)
+	  {
+	    size_t j = idx->tab[i].hash & (size - 1);
+
+	    while (tab[j].adr)
+	      j = (j + 1) & (size - 1);
+	    tab[j] = idx->tab[i];
+	  }
+      free (idx->tab);
+      idx->tab = tab;
+      idx->size = size;
+    }
+
+  i = hash & (idx->size - 1);
+  while (idx->tab[i].adr)
+    i = (i + 1) & (idx->size - 1);
+  idx->tab[i].hash = hash;
+  idx->tab[i].adr = adr;
+  idx->count++;
+  return 0;
+}
+
+/* Remove the entry (HASH, ADR) from IDX, if it is there. */
+static void
+index_remove (struct dedup_index *idx, uint64_t hash, off_t adr)
+{
+  size_t mask = idx->size - 1;
+  size_t i, j;
+
+  if (idx->size == 0)
+    return;
+  for (i = hash & mask; idx->tab[i].adr != adr; i = (i + 1) & mask)
+    if (idx->tab[i].adr == 0)
+      return;
+
+  /* Shift back the entries that follow, unless they are at their home
+     slot or past it. */
+  for (j = (i + 1) & mask; idx->tab[j].adr; j = (j + 1) & mask)
+    {
+      size_t home = idx->tab[j].hash & mask;
+
+      if (((j - home) & mask) >= ((j - i) & mask))
+	{
+	  idx->tab[i] = idx->tab[j];
+	  i = j;
+	}
+    }
+  idx->tab[i].adr = 0;
+  idx->count--;
+}
+
+static void
+index_free (struct dedup_index *idx)
+{
+  free (idx->release);
+  free (idx->tab);
+  free (idx);
+}
+
+/* Load the dedup index of DBF and release its file space. */
+static struct dedup_index *
+dedup_index_load (GDBM_FILE dbf)
+{
+  struct dedup_index *idx;
+  struct dedup_entry buf[256];
+  off_t adr = dbf->xheader->dedup_index;
+  int count = dbf->xheader->dedup_count;
+  int i, n;
+
+  idx = calloc (1, sizeof (*idx));
+  if (!idx)
+    {
+      GDBM_SET_ERRNO (dbf, GDBM_MALLOC_ERROR, FALSE);
+      return NULL;
+    }
+
+  if (count < 0 || (count > 0 && adr == 0))
+    {
+      GDBM_SET_ERRNO (dbf, GDBM_BAD_HEADER, TRUE);
+      index_free (idx);
+      return NULL;
+    }
+
+  for (i = 0; i < count; i += n)
+    {
+      int j;
+
+      n = count - i;
+      if (n > sizeof (buf) / sizeof (buf[0]))
+	n = sizeof (buf) / sizeof (buf[0]);
+      if (_gdbm_read_at (dbf, adr + (off_t) i * sizeof (buf[0]), buf,
+			 n * sizeof (buf[0])))
+	{
+	  index_free (idx);
+	  return NULL;
+	}
+      for (j = 0; j < n; j++)
+	if (index_insert (dbf, idx, buf[j].hash, buf[j].adr))
+	  {
+	    index_free (idx);
+	    return NULL;
+	  }
+    }
+
+  /* From now on the in-memory index is the only one.  The freed space
+     may go to the avail table of the current bucket. */
+  if (count > 0)
+    {
+      if (_gdbm_free_large (dbf, adr, (off_t) count * sizeof (buf[0])))
+	{
+	  index_free (idx);
+	  return NULL;
+	}
+      _gdbm_current_bucket_changed (dbf);
+    }
+  dbf->xheader->dedup_index = 0;
+  dbf->xheader->dedup_count = 0;
+  dbf->header_changed = TRUE;
+
+  return idx;
+}
+
+static inline struct dedup_index *
+dedup_index (GDBM_FILE dbf)
+{
+  if (!dbf->dedup_index)
+    dbf->dedup_index = dedup_index_load (dbf);
+  return dbf->dedup_index;
+}
+
+/* Return 1 if the SIZE bytes at ADR equal BUF, 0 if they don't and -1
+   on error. */
+static int
+value_equal (GDBM_FILE dbf, off_t adr, char const *buf, size_t size)
+{
+  char tmp[1024];
+
+  while (size > 0)
+    {
+      size_t n = size < sizeof (tmp) ? size : sizeof (tmp);
+
+      if (_gdbm_read_at (dbf, adr, tmp, n))
+	return -1;
+      if (memcmp (tmp, buf, n))
+	return 0;
+      adr += n;
+      buf += n;
+      size -= n;
+    }
+  return 1;
+}
+
+/* Find the shared value equal to CONTENT, or store a new one, and add a
+   reference to it.  Return its address, or 0 on error. */
+static off_t
+dedup_ref (GDBM_FILE dbf, datum content)
+{
+  struct dedup_index *idx;
+  uint64_t hash = _gdbm_hash64 (content);
+  gdbm_shared_value hdr;
+  size_t i;
+  off_t adr;
+
+  if ((idx = dedup_index (dbf)) == NULL)
+    return 0;
+
+  for (i = hash & (idx->size - 1); idx->size && idx->tab[i].adr;
+       i = (i + 1) & (idx->size - 1))
+    {
+      if (idx->tab[i].hash != hash)
+	continue;
+      adr = idx->tab[i].adr;
+      if (value_header_read (dbf, adr, &hdr))
+	return 0;
+      if (hdr.hash == hash && hdr.size == content.dsize
+	  && hdr.refcount < UINT_MAX)
+	{
+	  switch (value_equal (dbf, adr + sizeof (hdr), content.dptr,
+			       content.dsize))
+	    {
+	    case 1:
+	      hdr.refcount++;
+	      if (_gdbm_write_at (dbf, adr, &hdr, sizeof (hdr)))
+		return 0;
+	      return adr;
+
+	    case -1:
+	      return 0;
+	    }
+	}
+    }
+
+  /* Store a new value. */
+  adr = _gdbm_alloc_large (dbf, sizeof (hdr) + content.dsize);
+  if (adr == 0)
+    return 0;
+  memset (&hdr, 0, sizeof (hdr));
+  hdr.refcount = 1;
+  hdr.size = content.dsize;
+  hdr.hash = hash;
+  if (_gdbm_write_at (dbf, adr, &hdr, sizeof (hdr))
+      || _gdbm_write_at (dbf, adr + sizeof (hdr), content.dptr, content.dsize))
+    return 0;
+  /* The number of index entries is stored in an int.  Values beyond
+     that just aren't shared. */
+  if (idx->count < INT_MAX && index_insert (dbf, idx, hash, adr))
+    return 0;
+  return adr;
+}
+
+/* Add a reference to the shared value equal to the encoded data
+   CONTENT and make CONTENT point to the reference, unless it is not
+   shorter than the data.  The reference is kept in the same buffer as
+   the data.  Return 0 on success and -1 on error. */
+int
+_gdbm_dedup_store (GDBM_FILE dbf, datum *content)
+{
+  unsigned char *p;
+  off_t adr;
+
+  if (content->dsize <= dbf->xheader->encode_min)
+    return 0;
+
+  adr = dedup_ref (dbf, *content);
+  if (adr == 0)
+    return -1;
+
+  p = (unsigned char *) content->dptr;
+  memset (p, 0, dbf->xheader->encode_min);
+  p[0] = GDBM_VALUE_REF;
+  memcpy (p + 1, &adr, sizeof (adr));
+  content->dsize = dbf->xheader->encode_min;
+  return 0;
+}
+
+/* Replace the reference in DATA_CA with the encoded shared value it
+   refers to. */
+int
+_gdbm_dedup_read (GDBM_FILE dbf, data_cache_elem *data_ca)
+{
+  gdbm_shared_value hdr;
+  off_t adr;
+  size_t dsize;
+
+  if (data_ca->data_size < 1 + sizeof (adr))
+    {
+      GDBM_SET_ERRNO (dbf, GDBM_BAD_HASH_ENTRY, TRUE);
+      return -1;
+    }
+  memcpy (&adr, data_ca->dptr + data_ca->key_size + 1, sizeof (adr));
+  if (value_header_read (dbf, adr, &hdr))
+    return -1;
+
+  dsize = data_ca->key_size + hdr.size;
+  if (dsize > data_ca->dsize)
+    {
+      char *buf = realloc (data_ca->dptr, dsize);
+
+      if (!buf)
+	{
+	  GDBM_SET_ERRNO (dbf, GDBM_MALLOC_ERROR, FALSE);
+	  return -1;
+	}
+      _gdbm_cache_data_resized (dbf, data_ca->dsize, dsize);
+      data_ca->dptr = buf;
+      data_ca->dsize = dsize;
+    }
+  if (_gdbm_full_read (dbf, data_ca->dptr + data_ca->key_size, hdr.size))
+    {
+      dbf->need_recovery = TRUE;
+      _gdbm_fatal (dbf, gdbm_db_strerror (dbf));
+      return -1;
+    }
+  data_ca->data_size = hdr.size;
+  return 0;
+}
+
+/* If the record of ELEM refers to a shared value, drop the reference.
+   The reference count is decremented, and the value freed if it was
+   the last reference, by _gdbm_dedup_flush.  This must be called before
+   the file space of the record is released. */
+int
+_gdbm_dedup_release (GDBM_FILE dbf, bucket_element const *elem)
+{
+  unsigned char ref[1 + sizeof (off_t)];
+  gdbm_shared_value hdr;
+  struct dedup_index *idx;
+  off_t adr;
+
+  if (!gdbm_dedup_p (dbf)
+      || elem->data_size != dbf->xheader->encode_min
+      || bucket_element_inline_p (dbf, elem))
+    return 0;
+
+  if (_gdbm_read_at (dbf, elem->data_pointer + elem->key_size,
+		     ref, sizeof (ref)))
+    return -1;
+  if (ref[0] != GDBM_VALUE_REF)
+    return 0;
+  memcpy (&adr, ref + 1, sizeof (adr));
+
+  if (value_header_read (dbf, adr, &hdr))
+    return -1;
+  if ((idx = dedup_index (dbf)) == NULL)
+    return -1;
+
+  if (idx->nrelease == idx->release_max)
+    {
+      size_t n = idx->release_max ? 2 * idx->release_max : 16;
+      off_t *p = realloc (idx->release, n * sizeof (idx->release[0]));
+
+      if (!p)
+	{
+	  GDBM_SET_ERRNO (dbf, GDBM_MALLOC_ERROR, FALSE);
+	  return -1;
+	}
+      idx->release = p;
+      idx->release_max = n;
+    }
+  idx->release[idx->nrelease++] = adr;
+  return 0;
+}
+
+/* Decrement the reference counts of the values released since the last
+   call, freeing the values that are no longer referenced.  Called by
+   _gdbm_end_update, once the file no longer holds the references. */
+int
+_gdbm_dedup_flush (GDBM_FILE dbf)
+{
+  struct dedup_index *idx = dbf->dedup_index;
+
+  if (!idx)
+    return 0;
+
+  while (idx->nrelease > 0)
+    {
+      off_t adr = idx->release[--idx->nrelease];
+      gdbm_shared_value hdr;
+
+      if (value_header_read (dbf, adr, &hdr))
+	return -1;
+      if (--hdr.refcount > 0)
+	{
+	  if (_gdbm_write_at (dbf, adr, &hdr, sizeof (hdr)))
+	    return -1;
+	}
+      else
+	{
+	  index_remove (idx, hdr.hash, adr);
+	  if (_gdbm_free_large (dbf, adr, sizeof (hdr) + hdr.size))
+	    return -1;
+	  /* The space may go to the avail table of the current bucket. */
+	  _gdbm_current_bucket_changed (dbf);
+	}
+    }
+  return 0;
+}
+
+/* Write the dedup index back to the file and discard it. */
+int
+_gdbm_dedup_index_save (GDBM_FILE dbf)
+{
+  struct dedup_index *idx = dbf->dedup_index;
+  struct dedup_entry buf[256];
+  off_t adr = 0, pos;
+  size_t i, n;
+  int rc = -1;
+
+  if (!idx)
+    return 0;
+
+  /* Drop the references released by a failed update first. */
+  if (idx->nrelease > 0 && _gdbm_end_update (dbf))
+    return -1;
+
+  if (idx->count > 0)
+    {
+      adr = _gdbm_alloc_large (dbf, (off_t) idx->count * sizeof (buf[0]));
+      if (adr == 0)
+	goto end;
+      pos = adr;
+      /* The space may come from the avail table of the current bucket,
+	 which must then be written as well. */
+      _gdbm_current_bucket_changed (dbf);
+      for (i = n = 0; i < idx->size; i++)
+	{
+	  if (idx->tab[i].adr == 0)
+	    continue;
+	  memset (&buf[n], 0, sizeof (buf[n]));
+	  buf[n].hash = idx->tab[i].hash;
+	  buf[n].adr = idx->tab[i].adr;
+	  if (++n == sizeof (buf) / sizeof (buf[0]))
+	    {
+	      if (_gdbm_write_at (dbf, pos, buf, n * sizeof (buf[0])))
+		goto end;
+	      pos += n * sizeof (buf[0]);
+	      n = 0;
+	    }
+	}
+      if (_gdbm_write_at (dbf, pos, buf, n * sizeof (buf[0])))
+	goto end;
+    }
+
+  dbf->xheader->dedup_index = adr;
+  dbf->xheader->dedup_count = idx->count;
+  dbf->header_changed = TRUE;
+  rc = 0;
+ end:
+  _gdbm_dedup_index_free (dbf);
+  return rc;
+}
+
+/* Discard the dedup index without writing it back. */
+void
+_gdbm_dedup_index_free (GDBM_FILE dbf)
+{
+  if (dbf->dedup_index)
+    {
+      index_free (dbf->dedup_index);
+      dbf->dedup_index = NULL;
+    }
+}
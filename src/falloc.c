@@ -26,9 +26,11 @@
    the definition of the function. */
 
 static avail_elem get_elem (int, avail_elem [], int *);
-static avail_elem get_block (int, GDBM_FILE);
+static avail_elem take_elem (off_t, int, off_t, avail_elem [], int *);
 static int push_avail_block (GDBM_FILE);
 static int pop_avail_block (GDBM_FILE);
+static int put_central_elem (GDBM_FILE, avail_elem);
+static off_t alloc_extent (GDBM_FILE, int);
 static int adjust_bucket_avail (GDBM_FILE);
 
 int
@@ -48,6 +50,24 @@ _gdbm_avail_block_read (GDBM_FILE dbf, avail_block *avblk, size_t size)
   return rc;
 }
 
+/* Get an element of at least SIZE bytes from the header avail table,
+   refilling it from the avail stack if it is less than half full.  If
+   no suitable element is found, the size of *RET is set to 0. */
+
+static int
+get_header_elem (GDBM_FILE dbf, int size, avail_elem *ret)
+{
+  /* If the header avail table is less than half full, and there's
+     something on the stack. */
+  if ((dbf->avail->count <= (dbf->avail->size >> 1))
+      && (dbf->avail->next_block != 0))
+    if (pop_avail_block (dbf))
+      return -1;
+
+  *ret = get_elem (size, dbf->avail->av_table, &dbf->avail->count);
+  return 0;
+}
+
 /* Allocate space in the file DBF for a block NUM_BYTES in length.  Return
    the file address of the start of the block.  
 
@@ -62,7 +82,13 @@ _gdbm_avail_block_read (GDBM_FILE dbf, avail_block *avblk, size_t size)
    "guarantees" that an allocation does not cross a block boundary unless
    the size is larger than a single block.  The avail structure is
    changed by this routine if a change is needed.  If an error occurs,
-   the value of 0 will be returned.  */
+   the value of 0 will be returned.
+
+   If the avail index is in use, it replaces the header avail block
+   and the avail stack.  Space is then allocated on a best fit basis.
+
+   Requests of extent_threshold bytes or more are served by
+   alloc_extent.  */
 
 off_t
 _gdbm_alloc (GDBM_FILE dbf, int num_bytes)
@@ -70,6 +96,9 @@ _gdbm_alloc (GDBM_FILE dbf, int num_bytes)
   off_t file_adr;		/* The address of the block. */
   avail_elem av_el;		/* For temporary use. */
 
+  if (dbf->extent_threshold && (size_t) num_bytes >= dbf->extent_threshold)
+    return alloc_extent (dbf, num_bytes);
+
   /* The current bucket is the first place to look for space. */
   av_el = get_elem (num_bytes, dbf->bucket->bucket_avail,
 		    &dbf->bucket->av_count);
@@ -77,18 +106,20 @@ _gdbm_alloc (GDBM_FILE dbf, int num_bytes)
   /* If we did not find some space, we have more work to do. */
   if (av_el.av_size == 0)
     {
-      /* If the header avail table is less than half full, and there's
-	 something on the stack. */
-      if ((dbf->avail->count <= (dbf->avail->size >> 1))
-          && (dbf->avail->next_block != 0))
-        if (pop_avail_block (dbf))
-	  return 0;
-
-      /* check the header avail table next */
-      av_el = get_elem (num_bytes, dbf->avail->av_table, &dbf->avail->count);
-      if (av_el.av_size == 0)
-        /* Get another full block from end of file. */
-        av_el = get_block (num_bytes, dbf);
+      if (dbf->use_avail_index)
+	{
+	  if (_gdbm_avail_index_get (dbf, num_bytes, &av_el))
+	    return 0;
+	}
+      else
+	{
+	  /* check the header avail table next */
+	  if (get_header_elem (dbf, num_bytes, &av_el))
+	    return 0;
+	  if (av_el.av_size == 0)
+	    /* Get another full block from end of file. */
+	    av_el = _gdbm_get_block (num_bytes, dbf);
+	}
 
       dbf->header_changed = TRUE;
     }
@@ -107,6 +138,129 @@ _gdbm_alloc (GDBM_FILE dbf, int num_bytes)
   
 }
 
+/* Allocate NUM_BYTES of file space for a large record.  The space
+   starts on a block boundary, so that the record can be read with
+   aligned I/O.  It is never taken from the bucket avail tables, which
+   hold the small pieces of space used for small records.  A free area
+   that can hold the aligned extent is looked for in the header avail
+   table or avail index.  If there is none, new blocks are allocated at
+   the end of the file.  The unused space before and after the extent
+   is returned to the avail structure.  */
+
+static off_t
+alloc_extent (GDBM_FILE dbf, int num_bytes)
+{
+  int block_size = dbf->header->block_size;
+  int size;
+  off_t adr;
+  avail_elem av_el;
+
+  size = (num_bytes + block_size - 1) / block_size * block_size;
+
+  if (dbf->use_avail_index)
+    {
+      if (_gdbm_avail_index_get (dbf, size, &av_el))
+	return 0;
+    }
+  else if (get_header_elem (dbf, size, &av_el))
+    return 0;
+
+  adr = (av_el.av_adr + block_size - 1) / block_size * block_size;
+  if (av_el.av_size == 0 || adr + num_bytes > av_el.av_adr + av_el.av_size)
+    {
+      /* The area is misaligned.  Put it back and get new blocks. */
+      if (av_el.av_size > 0 && put_central_elem (dbf, av_el))
+	return 0;
+      av_el = _gdbm_get_block (size
+			       + (block_size
+				  - dbf->header->next_block % block_size)
+			         % block_size,
+			       dbf);
+      adr = (av_el.av_adr + block_size - 1) / block_size * block_size;
+    }
+  dbf->header_changed = TRUE;
+
+  /* Return the unused space. */
+  if (_gdbm_free (dbf, av_el.av_adr, adr - av_el.av_adr)
+      || _gdbm_free (dbf, adr + num_bytes,
+		     av_el.av_adr + av_el.av_size - adr - num_bytes))
+    return 0;
+
+  return adr;
+}
+
+/* Try to grow the block of file space that ends at ADR by NUM_BYTES
+   bytes, without moving it.  This is possible if the free space that
+   starts at ADR is listed in the avail table of the current bucket, in
+   the header avail table or in the avail index, or if ADR is the end
+   of the allocated part of the file.  Free space that is too short but
+   extends to the end of the allocated part is topped up with new
+   blocks.  The unused part of the free space is returned to the avail
+   structure.
+
+   Returns 0 if the block was extended, 1 if it can't be extended, and
+   -1 on error. */
+
+int
+_gdbm_extend (GDBM_FILE dbf, off_t adr, int num_bytes)
+{
+  avail_elem av_el;
+
+  /* Look in the current bucket first. */
+  av_el = take_elem (adr, num_bytes, dbf->header->next_block,
+		     dbf->bucket->bucket_avail, &dbf->bucket->av_count);
+  if (av_el.av_size > 0)
+    _gdbm_current_bucket_changed (dbf);
+  else
+    {
+      if (dbf->use_avail_index)
+	{
+	  int rc = _gdbm_avail_index_take (dbf, adr, num_bytes, &av_el);
+	  if (rc)
+	    return rc;
+	}
+      else
+	av_el = take_elem (adr, num_bytes, dbf->header->next_block,
+			   dbf->avail->av_table, &dbf->avail->count);
+      if (av_el.av_size == 0)
+	{
+	  if (adr != dbf->header->next_block)
+	    return 1;
+	  avail_elem_init (&av_el, 0, adr);
+	}
+      dbf->header_changed = TRUE;
+    }
+
+  if (av_el.av_size < num_bytes)
+    /* The area ends at next_block.  Append new blocks to it. */
+    av_el.av_size += _gdbm_get_block (num_bytes - av_el.av_size, dbf).av_size;
+
+  /* Put the unused space back in the avail block. */
+  if (_gdbm_free (dbf, av_el.av_adr + num_bytes, av_el.av_size - num_bytes))
+    return -1;
+  return 0;
+}
+
+/* Put the avail element AV_EL to the header avail table or, if it is
+   in use, to the avail index. */
+
+static int
+put_central_elem (GDBM_FILE dbf, avail_elem av_el)
+{
+  if (dbf->use_avail_index)
+    return _gdbm_avail_index_put (dbf, av_el);
+
+  if (dbf->avail->count == dbf->avail->size)
+    {
+      if (push_avail_block (dbf))
+	return -1;
+    }
+  _gdbm_put_av_elem (av_el, dbf->avail->av_table,
+		     &dbf->avail->count, dbf->coalesce_blocks);
+  dbf->header_changed = TRUE;
+  return 0;
+}
+
 /* Free space of size NUM_BYTES in the file DBF at file address FILE_ADR.  Make
    it available for reuse through _gdbm_alloc.  This routine changes the
    avail structure. */
@@ -126,14 +280,8 @@ _gdbm_free (GDBM_FILE dbf, off_t file_adr, int num_bytes)
   /* Is the freed space large or small? */
   if ((num_bytes >= dbf->header->block_size) || dbf->central_free)
     {
-      if (dbf->avail->count == dbf->avail->size)
-	{
-	  if (push_avail_block (dbf))
-	    return -1;
-	}
-      _gdbm_put_av_elem (temp, dbf->avail->av_table,
-			 &dbf->avail->count, dbf->coalesce_blocks);
-      dbf->header_changed = TRUE;
+      if (put_central_elem (dbf, temp))
+	return -1;
     }
   else
     {
@@ -141,17 +289,8 @@ _gdbm_free (GDBM_FILE dbf, off_t file_adr, int num_bytes)
       if (dbf->bucket->av_count < BUCKET_AVAIL)
 	_gdbm_put_av_elem (temp, dbf->bucket->bucket_avail,
 			   &dbf->bucket->av_count, dbf->coalesce_blocks);
-      else
-	{
-	  if (dbf->avail->count == dbf->avail->size)
-	    {
-	      if (push_avail_block (dbf))
-		return -1;
-	    }
-	  _gdbm_put_av_elem (temp, dbf->avail->av_table,
-			     &dbf->avail->count, dbf->coalesce_blocks);
-	  dbf->header_changed = TRUE;
-	}
+      else if (put_central_elem (dbf, temp))
+	return -1;
     }
 
   if (dbf->header_changed && adjust_bucket_avail (dbf))
@@ -161,6 +300,46 @@ _gdbm_free (GDBM_FILE dbf, off_t file_adr, int num_bytes)
   return 0;
 }
 
+/* Allocate NUM_BYTES of file space, which may be more than fits into an
+   int.  This is used for the directories of large databases.  Requests
+   that fit into an avail element are served by _gdbm_alloc, larger ones
+   get new blocks at the end of the file. */
+off_t
+_gdbm_alloc_large (GDBM_FILE dbf, off_t num_bytes)
+{
+  off_t file_adr;
+  off_t size;
+
+  if (num_bytes <= INT_MAX)
+    return _gdbm_alloc (dbf, num_bytes);
+
+  size = (num_bytes + dbf->header->block_size - 1)
+         / dbf->header->block_size * dbf->header->block_size;
+  file_adr = dbf->header->next_block;
+  dbf->header->next_block += size;
+  dbf->header_changed = TRUE;
+  if (_gdbm_free (dbf, file_adr + num_bytes, size - num_bytes))
+    return 0;
+  return file_adr;
+}
+
+/* Free NUM_BYTES of file space at FILE_ADR, allocated by
+   _gdbm_alloc_large.  Large areas are freed in pieces of whole blocks
+   small enough to fit into avail elements. */
+int
+_gdbm_free_large (GDBM_FILE dbf, off_t file_adr, off_t num_bytes)
+{
+  off_t max = INT_MAX / 2 / dbf->header->block_size * dbf->header->block_size;
+
+  while (num_bytes > max)
+    {
+      if (_gdbm_free (dbf, file_adr, max))
+	return -1;
+      file_adr += max;
+      num_bytes -= max;
+    }
+  return _gdbm_free (dbf, file_adr, num_bytes);
+}
 
 
 /* The following are all utility routines needed by the previous two. */
@@ -291,7 +470,7 @@ push_avail_block (GDBM_FILE dbf)
   /* Get address in file for new av_size bytes. */
   new_loc = get_elem (av_size, dbf->avail->av_table, &dbf->avail->count);
   if (new_loc.av_size == 0)
-    new_loc = get_block (av_size, dbf);
+    new_loc = _gdbm_get_block (av_size, dbf);
   av_adr = new_loc.av_adr;
 
   /* Split the header block. */
@@ -419,6 +598,33 @@ get_elem (int size, avail_elem av_table[], int *av_count)
   return val;
 }
 
+/* Take_elem extracts from the AV_TABLE the element that starts at the
+   address ADR and is either at least SIZE bytes long or ends at the
+   address END.  If there is no such element, it returns a size of zero.
+   This routine does no I/O. */
+
+static avail_elem
+take_elem (off_t adr, int size, off_t end, avail_elem av_table[],
+	   int *av_count)
+{
+  int index;
+  avail_elem val;
+
+  for (index = 0; index < *av_count; index++)
+    if (av_table[index].av_adr == adr)
+      {
+	if (av_table[index].av_size < size
+	    && av_table[index].av_adr + av_table[index].av_size != end)
+	  break;
+	val = av_table[index];
+	avail_move (av_table, av_count, index + 1, index);
+	return val;
+      }
+
+  avail_elem_init (&val, 0, 0);
+  return val;
+}
+
 /* This routine inserts a single NEW_EL into the AV_TABLE block.
    This routine does no I/O. */
 
@@ -439,7 +645,10 @@ _gdbm_put_av_elem (avail_elem new_el, avail_elem av_table[], int *av_count,
       
       for (i = 0; i < *av_count;)
 	{
-	  if ((av_table[i].av_adr + av_table[i].av_size) == new_el.av_adr)
+	  if (av_table[i].av_size > INT_MAX - new_el.av_size)
+	    /* The merged block would be too large. */
+	    i++;
+	  else if ((av_table[i].av_adr + av_table[i].av_size) == new_el.av_adr)
 	    {
 	      /* Right adjacent */
 	      new_el.av_size += av_table[i].av_size;
@@ -472,8 +681,8 @@ _gdbm_put_av_elem (avail_elem new_el, avail_elem av_table[], int *av_count,
    DBF contains the file header that needs updating.  This routine does
    no I/O.  */
 
-static avail_elem
-get_block (int size, GDBM_FILE dbf)
+avail_elem
+_gdbm_get_block (int size, GDBM_FILE dbf)
 {
   avail_elem val;
 
@@ -496,13 +705,34 @@ get_block (int size, GDBM_FILE dbf)
 
 
 /*  When the header already needs writing, we can make sure the current
-    bucket has its avail block as close to 1/3 full as possible. */
+    bucket has its avail block as close to 1/3 full as possible.  If the
+    avail index is in use, excess entries are moved to it, but nothing
+    is taken from it: best fit allocation works better when all the
+    space is kept in the index. */
 static int
 adjust_bucket_avail (GDBM_FILE dbf)
 {
   int third = BUCKET_AVAIL / 3;
   avail_elem av_el;
 
+  if (dbf->use_avail_index)
+    {
+      while (dbf->bucket->av_count > BUCKET_AVAIL-third)
+	{
+	  av_el = get_elem (0, dbf->bucket->bucket_avail,
+			    &dbf->bucket->av_count);
+	  if (av_el.av_size == 0)
+	    {
+	      GDBM_SET_ERRNO (dbf, GDBM_BAD_AVAIL, TRUE);
+	      return -1;
+	    }
+	  if (_gdbm_avail_index_put (dbf, av_el))
+	    return -1;
+	  _gdbm_current_bucket_changed (dbf);
+	}
+      return 0;
+    }
+
   /* Can we add more entries to the bucket? */
   if (dbf->bucket->av_count < third)
     {
@@ -38,9 +38,13 @@ gdbm_offset_ok (GDBM_FILE dbf, off_t off)
 static inline int
 gdbm_bucket_element_valid_p (GDBM_FILE dbf, int elem_loc)
 {
-  return elem_loc < dbf->header->bucket_elems
-    && dbf->bucket->h_table[elem_loc].hash_value != -1
-    && dbf->bucket->h_table[elem_loc].key_size >= 0
+  if (!(elem_loc < dbf->header->bucket_elems
+	&& dbf->bucket->h_table[elem_loc].hash_value != -1))
+    return 0;
+  /* Inline records occupy no file space. */
+  if (bucket_element_inline_p (dbf, &dbf->bucket->h_table[elem_loc]))
+    return 1;
+  return dbf->bucket->h_table[elem_loc].key_size >= 0
     && off_t_sum_ok (dbf->bucket->h_table[elem_loc].data_pointer,
 		     dbf->bucket->h_table[elem_loc].key_size)
     && dbf->bucket->h_table[elem_loc].data_size >= 0
@@ -53,98 +57,269 @@ gdbm_bucket_element_valid_p (GDBM_FILE dbf, int elem_loc)
 		       + dbf->bucket->h_table[elem_loc].data_size);
 }
   
-/* Read the data found in bucket entry ELEM_LOC in file DBF and
-   return a pointer to it.  Also, cache the read value. */
-
-char *
-_gdbm_read_entry (GDBM_FILE dbf, int elem_loc)
+/* Make sure the data cache DATA_CA has room for SIZE bytes.  Its
+   contents are preserved. */
+static int
+data_cache_reserve (GDBM_FILE dbf, data_cache_elem *data_ca, size_t size)
 {
-  int rc;
-  off_t file_pos;
-  int key_size;
-  int data_size;
-  size_t dsize;
-  data_cache_elem *data_ca;
-
-  /* Is it already in the cache? */
-  if (dbf->cache_mru->ca_data.elem_loc == elem_loc)
-    return dbf->cache_mru->ca_data.dptr;
-
-  if (!gdbm_bucket_element_valid_p (dbf, elem_loc))
-    {
-      GDBM_SET_ERRNO (dbf, GDBM_BAD_HASH_TABLE, TRUE);
-      return NULL;
-    }
-  
-  /* Set sizes and pointers. */
-  key_size = dbf->bucket->h_table[elem_loc].key_size;
-  data_size = dbf->bucket->h_table[elem_loc].data_size;
-  dsize = key_size + data_size;
-  data_ca = &dbf->cache_mru->ca_data;
-
-  /* Make sure data_ca has sufficient space to accommodate both
-     key and content. */
-  if (dsize <= data_ca->dsize)
+  if (size <= data_ca->dsize)
     {
       if (data_ca->dsize == 0)
 	{
 	  data_ca->dptr = malloc (1);
 	  if (data_ca->dptr)
-	    data_ca->dsize = 1;
+	    {
+	      _gdbm_cache_data_resized (dbf, 0, 1);
+	      data_ca->dsize = 1;
+	    }
 	  else
 	    {
 	      GDBM_SET_ERRNO2 (dbf, GDBM_MALLOC_ERROR, FALSE, GDBM_DEBUG_LOOKUP);
 	      _gdbm_fatal (dbf, _("malloc error"));
-	      return NULL;
+	      return -1;
 	    }
 	}
     }
   else
     {
-      char *p = realloc (data_ca->dptr, dsize);
+      char *p = realloc (data_ca->dptr, size);
       if (p)
 	{
+	  _gdbm_cache_data_resized (dbf, data_ca->dsize, size);
 	  data_ca->dptr = p;
-	  data_ca->dsize = dsize;
+	  data_ca->dsize = size;
 	}
       else
 	{
 	  GDBM_SET_ERRNO2 (dbf, GDBM_MALLOC_ERROR, FALSE, GDBM_DEBUG_LOOKUP);
 	  _gdbm_fatal (dbf, _("malloc error"));
-	  return NULL;
+	  return -1;
 	}
     }
+  return 0;
+}
+
+/* Read the data found in bucket entry ELEM_LOC in file DBF and
+   return a pointer to it.  Also, cache the read value.  Compressed
+   data are decoded, so the data_size member of the data cache may
+   differ from that of the bucket element.  If the key of the entry
+   is already in the cache, only the data are read. */
+
+char *
+_gdbm_read_entry (GDBM_FILE dbf, int elem_loc)
+{
+  int key_size;
+  int data_size;
+  size_t off;
+  data_cache_elem *data_ca = &dbf->cache_mru->ca_data;
+
+  /* Is it already in the cache? */
+  if (gdbm_record_cached_p (dbf, elem_loc))
+    return data_ca->dptr;
+
+  if (!gdbm_bucket_element_valid_p (dbf, elem_loc))
+    {
+      GDBM_SET_ERRNO (dbf, GDBM_BAD_HASH_TABLE, TRUE);
+      return NULL;
+    }
+  
+  /* Set sizes and pointers. */
+  key_size = dbf->bucket->h_table[elem_loc].key_size;
+  data_size = dbf->bucket->h_table[elem_loc].data_size;
+  off = data_ca->elem_loc == elem_loc ? key_size : 0;
+
+  /* Make sure data_ca has sufficient space to accommodate both
+     key and content. */
+  if (data_cache_reserve (dbf, data_ca, key_size + data_size))
+    return NULL;
 
-  /* Read into the cache. */
-  file_pos = gdbm_file_seek (dbf, dbf->bucket->h_table[elem_loc].data_pointer,
-                             SEEK_SET);
-  if (file_pos != dbf->bucket->h_table[elem_loc].data_pointer)
+  if (bucket_element_inline_p (dbf, &dbf->bucket->h_table[elem_loc]))
+    /* The record is kept in the bucket. */
+    bucket_element_inline_get (&dbf->bucket->h_table[elem_loc],
+			       data_ca->dptr);
+  else if (_gdbm_read_at (dbf,
+			  dbf->bucket->h_table[elem_loc].data_pointer + off,
+			  data_ca->dptr + off, key_size + data_size - off))
     {
-      GDBM_SET_ERRNO2 (dbf, GDBM_FILE_SEEK_ERROR, TRUE, GDBM_DEBUG_LOOKUP);
-      _gdbm_fatal (dbf, _("lseek error"));
+      data_ca->elem_loc = -1;
       return NULL;
     }
 
-  rc = _gdbm_full_read (dbf, data_ca->dptr, key_size+data_size);
-  if (rc)
+  /* Set up the cache. */
+  data_ca->key_size = key_size;
+  data_ca->data_size = data_size;
+  data_ca->key_only = FALSE;
+  if (bucket_element_encoded_p (dbf, &dbf->bucket->h_table[elem_loc])
+      && _gdbm_decode_data (dbf, data_ca))
     {
-      GDBM_DEBUG (GDBM_DEBUG_ERR|GDBM_DEBUG_LOOKUP|GDBM_DEBUG_READ,
-                 "%s: error reading entry: %s",
-                 dbf->name, gdbm_db_strerror (dbf));
-      dbf->need_recovery = TRUE;
-      _gdbm_fatal (dbf, gdbm_db_strerror (dbf));
+      data_ca->elem_loc = -1;
       return NULL;
     }
+  data_ca->elem_loc = elem_loc;
+  data_ca->hash_val = dbf->bucket->h_table[elem_loc].hash_value;
+
+  return data_ca->dptr;
+}
+
+/* Read the key found in bucket entry ELEM_LOC in file DBF into the data
+   cache and return a pointer to it.  The data are not read: they are
+   read by _gdbm_read_entry, if needed. */
+
+char *
+_gdbm_read_key (GDBM_FILE dbf, int elem_loc)
+{
+  int key_size;
+  data_cache_elem *data_ca = &dbf->cache_mru->ca_data;
+
+  /* Is it already in the cache? */
+  if (data_ca->elem_loc == elem_loc)
+    return data_ca->dptr;
+
+  /* Inline records are read as a whole. */
+  if (elem_loc < dbf->header->bucket_elems
+      && bucket_element_inline_p (dbf, &dbf->bucket->h_table[elem_loc]))
+    return _gdbm_read_entry (dbf, elem_loc);
   
+  if (!gdbm_bucket_element_valid_p (dbf, elem_loc))
+    {
+      GDBM_SET_ERRNO (dbf, GDBM_BAD_HASH_TABLE, TRUE);
+      return NULL;
+    }
+
+  key_size = dbf->bucket->h_table[elem_loc].key_size;
+  if (data_cache_reserve (dbf, data_ca, key_size)
+      || _gdbm_read_at (dbf, dbf->bucket->h_table[elem_loc].data_pointer,
+			data_ca->dptr, key_size))
+    {
+      data_ca->elem_loc = -1;
+      return NULL;
+    }
+
   /* Set up the cache. */
   data_ca->key_size = key_size;
-  data_ca->data_size = data_size;
+  data_ca->data_size = 0;
+  data_ca->key_only = TRUE;
   data_ca->elem_loc = elem_loc;
   data_ca->hash_val = dbf->bucket->h_table[elem_loc].hash_value;
 
   return data_ca->dptr;
 }
 
+/* Read the key of the element ELEM_LOC into the data cache.  Return 1
+   if it is equal to KEY, 0 if it isn't and -1 on error. */
+static int
+key_read_match (GDBM_FILE dbf, int elem_loc, datum key)
+{
+  char *file_key = _gdbm_read_key (dbf, elem_loc);
+
+  if (!file_key)
+    {
+      GDBM_DEBUG (GDBM_DEBUG_LOOKUP, "%s: error reading entry: %s",
+		  dbf->name, gdbm_db_strerror (dbf));
+      return -1;
+    }
+  return memcmp (file_key, key.dptr, key.dsize) == 0;
+}
+
+/* Return 1 if the key of the element ELEM_LOC, which has the same hash
+   value and size as KEY, is equal to KEY, and 0 otherwise.  Only the
+   key part of the record is read, and the data cache is left untouched.
+   Return -1 on error. */
+static int
+key_match (GDBM_FILE dbf, int elem_loc, datum key)
+{
+  bucket_element *elem = &dbf->bucket->h_table[elem_loc];
+  char sbuf[256], *buf;
+  int rc;
+
+  if (!gdbm_bucket_element_valid_p (dbf, elem_loc))
+    {
+      GDBM_SET_ERRNO (dbf, GDBM_BAD_HASH_TABLE, TRUE);
+      return -1;
+    }
+
+  /* Short keys are kept in the bucket in their entirety, except in
+     large databases. */
+  if (key.dsize <= SMALL && !gdbm_large_p (dbf))
+    return 1;
+
+  if (bucket_element_inline_p (dbf, elem))
+    {
+      char ibuf[INLINE_RECORD_SIZE];
+
+      bucket_element_inline_get (elem, ibuf);
+      return memcmp (ibuf, key.dptr, key.dsize) == 0;
+    }
+
+  if (dbf->cache_mru->ca_data.elem_loc == elem_loc)
+    return memcmp (dbf->cache_mru->ca_data.dptr, key.dptr, key.dsize) == 0;
+
+  if (key.dsize <= sizeof (sbuf))
+    buf = sbuf;
+  else if ((buf = malloc (key.dsize)) == NULL)
+    {
+      GDBM_SET_ERRNO2 (dbf, GDBM_MALLOC_ERROR, FALSE, GDBM_DEBUG_LOOKUP);
+      return -1;
+    }
+
+  if (_gdbm_read_at (dbf, elem->data_pointer, buf, key.dsize))
+    rc = -1;
+  else
+    rc = memcmp (buf, key.dptr, key.dsize) == 0;
+
+  if (buf != sbuf)
+    free (buf);
+  return rc;
+}
+
+/* Search the current bucket for KEY, starting at the home location
+   ELEM_LOC.  HASH_VAL and KEY_START are the hash value and the key
+   start computed for KEY.  MATCH is called for each element whose hash
+   value, key size and key start are those of KEY: it returns 1 if the
+   key of the element is KEY, 0 if it isn't and -1 on error.
+
+   Return the location of KEY in the bucket.  If it is not found, return
+   -1 and set gdbm_errno to GDBM_ITEM_NOT_FOUND. */
+static int
+bucket_probe (GDBM_FILE dbf, datum key, int hash_val, char const *key_start,
+	      int elem_loc, int (*match) (GDBM_FILE, int, datum))
+{
+  int home_loc = elem_loc;
+  bucket_element *elem;
+
+  do
+    {
+      elem = &dbf->bucket->h_table[elem_loc];
+      if (elem->hash_value == -1
+	  || bucket_probe_end_p (dbf, home_loc, elem_loc))
+	break;
+      if (elem->hash_value == hash_val
+	  && elem->key_size == key.dsize
+	  && memcmp (elem->key_start, key_start,
+		     gdbm_key_start_len (dbf, key.dsize)) == 0)
+	{
+	  switch (match (dbf, elem_loc, key))
+	    {
+	    case 1:
+	      GDBM_DEBUG (GDBM_DEBUG_LOOKUP, "%s: found", dbf->name);
+	      return elem_loc;
+
+	    case -1:
+	      return -1;
+	    }
+	}
+      elem_loc = (elem_loc + 1) % dbf->header->bucket_elems;
+      GDBM_DEBUG (GDBM_DEBUG_LOOKUP, "%s: next location = %#4x:%d",
+		  dbf->name, dbf->bucket->h_table[elem_loc].hash_value,
+		  elem_loc);
+    }
+  while (elem_loc != home_loc);
+
+  /* If we get here, we never found the key. */
+  GDBM_SET_ERRNO2 (dbf, GDBM_ITEM_NOT_FOUND, FALSE, GDBM_DEBUG_LOOKUP);
+  return -1;
+}
+
 /* Find the KEY in the file and get ready to read the associated data.  The
    return value is the location in the current hash bucket of the KEY's
    entry.  If it is found, additional data are returned as follows:
@@ -157,18 +332,17 @@ _gdbm_read_entry (GDBM_FILE dbf, int elem_loc)
 int
 _gdbm_findkey (GDBM_FILE dbf, datum key, char **ret_dptr, int *ret_hash_val)
 {
-  int    bucket_hash_val;	/* The hash value from the bucket. */
   int    new_hash_val;          /* Computed hash value for the key */
   char  *file_key;		/* The complete key as stored in the file. */
   int    bucket_dir;            /* Number of the bucket in directory. */
   int    elem_loc;		/* The location in the bucket. */
-  int    home_loc;		/* The home location in the bucket. */
-  int    key_size;		/* Size of the key on the file.  */
+  char   key_start[SMALL];      /* Expected key_start of the element. */
 
   GDBM_DEBUG_DATUM (GDBM_DEBUG_LOOKUP, key, "%s: fetching key:", dbf->name);
   
   /* Compute hash value and load proper bucket.  */
-  _gdbm_hash_key (dbf, key, &new_hash_val, &bucket_dir, &elem_loc);
+  _gdbm_hash_key_start (dbf, key, &new_hash_val, &bucket_dir, &elem_loc,
+			key_start);
 
   GDBM_DEBUG (GDBM_DEBUG_LOOKUP, "%s: location = %#4x:%d:%d", dbf->name,
 	      new_hash_val, bucket_dir, elem_loc);
@@ -186,63 +360,50 @@ _gdbm_findkey (GDBM_FILE dbf, datum key, char **ret_dptr, int *ret_hash_val)
       && memcmp (dbf->cache_mru->ca_data.dptr, key.dptr, key.dsize) == 0)
     {
       GDBM_DEBUG (GDBM_DEBUG_LOOKUP, "%s: found in cache", dbf->name);
-      /* This is it. Return the cache pointer. */
-      if (ret_dptr)
-	*ret_dptr = dbf->cache_mru->ca_data.dptr + key.dsize;
-      return dbf->cache_mru->ca_data.elem_loc;
+      elem_loc = dbf->cache_mru->ca_data.elem_loc;
     }
-      
-  /* It is not the cached value, search for element in the bucket. */
-  home_loc = elem_loc;
-  bucket_hash_val = dbf->bucket->h_table[elem_loc].hash_value;
-  while (bucket_hash_val != -1)
+  else
     {
-      key_size = dbf->bucket->h_table[elem_loc].key_size;
-      if (bucket_hash_val != new_hash_val
-	 || key_size != key.dsize
-	 || memcmp (dbf->bucket->h_table[elem_loc].key_start, key.dptr,
-			(SMALL < key_size ? SMALL : key_size)) != 0) 
-	{
-	  /* Current elem_loc is not the item, go to next item. */
-	  elem_loc = (elem_loc + 1) % dbf->header->bucket_elems;
-	  if (elem_loc == home_loc)
-	    break;
-	  bucket_hash_val = dbf->bucket->h_table[elem_loc].hash_value;
-	}
-      else
-	{
-	  /* This may be the one we want.
-	     The only way to tell is to read it. */
-	  file_key = _gdbm_read_entry (dbf, elem_loc);
-	  if (!file_key)
-	    {
-	      GDBM_DEBUG (GDBM_DEBUG_LOOKUP, "%s: error reading entry: %s",
-			  dbf->name, gdbm_db_strerror (dbf));
-	      return -1;
-	    }
-	  if (memcmp (file_key, key.dptr, key_size) == 0)
-	    {
-	      /* This is the item. */
-	      GDBM_DEBUG (GDBM_DEBUG_LOOKUP, "%s: found", dbf->name);
-	      if (ret_dptr)
-		*ret_dptr = file_key + key.dsize;
-	      return elem_loc;
-	    }
-	  else
-	    {
-	      /* Not the item, try the next one.  Return if not found. */
-	      elem_loc = (elem_loc + 1) % dbf->header->bucket_elems;
-	      if (elem_loc == home_loc)
-		break;
-	      bucket_hash_val = dbf->bucket->h_table[elem_loc].hash_value;
-	    }
-	}
-      GDBM_DEBUG (GDBM_DEBUG_LOOKUP, "%s: next location = %#4x:%d:%d",
-		  dbf->name, bucket_hash_val, bucket_dir, elem_loc);
+      /* It is not the cached value, search for element in the bucket. */
+      elem_loc = bucket_probe (dbf, key, new_hash_val, key_start, elem_loc,
+			       key_read_match);
+      if (elem_loc == -1)
+	return -1;
     }
 
-  /* If we get here, we never found the key. */
-  GDBM_SET_ERRNO2 (dbf, GDBM_ITEM_NOT_FOUND, FALSE, GDBM_DEBUG_LOOKUP);
-  return -1;
+  /* Return the cache pointer, reading the data first if only the key
+     is cached. */
+  if (ret_dptr)
+    {
+      file_key = _gdbm_read_entry (dbf, elem_loc);
+      if (!file_key)
+	return -1;
+      *ret_dptr = file_key + key.dsize;
+    }
+  return elem_loc;
+}
+
+/* Find the KEY in the file, like _gdbm_findkey, but without reading the
+   data associated with it.  Only the key is read from the file, and
+   only if it doesn't fit into the key_start field of the bucket
+   element.  The data cache is left untouched. */
+int
+_gdbm_findkey_loc (GDBM_FILE dbf, datum key, int *ret_hash_val)
+{
+  int    new_hash_val;          /* Computed hash value for the key */
+  int    bucket_dir;            /* Number of the bucket in directory. */
+  int    elem_loc;		/* The location in the bucket. */
+  char   key_start[SMALL];      /* Expected key_start of the element. */
+
+  GDBM_DEBUG_DATUM (GDBM_DEBUG_LOOKUP, key, "%s: locating key:", dbf->name);
+
+  _gdbm_hash_key_start (dbf, key, &new_hash_val, &bucket_dir, &elem_loc,
+			key_start);
+  if (ret_hash_val)
+    *ret_hash_val = new_hash_val;
+  if (_gdbm_get_bucket (dbf, bucket_dir))
+    return -1;
 
+  return bucket_probe (dbf, key, new_hash_val, key_start, elem_loc,
+		       key_match);
 }
@@ -79,6 +79,75 @@ _gdbm_full_write (GDBM_FILE dbf, void *buffer, size_t size)
   return 0;
 }
 
+/* Position DBF at the address ADR.  On error, mark the database as
+   needing recovery. */
+static int
+seek_to (GDBM_FILE dbf, off_t adr)
+{
+  if (gdbm_file_seek (dbf, adr, SEEK_SET) != adr)
+    {
+      GDBM_SET_ERRNO (dbf, GDBM_FILE_SEEK_ERROR, TRUE);
+      _gdbm_fatal (dbf, _("lseek error"));
+      return -1;
+    }
+  return 0;
+}
+
+/* Read SIZE bytes at the address ADR of DBF into BUF.  Return 0 on
+   success.  On error, mark the database as needing recovery and return
+   -1. */
+int
+_gdbm_read_at (GDBM_FILE dbf, off_t adr, void *buf, size_t size)
+{
+  if (seek_to (dbf, adr))
+    return -1;
+  if (_gdbm_full_read (dbf, buf, size))
+    {
+      GDBM_DEBUG (GDBM_DEBUG_ERR|GDBM_DEBUG_READ,
+		  "%s: error reading %zu bytes at %lu: %s",
+		  dbf->name, size, (unsigned long) adr,
+		  gdbm_db_strerror (dbf));
+      dbf->need_recovery = TRUE;
+      _gdbm_fatal (dbf, gdbm_db_strerror (dbf));
+      return -1;
+    }
+  return 0;
+}
+
+/* Write SIZE bytes from BUF at the address ADR of DBF.  If BUF is NULL,
+   write SIZE zero bytes.  Return 0 on success and -1 on error. */
+int
+_gdbm_write_at (GDBM_FILE dbf, off_t adr, void const *buf, size_t size)
+{
+  static char const zeros[512];
+
+  if (size == 0)
+    return 0;
+  if (seek_to (dbf, adr))
+    return -1;
+  while (size > 0)
+    {
+      size_t n;
+
+      if (buf)
+	n = size;
+      else
+	n = size < sizeof (zeros) ? size : sizeof (zeros);
+      if (_gdbm_full_write (dbf, (void *) (buf ? buf : zeros), n))
+	{
+	  GDBM_DEBUG (GDBM_DEBUG_STORE|GDBM_DEBUG_ERR,
+		      "%s: error writing %zu bytes at %lu: %s",
+		      dbf->name, n, (unsigned long) adr,
+		      gdbm_db_strerror (dbf));
+	  _gdbm_fatal (dbf, gdbm_db_strerror (dbf));
+	  return -1;
+	}
+      adr += n;
+      size -= n;
+    }
+  return 0;
+}
+
 /* Grow the disk file of DBF to SIZE bytes in length. Fill the
    newly allocated space with zeros. */
 int
@@ -35,7 +35,14 @@ gdbm_close (GDBM_FILE dbf)
     {
       /* Make sure the database is all on disk. */
       if (dbf->read_write != GDBM_READER)
-	gdbm_file_sync (dbf);
+	{
+	  /* Write back the dedup and avail indexes. */
+	  if ((dbf->dedup_index || dbf->avail_index) && !dbf->need_recovery
+	      && _gdbm_dedup_index_save (dbf) == 0
+	      && _gdbm_avail_index_save (dbf) == 0)
+	    _gdbm_end_update (dbf);
+	  gdbm_file_sync (dbf);
+	}
 
       _gdbmsync_done (dbf);
       
@@ -56,8 +63,15 @@ gdbm_close (GDBM_FILE dbf)
   
   free (dbf->name);
   free (dbf->dir);
+  _gdbm_segdir_free (dbf);
 
+  _gdbm_dedup_index_free (dbf);
+  _gdbm_avail_index_free (dbf);
   _gdbm_cache_free (dbf);
+  free (dbf->bucket_buf);
+  free (dbf->value_buf);
+  _gdbm_cache_pool_detach (dbf);
+  _gdbm_shm_cache_close (dbf);
   
   free (dbf->header);
   free (dbf);
@@ -40,9 +40,69 @@
 #define GDBM_NUMSYNC_MAGIC32_SWAP    0xd09a5713u
 #define GDBM_NUMSYNC_MAGIC64_SWAP    0xd19a5713u
 
+/* Numsync format with feature flags in the extended header.  Earlier
+   versions of the library refuse to open such files. */
+#define GDBM_FEATURE_MAGIC32    0x13579ad2u
+#define GDBM_FEATURE_MAGIC64    0x13579ad3u
+
+#define GDBM_FEATURE_MAGIC32_SWAP    0xd29a5713u
+#define GDBM_FEATURE_MAGIC64_SWAP    0xd39a5713u
+
+/* Feature flags. */
+#define GDBM_FEATURE_INLINE  0x0001  /* Tiny records are kept in bucket
+					elements. */
+#define GDBM_FEATURE_COMPACT 0x0002  /* Buckets are stored in compact
+					encoding. */
+#define GDBM_FEATURE_ROBINHOOD 0x0004 /* Robin Hood placement of elements
+					 in buckets. */
+#define GDBM_FEATURE_LARGE   0x0008  /* 64-bit hash values and large
+					directory. */
+#define GDBM_FEATURE_COMPRESS 0x0010 /* Record data are compressed. */
+#define GDBM_FEATURE_DEDUP   0x0020  /* Identical record data are
+					shared. */
+#define GDBM_FEATURE_SEGDIR  0x0040  /* The directory is made of
+					segments. */
+#define GDBM_FEATURE_MASK    (GDBM_FEATURE_INLINE|GDBM_FEATURE_COMPACT\
+			      |GDBM_FEATURE_ROBINHOOD|GDBM_FEATURE_LARGE\
+			      |GDBM_FEATURE_COMPRESS|GDBM_FEATURE_DEDUP\
+			      |GDBM_FEATURE_SEGDIR)
+
+/* Average size of an element in a compact bucket, assumed when computing
+   the number of slots in its hash table. */
+#define COMPACT_SLOT_SIZE 10
+
 /* Size of a hash value, in bits */
 #define GDBM_HASH_BITS 31
 
+/* In large databases, size of the directory hash kept in the key_start
+   field of bucket elements, in bits, and the maximum number of bits of
+   the directory index. */
+#define GDBM_DIR_HASH_BITS 32
+#define GDBM_LARGE_DIR_BITS 30
+
+/* Maximum size of the directory of other databases, in bytes.  The
+   directory is not doubled past GDBM_MAX_DIR_HALF. */
+#define GDBM_MAX_DIR_SIZE INT32_MAX
+#define GDBM_MAX_DIR_HALF (GDBM_MAX_DIR_SIZE / 2)
+
+/* In databases with segmented directories, the maximum number of bits
+   of the index of an entry within its segment.  The directory index
+   is limited to GDBM_LARGE_DIR_BITS bits. */
+#define GDBM_DIR_SEGMENT_BITS 10
+
+/* In databases with compressed records, data of this size or larger
+   are stored in encoded form (see the comment to GDBM_VALUE_RAW in
+   gdbmdefs.h).  The value is recorded in the extended header when the
+   database is created. */
+#define GDBM_COMPRESS_THRESHOLD 64
+
+/* In databases with shared record data, data of GDBM_DEDUP_THRESHOLD
+   bytes or larger are shared.  A record refers to its shared data by
+   a reference of GDBM_VALUE_REF_SIZE bytes, which is also the size
+   from which data are stored in encoded form. */
+#define GDBM_DEDUP_THRESHOLD 64
+#define GDBM_VALUE_REF_SIZE 16
+
 /* Minimal acceptable block size */
 #define GDBM_MIN_BLOCK_SIZE 512
 
@@ -59,6 +119,40 @@
 /* The size of the bucket cache. */
 #define DEFAULT_CACHESIZE  GDBM_CACHE_AUTO
 
+/* Size of the write buffer used by gdbm_store_many. */
+#define STORE_BATCH_BUFSIZE (64*1024)
+
+/* Maximum size of a file extent allocated by gdbm_store_many. */
+#define STORE_BATCH_EXTENT (1024*1024)
+
+/* Size of the buffer used to copy records relocated by gdbm_store_range
+   and gdbm_append. */
+#define RANGE_COPY_BUFSIZE (64*1024)
+
+/* Number of records whose addresses are sorted at a time by
+   gdbm_scan_physical. */
+#define SCAN_BATCH 8192
+
+/* Maximum size of a single read done by gdbm_scan_physical.  Records
+   that lie within that distance are read together. */
+#define SCAN_READ_SIZE (1024*1024)
+
+/* Maximum number of threads used by checks of all buckets (see
+   GDBM_SETCHECKTHREADS). */
+#define GDBM_MAX_CHECK_THREADS 256
+
+/* Maximum number of buckets read by each recovery thread at a time. */
+#define RECOVER_BATCH_BUCKETS 1024
+
+/* Amount of record data after which a recovery thread stops reading
+   more buckets.  At least one bucket is read at a time. */
+#define RECOVER_BATCH_SIZE (1024*1024)
+
+/* Average fill of the buckets created for the expected number of
+   entries of a new database (see gdbm_open_spec), in percents of
+   bucket_elems.  Leaves room for uneven hashing. */
+#define PRESIZE_BUCKET_FILL 70
+
 #ifndef SIZE_T_MAX
 /* Maximum size representable by a size_t variable */
 # define SIZE_T_MAX ((size_t)-1)
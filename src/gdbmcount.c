@@ -29,6 +29,9 @@ gdbm_count (GDBM_FILE dbf, gdbm_count_t *pcount)
   
   /* Return immediately if the database needs recovery */	
   GDBM_ASSERT_CONSISTENCY (dbf, -1);
+
+  if (_gdbm_check_parallel_p (dbf))
+    return _gdbm_check_buckets (dbf, 0, pcount);
   
   for (i = 0; i < nbuckets; i = _gdbm_next_bucket_dir (dbf, i))
     {
@@ -24,9 +24,11 @@
 #if SIZEOF_OFF_T == 4
 # define GDBM_MAGIC	GDBM_MAGIC32
 # define GDBM_NUMSYNC_MAGIC GDBM_NUMSYNC_MAGIC32
+# define GDBM_FEATURE_MAGIC GDBM_FEATURE_MAGIC32
 #elif SIZEOF_OFF_T == 8
 # define GDBM_MAGIC	GDBM_MAGIC64
 # define GDBM_NUMSYNC_MAGIC GDBM_NUMSYNC_MAGIC64
+# define GDBM_FEATURE_MAGIC GDBM_FEATURE_MAGIC64
 #else
 # error "Unsupported off_t size, contact GDBM maintainer.  What crazy system is this?!?"
 #endif
@@ -99,7 +101,8 @@ typedef struct
   int   header_magic;  /* Version of file. */
   int   block_size;    /* The optimal i/o blocksize from stat. */
   off_t dir;           /* File address of hash directory table. */
-  int   dir_size;      /* Size in bytes of the table.  */
+  int   dir_size;      /* Size in bytes of the table (number of entries
+			  in large databases).  */
   int   dir_bits;      /* The number of address bits used in the table.*/
   int   bucket_size;   /* Size in bytes of a hash bucket struct. */
   int   bucket_elems;  /* Number of elements in a hash bucket. */
@@ -111,7 +114,14 @@ typedef struct
 {
   int version;         /* Version number (currently 0). */
   unsigned numsync;    /* Number of synchronizations. */
-  int pad[6];          /* Reserve space for further use. */
+  unsigned features;   /* Feature flags (GDBM_FEATURE_MAGIC only). */
+  int encode_min;      /* Minimal size of encoded data
+			  (GDBM_FEATURE_COMPRESS and GDBM_FEATURE_DEDUP
+			  only). */
+  off_t dedup_index;   /* File address of the shared data index
+			  (GDBM_FEATURE_DEDUP only). */
+  int dedup_count;     /* Number of entries in the index. */
+  int pad[1];          /* Reserve space for further use. */
 } gdbm_ext_header;
 
 /* Standard GDBM file header. */
@@ -145,6 +155,79 @@ typedef struct
   int   data_size;        /* Size of associated data in the file. */
 } bucket_element;
 
+/* In databases with the GDBM_FEATURE_INLINE feature, records whose key
+   and data together take no more than INLINE_RECORD_SIZE bytes are kept
+   in the bucket element itself: the key_start and data_pointer fields
+   hold the key immediately followed by the data. */
+#define INLINE_RECORD_SIZE (SMALL + sizeof (off_t))
+
+/* In databases with the GDBM_FEATURE_LARGE feature, keys are hashed to
+   64 bits.  The low GDBM_HASH_BITS bits are kept in hash_value and
+   select the home slot of the element in its bucket, as usual.  The top
+   GDBM_DIR_HASH_BITS bits are kept in key_start instead of the key
+   prefix, and index the directory, so that its depth doesn't reduce the
+   number of hash bits that distinguish the elements of a bucket.  The
+   dir_size field of the header holds the number of directory entries,
+   rather than their size in bytes. */
+
+/* In databases with the GDBM_FEATURE_SEGDIR feature, the directory is
+   made of segments of up to 2^GDBM_DIR_SEGMENT_BITS entries, so that
+   it grows by small steps instead of being doubled and rewritten as a
+   whole.  Each segment covers the directory indexes that start with a
+   prefix of prefix_bits bits, and holds an entry for each value of the
+   depth bits that follow.  header->dir is the address of a table of
+   header->dir_size segment addresses, indexed by the top bits of the
+   directory index, in which a segment with a shorter prefix appears
+   as many times as needed.  header->dir_bits is the number of bits of
+   the directory index, that is the largest prefix_bits + depth of the
+   segments.  On the disk, a segment is a dir_segment_header followed by
+   its 2^depth entries, and takes DIR_SEGMENT_DISK_SIZE bytes whatever
+   its depth. */
+typedef struct
+{
+  int prefix_bits;     /* Number of bits of the prefix. */
+  int depth;           /* Number of bits of the index in the segment. */
+} dir_segment_header;
+
+#define DIR_SEGMENT_DISK_SIZE \
+  (sizeof (dir_segment_header) + (sizeof (off_t) << GDBM_DIR_SEGMENT_BITS))
+
+/* In-memory image of a directory segment. */
+typedef struct
+{
+  off_t adr;           /* File address of the segment. */
+  int changed;         /* True if the segment has to be written. */
+  dir_segment_header hdr;
+  off_t entry[1];      /* Room for 2^GDBM_DIR_SEGMENT_BITS entries. */
+} dir_segment;
+
+#define DIR_SEGMENT_MEM_SIZE \
+  (offsetof (dir_segment, entry) + (sizeof (off_t) << GDBM_DIR_SEGMENT_BITS))
+
+/* In databases with the GDBM_FEATURE_COMPRESS or GDBM_FEATURE_DEDUP
+   feature, data shorter than xheader->encode_min bytes are stored as
+   is.  Longer data are stored in encoded form, starting with a tag
+   byte.  GDBM_VALUE_RAW is followed by the data themselves.
+   GDBM_VALUE_LZ is followed by the size of the data as a varint and by
+   the data compressed with the built-in LZ77 codec (see compress.c),
+   possibly padded with zeros up to encode_min bytes.  GDBM_VALUE_REF
+   is followed by the file address of a shared value (see dedup.c),
+   padded up to encode_min bytes.  The data_size field of the bucket
+   element holds the size of the stored form.  The data cache always
+   holds the decoded data. */
+#define GDBM_VALUE_RAW 0
+#define GDBM_VALUE_LZ  1
+#define GDBM_VALUE_REF 2
+
+/* A shared value starts with this header, which is followed by the
+   value in encoded form (GDBM_VALUE_RAW or GDBM_VALUE_LZ). */
+typedef struct
+{
+  unsigned refcount;   /* Number of records referring to the value. */
+  int size;            /* Size of the value that follows. */
+  uint64_t hash;       /* Hash of the value. */
+} gdbm_shared_value;
+
 /* A bucket is a small hash table.  This one consists of a number of
    bucket elements plus some bookkeeping fields.  The number of elements
    depends on the optimum blocksize for the storage device and on a
@@ -166,16 +249,31 @@ typedef struct
   bucket_element h_table[1]; /* The table.  Make it look like an array.*/
 } hash_bucket;
 
+/* In databases with the GDBM_FEATURE_COMPACT feature, the in-memory
+   image of a bucket is as described above, but on disk it is encoded
+   as follows: the header fields (up to h_table) are followed by a bitmap
+   of occupied slots, (bucket_elems + 7) / 8 bytes long, and by the
+   occupied elements in slot order.  Each element is stored as its
+   hash value, followed by the key and data sizes as varints.  Then
+   come either the inline record (see INLINE_RECORD_SIZE), or the first
+   min(SMALL, key size) bytes of the key and the data pointer as a
+   varint.  The rest of the block is filled with zeros.  The number of
+   slots is computed assuming an average element size of
+   COMPACT_SLOT_SIZE, so a bucket is split either when all its slots
+   are occupied or when its encoding would not fit into the block. */
+#define COMPACT_BUCKET_HDR_SIZE(dbf) \
+  (offsetof (hash_bucket, h_table) + ((dbf)->header->bucket_elems + 7) / 8)
+
 /* We want to keep from reading buckets as much as possible.  The following is
    to implement a bucket cache.  When full, buckets will be dropped in a
    least recently used order.  */
 
 /* To speed up fetching and "sequential" access, we need to implement a
    data cache for key/data pairs read from the file.  To find a key, we
-   must exactly match the key from the file.  To reduce overhead, the
-   data will be read at the same time.  Both key and data will be stored
-   in a data cache.  Each bucket cached will have a one element data
-   cache.  */
+   must exactly match the key from the file.  Only the key is read for
+   that; the data are read when they are asked for, and stored in the
+   data cache right after the key.  Each bucket cached will have a one
+   element data cache.  */
 
 typedef struct
 {
@@ -185,12 +283,15 @@ typedef struct
   char    *dptr;
   size_t  dsize;
   int     elem_loc;
+  int     key_only;    /* Only the key of elem_loc has been read. */
 } data_cache_elem;
 
 typedef struct cache_elem cache_elem;
+typedef struct cache_slab cache_slab;
 
 struct cache_elem
 {
+  cache_slab      *ca_slab;    /* Slab this element belongs to. */
   off_t           ca_adr;
   char            ca_changed;  /* Data in the bucket changed. */
   data_cache_elem ca_data;     /* Cached datum */
@@ -201,10 +302,30 @@ struct cache_elem
 			          available element. */
                   *ca_coll;    /* Next element in a collision sequence */
   size_t          ca_hits;     /* Number of times this element was requested */
-  hash_bucket     ca_bucket[1];/* Associated  bucket (dbf->header->bucket_size
+  size_t          ca_win;      /* Number of the auto-sizing window in which
+				  the element was last requested */
+  unsigned long   ca_tick;     /* Cache pool clock at the last request */
+  int             ca_size;     /* Upper bound of the size of the compact
+				  encoding of the bucket (-1 if unknown) */
+  hash_bucket     ca_bucket[1];/* Associated  bucket (dbf->bucket_mem_size
 				  bytes). */
 };
 
+/* Cache elements are allocated from slabs: contiguous memory regions
+   holding a number of elements of the same size. */
+struct cache_slab
+{
+  cache_slab      *prev, *next; /* Links in the list of slabs */
+  cache_elem      *free;        /* List of released elements (linked by
+				   ca_next) */
+  size_t          stride;       /* Size of an element, in bytes */
+  size_t          nelem;        /* Total number of elements */
+  size_t          nfresh;       /* Number of elements ever handed out */
+  size_t          used;         /* Number of elements in use */
+  size_t          size;         /* Size of the slab, in bytes */
+  int             mapped;       /* Slab was allocated by mmap */
+};
+
 /* Type of file locking in use. */
 enum lock_type
   {
@@ -214,6 +335,24 @@ enum lock_type
     LOCKING_FCNTL
   };
 
+/* Bucket cache pool shared by several databases.  The cache of each
+   attached database is protected by its own cache_mutex.  The mem and
+   tick members are accessed atomically. */
+struct gdbm_cache_pool
+{
+#if HAVE_PTHREAD_H
+  pthread_mutex_t mutex;   /* Protects the list of attached databases and
+			      the reference count. */
+#endif
+  size_t refcount;         /* Reference count: the creator plus each
+			      attached database. */
+  size_t mem_max;          /* Memory budget (bytes). */
+  size_t mem;              /* Memory used by cache elements and data caches
+			      of the attached databases. */
+  unsigned long tick;      /* Clock incremented on each cache access. */
+  GDBM_FILE dbf_head;      /* List of attached databases. */
+};
+
 /* This final structure contains all main memory based information for
    a gdbm file.  This allows multiple gdbm files to be opened at the same
    time by one program. */
@@ -251,6 +390,12 @@ struct gdbm_file_info
 
   /* Automatic bucket cache size */
   unsigned cache_auto :1;
+
+  /* Keep available file space in an in-memory index */
+  unsigned use_avail_index :1;
+
+  /* Allocate cache slabs from huge pages */
+  unsigned cache_hugepages :1;
   
   /* Last GDBM error number */
   gdbm_error last_error;
@@ -274,6 +419,12 @@ struct gdbm_file_info
   avail_block *avail;
   size_t avail_size;  /* Size of avail, in bytes */
 
+  /* In-memory index of available space (or NULL, if not loaded) */
+  struct avail_index *avail_index;
+
+  /* In-memory index of shared values (or NULL, if not loaded) */
+  struct dedup_index *dedup_index;
+
   /* Extended header (or NULL) */
   gdbm_ext_header *xheader;
   
@@ -281,6 +432,12 @@ struct gdbm_file_info
      ACM Trans on Database Systems, Vol 4, No 3. Sept 1979, 315-344 */
   off_t *dir;
 
+  /* The segments of the directory, indexed by the top dir_top_bits
+     bits of the directory index (GDBM_FEATURE_SEGDIR only). */
+  dir_segment **dir_seg;
+  int dir_top_bits;
+  size_t dir_seg_count;    /* Number of distinct segments */
+
   /* The bucket cache. */
   int cache_bits;          /* Address bits used for computing bucket hash */
   size_t cache_size;       /* Cache capacity: 2^cache_bits */
@@ -293,20 +450,72 @@ struct gdbm_file_info
   cache_elem *cache_lru;   /* Last recently used element - tail of the list */ 
   cache_elem *cache_avail; /* Pool of available elements (linked by prev, next)
 			    */
+  cache_slab *cache_slab_partial; /* Slabs with unused elements */
+  cache_slab *cache_slab_full;    /* Slabs with all elements in use */
   /* Points to dbf->cache_mru.ca_bucket -- the current hash bucket */
   hash_bucket *bucket;
   
   /* The directory entry used to get the current hash bucket. */
   int bucket_dir;
 
+  /* Size of the in-memory image of a bucket.  It differs from
+     header->bucket_size if buckets are stored in compact encoding. */
+  size_t bucket_mem_size;
+  /* Buffer for encoding and decoding compact buckets (or NULL) */
+  char *bucket_buf;
+
+  /* Buffer for encoding and decoding compressed data (or NULL) */
+  char *value_buf;
+  size_t value_buf_size;
+
   /* Cache statistics */
   size_t cache_access_count; /* Number of cache accesses */
   size_t cache_hits;         /* Number of cache hits */
+
+  /* Cache memory budget */
+  size_t cache_mem_max;      /* Max. number of bytes used by the bucket cache,
+				data caches and directory (0 - unlimited) */
+  size_t cache_mem;          /* Bytes used by cache elements and their data
+				caches */
+
+  /* Automatic cache sizing: statistics for the current window */
+  size_t cache_win;          /* Window number */
+  size_t cache_win_access;   /* Accesses within the window */
+  size_t cache_win_hits;     /* Hits within the window */
+  size_t cache_win_touched;  /* Distinct elements requested within the
+				window */
+
+  /* Bucket cache shared with other processes (or NULL) */
+  struct shm_cache *shm_cache;
+  size_t shm_hits;           /* Number of buckets found in shm_cache */
+
+  /* Allocator for the data returned to the caller */
+  gdbm_allocator result_alloc;
+
+  /* Records of this size or larger are allocated in block-aligned
+     extents (0 - disabled) */
+  size_t extent_threshold;
+
+  /* Number of threads used by checks of all buckets (0 - one per
+     online CPU) */
+  int check_threads;
+
+  /* Shared cache pool this database is attached to (or NULL) */
+  gdbm_cache_pool *cache_pool;
+  GDBM_FILE pool_prev, pool_next; /* List of databases attached to the
+				     pool */
+#if HAVE_PTHREAD_H
+  pthread_mutex_t cache_mutex;    /* Serializes access to the cache, if
+				     attached to a pool */
+#endif
+  unsigned long pool_call_tick;   /* Pool clock at the start of the
+				     latest call */
   
   /* Bookkeeping of things that need to be written back at the
      end of an update. */
   unsigned header_changed :1;
   unsigned directory_changed :1;
+  unsigned dir_top_changed :1; /* The segment table must be written */
 
   off_t file_size;       /* Cached value of the current disk file size.
 			    If -1, fstat will be used to retrieve it. */
@@ -331,7 +540,8 @@ struct gdbm_file_info
 #endif /* GDBM_FAILURE_ATOMIC */
 };
 
-#define GDBM_DIR_COUNT(db) ((db)->header->dir_size / sizeof (off_t))
+#define GDBM_DIR_COUNT(db) ((size_t) gdbm_dir_count (db))
+#define GDBM_DIR_SIZE(db) ((size_t) gdbm_dir_count (db) * sizeof (off_t))
 
 /* Offset of the avail block in GDBM header. */
 #define GDBM_HEADER_AVAIL_OFFSET(db) \
@@ -360,8 +570,23 @@ struct gdbm_file_info
           GDBM_SET_ERRNO (dbf, GDBM_NEED_RECOVERY, TRUE);	\
 	  return onerr;						\
 	}							\
+      GDBM_CACHE_POOL_ENTER (dbf);				\
     }								\
   while (0)
+
+/* Record the start of a new call on DBF.  Cache elements DBF looks up
+   from now on are not evicted by other databases of its cache pool
+   (see cache_pool_victim in bucket.c). */
+#define GDBM_CACHE_POOL_ENTER(dbf)					\
+  do									\
+    {									\
+      if ((dbf)->cache_pool)						\
+	__atomic_store_n (&(dbf)->pool_call_tick,			\
+			  __atomic_load_n (&(dbf)->cache_pool->tick,	\
+					   __ATOMIC_RELAXED),		\
+			  __ATOMIC_RELAXED);				\
+    }									\
+  while (0)
 
 /* Debugging hooks */
 #ifdef GDBM_DEBUG_ENABLE
@@ -21,44 +21,35 @@
 
 #include "gdbmdefs.h"
 
-/* Remove the KEYed item and the KEY from the database DBF.  The file on disk
-   is updated to reflect the structure of the new database before returning
-   from this procedure.  */
-
-int
-gdbm_delete (GDBM_FILE dbf, datum key)
+/* Remove the element at ELEM_LOC from the current bucket of DBF.  Other
+   elements are moved to guarantee that they can be found. */
+static void
+remove_elem (GDBM_FILE dbf, int elem_loc)
 {
-  int elem_loc;		/* The location in the current hash bucket. */
   int last_loc;		/* Last location emptied by the delete.  */
   int home;		/* Home position of an item. */
-  bucket_element elem;  /* The element to be deleted. */
-  off_t free_adr;       /* Temporary storage for address and size. */
-  int   free_size;
-
-  GDBM_ASSERT_CONSISTENCY (dbf, -1);
-
-  /* First check to make sure this guy is a writer. */
-  if (dbf->read_write == GDBM_READER)
-    {
-      GDBM_SET_ERRNO (dbf, GDBM_READER_CANT_DELETE, FALSE);
-      return -1;
-    }
-  
-  /* Initialize the gdbm_errno variable. */
-  gdbm_set_errno (dbf, GDBM_NO_ERROR, FALSE);
-
-  /* Find the item. */
-  elem_loc = _gdbm_findkey (dbf, key, NULL, NULL);
-  if (elem_loc == -1)
-    return -1;
-
-  /* Save the element.  */
-  elem = dbf->bucket->h_table[elem_loc];
 
   /* Delete the element.  */
   dbf->bucket->h_table[elem_loc].hash_value = -1;
   dbf->bucket->count--;
 
+  if (gdbm_robin_hood_p (dbf))
+    {
+      /* Backward shift: move the following elements of the cluster one
+	 slot closer to their home slots. */
+      last_loc = elem_loc;
+      elem_loc = (elem_loc + 1) % dbf->header->bucket_elems;
+      while (dbf->bucket->h_table[elem_loc].hash_value != -1
+	     && bucket_element_distance (dbf, dbf->bucket, elem_loc) > 0)
+	{
+	  dbf->bucket->h_table[last_loc] = dbf->bucket->h_table[elem_loc];
+	  dbf->bucket->h_table[elem_loc].hash_value = -1;
+	  last_loc = elem_loc;
+	  elem_loc = (elem_loc + 1) % dbf->header->bucket_elems;
+	}
+      return;
+    }
+
   /* Move other elements to guarantee that they can be found. */
   last_loc = elem_loc;
   elem_loc = (elem_loc + 1) % dbf->header->bucket_elems;
@@ -77,13 +68,12 @@ gdbm_delete (GDBM_FILE dbf, datum key)
 	}
       elem_loc = (elem_loc + 1) % dbf->header->bucket_elems;
     }
+}
 
-  /* Free the file space. */
-  free_adr = elem.data_pointer;
-  free_size = elem.key_size + elem.data_size;
-  if (_gdbm_free (dbf, free_adr, free_size))
-    return -1;
-
+/* Mark the current bucket as changed and invalidate its data cache. */
+static void
+bucket_modified (GDBM_FILE dbf)
+{
   /* Set the flags. */
   _gdbm_current_bucket_changed (dbf);
 
@@ -91,7 +81,404 @@ gdbm_delete (GDBM_FILE dbf, datum key)
   dbf->cache_mru->ca_data.hash_val = -1;
   dbf->cache_mru->ca_data.key_size = 0;
   dbf->cache_mru->ca_data.elem_loc = -1;
+}
+
+static int
+extent_cmp (void const *a, void const *b)
+{
+  avail_elem const *ea = a;
+  avail_elem const *eb = b;
+
+  if (ea->av_adr < eb->av_adr)
+    return -1;
+  return ea->av_adr > eb->av_adr;
+}
+
+/* Free COUNT file extents from the array EXT.  Adjacent extents are
+   merged and freed together. */
+static int
+free_extents (GDBM_FILE dbf, avail_elem *ext, size_t count)
+{
+  size_t i;
+  avail_elem cur;
+
+  if (count == 0)
+    return 0;
+  qsort (ext, count, sizeof (ext[0]), extent_cmp);
+  cur = ext[0];
+  for (i = 1; i < count; i++)
+    {
+      if (cur.av_adr + cur.av_size == ext[i].av_adr
+	  && cur.av_size <= INT_MAX - ext[i].av_size)
+	cur.av_size += ext[i].av_size;
+      else
+	{
+	  if (_gdbm_free (dbf, cur.av_adr, cur.av_size))
+	    return -1;
+	  cur = ext[i];
+	}
+    }
+  return _gdbm_free (dbf, cur.av_adr, cur.av_size);
+}
+
+/* Remove KEY from DBF without updating the file structure.  If FREED is
+   NULL, free the file space occupied by the record.  Otherwise, store
+   its location in FREED, for the caller to free it later. */
+int
+_gdbm_delete_record (GDBM_FILE dbf, datum key, avail_elem *freed)
+{
+  int elem_loc;		/* The location in the current hash bucket. */
+  bucket_element elem;  /* The element to be deleted. */
+  avail_elem ext;
+
+  /* Find the item. */
+  elem_loc = _gdbm_findkey (dbf, key, NULL, NULL);
+  if (elem_loc == -1)
+    return -1;
+
+  /* Save and delete the element.  */
+  elem = dbf->bucket->h_table[elem_loc];
+  if (_gdbm_dedup_release (dbf, &elem))
+    return -1;
+  remove_elem (dbf, elem_loc);
+
+  /* Free the file space.  Inline records have none. */
+  if (bucket_element_inline_p (dbf, &elem))
+    avail_elem_init (&ext, 0, 0);
+  else
+    avail_elem_init (&ext, elem.key_size + elem.data_size, elem.data_pointer);
+  if (freed)
+    *freed = ext;
+  else if (_gdbm_free (dbf, ext.av_adr, ext.av_size))
+    return -1;
+
+  bucket_modified (dbf);
+  return 0;
+}
+
+/* Check if records can be deleted from DBF. */
+static int
+delete_check (GDBM_FILE dbf)
+{
+  /* First check to make sure this guy is a writer. */
+  if (dbf->read_write == GDBM_READER)
+    {
+      GDBM_SET_ERRNO (dbf, GDBM_READER_CANT_DELETE, FALSE);
+      return -1;
+    }
+  
+  /* Initialize the gdbm_errno variable. */
+  gdbm_set_errno (dbf, GDBM_NO_ERROR, FALSE);
+  return 0;
+}
+
+/* Remove the KEYed item and the KEY from the database DBF.  The file on disk
+   is updated to reflect the structure of the new database before returning
+   from this procedure.  */
+
+int
+gdbm_delete (GDBM_FILE dbf, datum key)
+{
+  GDBM_ASSERT_CONSISTENCY (dbf, -1);
+
+  if (delete_check (dbf))
+    return -1;
+
+  if (_gdbm_delete_record (dbf, key, NULL))
+    return -1;
 
   /* Do the writes. */
   return _gdbm_end_update (dbf);
 }
+
+struct delete_order
+{
+  int bucket_dir;          /* Directory index of the key. */
+  int hash;                /* Hash value of the key. */
+  size_t idx;              /* Index of the key in the array. */
+};
+
+static int
+delete_order_cmp (void const *a, void const *b)
+{
+  struct delete_order const *oa = a;
+  struct delete_order const *ob = b;
+
+  /* In GDBM_LARGE databases the directory index is not derived from
+     the hash value, so compare it first. */
+  if (oa->bucket_dir < ob->bucket_dir)
+    return -1;
+  if (oa->bucket_dir > ob->bucket_dir)
+    return 1;
+  if (oa->hash < ob->hash)
+    return -1;
+  return oa->hash > ob->hash;
+}
+
+/* Remove COUNT keys from the array KEYS.  Keys are processed in the
+   order of their directory indices and hash values, so that the keys
+   from the same bucket are removed while it is current.  Keys that are not present in the
+   database are ignored.  The freed file space is returned to the
+   available space in one go, and the file structure is updated once.
+
+   Unless PCOUNT is NULL, the number of removed keys is stored in it.
+   Returns 0 on success and -1 on error. */
+
+int
+gdbm_delete_many (GDBM_FILE dbf, datum const *keys, size_t count,
+		  size_t *pcount)
+{
+  struct delete_order *order;
+  avail_elem *ext;
+  size_t i, n = 0;
+  int elem_loc;
+  int rc = 0;
+
+  GDBM_ASSERT_CONSISTENCY (dbf, -1);
+
+  if (delete_check (dbf))
+    return -1;
+
+  if (count > 0 && keys == NULL)
+    {
+      GDBM_SET_ERRNO (dbf, GDBM_ERR_USAGE, FALSE);
+      return -1;
+    }
+  for (i = 0; i < count; i++)
+    if (keys[i].dptr == NULL)
+      {
+	GDBM_SET_ERRNO (dbf, GDBM_MALFORMED_DATA, FALSE);
+	return -1;
+      }
+
+  if (pcount)
+    *pcount = 0;
+  if (count == 0)
+    return 0;
+
+  order = calloc (count, sizeof (order[0]));
+  ext = calloc (count, sizeof (ext[0]));
+  if (!order || !ext)
+    {
+      free (order);
+      free (ext);
+      GDBM_SET_ERRNO (dbf, GDBM_MALLOC_ERROR, FALSE);
+      return -1;
+    }
+
+  for (i = 0; i < count; i++)
+    {
+      _gdbm_hash_key (dbf, keys[i], &order[i].hash, &order[i].bucket_dir,
+		      &elem_loc);
+      order[i].idx = i;
+    }
+  qsort (order, count, sizeof (order[0]), delete_order_cmp);
+
+  for (i = 0; i < count; i++)
+    {
+      if (_gdbm_delete_record (dbf, keys[order[i].idx], &ext[n]) == 0)
+	n++;
+      else if (gdbm_errno == GDBM_ITEM_NOT_FOUND)
+	gdbm_set_errno (dbf, GDBM_NO_ERROR, FALSE);
+      else
+	{
+	  rc = -1;
+	  break;
+	}
+    }
+
+  if (!dbf->need_recovery)
+    {
+      if (free_extents (dbf, ext, n))
+	rc = -1;
+      else if (rc == 0)
+	rc = _gdbm_end_update (dbf);
+    }
+
+  if (pcount)
+    *pcount = n;
+  free (ext);
+  free (order);
+  return rc;
+}
+
+/* Remove from DBF all records for which the function FUNC returns a
+   positive value.  FUNC is called for each record with a copy of its
+   key and content and the DATA pointer as arguments.  It may read from
+   the database, but must not modify it.  If it returns a negative
+   value, the purge stops.
+
+   Each bucket is visited once.  The records to be removed are dropped
+   from its hash table, which is then rebuilt from the remaining
+   elements, and the file space they occupied is freed in one go.  The
+   file structure is updated once, at the end.
+
+   Unless PCOUNT is NULL, the number of removed records is stored in it.
+   Returns 0 on success and -1 on error. */
+
+int
+gdbm_purge (GDBM_FILE dbf, gdbm_purge_func func, void *data,
+	    gdbm_count_t *pcount)
+{
+  int nbuckets;
+  int bucket_elems;
+  bucket_element *keep;
+  avail_elem *ext;
+  char *buf = NULL;
+  size_t bufsize = 0;
+  gdbm_count_t count = 0;
+  int i, elem_loc, rc = 0;
+  int stop = 0;
+
+  GDBM_ASSERT_CONSISTENCY (dbf, -1);
+
+  if (delete_check (dbf))
+    return -1;
+
+  if (func == NULL)
+    {
+      GDBM_SET_ERRNO (dbf, GDBM_ERR_USAGE, FALSE);
+      return -1;
+    }
+
+  bucket_elems = dbf->header->bucket_elems;
+  keep = calloc (bucket_elems, sizeof (keep[0]));
+  ext = calloc (bucket_elems, sizeof (ext[0]));
+  if (!keep || !ext)
+    {
+      free (keep);
+      free (ext);
+      GDBM_SET_ERRNO (dbf, GDBM_MALLOC_ERROR, FALSE);
+      return -1;
+    }
+
+  nbuckets = GDBM_DIR_COUNT (dbf);
+  for (i = 0; !stop && i < nbuckets; i = _gdbm_next_bucket_dir (dbf, i))
+    {
+      int nkeep = 0, nfree = 0, n;
+      cache_elem *cache;
+      off_t bucket_adr;
+
+      if (_gdbm_get_bucket (dbf, i))
+	{
+	  rc = -1;
+	  break;
+	}
+      cache = dbf->cache_mru;
+      bucket_adr = cache->ca_adr;
+
+      for (elem_loc = 0; elem_loc < bucket_elems; elem_loc++)
+	{
+	  bucket_element *elem = &dbf->bucket->h_table[elem_loc];
+	  datum key, content;
+	  char *dptr;
+
+	  if (elem->hash_value == -1)
+	    continue;
+	  if (stop)
+	    {
+	      keep[nkeep++] = *elem;
+	      continue;
+	    }
+
+	  dptr = _gdbm_read_entry (dbf, elem_loc);
+	  if (!dptr)
+	    {
+	      rc = -1;
+	      break;
+	    }
+	  key.dsize = elem->key_size;
+	  content.dsize = dbf->cache_mru->ca_data.data_size;
+
+	  /* Give FUNC a copy of the record, so that it stays intact if
+	     FUNC reads from the database. */
+	  if ((size_t) key.dsize + content.dsize >= bufsize)
+	    {
+	      char *p;
+
+	      bufsize = key.dsize + content.dsize + 1;
+	      p = realloc (buf, bufsize);
+	      if (!p)
+		{
+		  GDBM_SET_ERRNO (dbf, GDBM_MALLOC_ERROR, FALSE);
+		  rc = -1;
+		  break;
+		}
+	      buf = p;
+	    }
+	  memcpy (buf, dptr, key.dsize + content.dsize);
+	  key.dptr = buf;
+	  content.dptr = buf + key.dsize;
+
+	  n = func (key, content, data);
+
+	  /* Make the bucket current again if FUNC has changed it. */
+	  if (dbf->cache_mru != cache || cache->ca_adr != bucket_adr)
+	    {
+	      if (_gdbm_get_bucket (dbf, i))
+		{
+		  rc = -1;
+		  break;
+		}
+	      cache = dbf->cache_mru;
+	      bucket_adr = cache->ca_adr;
+	      elem = &dbf->bucket->h_table[elem_loc];
+	    }
+
+	  if (n > 0)
+	    {
+	      if (_gdbm_dedup_release (dbf, elem))
+		{
+		  rc = -1;
+		  break;
+		}
+	      if (bucket_element_inline_p (dbf, elem))
+		avail_elem_init (&ext[nfree++], 0, 0);
+	      else
+		avail_elem_init (&ext[nfree++],
+				 elem->key_size + elem->data_size,
+				 elem->data_pointer);
+	    }
+	  else
+	    {
+	      if (n < 0)
+		stop = 1;
+	      keep[nkeep++] = *elem;
+	    }
+	}
+      if (rc)
+	break;
+
+      if (nfree > 0)
+	{
+	  /* Rebuild the hash table from the remaining elements. */
+	  for (elem_loc = 0; elem_loc < bucket_elems; elem_loc++)
+	    dbf->bucket->h_table[elem_loc].hash_value = -1;
+	  for (n = 0; n < nkeep; n++)
+	    {
+	      elem_loc = _gdbm_bucket_slot (dbf, dbf->bucket,
+					    keep[n].hash_value);
+	      dbf->bucket->h_table[elem_loc] = keep[n];
+	    }
+	  dbf->bucket->count = nkeep;
+	  bucket_modified (dbf);
+
+	  count += nfree;
+	  if (free_extents (dbf, ext, nfree))
+	    {
+	      rc = -1;
+	      break;
+	    }
+	}
+    }
+
+  if (!dbf->need_recovery && _gdbm_end_update (dbf))
+    rc = -1;
+
+  if (pcount)
+    *pcount = count;
+  free (buf);
+  free (ext);
+  free (keep);
+  return rc;
+}
@@ -53,6 +53,27 @@ print_datum (datum const *dat, unsigned char **bufptr,
   return 0;
 }
 
+struct dump_closure
+{
+  FILE *fp;
+  unsigned char *buffer;
+  size_t bufsize;
+  size_t count;
+  int rc;
+};
+
+static int
+dump_record (datum key, datum content, void *data)
+{
+  struct dump_closure *dc = data;
+
+  if ((dc->rc = print_datum (&key, &dc->buffer, &dc->bufsize, dc->fp)) ||
+      (dc->rc = print_datum (&content, &dc->buffer, &dc->bufsize, dc->fp)))
+    return 1;
+  dc->count++;
+  return 0;
+}
+
 int
 _gdbm_dump_ascii (GDBM_FILE dbf, FILE *fp)
 {
@@ -61,11 +82,9 @@ _gdbm_dump_ascii (GDBM_FILE dbf, FILE *fp)
   struct stat st;
   struct passwd *pw;
   struct group *gr;
-  datum key;
-  size_t count = 0;
-  unsigned char *buffer = NULL;
-  size_t bufsize = 0;
+  struct dump_closure dc = { NULL, NULL, 0, 0, 0 };
   int rc = 0;
+  char fmtbuf[GDBM_FMT_NAME_MAX];
 
   fd = gdbm_fdesc (dbf);
   if (fstat (fd, &st))
@@ -87,49 +106,25 @@ _gdbm_dump_ascii (GDBM_FILE dbf, FILE *fp)
   if (gr)
     fprintf (fp, "group=%s,", gr->gr_name);
   fprintf (fp, "mode=%03o\n", st.st_mode & 0777);
-  fprintf (fp, "#:format=%s\n", dbf->xheader ? "numsync" : "standard");
+  fprintf (fp, "#:format=%s\n",
+	   _gdbm_fmt2str (gdbm_db_format (dbf), fmtbuf));
   fprintf (fp, "# End of header\n");
   
-  key = gdbm_firstkey (dbf);
-
-  while (key.dptr)
+  /* Records are dumped in the order of their file addresses, which
+     reads the file sequentially. */
+  dc.fp = fp;
+  if (gdbm_scan_physical (dbf, dump_record, &dc))
+    rc = gdbm_last_errno (dbf);
+  else if (dc.rc)
     {
-      datum nextkey;
-      datum data = gdbm_fetch (dbf, key);
-      if (data.dptr)
- 	{
-	  if ((rc = print_datum (&key, &buffer, &bufsize, fp)) ||
-	      (rc = print_datum (&data, &buffer, &bufsize, fp)))
-	    {
-	      free (key.dptr);
-	      free (data.dptr);
-	      GDBM_SET_ERRNO (dbf, rc, FALSE);
-	      break;
-	    }
- 	}
-      else
-	break;
-      nextkey = gdbm_nextkey (dbf, key);
-      free (key.dptr);
-      free (data.dptr);
-      key = nextkey;
-      count++;
+      rc = dc.rc;
+      GDBM_SET_ERRNO (dbf, rc, FALSE);
     }
 
-  fprintf (fp, "#:count=%lu\n", (unsigned long) count);
+  fprintf (fp, "#:count=%lu\n", (unsigned long) dc.count);
   fprintf (fp, "# End of data\n");
   
-  if (rc == 0)
-    {
-      rc = gdbm_last_errno (dbf);
-      if (rc == GDBM_ITEM_NOT_FOUND)
-	{
-	  gdbm_clear_error (dbf);
-	  gdbm_errno = GDBM_NO_ERROR;
-	  rc = 0;
-	}
-    }
-  free (buffer);
+  free (dc.buffer);
 
   return rc ? -1 : 0;
 }
@@ -145,6 +145,7 @@ const char * const gdbm_errlist[_GDBM_MAX_ERRNO+1] = {
   [GDBM_ERR_SNAPSHOT_CLONE]     = N_("Reflink failed"),
   [GDBM_ERR_REALPATH]           = N_("Failed to resolve real path name"),
   [GDBM_ERR_USAGE]              = N_("Function usage error"),
+  [GDBM_BUFFER_TOO_SMALL]       = N_("Buffer too small"),
 };
 
 const char *
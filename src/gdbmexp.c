@@ -76,8 +76,8 @@ gdbm_export_to_file (GDBM_FILE dbf, FILE *fp)
  	}
       
       nextkey = gdbm_nextkey (dbf, key);
-      free (key.dptr);
-      free (data.dptr);
+      _gdbm_result_free (dbf, key.dptr);
+      _gdbm_result_free (dbf, data.dptr);
       key = nextkey;
       
       count++;
@@ -51,11 +51,11 @@ gdbm_fetch (GDBM_FILE dbf, datum key)
   if (elem_loc >= 0)
     {
       /* This is the item.  Return the associated data. */
-      return_val.dsize = dbf->bucket->h_table[elem_loc].data_size;
+      return_val.dsize = dbf->cache_mru->ca_data.data_size;
       if (return_val.dsize == 0)
-	return_val.dptr = (char *) malloc (1);
+	return_val.dptr = _gdbm_result_alloc (dbf, 1);
       else
-	return_val.dptr = (char *) malloc (return_val.dsize);
+	return_val.dptr = _gdbm_result_alloc (dbf, return_val.dsize);
       if (return_val.dptr == NULL)
 	{
 	  GDBM_SET_ERRNO2 (dbf, GDBM_MALLOC_ERROR, FALSE, GDBM_DEBUG_READ);
@@ -71,3 +71,45 @@ gdbm_fetch (GDBM_FILE dbf, datum key)
   
   return return_val;
 }
+
+/* Look up a given KEY and copy the associated data into the buffer BUF
+   of BUFSIZE bytes.  Unless NEEDED is NULL, store the size of the data
+   in it.  If the data don't fit into BUF, set GDBM_BUFFER_TOO_SMALL
+   and return -1.  The caller can then retry with a buffer of *NEEDED
+   bytes. */
+
+int
+gdbm_fetch_into (GDBM_FILE dbf, datum key, void *buf, size_t bufsize,
+		 size_t *needed)
+{
+  int    elem_loc;		/* The location in the bucket. */
+  char  *find_data;		/* Returned from find_key. */
+  size_t size;
+
+  GDBM_DEBUG_DATUM (GDBM_DEBUG_READ, key, "%s: fetching key:", dbf->name);
+
+  /* Return immediately if the database needs recovery */
+  GDBM_ASSERT_CONSISTENCY (dbf, -1);
+
+  /* Initialize the gdbm_errno variable. */
+  gdbm_set_errno (dbf, GDBM_NO_ERROR, FALSE);
+
+  /* Find the key and return a pointer to the data. */
+  elem_loc = _gdbm_findkey (dbf, key, &find_data, NULL);
+  if (elem_loc < 0)
+    {
+      GDBM_DEBUG (GDBM_DEBUG_READ, "%s: key not found", dbf->name);
+      return -1;
+    }
+
+  size = dbf->cache_mru->ca_data.data_size;
+  if (needed)
+    *needed = size;
+  if (size > bufsize)
+    {
+      GDBM_SET_ERRNO2 (dbf, GDBM_BUFFER_TOO_SMALL, FALSE, GDBM_DEBUG_READ);
+      return -1;
+    }
+  memcpy (buf, find_data, size);
+  return 0;
+}
@@ -469,14 +469,74 @@ _set_gdbm_meta_info (GDBM_FILE dbf, char *param, int meta_mask)
   return 0;
 }
 
+/* Names of the format features.  The name of a format with features
+   is the list of their names, separated by dashes, in this order. */
+static struct
+{
+  char const *name;
+  int flag;
+} feature_tab[] = {
+  { "compact", GDBM_COMPACT },
+  { "compress", GDBM_COMPRESS },
+  { "dedup", GDBM_DEDUP },
+  { "inline", GDBM_INLINE },
+  { "large", GDBM_LARGE },
+  { "robinhood", GDBM_ROBINHOOD },
+  { "segdir", GDBM_SEGDIR },
+  { NULL }
+};
+
 int
 _gdbm_str2fmt (char const *str)
 {
-  if (strcmp (str, "numsync") == 0)
-    return GDBM_NUMSYNC;
+  int fmt = 0;
+
   if (strcmp (str, "standard") == 0)
     return 0;
-  return -1;
+  if (strcmp (str, "numsync") == 0)
+    return GDBM_NUMSYNC;
+
+  while (*str)
+    {
+      size_t len = strcspn (str, "-");
+      int i;
+
+      for (i = 0; feature_tab[i].name; i++)
+	if (strlen (feature_tab[i].name) == len
+	    && memcmp (feature_tab[i].name, str, len) == 0)
+	  break;
+      if (!feature_tab[i].name)
+	return -1;
+      fmt |= feature_tab[i].flag;
+      str += len;
+      if (*str)
+	str++;
+    }
+  return fmt ? (fmt | GDBM_NUMSYNC) : -1;
+}
+
+/* Store the name of database format FMT, as returned by GDBM_GETDBFORMAT,
+   in BUF, which must be at least GDBM_FMT_NAME_MAX bytes long.  Return
+   BUF. */
+char *
+_gdbm_fmt2str (int fmt, char *buf)
+{
+  char *p = buf;
+  int i;
+
+  if (!(fmt & GDBM_NUMSYNC))
+    return strcpy (buf, "standard");
+  for (i = 0; feature_tab[i].name; i++)
+    if (fmt & feature_tab[i].flag)
+      {
+	if (p > buf)
+	  *p++ = '-';
+	strcpy (p, feature_tab[i].name);
+	p += strlen (p);
+      }
+  if (p == buf)
+    strcpy (buf, "numsync");
+  return buf;
 }
 
 static int
@@ -48,6 +48,66 @@ bucket_element_count (size_t bucket_size)
   return (bucket_size - sizeof (hash_bucket)) / sizeof (bucket_element) + 1;
 }
 
+/* Number of elements in a bucket stored in compact encoding.  Each slot
+   takes COMPACT_SLOT_SIZE bytes on average and one bit in the map of
+   occupied slots. */
+static inline int
+compact_bucket_element_count (size_t bucket_size)
+{
+  return (bucket_size - offsetof (hash_bucket, h_table)) * 8
+         / (8 * COMPACT_SLOT_SIZE + 1);
+}
+
+/* Compute the number of bits of the buckets needed to hold N records in
+   the new database DBF, and grow its initial directory, of *DIR_SIZE
+   (in the units of the dir_size header field) and *DIR_BITS, to match.
+   The directory gets one bit more than the buckets, so that it need not
+   be doubled when a few of them overflow. */
+static int
+presize_directory (GDBM_FILE dbf, size_t n, int *dir_size, int *dir_bits)
+{
+  size_t per_bucket = (size_t) dbf->header->bucket_elems
+                      * PRESIZE_BUCKET_FILL / 100;
+  size_t nbuckets;
+  int bits = 0;
+
+  if (per_bucket == 0)
+    per_bucket = 1;
+  nbuckets = n / per_bucket + (n % per_bucket != 0);
+  while (((size_t) 1 << bits) < nbuckets)
+    {
+      if (*dir_bits < bits + 2)
+	{
+	  if (gdbm_large_p (dbf) || gdbm_segdir_p (dbf)
+	      ? *dir_bits >= GDBM_LARGE_DIR_BITS
+	      : *dir_size >= GDBM_MAX_DIR_HALF)
+	    break;
+	  *dir_size <<= 1;
+	  (*dir_bits)++;
+	}
+      bits++;
+    }
+  return bits;
+}
+
+/* Return the size of the file space to preallocate for the records of
+   each of the 2^BUCKET_BITS initial buckets of a new database, as
+   requested by OP.  The space is listed in the bucket avail tables, so
+   that records are allocated next to those of the same bucket. */
+static int
+presize_share (struct gdbm_open_spec const *op, int bucket_bits)
+{
+  size_t rec_size = op->avg_key_size + op->avg_value_size;
+  size_t share;
+
+  if (rec_size < op->avg_key_size)
+    return INT_MAX / 2;
+  share = op->expected_entries >> bucket_bits;
+  if (share > 0 && rec_size > INT_MAX / 2 / share)
+    return INT_MAX / 2;
+  return share * rec_size;
+}
+
 static void
 gdbm_header_avail (gdbm_file_header *hdr,
 		   avail_block **avail_ptr, size_t *avail_size,
@@ -64,6 +124,7 @@ gdbm_header_avail (gdbm_file_header *hdr,
       break;
       
     case GDBM_NUMSYNC_MAGIC:
+    case GDBM_FEATURE_MAGIC:
       *exhdr = &((gdbm_file_extended_header*)hdr)->ext;
       *avail_ptr = &((gdbm_file_extended_header*)hdr)->avail;
       *avail_size = (hdr->block_size -
@@ -118,11 +179,31 @@ validate_header_std (gdbm_file_header const *hdr, struct stat const *st)
   return result;
 }
 
+/* Return true if HDR is the header of a large database. */
+static inline int
+header_large_p (gdbm_file_header const *hdr)
+{
+  return hdr->header_magic == GDBM_FEATURE_MAGIC
+         && (((gdbm_file_extended_header const *) hdr)->ext.features
+	     & GDBM_FEATURE_LARGE);
+}
+
+/* Return true if HDR is the header of a database with a segmented
+   directory. */
+static inline int
+header_segdir_p (gdbm_file_header const *hdr)
+{
+  return hdr->header_magic == GDBM_FEATURE_MAGIC
+         && (((gdbm_file_extended_header const *) hdr)->ext.features
+	     & GDBM_FEATURE_SEGDIR);
+}
+
 static int
 validate_header_numsync (gdbm_file_header const *hdr, struct stat const *st)
 {
   int result = GDBM_NO_ERROR;
   int dir_size, dir_bits;
+  off_t hdr_dir_size;
   
   if (!(hdr->block_size > 0
 	&& hdr->block_size > (sizeof (gdbm_file_header) + sizeof (gdbm_ext_header))
@@ -141,24 +222,57 @@ validate_header_numsync (gdbm_file_header const *hdr, struct stat const *st)
   if (hdr->next_block < st->st_size)
     result = GDBM_NEED_RECOVERY;
 
+  /* In databases with a segmented directory, dir_size is the number of
+     entries of the segment table, and in large databases, the number of
+     directory entries. */
+  if (header_segdir_p (hdr))
+    {
+      if (!(hdr->dir_bits >= 0 && hdr->dir_bits <= GDBM_LARGE_DIR_BITS
+	    && hdr->dir_size > 0
+	    && (hdr->dir_size & (hdr->dir_size - 1)) == 0
+	    && hdr->dir_size <= 1 << hdr->dir_bits))
+	return GDBM_BAD_HEADER;
+      hdr_dir_size = (off_t) hdr->dir_size * sizeof (off_t);
+    }
+  else if (header_large_p (hdr))
+    {
+      if (!(hdr->dir_bits > 0 && hdr->dir_bits <= GDBM_LARGE_DIR_BITS
+	    && hdr->dir_size == 1 << hdr->dir_bits))
+	return GDBM_BAD_HEADER;
+      hdr_dir_size = (off_t) hdr->dir_size * sizeof (off_t);
+    }
+  else
+    hdr_dir_size = hdr->dir_size;
+
   /* Make sure dir and dir + dir_size fall within the file boundary */
   if (!(hdr->dir > 0
 	&& hdr->dir < st->st_size
-	&& hdr->dir_size > 0
-	&& hdr->dir + hdr->dir_size < st->st_size))
+	&& hdr_dir_size > 0
+	&& hdr->dir + hdr_dir_size < st->st_size))
     return GDBM_BAD_HEADER;
 
-  compute_directory_size (hdr->block_size, &dir_size, &dir_bits);
-  if (!(hdr->dir_size >= dir_size))
-    return GDBM_BAD_HEADER;
-  compute_directory_size (hdr->dir_size, &dir_size, &dir_bits);
-  if (hdr->dir_bits != dir_bits)
-    return GDBM_BAD_HEADER;
+  if (!header_segdir_p (hdr))
+    {
+      compute_directory_size (hdr->block_size, &dir_size, &dir_bits);
+      if (!(hdr_dir_size >= dir_size))
+	return GDBM_BAD_HEADER;
+    }
+  if (!header_large_p (hdr) && !header_segdir_p (hdr))
+    {
+      compute_directory_size (hdr->dir_size, &dir_size, &dir_bits);
+      if (hdr->dir_bits != dir_bits)
+	return GDBM_BAD_HEADER;
+    }
   
   if (!(hdr->bucket_size > 0 && hdr->bucket_size > sizeof (hash_bucket)))
     return GDBM_BAD_HEADER;
 
-  if (hdr->bucket_elems != bucket_element_count (hdr->bucket_size))
+  /* Compact buckets are checked against the features in
+     validate_features. */
+  if (hdr->bucket_elems != bucket_element_count (hdr->bucket_size)
+      && !(hdr->header_magic == GDBM_FEATURE_MAGIC
+	   && hdr->bucket_elems
+	        == compact_bucket_element_count (hdr->bucket_size)))
     return GDBM_BAD_HEADER;
 
   return result;
@@ -175,6 +289,7 @@ validate_header (gdbm_file_header const *hdr, struct stat const *st)
       return validate_header_std (hdr, st);
       
     case GDBM_NUMSYNC_MAGIC:
+    case GDBM_FEATURE_MAGIC:
       return validate_header_numsync (hdr, st);
 
     default:
@@ -185,12 +300,16 @@ validate_header (gdbm_file_header const *hdr, struct stat const *st)
 	case GDBM_MAGIC64_SWAP:
 	case GDBM_NUMSYNC_MAGIC32_SWAP:
 	case GDBM_NUMSYNC_MAGIC64_SWAP:
+	case GDBM_FEATURE_MAGIC32_SWAP:
+	case GDBM_FEATURE_MAGIC64_SWAP:
 	  return GDBM_BYTE_SWAPPED;
 
 	case GDBM_MAGIC32:
 	case GDBM_MAGIC64:
 	case GDBM_NUMSYNC_MAGIC32:
 	case GDBM_NUMSYNC_MAGIC64:
+	case GDBM_FEATURE_MAGIC32:
+	case GDBM_FEATURE_MAGIC64:
 	  return GDBM_BAD_FILE_OFFSET;
 
 	default:
@@ -199,6 +318,52 @@ validate_header (gdbm_file_header const *hdr, struct stat const *st)
     }
 }
 
+/* Return true if all features of DBF are supported and consistent with
+   its header. */
+static inline int
+validate_features (GDBM_FILE dbf)
+{
+  if (dbf->header->header_magic != GDBM_FEATURE_MAGIC)
+    return 1;
+  if (dbf->xheader->features & ~GDBM_FEATURE_MASK)
+    return 0;
+  /* Inline records use the key_start field of bucket elements, which
+     holds the directory hash in large databases. */
+  if (gdbm_large_p (dbf) && gdbm_inline_records_p (dbf))
+    return 0;
+  /* Encoded data must not be taken for inline records, and must have
+     room for a reference to a shared value. */
+  if ((gdbm_compressed_p (dbf) || gdbm_dedup_p (dbf))
+      && dbf->xheader->encode_min <= INLINE_RECORD_SIZE)
+    return 0;
+  if (gdbm_dedup_p (dbf)
+      && (dbf->xheader->encode_min < 1 + sizeof (off_t)
+	  || dbf->xheader->dedup_count < 0))
+    return 0;
+  return dbf->header->bucket_elems
+           == (gdbm_compact_buckets_p (dbf)
+	       ? compact_bucket_element_count (dbf->header->bucket_size)
+	       : bucket_element_count (dbf->header->bucket_size));
+}
+
+/* Set up the in-memory bucket size of DBF and allocate the buffer for
+   compact buckets, if needed.  Return -1 if out of memory. */
+static int
+bucket_setup (GDBM_FILE dbf)
+{
+  if (gdbm_compact_buckets_p (dbf))
+    {
+      dbf->bucket_mem_size = sizeof (hash_bucket)
+	           + (dbf->header->bucket_elems - 1) * sizeof (bucket_element);
+      dbf->bucket_buf = malloc (dbf->header->bucket_size);
+      if (dbf->bucket_buf == NULL)
+	return -1;
+    }
+  else
+    dbf->bucket_mem_size = dbf->header->bucket_size;
+  return 0;
+}
+
 int
 _gdbm_validate_header (GDBM_FILE dbf)
 {
@@ -211,7 +376,9 @@ _gdbm_validate_header (GDBM_FILE dbf)
   rc = validate_header (dbf->header, &file_stat);
   if (rc == 0)
     {
-      if (gdbm_avail_block_validate (dbf, dbf->avail, dbf->avail_size))
+      if (!validate_features (dbf))
+	rc = GDBM_BAD_HEADER;
+      else if (gdbm_avail_block_validate (dbf, dbf->avail, dbf->avail_size))
 	rc = GDBM_BAD_AVAIL;
     }
   return rc;
@@ -232,45 +399,75 @@ _gdbm_ftruncate (GDBM_FILE dbf)
 #endif
 }
 
+/* Size of struct gdbm_open_spec in version 1.26 and earlier. */
+#define GDBM_OPEN_SPEC_SIZE_V1 offsetof (struct gdbm_open_spec, cache_pool)
+
 void
-gdbm_open_spec_init (struct gdbm_open_spec *spec)
+gdbm_open_spec_init_sized (struct gdbm_open_spec *spec, size_t size)
 {
-  memset (spec, 0, sizeof (*spec));
-  spec->fd = -1;
-  spec->mode = 0600;
-  spec->lock_wait = GDBM_LOCKWAIT_NONE;
+  struct gdbm_open_spec defspec;
+
+  memset (&defspec, 0, sizeof (defspec));
+  defspec.fd = -1;
+  defspec.mode = 0600;
+  defspec.lock_wait = GDBM_LOCKWAIT_NONE;
+
+  if (size > sizeof (defspec))
+    {
+      memset ((char*) spec + sizeof (defspec), 0, size - sizeof (defspec));
+      size = sizeof (defspec);
+    }
+  memcpy (spec, &defspec, size);
+}
+
+/* Copy the caller's open spec OP of SIZE bytes to SPEC, supplying
+   default values for the members the caller does not know about.
+   Members unknown to the library must be zero.  Return 0 on success
+   and -1 if OP cannot be used. */
+static int
+open_spec_import (struct gdbm_open_spec *spec,
+		  struct gdbm_open_spec const *op, size_t size)
+{
+  gdbm_open_spec_init_sized (spec, sizeof (*spec));
+  if (op == NULL)
+    return 0;
+  if (size < GDBM_OPEN_SPEC_SIZE_V1)
+    return -1;
+  if (size > sizeof (*spec))
+    {
+      char const *p = (char const *) op + sizeof (*spec);
+      char const *end = (char const *) op + size;
+
+      for (; p < end; p++)
+	if (*p)
+	  return -1;
+      size = sizeof (*spec);
+    }
+  memcpy (spec, op, size);
+  return 0;
 }
 
 GDBM_FILE
-gdbm_open_ext (char const *file_name, int flags,
-	       struct gdbm_open_spec const *op)
+gdbm_open_ext_sized (char const *file_name, int flags,
+		     struct gdbm_open_spec const *op, size_t size)
 {
   int fd;
   GDBM_FILE dbf;		/* The record to return. */
   struct stat file_stat;	/* Space for the stat information. */
   off_t       file_pos;		/* Used with seeks. */
   int	      index;		/* Used as a loop index. */
+  struct gdbm_open_spec spec;
 
   /* Initialize the gdbm_errno variable. */
   gdbm_set_errno (NULL, GDBM_NO_ERROR, FALSE);
 
-  if (file_name == NULL)
+  if (file_name == NULL || open_spec_import (&spec, op, size))
     {
       errno = EINVAL;
       GDBM_SET_ERRNO2 (NULL, GDBM_FILE_OPEN_ERROR, FALSE, GDBM_DEBUG_OPEN);
       return NULL;
     }
-
-  if (op == NULL)
-    {
-      static struct gdbm_open_spec default_open_spec = {
-	.fd = -1,
-	.mode = 0600,
-	.block_size = 0,
-	.fatal_func = NULL
-      };
-      op = &default_open_spec;
-    }
+  op = &spec;
 
   if (op->fd == -1)
     {
@@ -366,6 +563,7 @@ gdbm_open_ext (char const *file_name, int flags,
   dbf->file_locking = TRUE;	/* Default to doing file locking. */
   dbf->central_free = FALSE;	/* Default to not using central_free. */
   dbf->coalesce_blocks = FALSE; /* Default to not coalesce blocks. */
+  dbf->check_threads = 1;	/* Default to checking in a single thread. */
 
   dbf->need_recovery = FALSE;
   dbf->last_error = GDBM_NO_ERROR;
@@ -446,6 +644,19 @@ gdbm_open_ext (char const *file_name, int flags,
       /* This is a new file.  Create an empty database.  */
       int block_size = op->block_size;
       int dir_size, dir_bits;
+      int bucket_bits = 0;	/* Bits of the initial buckets. */
+      off_t bucket_adr;		/* Address of the first one. */
+      int share = 0;		/* Record space preallocated for each. */
+      off_t share_adr;		/* Address of that of the first one. */
+
+      if ((flags & GDBM_LARGE) && (flags & GDBM_INLINE))
+	{
+	  if (!(flags & GDBM_CLOERROR))
+	    dbf->desc = -1;
+	  gdbm_close (dbf);
+	  GDBM_SET_ERRNO2 (NULL, GDBM_ERR_USAGE, FALSE, GDBM_DEBUG_OPEN);
+	  return NULL;
+	}
       
       /* Start with the blocksize. */
       if (block_size < GDBM_MIN_BLOCK_SIZE)
@@ -486,7 +697,10 @@ gdbm_open_ext (char const *file_name, int flags,
 	}
 
       /* Set the magic number and the block_size. */
-      if (flags & GDBM_NUMSYNC)
+      if (flags & (GDBM_INLINE | GDBM_COMPACT | GDBM_ROBINHOOD | GDBM_LARGE
+		   | GDBM_COMPRESS | GDBM_DEDUP | GDBM_SEGDIR))
+	dbf->header->header_magic = GDBM_FEATURE_MAGIC;
+      else if (flags & GDBM_NUMSYNC)
 	dbf->header->header_magic = GDBM_NUMSYNC_MAGIC;
       else
 	dbf->header->header_magic = GDBM_MAGIC;
@@ -496,12 +710,89 @@ gdbm_open_ext (char const *file_name, int flags,
        */
       dbf->header->block_size = block_size;
       gdbm_header_avail (dbf->header, &dbf->avail, &dbf->avail_size, &dbf->xheader);
+      if (flags & GDBM_INLINE)
+	dbf->xheader->features |= GDBM_FEATURE_INLINE;
+      if (flags & GDBM_COMPACT)
+	dbf->xheader->features |= GDBM_FEATURE_COMPACT;
+      if (flags & GDBM_ROBINHOOD)
+	dbf->xheader->features |= GDBM_FEATURE_ROBINHOOD;
+      if (flags & GDBM_LARGE)
+	{
+	  dbf->xheader->features |= GDBM_FEATURE_LARGE;
+	  dir_size /= sizeof (off_t);
+	}
+      if (flags & GDBM_COMPRESS)
+	{
+	  dbf->xheader->features |= GDBM_FEATURE_COMPRESS;
+	  dbf->xheader->encode_min = GDBM_COMPRESS_THRESHOLD;
+	}
+      if (flags & GDBM_DEDUP)
+	{
+	  dbf->xheader->features |= GDBM_FEATURE_DEDUP;
+	  dbf->xheader->encode_min = GDBM_VALUE_REF_SIZE;
+	}
+      if (flags & GDBM_SEGDIR)
+	dbf->xheader->features |= GDBM_FEATURE_SEGDIR;
+
+      dbf->header->bucket_elems = (flags & GDBM_COMPACT)
+	             ? compact_bucket_element_count (dbf->header->block_size)
+	             : bucket_element_count (dbf->header->block_size);
+      dbf->header->bucket_size  = dbf->header->block_size;
+      if (op->expected_entries)
+	{
+	  bucket_bits = presize_directory (dbf, op->expected_entries,
+					   &dir_size, &dir_bits);
+	  GDBM_DEBUG (GDBM_DEBUG_OPEN,
+		      "%s: presized dir_bits=%d, bucket_bits=%d",
+		      dbf->name, dir_bits, bucket_bits);
+	}
+      /* A segmented directory starts with as few segments as
+	 possible. */
+      if (flags & GDBM_SEGDIR)
+	dir_size = 1 << (dir_bits > GDBM_DIR_SEGMENT_BITS
+			 ? dir_bits - GDBM_DIR_SEGMENT_BITS : 0);
       dbf->header->dir_size = dir_size;
       dbf->header->dir_bits = dir_bits;
+      dbf->header->dir = dbf->header->block_size;
 
-      /* Allocate the space for the directory. */
-      dbf->dir = (off_t *) malloc (dbf->header->dir_size);
-      if (dbf->dir == NULL)
+      /* Allocate the space for the directory.  Segments follow the
+	 segment table. */
+      if (flags & GDBM_SEGDIR)
+	{
+	  bucket_adr = dbf->header->dir
+	               + _gdbm_dir_top_disk_size (dbf, dir_size);
+	  if (_gdbm_segdir_create (dbf, &bucket_adr))
+	    {
+	      if (!(flags & GDBM_CLOERROR))
+		dbf->desc = -1;
+	      gdbm_close (dbf);
+	      GDBM_SET_ERRNO2 (NULL, GDBM_MALLOC_ERROR, FALSE,
+			       GDBM_DEBUG_OPEN);
+	      return NULL;
+	    }
+	  bucket_adr += (dbf->header->block_size
+			 - bucket_adr % dbf->header->block_size)
+	                % dbf->header->block_size;
+	}
+      else
+	{
+	  dbf->dir = (off_t *) malloc (GDBM_DIR_SIZE (dbf));
+	  if (dbf->dir == NULL)
+	    {
+	      if (!(flags & GDBM_CLOERROR))
+		dbf->desc = -1;
+	      gdbm_close (dbf);
+	      GDBM_SET_ERRNO2 (NULL, GDBM_MALLOC_ERROR, FALSE,
+			       GDBM_DEBUG_OPEN);
+	      return NULL;
+	    }
+	  bucket_adr = dbf->header->dir + GDBM_DIR_SIZE (dbf);
+	}
+
+      /* Create the hash buckets: a single one, unless the database is
+	 presized.  They follow the directory, whose size is a multiple
+	 of the block size. */
+      if (bucket_setup (dbf))
 	{
 	  if (!(flags & GDBM_CLOERROR))
 	    dbf->desc = -1;
@@ -509,12 +800,7 @@ gdbm_open_ext (char const *file_name, int flags,
 	  GDBM_SET_ERRNO2 (NULL, GDBM_MALLOC_ERROR, FALSE, GDBM_DEBUG_OPEN);
 	  return NULL;
 	}
-      dbf->header->dir = dbf->header->block_size;
-
-      /* Create the first and only hash bucket. */
-      dbf->header->bucket_elems = bucket_element_count (dbf->header->block_size);
-      dbf->header->bucket_size  = dbf->header->block_size;
-      dbf->bucket = calloc (1, dbf->header->bucket_size);
+      dbf->bucket = calloc (1, dbf->bucket_mem_size);
       if (dbf->bucket == NULL)
 	{
 	  if (!(flags & GDBM_CLOERROR))
@@ -523,14 +809,13 @@ gdbm_open_ext (char const *file_name, int flags,
 	  GDBM_SET_ERRNO2 (NULL, GDBM_MALLOC_ERROR, FALSE, GDBM_DEBUG_OPEN);
 	  return NULL;
 	}
-      _gdbm_new_bucket (dbf, dbf->bucket, 0);
-      dbf->bucket->av_count = 1;
-      dbf->bucket->bucket_avail[0].av_adr = 3*dbf->header->block_size;
-      dbf->bucket->bucket_avail[0].av_size = dbf->header->block_size;
+      _gdbm_new_bucket (dbf, dbf->bucket, bucket_bits);
 
       /* Set table entries to point to hash buckets. */
-      for (index = 0; index < GDBM_DIR_COUNT (dbf); index++)
-	dbf->dir[index] = 2*dbf->header->block_size;
+      for (index = 0; index < 1 << bucket_bits; index++)
+	_gdbm_dir_set (dbf, index << (dir_bits - bucket_bits),
+		       (index + 1) << (dir_bits - bucket_bits),
+		       bucket_adr + (off_t) index * dbf->header->block_size);
 
       /* Initialize the active avail block. */
       dbf->avail->size = (dbf->avail_size - offsetof(avail_block, av_table))
@@ -538,7 +823,18 @@ gdbm_open_ext (char const *file_name, int flags,
       dbf->avail->count = 0;
       dbf->avail->next_block = 0;
       
-      dbf->header->next_block  = 4*dbf->header->block_size;
+      /* The buckets are followed by the avail block of the first one,
+	 and by the space preallocated for the records, if any. */
+      share_adr = bucket_adr
+	          + ((off_t) (dbf->header->block_size) << bucket_bits)
+	          + dbf->header->block_size;
+      if (op->expected_entries)
+	share = presize_share (op, bucket_bits);
+      dbf->header->next_block = share_adr + ((off_t) share << bucket_bits);
+      dbf->header->next_block += (dbf->header->block_size
+				  - dbf->header->next_block
+				    % dbf->header->block_size)
+	                         % dbf->header->block_size;
 
       /* Write initial configuration to the file. */
       /* Block 0 is the file header and active avail block. */
@@ -553,8 +849,11 @@ gdbm_open_ext (char const *file_name, int flags,
 	  return NULL;
 	}
 
-      /* Block 1 is the initial bucket directory. */
-      if (_gdbm_full_write (dbf, dbf->dir, dbf->header->dir_size))
+      /* Block 1 starts the initial bucket directory. */
+      if (gdbm_segdir_p (dbf)
+	  ? (_gdbm_segdir_write (dbf)
+	     || gdbm_file_seek (dbf, bucket_adr, SEEK_SET) != bucket_adr)
+	  : _gdbm_full_write (dbf, dbf->dir, GDBM_DIR_SIZE (dbf)))
 	{
 	  GDBM_DEBUG (GDBM_DEBUG_OPEN|GDBM_DEBUG_ERR,
 		      "%s: error writing directory: %s",
@@ -565,16 +864,41 @@ gdbm_open_ext (char const *file_name, int flags,
 	  return NULL;
 	}
 
-      /* Block 2 is the only bucket. */
-      if (_gdbm_full_write (dbf, dbf->bucket, dbf->header->bucket_size))
+      /* Then come the buckets. */
+      for (index = 0; index < 1 << bucket_bits; index++)
 	{
-	  GDBM_DEBUG (GDBM_DEBUG_OPEN|GDBM_DEBUG_ERR,
-		      "%s: error writing bucket: %s",
-		      dbf->name, gdbm_db_strerror (dbf));	  
-	  if (!(flags & GDBM_CLOERROR))
-	    dbf->desc = -1;
-	  SAVE_ERRNO (gdbm_close (dbf));
-	  return NULL;
+	  avail_elem elem;
+
+	  dbf->bucket->av_count = 0;
+	  if (index == 0)
+	    {
+	      avail_elem_init (&elem, dbf->header->block_size,
+			       share_adr - dbf->header->block_size);
+	      _gdbm_put_av_elem (elem, dbf->bucket->bucket_avail,
+				 &dbf->bucket->av_count, FALSE);
+	    }
+	  if (share)
+	    {
+	      avail_elem_init (&elem, share,
+			       share_adr + (off_t) index * share);
+	      _gdbm_put_av_elem (elem, dbf->bucket->bucket_avail,
+				 &dbf->bucket->av_count, FALSE);
+	    }
+	  if (dbf->bucket_buf)
+	    _gdbm_bucket_encode (dbf, dbf->bucket, dbf->bucket_buf);
+	  if (_gdbm_full_write (dbf,
+				dbf->bucket_buf ? (void*) dbf->bucket_buf
+				                : (void*) dbf->bucket,
+				dbf->header->bucket_size))
+	    {
+	      GDBM_DEBUG (GDBM_DEBUG_OPEN|GDBM_DEBUG_ERR,
+			  "%s: error writing bucket: %s",
+			  dbf->name, gdbm_db_strerror (dbf));
+	      if (!(flags & GDBM_CLOERROR))
+		dbf->desc = -1;
+	      SAVE_ERRNO (gdbm_close (dbf));
+	      return NULL;
+	    }
 	}
       
       if (_gdbm_file_extend (dbf, dbf->header->next_block))
@@ -598,11 +922,24 @@ gdbm_open_ext (char const *file_name, int flags,
       /* This is an old database.  Read in the information from the file
 	 header and initialize the hash directory. */
 
-      gdbm_file_header partial_header;  /* For the first part of it. */
+      struct
+      {
+	gdbm_file_header hdr;
+	gdbm_ext_header ext;
+      } partial_header;  /* For the first part of it. */
+      size_t partial_size = sizeof (partial_header.hdr);
       int rc;
       
-      /* Read the partial file header. */
-      if (_gdbm_full_read (dbf, &partial_header, sizeof (partial_header)))
+      /* Read the partial file header.  The features are needed to
+	 validate it. */
+      rc = _gdbm_full_read (dbf, &partial_header.hdr, partial_size);
+      if (rc == 0 && partial_header.hdr.header_magic == GDBM_FEATURE_MAGIC)
+	{
+	  rc = _gdbm_full_read (dbf, &partial_header.ext,
+				sizeof (partial_header.ext));
+	  partial_size = sizeof (partial_header);
+	}
+      if (rc)
 	{
 	  GDBM_DEBUG (GDBM_DEBUG_ERR|GDBM_DEBUG_OPEN,
 		      "%s: error reading partial header: %s",
@@ -614,7 +951,7 @@ gdbm_open_ext (char const *file_name, int flags,
 	}
 
       /* Is the header valid? */
-      rc = validate_header (&partial_header, &file_stat);
+      rc = validate_header (&partial_header.hdr, &file_stat);
       if (rc == GDBM_NEED_RECOVERY)
 	{
 	  dbf->need_recovery = 1;
@@ -629,7 +966,7 @@ gdbm_open_ext (char const *file_name, int flags,
 	}
       
       /* It is a good database, read the entire header. */
-      dbf->header = malloc (partial_header.block_size);
+      dbf->header = malloc (partial_header.hdr.block_size);
       if (dbf->header == NULL)
 	{
 	  if (!(flags & GDBM_CLOERROR))
@@ -639,9 +976,9 @@ gdbm_open_ext (char const *file_name, int flags,
 	  return NULL;
 	}
       
-      memcpy (dbf->header, &partial_header, sizeof (partial_header));
-      if (_gdbm_full_read (dbf, dbf->header + 1,
-			   dbf->header->block_size - sizeof (gdbm_file_header)))
+      memcpy (dbf->header, &partial_header, partial_size);
+      if (_gdbm_full_read (dbf, (char *) dbf->header + partial_size,
+			   dbf->header->block_size - partial_size))
 	{
 	  if (!(flags & GDBM_CLOERROR))
 	    dbf->desc = -1;
@@ -652,7 +989,8 @@ gdbm_open_ext (char const *file_name, int flags,
 
       if (((dbf->header->block_size -
 	    (GDBM_HEADER_AVAIL_OFFSET (dbf) +
-	     sizeof (avail_block))) / sizeof (avail_elem) + 1) != dbf->avail->size)
+	     sizeof (avail_block))) / sizeof (avail_elem) + 1) != dbf->avail->size
+	  || !validate_features (dbf))
 	{
 	  if (!(flags & GDBM_CLOERROR))
 	    dbf->desc = -1;
@@ -668,10 +1006,8 @@ gdbm_open_ext (char const *file_name, int flags,
 	  SAVE_ERRNO (gdbm_close (dbf));
 	  return NULL;
 	}
-      
-      /* Allocate space for the hash table directory.  */
-      dbf->dir = malloc (dbf->header->dir_size);
-      if (dbf->dir == NULL)
+
+      if (bucket_setup (dbf))
 	{
 	  if (!(flags & GDBM_CLOERROR))
 	    dbf->desc = -1;
@@ -679,27 +1015,57 @@ gdbm_open_ext (char const *file_name, int flags,
 	  GDBM_SET_ERRNO2 (NULL, GDBM_MALLOC_ERROR, FALSE, GDBM_DEBUG_OPEN);
 	  return NULL;
 	}
-
-      /* Read the hash table directory. */
-      file_pos = gdbm_file_seek (dbf, dbf->header->dir, SEEK_SET);
-      if (file_pos != dbf->header->dir)
+      
+      /* Read the segments of a segmented directory. */
+      if (gdbm_segdir_p (dbf))
 	{
-	  if (!(flags & GDBM_CLOERROR))
-	    dbf->desc = -1;
-	  SAVE_ERRNO (gdbm_close (dbf));
-	  GDBM_SET_ERRNO2 (NULL, GDBM_FILE_SEEK_ERROR, FALSE, GDBM_DEBUG_OPEN);
-	  return NULL;
+	  if (_gdbm_segdir_read (dbf))
+	    {
+	      GDBM_DEBUG (GDBM_DEBUG_ERR|GDBM_DEBUG_OPEN,
+			  "%s: error reading dir: %s",
+			  dbf->name, gdbm_db_strerror (dbf));
+	      if (!(flags & GDBM_CLOERROR))
+		dbf->desc = -1;
+	      SAVE_ERRNO (gdbm_close (dbf));
+	      return NULL;
+	    }
 	}
-
-      if (_gdbm_full_read (dbf, dbf->dir, dbf->header->dir_size))
+      else
 	{
-	  GDBM_DEBUG (GDBM_DEBUG_ERR|GDBM_DEBUG_OPEN,
-		      "%s: error reading dir: %s",
-		      dbf->name, gdbm_db_strerror (dbf));
-	  if (!(flags & GDBM_CLOERROR))
-	    dbf->desc = -1;
-	  SAVE_ERRNO (gdbm_close (dbf));
-	  return NULL;
+	  /* Allocate space for the hash table directory.  */
+	  dbf->dir = malloc (GDBM_DIR_SIZE (dbf));
+	  if (dbf->dir == NULL)
+	    {
+	      if (!(flags & GDBM_CLOERROR))
+		dbf->desc = -1;
+	      gdbm_close (dbf);
+	      GDBM_SET_ERRNO2 (NULL, GDBM_MALLOC_ERROR, FALSE,
+			       GDBM_DEBUG_OPEN);
+	      return NULL;
+	    }
+
+	  /* Read the hash table directory. */
+	  file_pos = gdbm_file_seek (dbf, dbf->header->dir, SEEK_SET);
+	  if (file_pos != dbf->header->dir)
+	    {
+	      if (!(flags & GDBM_CLOERROR))
+		dbf->desc = -1;
+	      SAVE_ERRNO (gdbm_close (dbf));
+	      GDBM_SET_ERRNO2 (NULL, GDBM_FILE_SEEK_ERROR, FALSE,
+			       GDBM_DEBUG_OPEN);
+	      return NULL;
+	    }
+
+	  if (_gdbm_full_read (dbf, dbf->dir, GDBM_DIR_SIZE (dbf)))
+	    {
+	      GDBM_DEBUG (GDBM_DEBUG_ERR|GDBM_DEBUG_OPEN,
+			  "%s: error reading dir: %s",
+			  dbf->name, gdbm_db_strerror (dbf));
+	      if (!(flags & GDBM_CLOERROR))
+		dbf->desc = -1;
+	      SAVE_ERRNO (gdbm_close (dbf));
+	      return NULL;
+	    }
 	}
 
     }
@@ -714,6 +1080,23 @@ gdbm_open_ext (char const *file_name, int flags,
       SAVE_ERRNO (gdbm_close (dbf));
       return NULL;
     }
+
+  if (op->cache_pool && _gdbm_cache_pool_attach (dbf, op->cache_pool))
+    {
+      if (!(flags & GDBM_CLOERROR))
+	dbf->desc = -1;
+      SAVE_ERRNO (gdbm_close (dbf));
+      return NULL;
+    }
+
+  if (op->shm_cache_size && dbf->read_write == GDBM_READER
+      && _gdbm_shm_cache_open (dbf, op->shm_cache_size))
+    {
+      if (!(flags & GDBM_CLOERROR))
+	dbf->desc = -1;
+      SAVE_ERRNO (gdbm_close (dbf));
+      return NULL;
+    }
       
 #if HAVE_MMAP
   if (!(flags & GDBM_NOMMAP))
@@ -929,6 +1312,120 @@ _gdbm_convert_to_numsync (GDBM_FILE dbf)
   return rc;
 }
 
+/*
+ * Move the records that fit into their bucket elements there (if
+ * TO_INLINE is true), or move inline records out to the file (if it
+ * is false).  In the former case, the caller sets the inline feature
+ * afterwards, in the latter case, it clears it.
+ */
+static int
+_gdbm_convert_inline (GDBM_FILE dbf, int to_inline)
+{
+  int nbuckets = GDBM_DIR_COUNT (dbf);
+  int i, elem_loc;
+
+  for (i = 0; i < nbuckets; i = _gdbm_next_bucket_dir (dbf, i))
+    {
+      if (_gdbm_get_bucket (dbf, i))
+	return -1;
+      for (elem_loc = 0; elem_loc < dbf->header->bucket_elems; elem_loc++)
+	{
+	  bucket_element *elem = &dbf->bucket->h_table[elem_loc];
+	  size_t size;
+
+	  if (elem->hash_value == -1
+	      || elem->key_size < 0 || elem->data_size < 0)
+	    continue;
+	  size = (size_t) elem->key_size + elem->data_size;
+	  if (size > INLINE_RECORD_SIZE)
+	    continue;
+
+	  if (to_inline)
+	    {
+	      off_t adr = elem->data_pointer;
+	      char *dptr;
+	      datum key, content;
+
+	      dptr = _gdbm_read_entry (dbf, elem_loc);
+	      if (!dptr)
+		return -1;
+	      key.dptr = dptr;
+	      key.dsize = elem->key_size;
+	      content.dptr = dptr + key.dsize;
+	      content.dsize = elem->data_size;
+	      bucket_element_inline_set (elem, key, content);
+	      if (_gdbm_free (dbf, adr, size))
+		return -1;
+	    }
+	  else
+	    {
+	      char buf[INLINE_RECORD_SIZE];
+	      off_t adr;
+
+	      bucket_element_inline_get (elem, buf);
+	      adr = _gdbm_alloc (dbf, size);
+	      if (adr == 0)
+		return -1;
+	      if (gdbm_file_seek (dbf, adr, SEEK_SET) != adr)
+		{
+		  GDBM_SET_ERRNO (dbf, GDBM_FILE_SEEK_ERROR, TRUE);
+		  return -1;
+		}
+	      if (_gdbm_full_write (dbf, buf, size))
+		return -1;
+	      elem->data_pointer = adr;
+	    }
+	  _gdbm_current_bucket_changed (dbf);
+	}
+    }
+  return 0;
+}
+
+/*
+ * Reorder the elements of all buckets for Robin Hood placement.  The
+ * caller sets the robinhood feature beforehand.
+ */
+static int
+_gdbm_convert_robinhood (GDBM_FILE dbf)
+{
+  int nbuckets = GDBM_DIR_COUNT (dbf);
+  int bucket_elems = dbf->header->bucket_elems;
+  bucket_element *tab;
+  int i, elem_loc;
+
+  tab = calloc (bucket_elems, sizeof (tab[0]));
+  if (!tab)
+    {
+      GDBM_SET_ERRNO (dbf, GDBM_MALLOC_ERROR, FALSE);
+      return -1;
+    }
+
+  for (i = 0; i < nbuckets; i = _gdbm_next_bucket_dir (dbf, i))
+    {
+      if (_gdbm_get_bucket (dbf, i))
+	{
+	  free (tab);
+	  return -1;
+	}
+      memcpy (tab, dbf->bucket->h_table, bucket_elems * sizeof (tab[0]));
+      for (elem_loc = 0; elem_loc < bucket_elems; elem_loc++)
+	dbf->bucket->h_table[elem_loc].hash_value = -1;
+      for (elem_loc = 0; elem_loc < bucket_elems; elem_loc++)
+	{
+	  int loc;
+
+	  if (tab[elem_loc].hash_value == -1)
+	    continue;
+	  loc = _gdbm_bucket_slot (dbf, dbf->bucket, tab[elem_loc].hash_value);
+	  dbf->bucket->h_table[loc] = tab[elem_loc];
+	}
+      dbf->cache_mru->ca_data.elem_loc = -1;
+      _gdbm_current_bucket_changed (dbf);
+    }
+  free (tab);
+  return 0;
+}
+
 int
 gdbm_convert (GDBM_FILE dbf, int flag)
 {
@@ -945,34 +1442,123 @@ gdbm_convert (GDBM_FILE dbf, int flag)
       return -1;
     }
 
-  switch (flag)
+  if (flag & ~(GDBM_NUMSYNC | GDBM_INLINE | GDBM_COMPACT | GDBM_ROBINHOOD
+	       | GDBM_LARGE | GDBM_COMPRESS | GDBM_DEDUP | GDBM_SEGDIR))
     {
-    case 0:
-    case GDBM_NUMSYNC:
-      break;
-
-    default:
       GDBM_SET_ERRNO2 (dbf, GDBM_MALFORMED_DATA, FALSE,
 		       GDBM_DEBUG_STORE);
       return -1;
     }
 
+  if ((flag & GDBM_LARGE) && (flag & GDBM_INLINE))
+    {
+      GDBM_SET_ERRNO2 (dbf, GDBM_ERR_USAGE, FALSE, GDBM_DEBUG_STORE);
+      return -1;
+    }
+
+  /* Records are placed according to their hash values, which are
+     computed differently in large databases, and have to be rewritten
+     to compress them or to share their data, or back, so in all these
+     cases the database has to be rebuilt.  The directory is rebuilt as
+     well to change its layout.  This converts it to any other format
+     at the same time. */
+  if (!(flag & GDBM_LARGE) != !gdbm_large_p (dbf)
+      || !(flag & GDBM_COMPRESS) != !gdbm_compressed_p (dbf)
+      || !(flag & GDBM_DEDUP) != !gdbm_dedup_p (dbf)
+      || !(flag & GDBM_SEGDIR) != !gdbm_segdir_p (dbf))
+    return _gdbm_rebuild (dbf, flag);
+
+  /* The encoding of compact buckets depends on the format, so the
+     format of a database with compact buckets, or the bucket encoding,
+     can be changed only by rebuilding the database. */
+  if (!(flag & GDBM_COMPACT) != !gdbm_compact_buckets_p (dbf)
+      || (gdbm_compact_buckets_p (dbf)
+	  && !(flag & GDBM_INLINE) != !gdbm_inline_records_p (dbf)))
+    {
+      GDBM_SET_ERRNO2 (dbf, GDBM_ERR_USAGE, FALSE, GDBM_DEBUG_STORE);
+      return -1;
+    }
+
   rc = 0;
-  switch (dbf->header->header_magic)
+  if (gdbm_robin_hood_p (dbf) && !(flag & GDBM_ROBINHOOD))
     {
-    case GDBM_OMAGIC:
-    case GDBM_MAGIC:
-      if (flag == GDBM_NUMSYNC)
-	rc = _gdbm_convert_to_numsync (dbf);
-      break;
-      
-    case GDBM_NUMSYNC_MAGIC:
-      if (flag == 0)
-	rc = _gdbm_convert_from_numsync (dbf);	
+      /* Robin Hood placement is valid for plain linear probing as
+	 well, so it suffices to clear the feature. */
+      dbf->xheader->features &= ~GDBM_FEATURE_ROBINHOOD;
+      if (dbf->xheader->features == 0)
+	dbf->header->header_magic = GDBM_NUMSYNC_MAGIC;
+      dbf->header_changed = TRUE;
+    }
+
+  if (gdbm_inline_records_p (dbf) && !(flag & GDBM_INLINE))
+    {
+      /* Move inline records out and fall back to the numsync format,
+	 unless other features remain. */
+      rc = _gdbm_convert_inline (dbf, FALSE);
+      if (rc == 0)
+	{
+	  dbf->xheader->features &= ~GDBM_FEATURE_INLINE;
+	  if (dbf->xheader->features == 0)
+	    dbf->header->header_magic = GDBM_NUMSYNC_MAGIC;
+	  dbf->header_changed = TRUE;
+	}
+    }
+
+  if (rc == 0)
+    {
+      switch (dbf->header->header_magic)
+	{
+	case GDBM_OMAGIC:
+	case GDBM_MAGIC:
+	  if (flag != 0)
+	    rc = _gdbm_convert_to_numsync (dbf);
+	  break;
+
+	case GDBM_NUMSYNC_MAGIC:
+	  if (flag == 0)
+	    rc = _gdbm_convert_from_numsync (dbf);
+	}
+    }
+
+  if (rc == 0 && (flag & GDBM_INLINE) && !gdbm_inline_records_p (dbf))
+    {
+      rc = _gdbm_convert_inline (dbf, TRUE);
+      if (rc == 0)
+	{
+	  dbf->header->header_magic = GDBM_FEATURE_MAGIC;
+	  dbf->xheader->features |= GDBM_FEATURE_INLINE;
+	  dbf->header_changed = TRUE;
+	}
+    }
+
+  if (rc == 0 && (flag & GDBM_ROBINHOOD) && !gdbm_robin_hood_p (dbf))
+    {
+      dbf->header->header_magic = GDBM_FEATURE_MAGIC;
+      dbf->xheader->features |= GDBM_FEATURE_ROBINHOOD;
+      dbf->header_changed = TRUE;
+      rc = _gdbm_convert_robinhood (dbf);
     }
 
   if (rc == 0)
     rc = _gdbm_end_update (dbf);
   
-  return 0;
+  return rc;
+}
+
+/* Entry points used by programs built against version 1.26 and
+   earlier of gdbm.h, whose struct gdbm_open_spec ends at fatal_func. */
+#undef gdbm_open_spec_init
+#undef gdbm_open_ext
+
+void
+gdbm_open_spec_init (struct gdbm_open_spec *spec)
+{
+  gdbm_open_spec_init_sized (spec, GDBM_OPEN_SPEC_SIZE_V1);
+}
+
+GDBM_FILE
+gdbm_open_ext (char const *file_name, int flags,
+	       struct gdbm_open_spec const *op)
+{
+  return gdbm_open_ext_sized (file_name, flags, op, GDBM_OPEN_SPEC_SIZE_V1);
 }
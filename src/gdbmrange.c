@@ -0,0 +1,360 @@
+/* gdbmrange.c - Read and modify parts of stored values. */
+
+/* This file is part of GDBM, the GNU data base manager.
+   Copyright (C) 2025 Free Software Foundation, Inc.
+
+   GDBM is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3, or (at your option)
+   any later version.
+
+   GDBM is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with GDBM. If not, see <http://www.gnu.org/licenses/>.   */
+
+/* Include system configuration before all else. */
+#include "autoconf.h"
+
+#include "gdbmdefs.h"
+
+/* Copy SIZE bytes from the address SRC to the address DST. */
+static int
+copy_data (GDBM_FILE dbf, off_t dst, off_t src, size_t size)
+{
+  char *buf;
+  size_t bufsize;
+  int rc = 0;
+
+  bufsize = size < RANGE_COPY_BUFSIZE ? size : RANGE_COPY_BUFSIZE;
+  if (bufsize == 0)
+    return 0;
+  buf = malloc (bufsize);
+  if (!buf)
+    {
+      GDBM_SET_ERRNO2 (dbf, GDBM_MALLOC_ERROR, FALSE, GDBM_DEBUG_STORE);
+      return -1;
+    }
+  while (size > 0)
+    {
+      size_t n = size < bufsize ? size : bufsize;
+
+      if ((rc = _gdbm_read_at (dbf, src, buf, n)) != 0
+	  || (rc = _gdbm_write_at (dbf, dst, buf, n)) != 0)
+	break;
+      src += n;
+      dst += n;
+      size -= n;
+    }
+  free (buf);
+  return rc;
+}
+
+/* Look up KEY and return LEN bytes of its data, starting at offset OFF.
+   The returned slice is clipped to the actual size of the data.  Only
+   the requested part of the record is read from the file.
+
+   Returns the slice in a dynamically allocated memory block.  If KEY
+   is not found or an error occurs, the dptr member of the returned
+   datum is NULL. */
+
+datum
+gdbm_fetch_range (GDBM_FILE dbf, datum key, size_t off, size_t len)
+{
+  datum return_val;
+  int elem_loc;
+  bucket_element *elem;
+  size_t data_size;
+
+  GDBM_DEBUG_DATUM (GDBM_DEBUG_READ, key, "%s: fetching range of key:",
+		    dbf->name);
+
+  /* Set the default return value. */
+  return_val.dptr  = NULL;
+  return_val.dsize = 0;
+
+  /* Return immediately if the database needs recovery */
+  GDBM_ASSERT_CONSISTENCY (dbf, return_val);
+
+  /* Initialize the gdbm_errno variable. */
+  gdbm_set_errno (dbf, GDBM_NO_ERROR, FALSE);
+
+  elem_loc = _gdbm_findkey_loc (dbf, key, NULL);
+  if (elem_loc < 0)
+    {
+      GDBM_DEBUG (GDBM_DEBUG_READ, "%s: key not found", dbf->name);
+      return return_val;
+    }
+  elem = &dbf->bucket->h_table[elem_loc];
+
+  /* Compressed data can only be decoded as a whole. */
+  if (bucket_element_encoded_p (dbf, elem)
+      && _gdbm_read_entry (dbf, elem_loc) == NULL)
+    return return_val;
+  if (gdbm_record_cached_p (dbf, elem_loc))
+    data_size = dbf->cache_mru->ca_data.data_size;
+  else
+    data_size = elem->data_size;
+
+  if (off < data_size)
+    {
+      if (len > data_size - off)
+	len = data_size - off;
+    }
+  else
+    len = 0;
+
+  return_val.dptr = _gdbm_result_alloc (dbf, len ? len : 1);
+  if (return_val.dptr == NULL)
+    {
+      GDBM_SET_ERRNO2 (dbf, GDBM_MALLOC_ERROR, FALSE, GDBM_DEBUG_READ);
+      return return_val;
+    }
+
+  if (len > 0)
+    {
+      if (gdbm_record_cached_p (dbf, elem_loc))
+	/* The whole record is cached. */
+	memcpy (return_val.dptr,
+		dbf->cache_mru->ca_data.dptr + elem->key_size + off, len);
+      else if (bucket_element_inline_p (dbf, elem))
+	{
+	  char buf[INLINE_RECORD_SIZE];
+
+	  bucket_element_inline_get (elem, buf);
+	  memcpy (return_val.dptr, buf + elem->key_size + off, len);
+	}
+      else if (_gdbm_read_at (dbf, elem->data_pointer + elem->key_size + off,
+			      return_val.dptr, len))
+	{
+	  _gdbm_result_free (dbf, return_val.dptr);
+	  return_val.dptr = NULL;
+	  return return_val;
+	}
+    }
+  return_val.dsize = len;
+  return return_val;
+}
+
+/* Store the data of KEY anew: OLD, which may be empty, with CONTENT
+   written over it at offset OFF. */
+static int
+store_whole (GDBM_FILE dbf, datum key, datum old, size_t off, datum content)
+{
+  datum value;
+  int rc;
+
+  if (off > INT_MAX - content.dsize)
+    {
+      GDBM_SET_ERRNO2 (dbf, GDBM_MALFORMED_DATA, FALSE, GDBM_DEBUG_STORE);
+      return -1;
+    }
+  value.dsize = off + content.dsize;
+  if (value.dsize < old.dsize)
+    value.dsize = old.dsize;
+  value.dptr = calloc (1, value.dsize ? value.dsize : 1);
+  if (!value.dptr)
+    {
+      GDBM_SET_ERRNO2 (dbf, GDBM_MALLOC_ERROR, FALSE, GDBM_DEBUG_STORE);
+      return -1;
+    }
+  if (old.dsize > 0)
+    memcpy (value.dptr, old.dptr, old.dsize);
+  memcpy (value.dptr + off, content.dptr, content.dsize);
+  rc = _gdbm_store_record (dbf, key, value, GDBM_REPLACE);
+  free (value.dptr);
+  if (rc)
+    return -1;
+  return _gdbm_end_update (dbf);
+}
+
+/* Write CONTENT at offset OFF into the data of the record KEY.  If
+   APPEND is true, OFF is ignored and CONTENT is written at the end of
+   the data. */
+static int
+store_range (GDBM_FILE dbf, datum key, size_t off, datum content, int append)
+{
+  int elem_loc;
+  bucket_element *elem, newel;
+  off_t adr, data_adr;
+  size_t end;
+  int key_size, data_size;
+
+  GDBM_DEBUG_DATUM (GDBM_DEBUG_STORE, key, "%s: storing range of key:",
+		    dbf->name);
+
+  /* Return immediately if the database needs recovery */
+  GDBM_ASSERT_CONSISTENCY (dbf, -1);
+
+  if (dbf->read_write == GDBM_READER)
+    {
+      GDBM_SET_ERRNO2 (dbf, GDBM_READER_CANT_STORE, FALSE,
+		       GDBM_DEBUG_STORE);
+      return -1;
+    }
+
+  if (key.dptr == NULL || content.dptr == NULL || content.dsize < 0)
+    {
+      GDBM_SET_ERRNO2 (dbf, GDBM_MALFORMED_DATA, FALSE, GDBM_DEBUG_STORE);
+      return -1;
+    }
+
+  /* Initialize the gdbm_errno variable. */
+  gdbm_set_errno (dbf, GDBM_NO_ERROR, FALSE);
+
+  elem_loc = _gdbm_findkey_loc (dbf, key, NULL);
+  if (elem_loc == -1)
+    {
+      datum old;
+
+      if (gdbm_errno != GDBM_ITEM_NOT_FOUND)
+	return -1;
+      gdbm_set_errno (dbf, GDBM_NO_ERROR, FALSE);
+
+      /* Create new record. */
+      if (append)
+	off = 0;
+      old.dptr = NULL;
+      old.dsize = 0;
+      return store_whole (dbf, key, old, off, content);
+    }
+
+  elem = &dbf->bucket->h_table[elem_loc];
+  if (bucket_element_inline_p (dbf, elem))
+    {
+      /* The record is kept in the bucket element.  Rebuild it. */
+      char buf[INLINE_RECORD_SIZE];
+      datum old;
+
+      bucket_element_inline_get (elem, buf);
+      old.dptr = buf + elem->key_size;
+      old.dsize = elem->data_size;
+      if (append)
+	off = old.dsize;
+      return store_whole (dbf, key, old, off, content);
+    }
+
+  if (bucket_element_encoded_p (dbf, elem)
+      || gdbm_data_encoded_p (dbf, (append ? elem->data_size : off)
+				     + content.dsize))
+    {
+      /* Compressed data are decoded and stored anew, and so are the
+	 data that grow long enough to be compressed. */
+      char *dptr = _gdbm_read_entry (dbf, elem_loc);
+      datum old;
+
+      if (!dptr)
+	return -1;
+      old.dptr = dptr + elem->key_size;
+      old.dsize = dbf->cache_mru->ca_data.data_size;
+      if (append)
+	off = old.dsize;
+      return store_whole (dbf, key, old, off, content);
+    }
+
+  adr = elem->data_pointer;
+  key_size = elem->key_size;
+  data_size = elem->data_size;
+  if (append)
+    off = data_size;
+  if (off > INT_MAX - content.dsize)
+    {
+      GDBM_SET_ERRNO2 (dbf, GDBM_MALFORMED_DATA, FALSE, GDBM_DEBUG_STORE);
+      return -1;
+    }
+  end = off + content.dsize;
+
+  if (end > data_size)
+    {
+      /* The record must grow.  Extend it in place if possible. */
+      switch (_gdbm_extend (dbf, adr + key_size + data_size,
+			    end - data_size))
+	{
+	case 0:
+	  break;
+
+	case 1:
+	  {
+	    /* Relocate the record. */
+	    off_t new_adr = _gdbm_alloc (dbf, key_size + end);
+
+	    if (new_adr == 0)
+	      return -1;
+	    if (copy_data (dbf, new_adr, adr,
+			   key_size + (off < data_size ? off : data_size)))
+	      return -1;
+	    if (_gdbm_free (dbf, adr, key_size + data_size))
+	      return -1;
+	    adr = new_adr;
+	  }
+	  break;
+
+	default:
+	  return -1;
+	}
+
+      data_adr = adr + key_size;
+      /* Fill the gap between the old end of data and OFF with zeros. */
+      if (off > data_size
+	  && _gdbm_write_at (dbf, data_adr + data_size, NULL, off - data_size))
+	return -1;
+
+      newel = dbf->bucket->h_table[elem_loc];
+      newel.data_pointer = adr;
+      newel.data_size = end;
+      if (_gdbm_bucket_reserve (dbf, &elem_loc, &newel))
+	return -1;
+      dbf->bucket->h_table[elem_loc] = newel;
+      _gdbm_current_bucket_changed (dbf);
+    }
+  else
+    data_adr = adr + key_size;
+
+  if (_gdbm_write_at (dbf, data_adr + off, content.dptr, content.dsize))
+    return -1;
+
+  if (gdbm_record_cached_p (dbf, elem_loc))
+    {
+      data_cache_elem *data_ca = &dbf->cache_mru->ca_data;
+
+      if (end <= data_ca->data_size)
+	/* Keep the cached copy in sync. */
+	memcpy (data_ca->dptr + key_size + off, content.dptr, content.dsize);
+      else
+	/* Cached data are no longer valid. */
+	data_ca->elem_loc = -1;
+    }
+
+  /* Write everything that is needed to the disk. */
+  return _gdbm_end_update (dbf);
+}
+
+/* Write CONTENT at offset OFF into the data associated with KEY.  If
+   the data end before OFF, the gap is filled with zeros.  If KEY is
+   not in the database, a new record is created.
+
+   The record is modified in place, and grown into the adjacent free
+   space if necessary.  It is relocated only if it must grow and can't
+   be extended.
+
+   Returns 0 on success and -1 on error. */
+
+int
+gdbm_store_range (GDBM_FILE dbf, datum key, size_t off, datum content)
+{
+  return store_range (dbf, key, off, content, FALSE);
+}
+
+/* Append CONTENT to the data associated with KEY.  If KEY is not in
+   the database, a new record is created.
+
+   Returns 0 on success and -1 on error. */
+
+int
+gdbm_append (GDBM_FILE dbf, datum key, datum content)
+{
+  return store_range (dbf, key, 0, content, TRUE);
+}
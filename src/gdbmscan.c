@@ -0,0 +1,276 @@
+/* gdbmscan.c - Visit all records in the order of their file addresses. */
+
+/* This file is part of GDBM, the GNU data base manager.
+   Copyright (C) 2025 Free Software Foundation, Inc.
+
+   GDBM is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3, or (at your option)
+   any later version.
+
+   GDBM is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with GDBM. If not, see <http://www.gnu.org/licenses/>.   */
+
+/* Include system configuration before all else. */
+#include "autoconf.h"
+
+#include "gdbmdefs.h"
+
+/*
+ * Iteration by keys follows the hash directory, while the records are
+ * scattered across the file in the order they were allocated.  Reading
+ * them one by one thus results in random I/O.  Instead, gdbm_scan_physical
+ * collects the bucket elements of up to SCAN_BATCH records, sorts them
+ * by their file addresses and reads neighboring records together, with
+ * reads of up to SCAN_READ_SIZE bytes.
+ */
+
+struct scan
+{
+  GDBM_FILE dbf;
+  gdbm_scan_func func;       /* Function to call for each record */
+  void *data;                /* Its data pointer */
+  int stop;                  /* Set when FUNC asks to stop */
+  off_t file_size;           /* Size of the database file */
+  bucket_element *rec;       /* Elements of the records to be read */
+  size_t nrec;               /* Number of elements in REC */
+  size_t maxrec;             /* Capacity of REC */
+  char *buf;                 /* Read buffer */
+  size_t bufsize;            /* Its size */
+  data_cache_elem ca;        /* Decoded record */
+};
+
+static inline off_t
+rec_size (bucket_element const *elem)
+{
+  return (off_t) elem->key_size + elem->data_size;
+}
+
+static int
+rec_cmp (void const *a, void const *b)
+{
+  bucket_element const *ea = a;
+  bucket_element const *eb = b;
+
+  if (ea->data_pointer < eb->data_pointer)
+    return -1;
+  return ea->data_pointer > eb->data_pointer;
+}
+
+/* Pass the record of ELEM, whose key and stored data are at PTR, to the
+   scan function. */
+static int
+scan_record (struct scan *scan, bucket_element const *elem, char *ptr)
+{
+  GDBM_FILE dbf = scan->dbf;
+  datum key, content;
+
+  key.dptr = ptr;
+  key.dsize = elem->key_size;
+  content.dsize = elem->data_size;
+  if (bucket_element_encoded_p (dbf, elem))
+    {
+      /* Decode the data in the scan's own data cache. */
+      size_t size = rec_size (elem);
+
+      if (size > scan->ca.dsize)
+	{
+	  char *p = realloc (scan->ca.dptr, size);
+
+	  if (!p)
+	    {
+	      GDBM_SET_ERRNO (dbf, GDBM_MALLOC_ERROR, FALSE);
+	      return -1;
+	    }
+	  _gdbm_cache_data_resized (dbf, scan->ca.dsize, size);
+	  scan->ca.dptr = p;
+	  scan->ca.dsize = size;
+	}
+      memcpy (scan->ca.dptr, ptr, size);
+      scan->ca.key_size = elem->key_size;
+      scan->ca.data_size = elem->data_size;
+      if (_gdbm_decode_data (dbf, &scan->ca))
+	return -1;
+      key.dptr = scan->ca.dptr;
+      content.dsize = scan->ca.data_size;
+    }
+  content.dptr = key.dptr + key.dsize;
+
+  if (scan->func (key, content, scan->data))
+    scan->stop = 1;
+  return 0;
+}
+
+/* Read the collected records in the order of their addresses and pass
+   them to the scan function. */
+static int
+scan_flush (struct scan *scan)
+{
+  bucket_element *rec = scan->rec;
+  size_t nrec = scan->nrec;
+  size_t i, j, k;
+
+  scan->nrec = 0;
+
+  /* Inline records need no reading. */
+  for (i = j = 0; i < nrec; i++)
+    {
+      if (bucket_element_inline_p (scan->dbf, &rec[i]))
+	{
+	  char buf[INLINE_RECORD_SIZE];
+
+	  if (scan->stop)
+	    continue;
+	  bucket_element_inline_get (&rec[i], buf);
+	  if (scan_record (scan, &rec[i], buf))
+	    return -1;
+	}
+      else
+	rec[j++] = rec[i];
+    }
+  nrec = j;
+
+  qsort (rec, nrec, sizeof (rec[0]), rec_cmp);
+  for (i = 0; i < nrec && !scan->stop; i = j)
+    {
+      off_t start = rec[i].data_pointer;
+      off_t end = start + rec_size (&rec[i]);
+      size_t size;
+
+      /* Gather the records that can be read at once. */
+      for (j = i + 1; j < nrec; j++)
+	{
+	  off_t e = rec[j].data_pointer + rec_size (&rec[j]);
+
+	  if (e - start > SCAN_READ_SIZE)
+	    break;
+	  if (e > end)
+	    end = e;
+	}
+
+      size = end - start;
+      if (size > scan->bufsize)
+	{
+	  char *p = realloc (scan->buf, size);
+
+	  if (!p)
+	    {
+	      GDBM_SET_ERRNO (scan->dbf, GDBM_MALLOC_ERROR, FALSE);
+	      return -1;
+	    }
+	  scan->buf = p;
+	  scan->bufsize = size;
+	}
+      if (_gdbm_read_at (scan->dbf, start, scan->buf, size))
+	return -1;
+
+      for (k = i; k < j && !scan->stop; k++)
+	if (scan_record (scan, &rec[k],
+			 scan->buf + (rec[k].data_pointer - start)))
+	  return -1;
+    }
+  return 0;
+}
+
+/* Collect the records of the current bucket. */
+static int
+scan_bucket (struct scan *scan)
+{
+  GDBM_FILE dbf = scan->dbf;
+  int elem_loc;
+
+  for (elem_loc = 0; elem_loc < dbf->header->bucket_elems; elem_loc++)
+    {
+      bucket_element *elem = &dbf->bucket->h_table[elem_loc];
+
+      if (elem->hash_value == -1)
+	continue;
+      if (!bucket_element_inline_p (dbf, elem)
+	  && (elem->key_size < 0 || elem->data_size < 0
+	      || !off_t_sum_ok (elem->data_pointer, rec_size (elem))
+	      || elem->data_pointer + rec_size (elem) > scan->file_size))
+	{
+	  GDBM_SET_ERRNO (dbf, GDBM_BAD_HASH_TABLE, TRUE);
+	  return -1;
+	}
+      scan->rec[scan->nrec++] = *elem;
+    }
+  return 0;
+}
+
+/* Call FUNC for each record in DBF, with its key, its content and DATA
+   as arguments.  The records are visited in the order of their file
+   addresses, which allows for reading them sequentially, several at a
+   time.  The order is otherwise unspecified.  The key and content passed
+   to FUNC are valid until it returns.  FUNC may read from the database,
+   but must not modify it.  If FUNC returns a non-zero value, the scan
+   stops.
+
+   Returns 0 on success and -1 on error. */
+
+int
+gdbm_scan_physical (GDBM_FILE dbf, gdbm_scan_func func, void *data)
+{
+  struct scan scan;
+  int i;
+  int rc = 0;
+
+  GDBM_ASSERT_CONSISTENCY (dbf, -1);
+
+  if (func == NULL)
+    {
+      GDBM_SET_ERRNO (dbf, GDBM_ERR_USAGE, FALSE);
+      return -1;
+    }
+
+  gdbm_set_errno (dbf, GDBM_NO_ERROR, FALSE);
+
+  memset (&scan, 0, sizeof (scan));
+  scan.dbf = dbf;
+  scan.func = func;
+  scan.data = data;
+  if (_gdbm_file_size (dbf, &scan.file_size))
+    return -1;
+  scan.maxrec = SCAN_BATCH;
+  if (scan.maxrec < dbf->header->bucket_elems)
+    scan.maxrec = dbf->header->bucket_elems;
+  scan.rec = calloc (scan.maxrec, sizeof (scan.rec[0]));
+  if (!scan.rec)
+    {
+      GDBM_SET_ERRNO (dbf, GDBM_MALLOC_ERROR, FALSE);
+      return -1;
+    }
+
+  for (i = 0; !scan.stop && i < GDBM_DIR_COUNT (dbf);
+       i = _gdbm_next_bucket_dir (dbf, i))
+    {
+      /* Make sure the bucket fits into the batch. */
+      if (scan.nrec + dbf->header->bucket_elems > scan.maxrec
+	  && scan_flush (&scan))
+	{
+	  rc = -1;
+	  break;
+	}
+      if (_gdbm_get_bucket (dbf, i) || scan_bucket (&scan))
+	{
+	  rc = -1;
+	  break;
+	}
+    }
+  if (rc == 0 && !scan.stop)
+    rc = scan_flush (&scan);
+
+  free (scan.rec);
+  free (scan.buf);
+  if (scan.ca.dptr)
+    {
+      _gdbm_cache_data_resized (dbf, scan.ca.dsize, 0);
+      free (scan.ca.dptr);
+    }
+  return rc;
+}
@@ -31,7 +31,8 @@ gdbm_valid_key_p (GDBM_FILE dbf, char *key_ptr, int key_size, int elem_loc)
   key.dsize = key_size;
   _gdbm_hash_key (dbf, key, &hash, &bucket, &offset);
   if (gdbm_dir_entry_valid_p (dbf, bucket) &&
-      dbf->dir[bucket] == dbf->dir[dbf->bucket_dir] &&
+      gdbm_dir_entry (dbf, bucket)
+        == gdbm_dir_entry (dbf, dbf->bucket_dir) &&
       hash == dbf->bucket->h_table[elem_loc].hash_value)
     return 1;
   GDBM_SET_ERRNO (dbf, GDBM_BAD_HASH_ENTRY, TRUE);
@@ -39,17 +40,18 @@ gdbm_valid_key_p (GDBM_FILE dbf, char *key_ptr, int key_size, int elem_loc)
 }
 
 /* Find and read the next entry in the hash structure for DBF starting
-   at ELEM_LOC of the current bucket and using RETURN_VAL as the place to
-   put the data that is found.
+   at ELEM_LOC of the current bucket.  On success, return the location
+   of the entry in the current bucket and store the pointer to the key
+   in *RET_PTR.
 
    If no next key is found, gdbm_errno is set to GDBM_ITEM_NOT_FOUND
-   and RETURN_VAL remains unmodified.
+   and -1 is returned.
 
-   On error, gdbm_errno is set.
+   On error, gdbm_errno is set and -1 is returned.
 */
 
-static void
-get_next_key (GDBM_FILE dbf, int elem_loc, datum *return_val)
+static int
+find_next_key (GDBM_FILE dbf, int elem_loc, char **ret_ptr)
 {
   int   found;			/* Have we found the next key. */
   char  *find_data;		/* Data pointer returned by find_key. */
@@ -68,40 +70,62 @@ get_next_key (GDBM_FILE dbf, int elem_loc, datum *return_val)
 	  /* Find the next bucket.  It is possible several entries in
 	     the bucket directory point to the same bucket. */
 	  while (dbf->bucket_dir < GDBM_DIR_COUNT (dbf)
-		 && dbf->cache_mru->ca_adr == dbf->dir[dbf->bucket_dir])
+		 && dbf->cache_mru->ca_adr
+		      == gdbm_dir_entry (dbf, dbf->bucket_dir))
 	    dbf->bucket_dir++;
 
 	  /* Check to see if there was a next bucket. */
 	  if (dbf->bucket_dir < GDBM_DIR_COUNT (dbf))
 	    {
 	      if (_gdbm_get_bucket (dbf, dbf->bucket_dir))
-		return;
+		return -1;
 	    }
 	  else
 	    {
 	      /* No next key, just return. */
 	      GDBM_SET_ERRNO2 (dbf, GDBM_ITEM_NOT_FOUND, FALSE,
 			       GDBM_DEBUG_LOOKUP);
-	      return;
+	      return -1;
 	    }
 	}
       found = dbf->bucket->h_table[elem_loc].hash_value != -1;
     }
   
-  /* Found the next key, read it into return_val. */
-  find_data = _gdbm_read_entry (dbf, elem_loc);
+  /* Found the next key, read it.  Its data are not needed. */
+  find_data = _gdbm_read_key (dbf, elem_loc);
   if (!find_data)
-    return;
+    return -1;
   /* Verify if computed hash and bucket address for the key match the
      actual ones.  Bail out if not. */
   if (!gdbm_valid_key_p (dbf, find_data,
 			 dbf->bucket->h_table[elem_loc].key_size, elem_loc))
+    return -1;
+  *ret_ptr = find_data;
+  return elem_loc;
+}
+
+/* Find the next entry in DBF starting at ELEM_LOC of the current bucket
+   and copy its key to RETURN_VAL.
+
+   If no next key is found, gdbm_errno is set to GDBM_ITEM_NOT_FOUND
+   and RETURN_VAL remains unmodified.
+
+   On error, gdbm_errno is set.
+*/
+
+static void
+get_next_key (GDBM_FILE dbf, int elem_loc, datum *return_val)
+{
+  char  *find_data;
+
+  elem_loc = find_next_key (dbf, elem_loc, &find_data);
+  if (elem_loc == -1)
     return;
   return_val->dsize = dbf->bucket->h_table[elem_loc].key_size;
   if (return_val->dsize == 0)
-    return_val->dptr = (char *) malloc (1);
+    return_val->dptr = _gdbm_result_alloc (dbf, 1);
   else
-    return_val->dptr = (char *) malloc (return_val->dsize);
+    return_val->dptr = _gdbm_result_alloc (dbf, return_val->dsize);
   if (return_val->dptr == NULL)
     {
       return_val->dsize = 0;
@@ -111,6 +135,31 @@ get_next_key (GDBM_FILE dbf, int elem_loc, datum *return_val)
     memcpy (return_val->dptr, find_data, return_val->dsize);
 }
 
+/* Same as get_next_key, but copy the key to the buffer BUF of BUFSIZE
+   bytes.  Return 0 on success and -1 on error. */
+
+static int
+get_next_key_into (GDBM_FILE dbf, int elem_loc, void *buf, size_t bufsize,
+		   size_t *needed)
+{
+  char  *find_data;
+  size_t size;
+
+  elem_loc = find_next_key (dbf, elem_loc, &find_data);
+  if (elem_loc == -1)
+    return -1;
+  size = dbf->bucket->h_table[elem_loc].key_size;
+  if (needed)
+    *needed = size;
+  if (size > bufsize)
+    {
+      GDBM_SET_ERRNO2 (dbf, GDBM_BUFFER_TOO_SMALL, FALSE, GDBM_DEBUG_LOOKUP);
+      return -1;
+    }
+  memcpy (buf, find_data, size);
+  return 0;
+}
+
 
 /* Start the visit of all keys in the database.  This produces something in
    hash order, not in any sorted order.  */
@@ -191,3 +240,57 @@ gdbm_nextkey (GDBM_FILE dbf, datum key)
 
   return return_val;
 }
+
+
+/* Key-buffer variants of gdbm_firstkey and gdbm_nextkey.  The key is
+   copied to the buffer BUF of BUFSIZE bytes.  Unless NEEDED is NULL,
+   the size of the key is stored in it.  If the key doesn't fit into
+   BUF, GDBM_BUFFER_TOO_SMALL is set and -1 is returned.  Iteration can
+   then be restarted by calling gdbm_nextkey_into with the previous key,
+   or gdbm_firstkey_into, with a buffer of *NEEDED bytes. */
+
+int
+gdbm_firstkey_into (GDBM_FILE dbf, void *buf, size_t bufsize, size_t *needed)
+{
+  GDBM_DEBUG (GDBM_DEBUG_READ, "%s: getting first key", dbf->name);
+
+  /* Return immediately if the database needs recovery */
+  GDBM_ASSERT_CONSISTENCY (dbf, -1);
+
+  /* Initialize the gdbm_errno variable. */
+  gdbm_set_errno (dbf, GDBM_NO_ERROR, FALSE);
+
+  /* Get the first bucket.  */
+  if (_gdbm_get_bucket (dbf, 0))
+    return -1;
+  return get_next_key_into (dbf, -1, buf, bufsize, needed);
+}
+
+int
+gdbm_nextkey_into (GDBM_FILE dbf, datum key, void *buf, size_t bufsize,
+		   size_t *needed)
+{
+  int    elem_loc;		/* The location in the bucket. */
+
+  GDBM_DEBUG_DATUM (GDBM_DEBUG_READ, key, "%s: getting next key", dbf->name);
+
+  /* Return immediately if the database needs recovery */
+  GDBM_ASSERT_CONSISTENCY (dbf, -1);
+
+  /* Initialize the gdbm_errno variable. */
+  gdbm_set_errno (dbf, GDBM_NO_ERROR, FALSE);
+
+  /* Do we have a valid key? */
+  if (key.dptr == NULL)
+    {
+      GDBM_SET_ERRNO2 (dbf, GDBM_ITEM_NOT_FOUND, FALSE, GDBM_DEBUG_LOOKUP);
+      return -1;
+    }
+
+  /* Find the key.  */
+  elem_loc = _gdbm_findkey (dbf, key, NULL, NULL);
+  if (elem_loc == -1)
+    return -1;
+
+  return get_next_key_into (dbf, elem_loc, buf, bufsize, needed);
+}
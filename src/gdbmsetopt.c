@@ -20,6 +20,9 @@
 #include "autoconf.h"
 
 #include "gdbmdefs.h"
+#if HAVE_MMAP
+# include <sys/mman.h>
+#endif
 
 static int
 getbool (void *optval, int optlen)
@@ -100,6 +103,321 @@ setopt_gdbm_getcacheauto (GDBM_FILE dbf, void *optval, int optlen)
   return 0;
 }
 
+static int
+setopt_gdbm_setcachemem (GDBM_FILE dbf, void *optval, int optlen)
+{
+  size_t sz;
+
+  if (get_size (optval, optlen, &sz))
+    {     
+      GDBM_SET_ERRNO (dbf, GDBM_OPT_BADVAL, FALSE);
+      return -1;
+    }  
+  return _gdbm_cache_set_mem (dbf, sz);
+}
+
+static int
+setopt_gdbm_getcachemem (GDBM_FILE dbf, void *optval, int optlen)
+{
+  if (!optval || optlen != sizeof (size_t))
+    {
+      GDBM_SET_ERRNO (dbf, GDBM_OPT_BADVAL, FALSE);
+      return -1;
+    }
+  *(size_t*) optval = dbf->cache_mem_max;
+  return 0;
+}
+
+static int
+setopt_gdbm_getcachememusage (GDBM_FILE dbf, void *optval, int optlen)
+{
+  if (!optval || optlen != sizeof (size_t))
+    {
+      GDBM_SET_ERRNO (dbf, GDBM_OPT_BADVAL, FALSE);
+      return -1;
+    }
+  *(size_t*) optval = _gdbm_cache_mem_usage (dbf);
+  return 0;
+}
+
+/* Cgroup memory limits above this value mean "unlimited" (cgroup v1
+   reports such limits as a very large number). */
+#define CGROUP_MEM_UNLIMITED ((unsigned long long)1 << 62)
+
+/* Size of buffers for cgroup file names and /proc/self/cgroup lines. */
+#define CGROUP_BUF_SIZE 4096
+
+/* Read the memory limit from the file FILE in cgroup directory DIR.
+   On success, store the limit in *RET (0 if unlimited) and return 0.
+   Return -1 if the file cannot be read or parsed. */
+static int
+cgroup_read_limit (char const *dir, char const *file, size_t *ret)
+{
+  char name[CGROUP_BUF_SIZE];
+  char buf[64];
+  FILE *fp;
+  int rc = -1;
+
+  if (snprintf (name, sizeof name, "%s/%s", dir, file) >= sizeof name)
+    return -1;
+  fp = fopen (name, "r");
+  if (!fp)
+    return -1;
+  if (fgets (buf, sizeof buf, fp))
+    {
+      if (strncmp (buf, "max", 3) == 0)
+	{
+	  *ret = 0;
+	  rc = 0;
+	}
+      else
+	{
+	  char *end;
+	  unsigned long long n;
+
+	  errno = 0;
+	  n = strtoull (buf, &end, 10);
+	  if (errno == 0 && end > buf && (*end == '\n' || *end == 0))
+	    {
+	      *ret = (n >= CGROUP_MEM_UNLIMITED || n > SIZE_T_MAX) ? 0 : n;
+	      rc = 0;
+	    }
+	}
+    }
+  fclose (fp);
+  return rc;
+}
+
+/* Return the memory limit of the cgroup the calling process belongs
+   to, or 0 if it is not limited or the limit cannot be determined.
+   Both cgroup v2 (unified) and v1 hierarchies are supported. */
+static size_t
+cgroup_memory_limit (void)
+{
+  FILE *fp;
+  char buf[CGROUP_BUF_SIZE];
+  size_t limit;
+
+  fp = fopen ("/proc/self/cgroup", "r");
+  if (fp)
+    {
+      while (fgets (buf, sizeof buf, fp))
+	{
+	  char *ctl, *path, *p;
+	  char dir[CGROUP_BUF_SIZE];
+	  int rc = -1;
+
+	  /* Each line is: ID:CONTROLLERS:PATH */
+	  buf[strcspn (buf, "\n")] = 0;
+	  if ((ctl = strchr (buf, ':')) == NULL)
+	    continue;
+	  ctl++;
+	  if ((path = strchr (ctl, ':')) == NULL)
+	    continue;
+	  *path++ = 0;
+
+	  if (*ctl == 0)
+	    {
+	      /* cgroup v2 */
+	      if (snprintf (dir, sizeof dir, "/sys/fs/cgroup%s", path)
+		  < sizeof dir)
+		rc = cgroup_read_limit (dir, "memory.max", &limit);
+	    }
+	  else
+	    {
+	      /* cgroup v1: look for the memory controller */
+	      for (p = strtok (ctl, ","); p; p = strtok (NULL, ","))
+		if (strcmp (p, "memory") == 0)
+		  break;
+	      if (p
+		  && snprintf (dir, sizeof dir, "/sys/fs/cgroup/memory%s", path)
+		     < sizeof dir)
+		rc = cgroup_read_limit (dir, "memory.limit_in_bytes", &limit);
+	    }
+	  if (rc == 0)
+	    {
+	      fclose (fp);
+	      return limit;
+	    }
+	}
+      fclose (fp);
+    }
+
+  /* Within a cgroup namespace, the limit is visible at the root. */
+  if (cgroup_read_limit ("/sys/fs/cgroup", "memory.max", &limit) == 0
+      || cgroup_read_limit ("/sys/fs/cgroup/memory", "memory.limit_in_bytes",
+			    &limit) == 0)
+    return limit;
+  return 0;
+}
+
+static int
+setopt_gdbm_setcachememcg (GDBM_FILE dbf, void *optval, int optlen)
+{
+  int n;
+
+  if (!optval || optlen != sizeof (int)
+      || (n = *(int*)optval) <= 0 || n > 100)
+    {
+      GDBM_SET_ERRNO (dbf, GDBM_OPT_BADVAL, FALSE);
+      return -1;
+    }
+  return _gdbm_cache_set_mem (dbf, cgroup_memory_limit () / 100 * n);
+}
+
+static int
+setopt_gdbm_setavailindex (GDBM_FILE dbf, void *optval, int optlen)
+{
+  int n;
+
+  if ((n = getbool (optval, optlen)) == -1)
+    {
+      GDBM_SET_ERRNO (dbf, GDBM_OPT_BADVAL, FALSE);
+      return -1;
+    }
+  if (!n && dbf->avail_index)
+    {
+      /* Return to the on-disk avail structures. */
+      if (_gdbm_avail_index_save (dbf) || _gdbm_end_update (dbf))
+	return -1;
+    }
+  dbf->use_avail_index = n;
+  return 0;
+}
+
+static int
+setopt_gdbm_getavailindex (GDBM_FILE dbf, void *optval, int optlen)
+{
+  if (!optval || optlen != sizeof (int))
+    {
+      GDBM_SET_ERRNO (dbf, GDBM_OPT_BADVAL, FALSE);
+      return -1;
+    }
+  *(int*) optval = dbf->use_avail_index;
+  return 0;
+}
+
+static int
+setopt_gdbm_setextentthreshold (GDBM_FILE dbf, void *optval, int optlen)
+{
+  size_t sz;
+
+  if (get_size (optval, optlen, &sz)
+      || (sz != 0 && sz < (size_t) dbf->header->block_size))
+    {
+      GDBM_SET_ERRNO (dbf, GDBM_OPT_BADVAL, FALSE);
+      return -1;
+    }
+  dbf->extent_threshold = sz;
+  return 0;
+}
+
+static int
+setopt_gdbm_getextentthreshold (GDBM_FILE dbf, void *optval, int optlen)
+{
+  if (!optval || optlen != sizeof (size_t))
+    {
+      GDBM_SET_ERRNO (dbf, GDBM_OPT_BADVAL, FALSE);
+      return -1;
+    }
+  *(size_t*) optval = dbf->extent_threshold;
+  return 0;
+}
+
+static int
+setopt_gdbm_setcheckthreads (GDBM_FILE dbf, void *optval, int optlen)
+{
+  int n;
+
+  if (!optval || optlen != sizeof (int)
+      || (n = *(int*) optval) < 0 || n > GDBM_MAX_CHECK_THREADS)
+    {
+      GDBM_SET_ERRNO (dbf, GDBM_OPT_BADVAL, FALSE);
+      return -1;
+    }
+  dbf->check_threads = n;
+  return 0;
+}
+
+static int
+setopt_gdbm_getcheckthreads (GDBM_FILE dbf, void *optval, int optlen)
+{
+  if (!optval || optlen != sizeof (int))
+    {
+      GDBM_SET_ERRNO (dbf, GDBM_OPT_BADVAL, FALSE);
+      return -1;
+    }
+  *(int*) optval = dbf->check_threads;
+  return 0;
+}
+
+static int
+setopt_gdbm_setallocator (GDBM_FILE dbf, void *optval, int optlen)
+{
+  gdbm_allocator *ap;
+
+  if (!optval || optlen != sizeof (gdbm_allocator))
+    {
+      GDBM_SET_ERRNO (dbf, GDBM_OPT_BADVAL, FALSE);
+      return -1;
+    }
+  ap = optval;
+  /* Either both functions are supplied or none. */
+  if (!ap->alloc != !ap->free)
+    {
+      GDBM_SET_ERRNO (dbf, GDBM_OPT_BADVAL, FALSE);
+      return -1;
+    }
+  dbf->result_alloc = *ap;
+  return 0;
+}
+
+static int
+setopt_gdbm_getallocator (GDBM_FILE dbf, void *optval, int optlen)
+{
+  if (!optval || optlen != sizeof (gdbm_allocator))
+    {
+      GDBM_SET_ERRNO (dbf, GDBM_OPT_BADVAL, FALSE);
+      return -1;
+    }
+  *(gdbm_allocator*) optval = dbf->result_alloc;
+  return 0;
+}
+
+static int
+setopt_gdbm_setcachehugepages (GDBM_FILE dbf, void *optval, int optlen)
+{
+  int n;
+
+  if ((n = getbool (optval, optlen)) == -1)
+    {
+      GDBM_SET_ERRNO (dbf, GDBM_OPT_BADVAL, FALSE);
+      return -1;
+    }
+#if !(HAVE_MMAP && defined (MAP_ANONYMOUS) && defined (MADV_HUGEPAGE))
+  if (n)
+    {
+      /* Not supported on this system. */
+      GDBM_SET_ERRNO (dbf, GDBM_OPT_BADVAL, FALSE);
+      return -1;
+    }
+#endif
+  dbf->cache_hugepages = n;
+  return 0;
+}
+
+static int
+setopt_gdbm_getcachehugepages (GDBM_FILE dbf, void *optval, int optlen)
+{
+  if (!optval || optlen != sizeof (int))
+    {
+      GDBM_SET_ERRNO (dbf, GDBM_OPT_BADVAL, FALSE);
+      return -1;
+    }
+  *(int*) optval = dbf->cache_hugepages;
+  return 0;
+}
+
 /* Obsolete form of GDBM_SETSYNCMODE. */
 static int
 setopt_gdbm_fastmode (GDBM_FILE dbf, void *optval, int optlen)
@@ -295,8 +613,7 @@ setopt_gdbm_getflags (GDBM_FILE dbf, void *optval, int optlen)
       if (dbf->cloexec)
 	flags |= GDBM_CLOEXEC;
       
-      if (dbf->header->header_magic == GDBM_NUMSYNC_MAGIC)
-	flags |= GDBM_NUMSYNC;
+      flags |= gdbm_db_format (dbf);
       
       *(int*) optval = flags;
     }
@@ -342,16 +659,7 @@ setopt_gdbm_getdbformat (GDBM_FILE dbf, void *optval, int optlen)
 {
   if (optval && optlen == sizeof (int))
     {
-      switch (dbf->header->header_magic)
-	{
-	case GDBM_OMAGIC:
-	case GDBM_MAGIC:
-	  *(int*)optval = 0;
-	  break;
-      
-	case GDBM_NUMSYNC_MAGIC:
-	  *(int*)optval = GDBM_NUMSYNC;
-	}
+      *(int*)optval = gdbm_db_format (dbf);
       return 0;
     }
   
@@ -411,6 +719,20 @@ static setopt_handler setopt_handler_tab[] = {
   [GDBM_GETBUCKETSIZE]   = setopt_gdbm_getbucketsize,
   [GDBM_GETCACHEAUTO]    = setopt_gdbm_getcacheauto,
   [GDBM_SETCACHEAUTO]    = setopt_gdbm_setcacheauto,
+  [GDBM_SETCACHEMEM]     = setopt_gdbm_setcachemem,
+  [GDBM_GETCACHEMEM]     = setopt_gdbm_getcachemem,
+  [GDBM_SETCACHEMEMCG]   = setopt_gdbm_setcachememcg,
+  [GDBM_GETCACHEMEMUSAGE] = setopt_gdbm_getcachememusage,
+  [GDBM_SETAVAILINDEX]   = setopt_gdbm_setavailindex,
+  [GDBM_GETAVAILINDEX]   = setopt_gdbm_getavailindex,
+  [GDBM_SETALLOCATOR]    = setopt_gdbm_setallocator,
+  [GDBM_GETALLOCATOR]    = setopt_gdbm_getallocator,
+  [GDBM_SETCACHEHUGEPAGES] = setopt_gdbm_setcachehugepages,
+  [GDBM_GETCACHEHUGEPAGES] = setopt_gdbm_getcachehugepages,
+  [GDBM_SETEXTENTTHRESHOLD] = setopt_gdbm_setextentthreshold,
+  [GDBM_GETEXTENTTHRESHOLD] = setopt_gdbm_getextentthreshold,
+  [GDBM_SETCHECKTHREADS] = setopt_gdbm_setcheckthreads,
+  [GDBM_GETCHECKTHREADS] = setopt_gdbm_getcheckthreads,
 };
   
 int
@@ -22,60 +22,200 @@
 #include "gdbmdefs.h"
 
 
-/* Add a new element to the database.  CONTENT is keyed by KEY.  The
-   file on disk is updated to reflect the structure of the new database
-   before returning from this procedure.  The FLAGS define the action to
-   take when the KEY is already in the database.  The value GDBM_REPLACE
-   asks that the old data be replaced by the new CONTENT.  The value
-   GDBM_INSERT asks that an error be returned and no action taken.
+/* State of a batch of stores (see gdbm_store_many).  Space for the new
+   records is carved out of extents allocated in one go, and records
+   that follow each other in the file are accumulated in a buffer and
+   written with a single call. */
+struct store_batch
+{
+  off_t ext_adr;           /* Start of the unused part of the extent. */
+  int ext_size;            /* Size of the unused part. */
+  size_t remaining;        /* Total size of records not yet stored. */
+  off_t buf_adr;           /* File address of the buffered data. */
+  size_t buf_len;          /* Number of bytes buffered. */
+  char buf[STORE_BATCH_BUFSIZE];
+};
 
-   On success (the item was stored), 0 is returned. If the item could
-   not be stored because a matching key already exists and GDBM_REPLACE
-   was not given, 1 is returned and gdbm_errno (as well as the database
-   errno value) is set to GDBM_CANNOT_REPLACE. Otherwise, if another
-   error occurred, -1 is returned. */
+/* Write out the data buffered in BATCH. */
+static int
+batch_flush (GDBM_FILE dbf, struct store_batch *batch)
+{
+  int rc = 0;
 
-int
-gdbm_store (GDBM_FILE dbf, datum key, datum content, int flags)
+  if (batch->buf_len)
+    {
+      rc = _gdbm_write_at (dbf, batch->buf_adr, batch->buf, batch->buf_len);
+      batch->buf_len = 0;
+    }
+  return rc;
+}
+
+/* Finish the BATCH: write out the buffered data, return the unused part
+   of the extent to the free space and write the changed structures of
+   DBF. */
+static int
+batch_finish (GDBM_FILE dbf, struct store_batch *batch)
 {
-  int  new_hash_val;		/* The new hash value. */
-  int  elem_loc;		/* The location in hash bucket. */
-  off_t file_adr;		/* The address of new space in the file.  */
-  off_t file_pos;		/* The position after a lseek. */
-  off_t free_adr;		/* For keeping track of a freed section. */
-  int  free_size;
-  int   new_size;		/* Used in allocating space. */
-  int rc;
+  if (batch_flush (dbf, batch))
+    return -1;
+  if (batch->ext_size > 0)
+    {
+      if (_gdbm_free (dbf, batch->ext_adr, batch->ext_size))
+	return -1;
+      batch->ext_size = 0;
+    }
+  return _gdbm_end_update (dbf);
+}
 
-  GDBM_DEBUG_DATUM (GDBM_DEBUG_STORE, key, "%s: storing key:", dbf->name);
+/* Allocate SIZE bytes for a new record from the current extent of
+   BATCH.  If it is too small, return its remainder to the free space
+   and allocate a new extent, large enough to hold the records not yet
+   stored, within reasonable limits. */
+static off_t
+batch_alloc (GDBM_FILE dbf, struct store_batch *batch, int size)
+{
+  off_t adr;
 
-  /* Return immediately if the database needs recovery */	
-  GDBM_ASSERT_CONSISTENCY (dbf, -1);
-  
-  /* First check to make sure this guy is a writer. */
-  if (dbf->read_write == GDBM_READER)
+  if (batch->ext_size < size)
     {
-      GDBM_SET_ERRNO2 (dbf, GDBM_READER_CANT_STORE, FALSE,
-		       GDBM_DEBUG_STORE);
-      return -1;
+      int ext_size;
+
+      if (batch->ext_size > 0
+	  && _gdbm_free (dbf, batch->ext_adr, batch->ext_size))
+	return 0;
+      batch->ext_size = 0;
+
+      if (batch->remaining > STORE_BATCH_EXTENT)
+	ext_size = STORE_BATCH_EXTENT;
+      else
+	ext_size = batch->remaining;
+      if (ext_size < size)
+	ext_size = size;
+      batch->ext_adr = _gdbm_alloc (dbf, ext_size);
+      if (batch->ext_adr == 0)
+	return 0;
+      batch->ext_size = ext_size;
     }
+  adr = batch->ext_adr;
+  batch->ext_adr += size;
+  batch->ext_size -= size;
+  return adr;
+}
 
-  /* Check for illegal data values.  A NULL dptr field is illegal because
-     NULL dptr returned by a lookup procedure indicates an error. */
-  if ((key.dptr == NULL) || (content.dptr == NULL))
+/* Write the record KEY/CONTENT at the address ADR.  If BATCH is not
+   NULL, buffer it if possible. */
+static int
+write_record (GDBM_FILE dbf, struct store_batch *batch, off_t adr,
+	      datum key, datum content)
+{
+  size_t size = key.dsize + content.dsize;
+
+  if (batch)
     {
-      GDBM_SET_ERRNO2 (dbf, GDBM_MALFORMED_DATA, FALSE,
-		       GDBM_DEBUG_STORE);
-      return -1;
+      if (batch->buf_len > 0
+	  && (batch->buf_adr + batch->buf_len != adr
+	      || batch->buf_len + size > sizeof (batch->buf)))
+	{
+	  if (batch_flush (dbf, batch))
+	    return -1;
+	}
+      if (size <= sizeof (batch->buf))
+	{
+	  if (batch->buf_len == 0)
+	    batch->buf_adr = adr;
+	  memcpy (batch->buf + batch->buf_len, key.dptr, key.dsize);
+	  memcpy (batch->buf + batch->buf_len + key.dsize, content.dptr,
+		  content.dsize);
+	  batch->buf_len += size;
+	  return 0;
+	}
     }
 
-  /* Initialize the gdbm_errno variable. */
-  gdbm_set_errno (dbf, GDBM_NO_ERROR, FALSE);
+  if (_gdbm_write_at (dbf, adr, key.dptr, key.dsize))
+    return -1;
+  return _gdbm_write_at (dbf, adr + key.dsize, content.dptr, content.dsize);
+}
+
+/* Point the element ELEM_LOC of the current bucket to the record KEY
+   of DATA_SIZE bytes of data at the address FILE_ADR.  If ELEM_LOC is
+   -1, add a new element for KEY, whose hash value is HASH_VAL.  The
+   bucket is split if necessary.  Return the location of the element,
+   or -1 on error. */
+static int
+put_element (GDBM_FILE dbf, datum key, int elem_loc, int hash_val,
+	     off_t file_adr, int data_size)
+{
+  bucket_element newel;
+
+  /* Make sure the bucket has room for the element, splitting it if
+     necessary. */
+  newel.hash_value = hash_val;
+  if (elem_loc == -1)
+    _gdbm_key_start (dbf, key, newel.key_start);
+  else
+    memcpy (newel.key_start, dbf->bucket->h_table[elem_loc].key_start, SMALL);
+  newel.data_pointer = file_adr;
+  newel.key_size = key.dsize;
+  newel.data_size = data_size;
+  if (_gdbm_bucket_reserve (dbf, &elem_loc, &newel))
+    return -1;
+
+  /* If this is a new entry in the bucket, we need to do special things. */
+  if (elem_loc == -1)
+    {
+      /* Find space to insert into bucket and set elem_loc to that place. */
+      elem_loc = _gdbm_bucket_slot (dbf, dbf->bucket, hash_val);
+      if (elem_loc == -1)
+	{
+	  GDBM_SET_ERRNO (dbf, GDBM_BAD_HASH_TABLE, TRUE);
+	  return -1;
+	}
+      if (gdbm_robin_hood_p (dbf))
+	/* Elements may have been moved. */
+	dbf->cache_mru->ca_data.elem_loc = -1;
+      
+      /* We now have another element in the bucket.  Add the new information.*/
+      dbf->bucket->count++;
+      dbf->bucket->h_table[elem_loc].hash_value = hash_val;
+      memcpy (dbf->bucket->h_table[elem_loc].key_start, newel.key_start,
+	      SMALL);
+    }
+  else if (dbf->cache_mru->ca_data.elem_loc == elem_loc)
+    /* Cached data are no longer valid. */
+    dbf->cache_mru->ca_data.elem_loc = -1;
+
+  /* Update current bucket data pointer and sizes. */
+  dbf->bucket->h_table[elem_loc].data_pointer = file_adr;
+  dbf->bucket->h_table[elem_loc].key_size = key.dsize;
+  dbf->bucket->h_table[elem_loc].data_size = data_size;
+  return elem_loc;
+}
+
+/* Store KEY/CONTENT in DBF without updating the file structure.
+   Arguments and return value are as for gdbm_store.  If BATCH is not
+   NULL, the record space is allocated and written through it. */
+static int
+store_record (GDBM_FILE dbf, datum key, datum content, int flags,
+	      struct store_batch *batch)
+{
+  int  new_hash_val;		/* The new hash value. */
+  int  elem_loc;		/* The location in hash bucket. */
+  off_t file_adr;		/* The address of new space in the file.  */
+  off_t free_adr;		/* For keeping track of a freed section. */
+  int  free_size;
+  int   new_size;		/* Used in allocating space. */
+  int   in_place;		/* Is the record updated in place? */
 
   /* Look for the key in the file.
      A side effect loads the correct bucket and calculates the hash value. */
   elem_loc = _gdbm_findkey (dbf, key, NULL, &new_hash_val);
 
+  /* Compress the data, unless they won't be stored.  From now on,
+     CONTENT is what is written to the file. */
+  if ((elem_loc == -1 || flags == GDBM_REPLACE)
+      && _gdbm_encode_data (dbf, &content))
+    return -1;
+
   /* Initialize these. */
   file_adr = 0;
   new_size = key.dsize + content.dsize;
@@ -85,15 +225,51 @@ gdbm_store (GDBM_FILE dbf, datum key, datum content, int flags)
     {
       if (flags == GDBM_REPLACE)
 	{
+	  /* Drop the reference to the old shared data, if any.  The new
+	     data, if identical, already hold one. */
+	  if (_gdbm_dedup_release (dbf, &dbf->bucket->h_table[elem_loc]))
+	    return -1;
+
 	  /* Just replace the data. */
 	  free_adr = dbf->bucket->h_table[elem_loc].data_pointer;
 	  free_size = dbf->bucket->h_table[elem_loc].key_size
 	              + dbf->bucket->h_table[elem_loc].data_size;
-	  if (free_size != new_size)
+	  if (bucket_element_inline_p (dbf, &dbf->bucket->h_table[elem_loc]))
+	    {
+	      /* The old record occupies no file space. */
+	    }
+	  else if (gdbm_record_inline_p (dbf, new_size))
 	    {
+	      /* The record moves into the bucket element. */
 	      if (_gdbm_free (dbf, free_adr, free_size))
 		return -1;
 	    }
+	  else if (free_size > new_size)
+	    {
+	      /* Shrink the record and free its tail. */
+	      if (_gdbm_free (dbf, free_adr + new_size, free_size - new_size))
+		return -1;
+	      file_adr = free_adr;
+	    }
+	  else if (free_size < new_size)
+	    {
+	      /* Try to grow the record into the adjacent free space. */
+	      switch (_gdbm_extend (dbf, free_adr + free_size,
+				    new_size - free_size))
+		{
+		case 0:
+		  file_adr = free_adr;
+		  break;
+
+		case 1:
+		  if (_gdbm_free (dbf, free_adr, free_size))
+		    return -1;
+		  break;
+
+		default:
+		  return -1;
+		}
+	    }
 	  else
 	    {
 	      /* Just reuse the same address! */
@@ -112,86 +288,288 @@ gdbm_store (GDBM_FILE dbf, datum key, datum content, int flags)
   else
     return -1;
 
+  if (gdbm_record_inline_p (dbf, new_size))
+    {
+      /* Keep the record in the bucket element. */
+      elem_loc = put_element (dbf, key, elem_loc, new_hash_val, 0,
+			     content.dsize);
+      if (elem_loc == -1)
+	return -1;
+      bucket_element_inline_set (&dbf->bucket->h_table[elem_loc],
+				 key, content);
+      _gdbm_current_bucket_changed (dbf);
+      return 0;
+    }
+
+  in_place = file_adr != 0;
+
   /* Get the file address for the new space.
      (Current bucket's free space is first place to look.) */
   if (file_adr == 0)
     {
-      file_adr = _gdbm_alloc (dbf, new_size);
+      /* Large records get extents of their own (see _gdbm_alloc). */
+      if (batch && !(dbf->extent_threshold
+		     && (size_t) new_size >= dbf->extent_threshold))
+	file_adr = batch_alloc (dbf, batch, new_size);
+      else
+	file_adr = _gdbm_alloc (dbf, new_size);
       if (file_adr == 0)
 	return -1;
     }
 
-  /* If this is a new entry in the bucket, we need to do special things. */
+  elem_loc = put_element (dbf, key, elem_loc, new_hash_val, file_adr,
+			 content.dsize);
   if (elem_loc == -1)
+    return -1;
+
+  /* Write the data to the file.  If the record stays at its place,
+     the key is already there. */
+  if (in_place)
     {
-      int start_loc;
-      
-      if (dbf->bucket->count == dbf->header->bucket_elems)
-	{
-	  /* Split the current bucket. */
-	  if (_gdbm_split_bucket (dbf, new_hash_val))
-	    return -1;
-	}
-      
-      /* Find space to insert into bucket and set elem_loc to that place. */
-      elem_loc = start_loc = new_hash_val % dbf->header->bucket_elems;
-      while (dbf->bucket->h_table[elem_loc].hash_value != -1)
-	{
-	  elem_loc = (elem_loc + 1) % dbf->header->bucket_elems;
-	  if (elem_loc == start_loc)
-	    {
-	      GDBM_SET_ERRNO (dbf, GDBM_BAD_HASH_TABLE, TRUE);
-	      return -1;
-	    }
-	}
-      
-      /* We now have another element in the bucket.  Add the new information.*/
-      dbf->bucket->count++;
-      dbf->bucket->h_table[elem_loc].hash_value = new_hash_val;
-      memcpy (dbf->bucket->h_table[elem_loc].key_start, key.dptr,
-	     (SMALL < key.dsize ? SMALL : key.dsize));
+      if (_gdbm_write_at (dbf, file_adr + key.dsize,
+			  content.dptr, content.dsize))
+	return -1;
     }
+  else if (write_record (dbf, batch, file_adr, key, content))
+    return -1;
 
+  /* Current bucket has changed. */
+  _gdbm_current_bucket_changed (dbf);
+  return 0;
+}
 
-  /* Update current bucket data pointer and sizes. */
-  dbf->bucket->h_table[elem_loc].data_pointer = file_adr;
-  dbf->bucket->h_table[elem_loc].key_size = key.dsize;
-  dbf->bucket->h_table[elem_loc].data_size = content.dsize;
+/* Store KEY/CONTENT in DBF without updating the file structure. */
+int
+_gdbm_store_record (GDBM_FILE dbf, datum key, datum content, int flags)
+{
+  return store_record (dbf, key, content, flags, NULL);
+}
 
-  /* Write the data to the file. */
-  file_pos = gdbm_file_seek (dbf, file_adr, SEEK_SET);
-  if (file_pos != file_adr)
+/* Make KEY refer to the record of DATA_SIZE bytes of data, which has
+   already been written, along with the key, at the address FILE_ADR.
+   ELEM_LOC and HASH_VAL are the element location (or -1) and hash
+   value returned by _gdbm_findkey_loc for KEY.  No other bucket may
+   have been loaded since then.  The space of the old record, if any,
+   is freed.  The file structure is not updated. */
+int
+_gdbm_store_element (GDBM_FILE dbf, datum key, int elem_loc, int hash_val,
+		     off_t file_adr, int data_size)
+{
+  if (elem_loc != -1
+      && !bucket_element_inline_p (dbf, &dbf->bucket->h_table[elem_loc]))
     {
-      GDBM_DEBUG (GDBM_DEBUG_STORE|GDBM_DEBUG_ERR,
-		  "%s: lseek: %s", dbf->name, strerror (errno));      
-      GDBM_SET_ERRNO2 (dbf, GDBM_FILE_SEEK_ERROR, TRUE, GDBM_DEBUG_STORE);
-      _gdbm_fatal (dbf, _("lseek error"));
-      return -1;
+      bucket_element *elem = &dbf->bucket->h_table[elem_loc];
+
+      if (_gdbm_dedup_release (dbf, elem)
+	  || _gdbm_free (dbf, elem->data_pointer,
+			 elem->key_size + elem->data_size))
+	return -1;
     }
+  if (put_element (dbf, key, elem_loc, hash_val, file_adr, data_size) == -1)
+    return -1;
+  _gdbm_current_bucket_changed (dbf);
+  return 0;
+}
 
-  rc = _gdbm_full_write (dbf, key.dptr, key.dsize);
-  if (rc)
+/* Check if DBF can be modified and KEY and CONTENT are valid. */
+static int
+store_check (GDBM_FILE dbf, datum key, datum content)
+{
+  /* First check to make sure this guy is a writer. */
+  if (dbf->read_write == GDBM_READER)
     {
-      GDBM_DEBUG (GDBM_DEBUG_STORE|GDBM_DEBUG_ERR,
-		  "%s: error writing key: %s",
-		  dbf->name, gdbm_db_strerror (dbf));      
-      _gdbm_fatal (dbf, gdbm_db_strerror (dbf));
+      GDBM_SET_ERRNO2 (dbf, GDBM_READER_CANT_STORE, FALSE,
+		       GDBM_DEBUG_STORE);
       return -1;
     }
 
-  rc = _gdbm_full_write (dbf, content.dptr, content.dsize);
-  if (rc)
+  /* Check for illegal data values.  A NULL dptr field is illegal because
+     NULL dptr returned by a lookup procedure indicates an error. */
+  if ((key.dptr == NULL) || (content.dptr == NULL))
     {
-      GDBM_DEBUG (GDBM_DEBUG_STORE|GDBM_DEBUG_ERR,
-		  "%s: error writing content: %s",
-		  dbf->name, gdbm_db_strerror (dbf));      
-      _gdbm_fatal (dbf, gdbm_db_strerror (dbf));
+      GDBM_SET_ERRNO2 (dbf, GDBM_MALFORMED_DATA, FALSE,
+		       GDBM_DEBUG_STORE);
       return -1;
     }
+  return 0;
+}
 
-  /* Current bucket has changed. */
-  _gdbm_current_bucket_changed (dbf);
+/* Add a new element to the database.  CONTENT is keyed by KEY.  The
+   file on disk is updated to reflect the structure of the new database
+   before returning from this procedure.  The FLAGS define the action to
+   take when the KEY is already in the database.  The value GDBM_REPLACE
+   asks that the old data be replaced by the new CONTENT.  The value
+   GDBM_INSERT asks that an error be returned and no action taken.
+
+   On success (the item was stored), 0 is returned. If the item could
+   not be stored because a matching key already exists and GDBM_REPLACE
+   was not given, 1 is returned and gdbm_errno (as well as the database
+   errno value) is set to GDBM_CANNOT_REPLACE. Otherwise, if another
+   error occurred, -1 is returned. */
+
+int
+gdbm_store (GDBM_FILE dbf, datum key, datum content, int flags)
+{
+  int rc;
+
+  GDBM_DEBUG_DATUM (GDBM_DEBUG_STORE, key, "%s: storing key:", dbf->name);
+
+  /* Return immediately if the database needs recovery */	
+  GDBM_ASSERT_CONSISTENCY (dbf, -1);
+  
+  if (store_check (dbf, key, content))
+    return -1;
+
+  /* Initialize the gdbm_errno variable. */
+  gdbm_set_errno (dbf, GDBM_NO_ERROR, FALSE);
+
+  rc = store_record (dbf, key, content, flags, NULL);
+  if (rc)
+    return rc;
 
   /* Write everything that is needed to the disk. */
   return _gdbm_end_update (dbf);
 }
+
+struct store_order
+{
+  int bucket_dir;          /* Directory index of the key. */
+  int hash;                /* Hash value of the key. */
+  size_t idx;              /* Index of the item in the batch. */
+};
+
+static int
+store_order_cmp (void const *a, void const *b)
+{
+  struct store_order const *oa = a;
+  struct store_order const *ob = b;
+
+  /* In GDBM_LARGE databases the directory index is not derived from
+     the hash value, so compare it first. */
+  if (oa->bucket_dir < ob->bucket_dir)
+    return -1;
+  if (oa->bucket_dir > ob->bucket_dir)
+    return 1;
+  if (oa->hash < ob->hash)
+    return -1;
+  if (oa->hash > ob->hash)
+    return 1;
+  /* Keep the original order of items with equal hashes, so that the
+     last of duplicate keys wins. */
+  if (oa->idx < ob->idx)
+    return -1;
+  return oa->idx > ob->idx;
+}
+
+/* Store COUNT items from the array ITEMS.  FLAGS are as for gdbm_store.
+
+   The items are sorted by directory index and hash value, so that all
+   items that belong to the same bucket are stored while it is current.  The file structure
+   is updated once, after all items have been stored.
+
+   The result member of each item is set to 0 if it was stored, 1 if
+   its key already exists and FLAGS is GDBM_INSERT, and -1 if it was
+   not processed because of an error.
+
+   Returns 0 on success and -1 on error.  If some items were not
+   stored because their keys already exist, 1 is returned and
+   gdbm_errno is set to GDBM_CANNOT_REPLACE. */
+
+int
+gdbm_store_many (GDBM_FILE dbf, gdbm_store_item *items, size_t count,
+		 int flags)
+{
+  struct store_order *order;
+  struct store_batch *batch;
+  size_t i;
+  int elem_loc;
+  int rc, result = 0;
+
+  GDBM_DEBUG (GDBM_DEBUG_STORE, "%s: storing %zu items", dbf->name, count);
+
+  /* Return immediately if the database needs recovery */
+  GDBM_ASSERT_CONSISTENCY (dbf, -1);
+
+  if (count > 0 && items == NULL)
+    {
+      GDBM_SET_ERRNO (dbf, GDBM_ERR_USAGE, FALSE);
+      return -1;
+    }
+
+  for (i = 0; i < count; i++)
+    {
+      if (store_check (dbf, items[i].key, items[i].content))
+	return -1;
+      items[i].result = -1;
+    }
+
+  /* Initialize the gdbm_errno variable. */
+  gdbm_set_errno (dbf, GDBM_NO_ERROR, FALSE);
+
+  if (count == 0)
+    return 0;
+
+  order = calloc (count, sizeof (order[0]));
+  batch = malloc (sizeof (*batch));
+  if (!order || !batch)
+    {
+      free (order);
+      free (batch);
+      GDBM_SET_ERRNO (dbf, GDBM_MALLOC_ERROR, FALSE);
+      return -1;
+    }
+  batch->ext_adr = 0;
+  batch->ext_size = 0;
+  batch->remaining = 0;
+  batch->buf_len = 0;
+
+  for (i = 0; i < count; i++)
+    {
+      _gdbm_hash_key (dbf, items[i].key, &order[i].hash,
+		      &order[i].bucket_dir, &elem_loc);
+      order[i].idx = i;
+      /* Inline records take no file space. */
+      if (!gdbm_record_inline_p (dbf, items[i].key.dsize
+				      + items[i].content.dsize))
+	batch->remaining += items[i].key.dsize + items[i].content.dsize;
+    }
+  qsort (order, count, sizeof (order[0]), store_order_cmp);
+
+  for (i = 0; i < count; i++)
+    {
+      gdbm_store_item *item = &items[order[i].idx];
+
+      /* A record with the same hash value may be looked up while
+	 storing this item.  Make sure it is on disk. */
+      if (i > 0 && order[i].hash == order[i-1].hash
+	  && batch_flush (dbf, batch))
+	break;
+
+      rc = store_record (dbf, item->key, item->content, flags, batch);
+      if (rc == -1)
+	break;
+      item->result = rc;
+      if (rc)
+	result = 1;
+      if (!gdbm_record_inline_p (dbf, item->key.dsize + item->content.dsize))
+	batch->remaining -= item->key.dsize + item->content.dsize;
+    }
+
+  if (i < count)
+    {
+      /* Keep the stored items consistent, unless the error is fatal.
+	 Report the error that stopped the batch. */
+      if (!dbf->need_recovery)
+	SAVE_ERRNO (batch_finish (dbf, batch));
+      rc = -1;
+    }
+  else if ((rc = batch_finish (dbf, batch)) == 0 && result)
+    {
+      GDBM_SET_ERRNO2 (dbf, GDBM_CANNOT_REPLACE, FALSE, GDBM_DEBUG_STORE);
+      rc = 1;
+    }
+
+  free (batch);
+  free (order);
+  return rc;
+}
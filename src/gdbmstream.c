@@ -0,0 +1,436 @@
+/* gdbmstream.c - Transfer stored values to and from file descriptors. */
+
+/* This file is part of GDBM, the GNU data base manager.
+   Copyright (C) 2025 Free Software Foundation, Inc.
+
+   GDBM is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3, or (at your option)
+   any later version.
+
+   GDBM is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with GDBM. If not, see <http://www.gnu.org/licenses/>.   */
+
+/* Include system configuration before all else. */
+#include "autoconf.h"
+
+#include "gdbmdefs.h"
+#if HAVE_SYS_SENDFILE_H
+# include <sys/sendfile.h>
+#endif
+
+/*
+ * Data are moved between the database file and the other descriptor
+ * by the kernel, using copy_file_range or sendfile, if possible.  If
+ * neither is available or applicable to the descriptors at hand, the
+ * data are copied through a buffer.
+ */
+
+/* Size of the buffer used when the kernel can't do the copying. */
+#define STREAM_BUFSIZE (64*1024)
+
+/* Return true if ERR means that the kernel copying function can't be
+   used for these descriptors, so that the caller should fall back to
+   the buffered copy. */
+static inline int
+kernel_copy_unsupported (int err)
+{
+  return err == EINVAL || err == ENOSYS || err == EXDEV || err == EBADF
+#ifdef EOPNOTSUPP
+    || err == EOPNOTSUPP
+#endif
+    ;
+}
+
+/* Write SIZE bytes from BUF to FD. */
+static int
+write_fd (int fd, char const *buf, size_t size)
+{
+  while (size > 0)
+    {
+      ssize_t n = write (fd, buf, size);
+      if (n == -1)
+	{
+	  if (errno == EINTR)
+	    continue;
+	  return -1;
+	}
+      buf += n;
+      size -= n;
+    }
+  return 0;
+}
+
+/* Read SIZE bytes from FD into BUF. */
+static int
+read_fd (GDBM_FILE dbf, int fd, char *buf, size_t size)
+{
+  while (size > 0)
+    {
+      ssize_t n = read (fd, buf, size);
+      if (n == -1)
+	{
+	  if (errno == EINTR)
+	    continue;
+	  GDBM_SET_ERRNO (dbf, GDBM_FILE_READ_ERROR, FALSE);
+	  return -1;
+	}
+      if (n == 0)
+	{
+	  GDBM_SET_ERRNO (dbf, GDBM_FILE_EOF, FALSE);
+	  return -1;
+	}
+      buf += n;
+      size -= n;
+    }
+  return 0;
+}
+
+/* Copy LEN bytes at the offset OFF of the database file to FD. */
+static int
+copy_out (GDBM_FILE dbf, off_t off, size_t len, int fd)
+{
+  char *buf;
+  int rc = 0;
+
+#if HAVE_COPY_FILE_RANGE
+  while (len > 0)
+    {
+      ssize_t n = copy_file_range (dbf->desc, &off, fd, NULL, len, 0);
+      if (n > 0)
+	len -= n;
+      else if (n == 0)
+	{
+	  GDBM_SET_ERRNO (dbf, GDBM_FILE_EOF, FALSE);
+	  return -1;
+	}
+      else if (errno == EINTR)
+	continue;
+      else if (kernel_copy_unsupported (errno))
+	break;
+      else
+	{
+	  GDBM_SET_ERRNO (dbf, GDBM_FILE_WRITE_ERROR, FALSE);
+	  return -1;
+	}
+    }
+#endif
+#if HAVE_SENDFILE
+  while (len > 0)
+    {
+      ssize_t n = sendfile (fd, dbf->desc, &off, len);
+      if (n > 0)
+	len -= n;
+      else if (n == 0)
+	{
+	  GDBM_SET_ERRNO (dbf, GDBM_FILE_EOF, FALSE);
+	  return -1;
+	}
+      else if (errno == EINTR)
+	continue;
+      else if (kernel_copy_unsupported (errno))
+	break;
+      else
+	{
+	  GDBM_SET_ERRNO (dbf, GDBM_FILE_WRITE_ERROR, FALSE);
+	  return -1;
+	}
+    }
+#endif
+  if (len == 0)
+    return 0;
+
+  buf = malloc (len < STREAM_BUFSIZE ? len : STREAM_BUFSIZE);
+  if (!buf)
+    {
+      GDBM_SET_ERRNO (dbf, GDBM_MALLOC_ERROR, FALSE);
+      return -1;
+    }
+  while (rc == 0 && len > 0)
+    {
+      size_t n = len < STREAM_BUFSIZE ? len : STREAM_BUFSIZE;
+
+      if (_gdbm_read_at (dbf, off, buf, n))
+	rc = -1;
+      else if (write_fd (fd, buf, n))
+	{
+	  GDBM_SET_ERRNO (dbf, GDBM_FILE_WRITE_ERROR, FALSE);
+	  rc = -1;
+	}
+      off += n;
+      len -= n;
+    }
+  free (buf);
+  return rc;
+}
+
+/* Copy LEN bytes from FD to the offset OFF of the database file. */
+static int
+copy_in (GDBM_FILE dbf, off_t off, int fd, size_t len)
+{
+  char *buf;
+  int rc = 0;
+
+  /* The file grows behind the back of the mmap layer. */
+  dbf->file_size = -1;
+
+#if HAVE_COPY_FILE_RANGE
+  while (len > 0)
+    {
+      ssize_t n = copy_file_range (fd, NULL, dbf->desc, &off, len, 0);
+      if (n > 0)
+	len -= n;
+      else if (n == 0)
+	{
+	  GDBM_SET_ERRNO (dbf, GDBM_FILE_EOF, FALSE);
+	  return -1;
+	}
+      else if (errno == EINTR)
+	continue;
+      else if (kernel_copy_unsupported (errno))
+	break;
+      else
+	{
+	  GDBM_SET_ERRNO (dbf, GDBM_FILE_READ_ERROR, FALSE);
+	  return -1;
+	}
+    }
+#endif
+#if HAVE_SENDFILE
+  if (len > 0 && lseek (dbf->desc, off, SEEK_SET) == off)
+    {
+      while (len > 0)
+	{
+	  ssize_t n = sendfile (dbf->desc, fd, NULL, len);
+	  if (n > 0)
+	    {
+	      len -= n;
+	      off += n;
+	    }
+	  else if (n == 0)
+	    {
+	      GDBM_SET_ERRNO (dbf, GDBM_FILE_EOF, FALSE);
+	      return -1;
+	    }
+	  else if (errno == EINTR)
+	    continue;
+	  else if (kernel_copy_unsupported (errno))
+	    break;
+	  else
+	    {
+	      GDBM_SET_ERRNO (dbf, GDBM_FILE_READ_ERROR, FALSE);
+	      return -1;
+	    }
+	}
+    }
+#endif
+  if (len == 0)
+    return 0;
+
+  buf = malloc (len < STREAM_BUFSIZE ? len : STREAM_BUFSIZE);
+  if (!buf)
+    {
+      GDBM_SET_ERRNO (dbf, GDBM_MALLOC_ERROR, FALSE);
+      return -1;
+    }
+  while (len > 0)
+    {
+      ssize_t n = read (fd, buf, len < STREAM_BUFSIZE ? len : STREAM_BUFSIZE);
+      if (n == -1)
+	{
+	  if (errno == EINTR)
+	    continue;
+	  GDBM_SET_ERRNO (dbf, GDBM_FILE_READ_ERROR, FALSE);
+	  rc = -1;
+	  break;
+	}
+      if (n == 0)
+	{
+	  GDBM_SET_ERRNO (dbf, GDBM_FILE_EOF, FALSE);
+	  rc = -1;
+	  break;
+	}
+      if (_gdbm_write_at (dbf, off, buf, n))
+	{
+	  rc = -1;
+	  break;
+	}
+      off += n;
+      len -= n;
+    }
+  free (buf);
+  return rc;
+}
+
+/* Look up KEY and write the data associated with it to the file
+   descriptor FD.  The data are copied from the database file to FD
+   by the kernel, without passing through the user space, if possible.
+
+   Returns 0 on success and -1 on error. */
+
+int
+gdbm_fetch_to_fd (GDBM_FILE dbf, datum key, int fd)
+{
+  int elem_loc;
+  bucket_element *elem;
+
+  GDBM_DEBUG_DATUM (GDBM_DEBUG_READ, key, "%s: fetching key:", dbf->name);
+
+  /* Return immediately if the database needs recovery */
+  GDBM_ASSERT_CONSISTENCY (dbf, -1);
+
+  /* Initialize the gdbm_errno variable. */
+  gdbm_set_errno (dbf, GDBM_NO_ERROR, FALSE);
+
+  elem_loc = _gdbm_findkey_loc (dbf, key, NULL);
+  if (elem_loc < 0)
+    {
+      GDBM_DEBUG (GDBM_DEBUG_READ, "%s: key not found", dbf->name);
+      return -1;
+    }
+  elem = &dbf->bucket->h_table[elem_loc];
+
+  /* Compressed data have to be decoded. */
+  if (bucket_element_encoded_p (dbf, elem)
+      && _gdbm_read_entry (dbf, elem_loc) == NULL)
+    return -1;
+
+  if (gdbm_record_cached_p (dbf, elem_loc))
+    {
+      /* The data are at hand. */
+      if (write_fd (fd, dbf->cache_mru->ca_data.dptr + elem->key_size,
+		    dbf->cache_mru->ca_data.data_size))
+	{
+	  GDBM_SET_ERRNO (dbf, GDBM_FILE_WRITE_ERROR, FALSE);
+	  return -1;
+	}
+      return 0;
+    }
+
+  if (bucket_element_inline_p (dbf, elem))
+    {
+      char buf[INLINE_RECORD_SIZE];
+
+      bucket_element_inline_get (elem, buf);
+      if (write_fd (fd, buf + elem->key_size, elem->data_size))
+	{
+	  GDBM_SET_ERRNO (dbf, GDBM_FILE_WRITE_ERROR, FALSE);
+	  return -1;
+	}
+      return 0;
+    }
+
+  return copy_out (dbf, elem->data_pointer + elem->key_size,
+		   elem->data_size, fd);
+}
+
+/* Read LEN bytes from the file descriptor FD and store them as the
+   data associated with KEY, replacing the data stored previously.
+   The data are copied from FD to the database file by the kernel, if
+   possible.
+
+   The new data are always written to newly allocated space, so that
+   if FD delivers fewer than LEN bytes or an error occurs, the old
+   record, if any, is left intact.
+
+   Returns 0 on success and -1 on error. */
+
+int
+gdbm_store_from_fd (GDBM_FILE dbf, datum key, int fd, size_t len)
+{
+  int elem_loc;
+  int hash_val;
+  off_t file_adr;
+  int rc;
+
+  GDBM_DEBUG_DATUM (GDBM_DEBUG_STORE, key, "%s: storing key:", dbf->name);
+
+  /* Return immediately if the database needs recovery */
+  GDBM_ASSERT_CONSISTENCY (dbf, -1);
+
+  if (dbf->read_write == GDBM_READER)
+    {
+      GDBM_SET_ERRNO2 (dbf, GDBM_READER_CANT_STORE, FALSE,
+		       GDBM_DEBUG_STORE);
+      return -1;
+    }
+
+  if (key.dptr == NULL || len > INT_MAX - key.dsize)
+    {
+      GDBM_SET_ERRNO2 (dbf, GDBM_MALFORMED_DATA, FALSE, GDBM_DEBUG_STORE);
+      return -1;
+    }
+
+  /* Initialize the gdbm_errno variable. */
+  gdbm_set_errno (dbf, GDBM_NO_ERROR, FALSE);
+
+  if (gdbm_record_inline_p (dbf, key.dsize + len))
+    {
+      /* The record will be kept in the bucket element. */
+      char buf[INLINE_RECORD_SIZE];
+      datum content;
+
+      if (read_fd (dbf, fd, buf, len))
+	return -1;
+      content.dptr = buf;
+      content.dsize = len;
+      if (_gdbm_store_record (dbf, key, content, GDBM_REPLACE))
+	return -1;
+      return _gdbm_end_update (dbf);
+    }
+
+  if (gdbm_data_encoded_p (dbf, len))
+    {
+      /* The data will be compressed, which is done in memory. */
+      datum content;
+
+      content.dptr = malloc (len);
+      if (!content.dptr)
+	{
+	  GDBM_SET_ERRNO (dbf, GDBM_MALLOC_ERROR, FALSE);
+	  return -1;
+	}
+      content.dsize = len;
+      rc = read_fd (dbf, fd, content.dptr, len)
+	   || _gdbm_store_record (dbf, key, content, GDBM_REPLACE);
+      free (content.dptr);
+      if (rc)
+	return -1;
+      return _gdbm_end_update (dbf);
+    }
+
+  elem_loc = _gdbm_findkey_loc (dbf, key, &hash_val);
+  if (elem_loc == -1)
+    {
+      if (gdbm_errno != GDBM_ITEM_NOT_FOUND)
+	return -1;
+      gdbm_set_errno (dbf, GDBM_NO_ERROR, FALSE);
+    }
+
+  file_adr = _gdbm_alloc (dbf, key.dsize + len);
+  if (file_adr == 0)
+    return -1;
+
+  if (_gdbm_write_at (dbf, file_adr, key.dptr, key.dsize))
+    return -1;
+
+  if (copy_in (dbf, file_adr + key.dsize, fd, len))
+    {
+      /* Give the space back.  The database itself is not damaged. */
+      if (_gdbm_free (dbf, file_adr, key.dsize + len) == 0)
+	_gdbm_end_update (dbf);
+      return -1;
+    }
+
+  rc = _gdbm_store_element (dbf, key, elem_loc, hash_val, file_adr, len);
+  if (rc)
+    return rc;
+
+  /* Write everything that is needed to the disk. */
+  return _gdbm_end_update (dbf);
+}
@@ -469,6 +469,11 @@ gdbm_sync (GDBM_FILE dbf)
       dbf->xheader->numsync++;
       dbf->header_changed = TRUE;
     }
+
+  /* Write back the dedup and avail indexes.  The former allocates file
+     space, so it goes first. */
+  if (_gdbm_dedup_index_save (dbf) || _gdbm_avail_index_save (dbf))
+    return -1;
   
   _gdbm_end_update (dbf);
   
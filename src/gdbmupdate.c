@@ -0,0 +1,185 @@
+/* gdbmupdate.c - Read-modify-write update of a record. */
+
+/* This file is part of GDBM, the GNU data base manager.
+   Copyright (C) 2025 Free Software Foundation, Inc.
+
+   GDBM is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3, or (at your option)
+   any later version.
+
+   GDBM is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with GDBM. If not, see <http://www.gnu.org/licenses/>.   */
+
+/* Include system configuration before all else. */
+#include "autoconf.h"
+
+#include "gdbmdefs.h"
+
+/* Overwrite the data of the record at ELEM_LOC in the current bucket
+   with CONTENT, which is not longer than the actual data and doesn't
+   overlap the data cache.  OLD_DPTR points to the cached copy of the
+   data, which is updated as well.
+   The space freed at the end of the record, if any, is returned to
+   the available space. */
+static int
+update_in_place (GDBM_FILE dbf, int elem_loc, char *old_dptr, datum content)
+{
+  bucket_element *elem = &dbf->bucket->h_table[elem_loc];
+  off_t adr = elem->data_pointer + elem->key_size;
+
+  /* Keep the data cache consistent with the file. */
+  memcpy (old_dptr, content.dptr, content.dsize);
+
+  if (_gdbm_write_at (dbf, adr, old_dptr, content.dsize))
+    return -1;
+
+  if (content.dsize < elem->data_size)
+    {
+      int tail = elem->data_size - content.dsize;
+
+      elem->data_size = content.dsize;
+      dbf->cache_mru->ca_data.data_size = content.dsize;
+      _gdbm_current_bucket_changed (dbf);
+      if (_gdbm_free (dbf, adr + content.dsize, tail))
+	return -1;
+    }
+  return 0;
+}
+
+/* Look up KEY in DBF and call FUNC to compute its new content.
+
+   FUNC is called with KEY, a pointer to the datum holding the actual
+   content, and DATA.  If KEY is not in the database, the dptr member
+   of the content is NULL.  FUNC returns GDBM_UPDATE_KEEP to leave the
+   record unchanged, GDBM_UPDATE_DELETE to delete it, and
+   GDBM_UPDATE_STORE to store the content it has placed in the datum.
+   The content passed to FUNC is a private copy of the record data,
+   which can be modified in place, as long as its size doesn't grow.
+   FUNC may read from the database, but must not modify it.
+
+   The record is overwritten in place, unless its new content is larger
+   than the old one, in which case it is relocated.
+
+   Returns 0 on success and -1 on error. */
+
+int
+gdbm_update (GDBM_FILE dbf, datum key, gdbm_update_func func, void *data)
+{
+  int elem_loc;
+  char *find_data;
+  char *copy = NULL;
+  datum content;
+  int rc;
+
+  GDBM_DEBUG_DATUM (GDBM_DEBUG_STORE, key, "%s: updating key:", dbf->name);
+
+  /* Return immediately if the database needs recovery */
+  GDBM_ASSERT_CONSISTENCY (dbf, -1);
+
+  if (dbf->read_write == GDBM_READER)
+    {
+      GDBM_SET_ERRNO2 (dbf, GDBM_READER_CANT_STORE, FALSE,
+		       GDBM_DEBUG_STORE);
+      return -1;
+    }
+
+  if (key.dptr == NULL)
+    {
+      GDBM_SET_ERRNO2 (dbf, GDBM_MALFORMED_DATA, FALSE, GDBM_DEBUG_STORE);
+      return -1;
+    }
+
+  if (func == NULL)
+    {
+      GDBM_SET_ERRNO (dbf, GDBM_ERR_USAGE, FALSE);
+      return -1;
+    }
+
+  /* Initialize the gdbm_errno variable. */
+  gdbm_set_errno (dbf, GDBM_NO_ERROR, FALSE);
+
+  elem_loc = _gdbm_findkey (dbf, key, &find_data, NULL);
+  if (elem_loc == -1)
+    {
+      if (gdbm_errno != GDBM_ITEM_NOT_FOUND)
+	return -1;
+      gdbm_set_errno (dbf, GDBM_NO_ERROR, FALSE);
+      content.dptr = NULL;
+      content.dsize = 0;
+    }
+  else
+    {
+      /* Don't let FUNC modify the data cache. */
+      content.dsize = dbf->cache_mru->ca_data.data_size;
+      copy = malloc (content.dsize ? content.dsize : 1);
+      if (!copy)
+	{
+	  GDBM_SET_ERRNO2 (dbf, GDBM_MALLOC_ERROR, FALSE, GDBM_DEBUG_STORE);
+	  return -1;
+	}
+      memcpy (copy, find_data, content.dsize);
+      content.dptr = copy;
+    }
+
+  switch (func (key, &content, data))
+    {
+    case GDBM_UPDATE_KEEP:
+      free (copy);
+      return 0;
+
+    case GDBM_UPDATE_DELETE:
+      if (elem_loc == -1)
+	return 0;
+      rc = _gdbm_delete_record (dbf, key, NULL);
+      break;
+
+    case GDBM_UPDATE_STORE:
+      if (content.dptr == NULL || content.dsize < 0)
+	{
+	  GDBM_SET_ERRNO2 (dbf, GDBM_MALFORMED_DATA, FALSE,
+			   GDBM_DEBUG_STORE);
+	  rc = -1;
+	  break;
+	}
+      /* FUNC may have read from the database, which changes the
+	 current bucket and the data cache, so look the key up again. */
+      if (elem_loc != -1
+	  && (elem_loc = _gdbm_findkey (dbf, key, &find_data, NULL)) == -1)
+	{
+	  if (gdbm_errno != GDBM_ITEM_NOT_FOUND)
+	    {
+	      rc = -1;
+	      break;
+	    }
+	  gdbm_set_errno (dbf, GDBM_NO_ERROR, FALSE);
+	}
+      /* Records that fit into the bucket element are stored there.
+	 Compressed data have to be encoded anew. */
+      if (elem_loc != -1
+	  && content.dsize <= dbf->bucket->h_table[elem_loc].data_size
+	  && !gdbm_record_inline_p (dbf, (size_t) key.dsize + content.dsize)
+	  && !bucket_element_encoded_p (dbf,
+					&dbf->bucket->h_table[elem_loc]))
+	rc = update_in_place (dbf, elem_loc, find_data, content);
+      else
+	rc = _gdbm_store_record (dbf, key, content, GDBM_REPLACE);
+      break;
+
+    default:
+      GDBM_SET_ERRNO (dbf, GDBM_ERR_USAGE, FALSE);
+      rc = -1;
+    }
+
+  free (copy);
+  if (rc)
+    return -1;
+
+  /* Write everything that is needed to the disk. */
+  return _gdbm_end_update (dbf);
+}
@@ -43,17 +43,88 @@ _gdbm_hash (datum key)
   return((int) value);
 }
 
+/* The hash function for large databases.  It computes a 64-bit FNV-1a
+   hash of the key and mixes it with the MurmurHash3 finalizer, so that
+   both halves of the result depend on all bytes of the key. */
+uint64_t
+_gdbm_hash64 (datum key)
+{
+  uint64_t value = 0xcbf29ce484222325ull;
+  int index;
+
+  for (index = 0; index < key.dsize; index++)
+    {
+      value ^= (unsigned char) key.dptr[index];
+      value *= 0x100000001b3ull;
+    }
+
+  value ^= value >> 33;
+  value *= 0xff51afd7ed558ccdull;
+  value ^= value >> 33;
+  value *= 0xc4ceb9fe1a85ec53ull;
+  value ^= value >> 33;
+  return value;
+}
+
 int
 _gdbm_bucket_dir (GDBM_FILE dbf, int hash)
 {
   return hash >> (GDBM_HASH_BITS - dbf->header->dir_bits);
 }
 
+/* Compute the hash value of KEY, the directory index of its bucket and
+   its home slot in the bucket.  If KEY_START is not NULL, store there the
+   SMALL bytes expected in the key_start field of its bucket element. */
 void
-_gdbm_hash_key (GDBM_FILE dbf, datum key, int *hash, int *bucket, int *offset)
+_gdbm_hash_key_start (GDBM_FILE dbf, datum key, int *hash, int *bucket,
+		      int *offset, char *key_start)
 {
-  int hashval = _gdbm_hash (key);
+  int hashval;
+
+  if (gdbm_large_p (dbf))
+    {
+      uint64_t value = _gdbm_hash64 (key);
+      uint32_t dirhash = value >> (64 - GDBM_DIR_HASH_BITS);
+
+      hashval = value & 0x7FFFFFFF;
+      *bucket = dirhash >> (GDBM_DIR_HASH_BITS - dbf->header->dir_bits);
+      if (key_start)
+	memcpy (key_start, &dirhash, SMALL);
+    }
+  else
+    {
+      hashval = _gdbm_hash (key);
+      *bucket = _gdbm_bucket_dir (dbf, hashval);
+      if (key_start)
+	{
+	  memset (key_start, 0, SMALL);
+	  memcpy (key_start, key.dptr, SMALL < key.dsize ? SMALL : key.dsize);
+	}
+    }
   *hash = hashval;
-  *bucket = _gdbm_bucket_dir (dbf, hashval);
   *offset = hashval % dbf->header->bucket_elems;
 }
+
+void
+_gdbm_hash_key (GDBM_FILE dbf, datum key, int *hash, int *bucket, int *offset)
+{
+  _gdbm_hash_key_start (dbf, key, hash, bucket, offset, NULL);
+}
+
+/* Store the SMALL bytes to be kept in the key_start field of the bucket
+   element of KEY in KEY_START. */
+void
+_gdbm_key_start (GDBM_FILE dbf, datum key, char *key_start)
+{
+  if (gdbm_large_p (dbf))
+    {
+      int hash, bucket, offset;
+
+      _gdbm_hash_key_start (dbf, key, &hash, &bucket, &offset, key_start);
+    }
+  else
+    {
+      memset (key_start, 0, SMALL);
+      memcpy (key_start, key.dptr, SMALL < key.dsize ? SMALL : key.dsize);
+    }
+}
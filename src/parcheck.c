@@ -0,0 +1,366 @@
+/* parcheck.c - Check and read all buckets of a database in several
+   threads. */
+
+/* This file is part of GDBM, the GNU data base manager.
+   Copyright (C) 2025 Free Software Foundation, Inc.
+
+   GDBM is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3, or (at your option)
+   any later version.
+
+   GDBM is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with GDBM. If not, see <http://www.gnu.org/licenses/>.   */
+
+/* Include system configuration before all else. */
+#include "autoconf.h"
+
+#include "gdbmdefs.h"
+
+/*
+ * Passes over all buckets, such as gdbm_count and the consistency check
+ * of gdbm_recover, normally load the buckets one by one through the
+ * bucket cache.  On large files these passes are bound by the latency
+ * of the reads.  If the number of check threads of the database (see
+ * GDBM_SETCHECKTHREADS) is greater than one, _gdbm_check_buckets splits
+ * the directory in as many ranges and lets each thread check the
+ * buckets of its range.  The threads read the buckets and keys with
+ * pread into their own buffers, so that the state of the database,
+ * including its bucket cache, is left untouched.  The results are then
+ * merged in directory order, so that the error reported is the one the
+ * sequential pass would have found first.  The recovery (see recover.c)
+ * reads the records to salvage in the same way.
+ */
+
+struct check_part
+{
+  GDBM_FILE dbf;
+  int flags;                 /* CHECK_ flags */
+  int start;                 /* First directory index of the range */
+  int end;                   /* Directory index past the range */
+  off_t file_size;           /* Size of the database file */
+  char *buf;                 /* Bucket image read from the disk */
+  hash_bucket *bucket;       /* Decoded bucket */
+  char *key;                 /* Key buffer */
+  size_t key_size;           /* Its size */
+  gdbm_count_t count;        /* Number of records found */
+  int ec;                    /* Error code (GDBM_NO_ERROR if none) */
+  int syserror;              /* System error, for read errors */
+};
+
+/* Read exactly SIZE bytes at ADR of DBF into BUF, without changing the
+   state of DBF, so that several threads can read at once.  Return
+   GDBM_NO_ERROR on success, or the error code.  For read errors, the
+   system error is stored in *PSYSERROR. */
+int
+_gdbm_pread (GDBM_FILE dbf, off_t adr, void *buf, size_t size,
+	     int *psyserror)
+{
+  char *ptr = buf;
+
+  while (size)
+    {
+      ssize_t n = pread (dbf->desc, ptr, size, adr);
+
+      if (n == -1)
+	{
+	  if (errno == EINTR)
+	    continue;
+	  *psyserror = errno;
+	  return GDBM_FILE_READ_ERROR;
+	}
+      if (n == 0)
+	return GDBM_FILE_EOF;
+      ptr += n;
+      adr += n;
+      size -= n;
+    }
+  return GDBM_NO_ERROR;
+}
+
+/* Check the record of the element ELEM of the bucket at directory index
+   DIR_INDEX: its location must be within the file, and its key must hash
+   to that bucket and match the hash value and key start of ELEM. */
+static int
+check_record (struct check_part *part, int dir_index, bucket_element *elem)
+{
+  GDBM_FILE dbf = part->dbf;
+  char inline_buf[INLINE_RECORD_SIZE];
+  char key_start[SMALL];
+  int hashval, bucket, off;
+  datum key;
+
+  if (elem->key_size < 0 || elem->data_size < 0)
+    {
+      part->ec = GDBM_BAD_HASH_TABLE;
+      return -1;
+    }
+
+  key.dsize = elem->key_size;
+  if (bucket_element_inline_p (dbf, elem))
+    {
+      bucket_element_inline_get (elem, inline_buf);
+      key.dptr = inline_buf;
+    }
+  else
+    {
+      off_t size = (off_t) elem->key_size + elem->data_size;
+
+      if (!off_t_sum_ok (elem->data_pointer, size)
+	  || elem->data_pointer < dbf->header->block_size
+	  || elem->data_pointer + size > part->file_size)
+	{
+	  part->ec = GDBM_BAD_HASH_TABLE;
+	  return -1;
+	}
+      if (key.dsize > part->key_size)
+	{
+	  char *p = realloc (part->key, key.dsize);
+
+	  if (!p)
+	    {
+	      part->ec = GDBM_MALLOC_ERROR;
+	      return -1;
+	    }
+	  part->key = p;
+	  part->key_size = key.dsize;
+	}
+      if ((part->ec = _gdbm_pread (dbf, elem->data_pointer, part->key,
+				   key.dsize, &part->syserror))
+	  != GDBM_NO_ERROR)
+	return -1;
+      key.dptr = part->key;
+    }
+
+  _gdbm_hash_key_start (dbf, key, &hashval, &bucket, &off, key_start);
+  if (hashval != elem->hash_value
+      || memcmp (elem->key_start, key_start,
+		 gdbm_key_start_len (dbf, key.dsize))
+      || bucket >= GDBM_DIR_COUNT (dbf)
+      || gdbm_dir_entry (dbf, bucket) != gdbm_dir_entry (dbf, dir_index))
+    {
+      part->ec = GDBM_BAD_HASH_ENTRY;
+      return -1;
+    }
+  return 0;
+}
+
+/* Check the buckets whose first directory entry lies in the range of
+   PART.  Stop at the first problem found. */
+static void
+check_range (void *arg)
+{
+  struct check_part *part = arg;
+  GDBM_FILE dbf = part->dbf;
+  int i, j;
+
+  for (i = part->start; i < part->end; i++)
+    {
+      if (i > 0 && gdbm_dir_entry (dbf, i) == gdbm_dir_entry (dbf, i-1))
+	continue;
+      if (!gdbm_dir_entry_valid_p (dbf, i))
+	{
+	  part->ec = GDBM_BAD_DIR_ENTRY;
+	  return;
+	}
+      if ((part->ec = _gdbm_pread (dbf, gdbm_dir_entry (dbf, i), part->buf,
+				   dbf->header->bucket_size, &part->syserror))
+	  != GDBM_NO_ERROR)
+	return;
+      if ((part->ec = _gdbm_bucket_decode (dbf, part->buf, part->bucket))
+	  != GDBM_NO_ERROR)
+	return;
+      part->count += part->bucket->count;
+
+      if (part->flags & CHECK_RECORDS)
+	for (j = 0; j < dbf->header->bucket_elems; j++)
+	  {
+	    bucket_element *elem = &part->bucket->h_table[j];
+
+	    if (elem->hash_value != -1 && check_record (part, i, elem))
+	      return;
+	  }
+    }
+}
+
+/* Return the number of threads to use for passes over all buckets of
+   DBF. */
+int
+_gdbm_thread_count (GDBM_FILE dbf)
+{
+  int n = dbf->check_threads;
+
+#if HAVE_PTHREAD_H
+  if (n == 0)
+    {
+# ifdef _SC_NPROCESSORS_ONLN
+      long ncpu = sysconf (_SC_NPROCESSORS_ONLN);
+
+      n = ncpu < 1 ? 1
+	    : ncpu > GDBM_MAX_CHECK_THREADS ? GDBM_MAX_CHECK_THREADS
+	    : ncpu;
+# else
+      n = 1;
+# endif
+    }
+  /* Each thread must get at least one directory entry. */
+  if (n > GDBM_DIR_COUNT (dbf))
+    n = GDBM_DIR_COUNT (dbf);
+#else
+  n = 1;
+#endif
+  return n;
+}
+
+#if HAVE_PTHREAD_H
+struct thread_arg
+{
+  void (*func) (void *);
+  void *arg;
+};
+
+static void *
+thread_start (void *ptr)
+{
+  struct thread_arg *ta = ptr;
+
+  ta->func (ta->arg);
+  return NULL;
+}
+#endif
+
+/* Call FUNC for each of the NPARTS elements of the array PARTS, whose
+   elements are SIZE bytes long, each in a thread of its own.  The
+   calling thread takes the first element itself, as well as those that
+   could not be given to a new thread.  Return when all calls are
+   done. */
+void
+_gdbm_run_parts (void (*func) (void *), void *parts, size_t size, int nparts)
+{
+  char *base = parts;
+  int i;
+#if HAVE_PTHREAD_H
+  pthread_t *tids = NULL;
+  struct thread_arg *args = NULL;
+  int nthreads = 1;
+
+  if (nparts > 1)
+    {
+      tids = calloc (nparts, sizeof (tids[0]));
+      args = calloc (nparts, sizeof (args[0]));
+      if (tids && args)
+	for (; nthreads < nparts; nthreads++)
+	  {
+	    args[nthreads].func = func;
+	    args[nthreads].arg = base + nthreads * size;
+	    if (pthread_create (&tids[nthreads], NULL, thread_start,
+				&args[nthreads]))
+	      break;
+	  }
+    }
+  for (i = 0; i < nparts; i++)
+    if (i == 0 || i >= nthreads)
+      func (base + i * size);
+  for (i = 1; i < nthreads; i++)
+    pthread_join (tids[i], NULL);
+  free (tids);
+  free (args);
+#else
+  for (i = 0; i < nparts; i++)
+    func (base + i * size);
+#endif
+}
+
+/* Return true if the buckets of DBF are to be checked in several
+   threads. */
+int
+_gdbm_check_parallel_p (GDBM_FILE dbf)
+{
+  return _gdbm_thread_count (dbf) > 1;
+}
+
+/* Check all buckets of DBF, splitting the work between its check
+   threads.  FLAGS is a combination of CHECK_ flags.  On success, store
+   the number of records in *PCOUNT (unless it is NULL) and return 0.
+   Otherwise, set the error code of DBF to that of the first problem
+   found, in directory order, and return -1. */
+int
+_gdbm_check_buckets (GDBM_FILE dbf, int flags, gdbm_count_t *pcount)
+{
+  int nparts = _gdbm_thread_count (dbf);
+  int dir_count = GDBM_DIR_COUNT (dbf);
+  struct check_part *parts;
+  off_t file_size;
+  gdbm_count_t count = 0;
+  int i;
+  int rc = 0;
+
+  /* The threads read the disk: make sure it is up to date. */
+  if (dbf->read_write && _gdbm_cache_flush (dbf))
+    return -1;
+  if (_gdbm_file_size (dbf, &file_size))
+    return -1;
+
+  parts = calloc (nparts, sizeof (parts[0]));
+  if (!parts)
+    {
+      GDBM_SET_ERRNO (dbf, GDBM_MALLOC_ERROR, FALSE);
+      return -1;
+    }
+  for (i = 0; i < nparts; i++)
+    {
+      struct check_part *part = &parts[i];
+
+      part->dbf = dbf;
+      part->flags = flags;
+      part->start = (long long) dir_count * i / nparts;
+      part->end = (long long) dir_count * (i + 1) / nparts;
+      part->file_size = file_size;
+      part->ec = GDBM_NO_ERROR;
+      part->buf = malloc (dbf->header->bucket_size);
+      part->bucket = gdbm_compact_buckets_p (dbf)
+	               ? malloc (dbf->bucket_mem_size)
+	               : (hash_bucket *) part->buf;
+      if (!part->buf || !part->bucket)
+	{
+	  GDBM_SET_ERRNO (dbf, GDBM_MALLOC_ERROR, FALSE);
+	  rc = -1;
+	}
+    }
+
+  if (rc == 0)
+    {
+      _gdbm_run_parts (check_range, parts, sizeof (parts[0]), nparts);
+
+      for (i = 0; i < nparts; i++)
+	{
+	  if (parts[i].ec != GDBM_NO_ERROR)
+	    {
+	      errno = parts[i].syserror;
+	      GDBM_SET_ERRNO (dbf, parts[i].ec,
+			      parts[i].ec != GDBM_MALLOC_ERROR);
+	      rc = -1;
+	      break;
+	    }
+	  count += parts[i].count;
+	}
+    }
+
+  for (i = 0; i < nparts; i++)
+    {
+      if ((char *) parts[i].bucket != parts[i].buf)
+	free (parts[i].bucket);
+      free (parts[i].buf);
+      free (parts[i].key);
+    }
+  free (parts);
+
+  if (rc == 0 && pcount)
+    *pcount = count;
+  return rc;
+}
@@ -20,12 +20,21 @@
 /* From bucket.c */
 void _gdbm_new_bucket	(GDBM_FILE, hash_bucket *, int);
 int _gdbm_get_bucket	(GDBM_FILE, int);
+int _gdbm_bucket_decode (GDBM_FILE, char const *, hash_bucket *);
 
-int _gdbm_split_bucket (GDBM_FILE, int);
+int _gdbm_bucket_reserve (GDBM_FILE, int *, bucket_element const *);
+int _gdbm_bucket_slot (GDBM_FILE, hash_bucket *, int);
+int _gdbm_bucket_encode (GDBM_FILE, hash_bucket const *, char *);
 int _gdbm_write_bucket (GDBM_FILE, cache_elem *);
 int _gdbm_cache_init   (GDBM_FILE, size_t);
 void _gdbm_cache_free  (GDBM_FILE dbf);
 int _gdbm_cache_flush  (GDBM_FILE dbf);
+int _gdbm_cache_set_mem (GDBM_FILE dbf, size_t size);
+size_t _gdbm_cache_mem_usage (GDBM_FILE dbf);
+void _gdbm_cache_data_resized (GDBM_FILE dbf, size_t oldsize, size_t newsize);
+void _gdbm_cache_transfer (GDBM_FILE dbf, GDBM_FILE new_dbf);
+int _gdbm_cache_pool_attach (GDBM_FILE dbf, gdbm_cache_pool *pool);
+void _gdbm_cache_pool_detach (GDBM_FILE dbf);
 
 /* Mark current bucket as changed. */
 static inline void
@@ -34,6 +43,85 @@ _gdbm_current_bucket_changed (GDBM_FILE dbf)
   dbf->cache_mru->ca_changed = TRUE;
 }
 
+/* Return true if DBF is in the large format (wide hash values and large
+   directory). */
+static inline int
+gdbm_large_p (GDBM_FILE dbf)
+{
+  return dbf->header->header_magic == GDBM_FEATURE_MAGIC
+         && (dbf->xheader->features & GDBM_FEATURE_LARGE);
+}
+
+/* Return true if the directory of DBF is made of segments. */
+static inline int
+gdbm_segdir_p (GDBM_FILE dbf)
+{
+  return dbf->header->header_magic == GDBM_FEATURE_MAGIC
+         && (dbf->xheader->features & GDBM_FEATURE_SEGDIR);
+}
+
+/* Return the number of entries in the hash directory of DBF. */
+static inline int
+gdbm_dir_count (GDBM_FILE dbf)
+{
+  if (gdbm_segdir_p (dbf))
+    return 1 << dbf->header->dir_bits;
+  return gdbm_large_p (dbf)
+           ? dbf->header->dir_size
+           : (int) (dbf->header->dir_size / sizeof (off_t));
+}
+
+/* Return the segment of the directory of DBF that holds the entry at
+   DIR_INDEX, and store the index of the entry in the segment in
+   *SEG_INDEX. */
+static inline dir_segment *
+gdbm_dir_segment (GDBM_FILE dbf, int dir_index, int *seg_index)
+{
+  int bits = dbf->header->dir_bits;
+  dir_segment *seg = dbf->dir_seg[dir_index >> (bits - dbf->dir_top_bits)];
+
+  *seg_index = (dir_index >> (bits - seg->hdr.prefix_bits - seg->hdr.depth))
+               & ((1 << seg->hdr.depth) - 1);
+  return seg;
+}
+
+/* Return the directory entry of DBF at DIR_INDEX. */
+static inline off_t
+gdbm_dir_entry (GDBM_FILE dbf, int dir_index)
+{
+  if (gdbm_segdir_p (dbf))
+    {
+      int n;
+      dir_segment *seg = gdbm_dir_segment (dbf, dir_index, &n);
+
+      return seg->entry[n];
+    }
+  return dbf->dir[dir_index];
+}
+
+/* Return the top BITS bits of the directory hash of ELEM. */
+static inline int
+bucket_element_dir_index (GDBM_FILE dbf, bucket_element const *elem,
+			  int bits)
+{
+  if (gdbm_large_p (dbf))
+    {
+      uint32_t h;
+
+      memcpy (&h, elem->key_start, sizeof (h));
+      return h >> (GDBM_DIR_HASH_BITS - bits);
+    }
+  return elem->hash_value >> (GDBM_HASH_BITS - bits);
+}
+
+/* Return the number of bytes of the key_start field of an element with
+   key of KEY_SIZE bytes that are significant. */
+static inline int
+gdbm_key_start_len (GDBM_FILE dbf, int key_size)
+{
+  return (gdbm_large_p (dbf) || key_size > SMALL) ? SMALL : key_size;
+}
+
 /* Return true if the directory entry at DIR_INDEX can be considered
    valid. This means that DIR_INDEX is in the valid range for addressing
    the dir array, and the offset stored in dir[DIR_INDEX] points past
@@ -46,24 +134,209 @@ gdbm_dir_entry_valid_p (GDBM_FILE dbf, int dir_index)
 {
   return dir_index >= 0
          && dir_index < GDBM_DIR_COUNT (dbf)
-         && dbf->dir[dir_index] >= dbf->header->block_size;
+         && gdbm_dir_entry (dbf, dir_index) >= dbf->header->block_size;
 }
 
 
+/* From gdbmstore.c */
+int _gdbm_store_record (GDBM_FILE dbf, datum key, datum content, int flags);
+int _gdbm_store_element (GDBM_FILE dbf, datum key, int elem_loc, int hash_val,
+			 off_t file_adr, int data_size);
+
+/* From gdbmdelete.c */
+int _gdbm_delete_record (GDBM_FILE dbf, datum key, avail_elem *freed);
+
+/* From shmcache.c */
+int _gdbm_shm_cache_open (GDBM_FILE dbf, size_t size);
+void _gdbm_shm_cache_close (GDBM_FILE dbf);
+void _gdbm_shm_cache_remove (GDBM_FILE dbf);
+int _gdbm_shm_cache_get (GDBM_FILE dbf, off_t adr, hash_bucket *bucket);
+void _gdbm_shm_cache_put (GDBM_FILE dbf, off_t adr, hash_bucket const *bucket);
+
 /* From falloc.c */
 off_t _gdbm_alloc       (GDBM_FILE, int);
 int  _gdbm_free         (GDBM_FILE, off_t, int);
+off_t _gdbm_alloc_large (GDBM_FILE, off_t);
+int  _gdbm_free_large   (GDBM_FILE, off_t, off_t);
+int  _gdbm_extend       (GDBM_FILE, off_t, int);
 void _gdbm_put_av_elem  (avail_elem, avail_elem [], int *, int);
 int _gdbm_avail_block_read (GDBM_FILE dbf, avail_block *avblk, size_t size);
+avail_elem _gdbm_get_block (int size, GDBM_FILE dbf);
+
+/* From avindex.c */
+int _gdbm_avail_index_get (GDBM_FILE dbf, int size, avail_elem *ret);
+int _gdbm_avail_index_put (GDBM_FILE dbf, avail_elem elem);
+int _gdbm_avail_index_take (GDBM_FILE dbf, off_t adr, int size,
+			    avail_elem *ret);
+int _gdbm_avail_index_flush (GDBM_FILE dbf);
+int _gdbm_avail_index_save (GDBM_FILE dbf);
+void _gdbm_avail_index_free (GDBM_FILE dbf);
 
 /* From findkey.c */
 char *_gdbm_read_entry  (GDBM_FILE, int);
+char *_gdbm_read_key    (GDBM_FILE, int);
 int _gdbm_findkey       (GDBM_FILE, datum, char **, int *);
+int _gdbm_findkey_loc   (GDBM_FILE, datum, int *);
+
+/* Return true if DBF keeps tiny records in bucket elements. */
+static inline int
+gdbm_inline_records_p (GDBM_FILE dbf)
+{
+  return dbf->header->header_magic == GDBM_FEATURE_MAGIC
+         && (dbf->xheader->features & GDBM_FEATURE_INLINE);
+}
+
+/* Return true if DBF stores buckets in compact encoding. */
+static inline int
+gdbm_compact_buckets_p (GDBM_FILE dbf)
+{
+  return dbf->header->header_magic == GDBM_FEATURE_MAGIC
+         && (dbf->xheader->features & GDBM_FEATURE_COMPACT);
+}
+
+/* Return true if DBF places bucket elements using the Robin Hood
+   policy. */
+static inline int
+gdbm_robin_hood_p (GDBM_FILE dbf)
+{
+  return dbf->header->header_magic == GDBM_FEATURE_MAGIC
+         && (dbf->xheader->features & GDBM_FEATURE_ROBINHOOD);
+}
+
+/* Return true if DBF compresses record data. */
+static inline int
+gdbm_compressed_p (GDBM_FILE dbf)
+{
+  return dbf->header->header_magic == GDBM_FEATURE_MAGIC
+         && (dbf->xheader->features & GDBM_FEATURE_COMPRESS);
+}
+
+/* Return true if DBF shares identical record data. */
+static inline int
+gdbm_dedup_p (GDBM_FILE dbf)
+{
+  return dbf->header->header_magic == GDBM_FEATURE_MAGIC
+         && (dbf->xheader->features & GDBM_FEATURE_DEDUP);
+}
+
+/* Return true if data of SIZE bytes are stored in DBF in encoded
+   form. */
+static inline int
+gdbm_data_encoded_p (GDBM_FILE dbf, size_t size)
+{
+  return (gdbm_compressed_p (dbf) || gdbm_dedup_p (dbf))
+         && size >= dbf->xheader->encode_min;
+}
+
+/* Return the format of DBF, as returned by GDBM_GETDBFORMAT. */
+static inline int
+gdbm_db_format (GDBM_FILE dbf)
+{
+  return (dbf->xheader ? GDBM_NUMSYNC : 0)
+         | (gdbm_inline_records_p (dbf) ? GDBM_INLINE : 0)
+         | (gdbm_compact_buckets_p (dbf) ? GDBM_COMPACT : 0)
+         | (gdbm_robin_hood_p (dbf) ? GDBM_ROBINHOOD : 0)
+         | (gdbm_large_p (dbf) ? GDBM_LARGE : 0)
+         | (gdbm_compressed_p (dbf) ? GDBM_COMPRESS : 0)
+         | (gdbm_dedup_p (dbf) ? GDBM_DEDUP : 0)
+         | (gdbm_segdir_p (dbf) ? GDBM_SEGDIR : 0);
+}
+
+/* Return the distance of the element at ELEM_LOC of BUCKET from its home
+   slot. */
+static inline int
+bucket_element_distance (GDBM_FILE dbf, hash_bucket const *bucket,
+			 int elem_loc)
+{
+  int n = dbf->header->bucket_elems;
+
+  return (elem_loc - bucket->h_table[elem_loc].hash_value % n + n) % n;
+}
+
+/* Return true if a lookup that started at HOME_LOC can stop at the
+   occupied slot ELEM_LOC of the current bucket.  With Robin Hood
+   placement, the key would have been placed before any element closer
+   to its home slot than the key is to HOME_LOC. */
+static inline int
+bucket_probe_end_p (GDBM_FILE dbf, int home_loc, int elem_loc)
+{
+  int n = dbf->header->bucket_elems;
+
+  return gdbm_robin_hood_p (dbf)
+         && bucket_element_distance (dbf, dbf->bucket, elem_loc)
+	      < (elem_loc - home_loc + n) % n;
+}
+
+/* Return true if a record of SIZE bytes (key and data) is to be kept
+   in its bucket element. */
+static inline int
+gdbm_record_inline_p (GDBM_FILE dbf, size_t size)
+{
+  return size <= INLINE_RECORD_SIZE && gdbm_inline_records_p (dbf);
+}
+
+/* Return true if the record of bucket element ELEM is kept in the
+   element itself. */
+static inline int
+bucket_element_inline_p (GDBM_FILE dbf, bucket_element const *elem)
+{
+  return elem->key_size >= 0 && elem->data_size >= 0
+         && gdbm_record_inline_p (dbf, (size_t) elem->key_size
+				        + elem->data_size);
+}
+
+/* Return true if the data of the record of bucket element ELEM are
+   stored in encoded form. */
+static inline int
+bucket_element_encoded_p (GDBM_FILE dbf, bucket_element const *elem)
+{
+  return elem->data_size >= 0
+         && gdbm_data_encoded_p (dbf, elem->data_size);
+}
+
+/* Return true if the data cache of the current bucket holds the whole
+   record of the element ELEM_LOC, and not only its key. */
+static inline int
+gdbm_record_cached_p (GDBM_FILE dbf, int elem_loc)
+{
+  return dbf->cache_mru->ca_data.elem_loc == elem_loc
+         && !dbf->cache_mru->ca_data.key_only;
+}
+
+/* Copy the inline record of ELEM (key followed by data) to BUF. */
+static inline void
+bucket_element_inline_get (bucket_element const *elem, char *buf)
+{
+  size_t size = elem->key_size + elem->data_size;
+
+  memcpy (buf, elem->key_start, size < SMALL ? size : SMALL);
+  if (size > SMALL)
+    memcpy (buf + SMALL, &elem->data_pointer, size - SMALL);
+}
+
+/* Store KEY and CONTENT in ELEM as an inline record. */
+static inline void
+bucket_element_inline_set (bucket_element *elem, datum key, datum content)
+{
+  char buf[INLINE_RECORD_SIZE];
+
+  memset (buf, 0, sizeof (buf));
+  memcpy (buf, key.dptr, key.dsize);
+  memcpy (buf + key.dsize, content.dptr, content.dsize);
+  memcpy (elem->key_start, buf, SMALL);
+  memcpy (&elem->data_pointer, buf + SMALL, sizeof (elem->data_pointer));
+  elem->key_size = key.dsize;
+  elem->data_size = content.dsize;
+}
 
 /* From hash.c */
 int _gdbm_hash (datum);
+uint64_t _gdbm_hash64 (datum);
 void _gdbm_hash_key (GDBM_FILE dbf, datum key, int *hash, int *bucket,
 		     int *offset);
+void _gdbm_hash_key_start (GDBM_FILE dbf, datum key, int *hash, int *bucket,
+			   int *offset, char *key_start);
+void _gdbm_key_start (GDBM_FILE dbf, datum key, char *key_start);
 int _gdbm_bucket_dir (GDBM_FILE dbf, int hash);
 
 /* From update.c */
@@ -77,6 +350,9 @@ int _gdbm_file_size (GDBM_FILE dbf, off_t *psize);
 
 /* From gdbmload.c */
 int _gdbm_str2fmt (char const *str);
+/* Maximum length of a database format name (see _gdbm_fmt2str) */
+#define GDBM_FMT_NAME_MAX 64
+char *_gdbm_fmt2str (int fmt, char *buf);
 
 /* From mmap.c */
 int _gdbm_mapped_init	(GDBM_FILE);
@@ -94,6 +370,8 @@ int _gdbm_lock_file_wait (GDBM_FILE, struct gdbm_open_spec const *);
 /* From fullio.c */
 int _gdbm_full_read (GDBM_FILE, void *, size_t);
 int _gdbm_full_write (GDBM_FILE, void *, size_t);
+int _gdbm_read_at (GDBM_FILE, off_t, void *, size_t);
+int _gdbm_write_at (GDBM_FILE, off_t, void const *, size_t);
 int _gdbm_file_extend (GDBM_FILE dbf, off_t size);
 
 /* From base64.c */
@@ -107,12 +385,107 @@ int _gdbm_base64_decode (const unsigned char *input, size_t input_len,
 int _gdbm_load (FILE *fp, GDBM_FILE *pdbf, unsigned long *line);
 int _gdbm_dump (GDBM_FILE dbf, FILE *fp);
 
+/* Variable-length integers: 7 bits per byte, least significant first,
+   the high bit set in all bytes but the last. */
+
+/* Return the number of bytes needed to encode N as a varint. */
+static inline int
+varint_size (uintmax_t n)
+{
+  int size = 1;
+
+  while (n >= 0x80)
+    {
+      n >>= 7;
+      size++;
+    }
+  return size;
+}
+
+/* Encode N as a varint at P.  Return the pointer past it. */
+static inline unsigned char *
+varint_put (unsigned char *p, uintmax_t n)
+{
+  while (n >= 0x80)
+    {
+      *p++ = (n & 0x7f) | 0x80;
+      n >>= 7;
+    }
+  *p++ = n;
+  return p;
+}
+
+/* Decode a varint at P, not looking past END, and store it in *RET.
+   Return the pointer past it, or NULL if the varint is malformed or
+   its value exceeds MAX. */
+static inline unsigned char const *
+varint_get (unsigned char const *p, unsigned char const *end, uintmax_t max,
+	    uintmax_t *ret)
+{
+  uintmax_t n = 0;
+  int shift = 0;
+
+  do
+    {
+      if (p == end || shift >= 64)
+	return NULL;
+      n |= (uintmax_t) (*p & 0x7f) << shift;
+      shift += 7;
+    }
+  while (*p++ & 0x80);
+
+  if (n > max)
+    return NULL;
+  *ret = n;
+  return p;
+}
+
+/* From compress.c */
+size_t _gdbm_lz_compress (unsigned char const *src, size_t len,
+			  unsigned char *dst, size_t size);
+int _gdbm_lz_decompress (unsigned char const *src, size_t len,
+			 unsigned char *dst, size_t size);
+int _gdbm_encode_data (GDBM_FILE dbf, datum *content);
+int _gdbm_decode_data (GDBM_FILE dbf, data_cache_elem *data_ca);
+
+/* From dedup.c */
+int _gdbm_dedup_store (GDBM_FILE dbf, datum *content);
+int _gdbm_dedup_read (GDBM_FILE dbf, data_cache_elem *data_ca);
+int _gdbm_dedup_release (GDBM_FILE dbf, bucket_element const *elem);
+int _gdbm_dedup_flush (GDBM_FILE dbf);
+int _gdbm_dedup_index_save (GDBM_FILE dbf);
+void _gdbm_dedup_index_free (GDBM_FILE dbf);
+
 /* From recover.c */
 int _gdbm_next_bucket_dir (GDBM_FILE dbf, int bucket_dir);
+int _gdbm_rebuild (GDBM_FILE dbf, int format);
+
+/* From parcheck.c */
+/* Check the location and the key of each record as well */
+#define CHECK_RECORDS 0x1
+int _gdbm_pread (GDBM_FILE dbf, off_t adr, void *buf, size_t size,
+		 int *psyserror);
+int _gdbm_thread_count (GDBM_FILE dbf);
+void _gdbm_run_parts (void (*func) (void *), void *parts, size_t size,
+		      int nparts);
+int _gdbm_check_parallel_p (GDBM_FILE dbf);
+int _gdbm_check_buckets (GDBM_FILE dbf, int flags, gdbm_count_t *pcount);
+
+/* From segdir.c */
+off_t _gdbm_dir_top_disk_size (GDBM_FILE dbf, int n);
+void _gdbm_segdir_free (GDBM_FILE dbf);
+int _gdbm_segdir_create (GDBM_FILE dbf, off_t *padr);
+int _gdbm_segdir_read (GDBM_FILE dbf);
+int _gdbm_segdir_write (GDBM_FILE dbf);
+int _gdbm_segdir_deepen (GDBM_FILE dbf, int dir_index, int bits,
+			 off_t *old_adr, off_t *old_size, int *old_count);
+void _gdbm_dir_set (GDBM_FILE dbf, int start, int end, off_t adr);
+size_t _gdbm_dir_mem_size (GDBM_FILE dbf);
 
 
 /* avail.c */
 int gdbm_avail_block_validate (GDBM_FILE dbf, avail_block *avblk, size_t size);
+int gdbm_bucket_avail_table_valid_p (GDBM_FILE dbf, hash_bucket *bucket);
 int gdbm_bucket_avail_table_validate (GDBM_FILE dbf, hash_bucket *bucket);
 int gdbm_avail_traverse (GDBM_FILE dbf,
 			 int (*cb) (avail_block *, off_t, void *),
@@ -150,6 +523,27 @@ gdbm_file_seek (GDBM_FILE dbf, off_t off, int whence)
 #endif
 }
 
+/* Allocate SIZE bytes for the data returned to the caller. */
+static inline void *
+_gdbm_result_alloc (GDBM_FILE dbf, size_t size)
+{
+  if (dbf->result_alloc.alloc)
+    return dbf->result_alloc.alloc (size, dbf->result_alloc.data);
+  return malloc (size);
+}
+
+/* Free the data returned to the caller. */
+static inline void
+_gdbm_result_free (GDBM_FILE dbf, void *ptr)
+{
+  if (!ptr)
+    return;
+  if (dbf->result_alloc.free)
+    dbf->result_alloc.free (ptr, dbf->result_alloc.data);
+  else
+    free (ptr);
+}
+
 /* From gdbmsync.c */
 int gdbm_file_sync (GDBM_FILE dbf);
 #ifdef GDBM_FAILURE_ATOMIC
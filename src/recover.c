@@ -130,6 +130,7 @@ _gdbm_finish_transfer (GDBM_FILE dbf, GDBM_FILE new_dbf,
   /* Restore cache settings */
   if (!dbf->cache_auto)
     _gdbm_cache_init (new_dbf, dbf->cache_size);
+  _gdbm_cache_set_mem (new_dbf, dbf->cache_mem_max);
   
   /* Move the new file to old name. */
 
@@ -143,33 +144,37 @@ _gdbm_finish_transfer (GDBM_FILE dbf, GDBM_FILE new_dbf,
   /* Fix up DBF to have the correct information for the new file. */
   if (dbf->file_locking)
     _gdbm_unlock_file (dbf);
+  _gdbm_shm_cache_remove (dbf);
   close (dbf->desc);
+  _gdbm_cache_transfer (dbf, new_dbf);
+  /* The avail and dedup indexes will be reloaded from the new file when
+     needed. */
+  _gdbm_avail_index_free (dbf);
+  _gdbm_dedup_index_free (dbf);
   free (dbf->header);
   free (dbf->dir);
-
-  _gdbm_cache_free (dbf);
+  _gdbm_segdir_free (dbf);
 
   dbf->lock_type         = new_dbf->lock_type;
   dbf->desc              = new_dbf->desc;
   dbf->header            = new_dbf->header;
   dbf->dir               = new_dbf->dir;
+  dbf->dir_seg           = new_dbf->dir_seg;
+  dbf->dir_top_bits      = new_dbf->dir_top_bits;
+  dbf->dir_seg_count     = new_dbf->dir_seg_count;
   dbf->bucket            = new_dbf->bucket;
   dbf->bucket_dir        = new_dbf->bucket_dir;
+  dbf->bucket_mem_size   = new_dbf->bucket_mem_size;
+  free (dbf->bucket_buf);
+  dbf->bucket_buf        = new_dbf->bucket_buf;
 
   dbf->avail             = new_dbf->avail;
   dbf->avail_size        = new_dbf->avail_size;
   dbf->xheader           = new_dbf->xheader;
 
-  dbf->cache_bits        = new_dbf->cache_bits;  
-  dbf->cache_size        = new_dbf->cache_size;  
-  dbf->cache_num         = new_dbf->cache_num;   
-  dbf->cache             = new_dbf->cache;   
-  dbf->cache_mru         = new_dbf->cache_mru;   
-  dbf->cache_lru         = new_dbf->cache_lru;   
-  dbf->cache_avail       = new_dbf->cache_avail;
-  
   dbf->header_changed    = new_dbf->header_changed;
   dbf->directory_changed = new_dbf->directory_changed;
+  dbf->dir_top_changed   = new_dbf->dir_top_changed;
 
   dbf->file_size = -1;
   
@@ -180,6 +185,7 @@ _gdbm_finish_transfer (GDBM_FILE dbf, GDBM_FILE new_dbf,
   dbf->mapped_off	 = new_dbf->mapped_off;         
   dbf->mmap_preread      = new_dbf->mmap_preread;        
     
+  free (new_dbf->value_buf);
   free (new_dbf->name);
   free (new_dbf);
    
@@ -198,8 +204,9 @@ _gdbm_next_bucket_dir (GDBM_FILE dbf, int bucket_dir)
     bucket_dir = dir_count;
   else
     {
-      off_t cur = dbf->dir[bucket_dir];
-      while (++bucket_dir < dir_count && cur == dbf->dir[bucket_dir])
+      off_t cur = gdbm_dir_entry (dbf, bucket_dir);
+      while (++bucket_dir < dir_count
+	     && cur == gdbm_dir_entry (dbf, bucket_dir))
 	;
     }
   return bucket_dir;
@@ -213,6 +220,8 @@ check_db (GDBM_FILE dbf)
 
   if (_gdbm_validate_header (dbf))
     return 1;
+  if (_gdbm_check_parallel_p (dbf))
+    return _gdbm_check_buckets (dbf, CHECK_RECORDS, NULL) != 0;
   for (bucket_dir = 0; bucket_dir < nbuckets;
        bucket_dir = _gdbm_next_bucket_dir (dbf, bucket_dir))
     {      
@@ -228,6 +237,7 @@ check_db (GDBM_FILE dbf)
 	      char *dptr;
 	      datum key;
 	      int hashval, bucket, off;
+	      char key_start[SMALL];
 
 	      if (dbf->bucket->h_table[i].hash_value == -1)
 		continue;
@@ -238,16 +248,17 @@ check_db (GDBM_FILE dbf)
 	      key.dptr   = dptr;
 	      key.dsize  = dbf->bucket->h_table[i].key_size;
 
-	      if (memcmp (dbf->bucket->h_table[i].key_start, key.dptr,
-			  (SMALL < key.dsize ? SMALL : key.dsize)))
+	      _gdbm_hash_key_start (dbf, key, &hashval, &bucket, &off,
+				    key_start);
+	      if (memcmp (dbf->bucket->h_table[i].key_start, key_start,
+			  gdbm_key_start_len (dbf, key.dsize)))
 		return 1;
-	      
-	      _gdbm_hash_key (dbf, key, &hashval, &bucket, &off);
 	      if (bucket >= nbuckets)
 		return 1;
 	      if (hashval != dbf->bucket->h_table[i].hash_value)
 		return 1;
-	      if (dbf->dir[bucket] != dbf->dir[bucket_dir])
+	      if (gdbm_dir_entry (dbf, bucket)
+		  != gdbm_dir_entry (dbf, bucket_dir))
 		return 1;
 	    }
 	}
@@ -255,110 +266,533 @@ check_db (GDBM_FILE dbf)
   return 0;
 }
 
+/*
+ * The recovery reads the old file in rounds.  In each round, the next
+ * buckets in directory order are split into ranges, one per check
+ * thread (see parcheck.c).  Each thread reads the buckets of its range
+ * and the records they refer to with pread, into buffers of its own.
+ * Then the calling thread goes through the results in directory order,
+ * accounting for the failures exactly as if the buckets were read one
+ * by one, decodes the records, and stores those of each range in the
+ * new database with a single gdbm_store_many call.
+ */
+
+/* A record read by a recovery thread. */
+struct rcvr_record
+{
+  int elem;                  /* Index of its bucket element */
+  off_t adr;                 /* Its file address */
+  int key_size;              /* Size of the key */
+  int data_size;             /* Size of the stored data */
+  int encoded;               /* The data are encoded */
+  size_t off;                /* Offset of the record in the part buffer */
+  int ec;                    /* Error code, if it couldn't be read */
+  int syserror;              /* System error, for read errors */
+};
+
+/* A bucket read by a recovery thread. */
+struct rcvr_bucket
+{
+  int dir;                   /* Its directory index */
+  size_t rec;                /* Index of its first record */
+  size_t nrec;               /* Number of its records */
+  int ec;                    /* Error code, if it couldn't be read */
+  int syserror;              /* System error, for read errors */
+};
+
+/* Results of a recovery thread. */
+struct rcvr_part
+{
+  GDBM_FILE dbf;
+  int start;                 /* First directory index of the range */
+  int end;                   /* Directory index past the range */
+  int stop;                  /* Directory index where reading stopped */
+  off_t file_size;           /* Size of the database file */
+  char *bucket_buf;          /* Bucket image read from the disk */
+  hash_bucket *bucket;       /* Decoded bucket */
+  struct rcvr_bucket *bkt;   /* Buckets read */
+  size_t nbkt, maxbkt;
+  struct rcvr_record *rec;   /* Records read */
+  size_t nrec, maxrec;
+  char *buf;                 /* Keys and data of the records */
+  size_t len, size;
+  int ec;                    /* GDBM_MALLOC_ERROR if out of memory */
+};
+
+/* Make sure the array *PA of *PMAX elements of SIZE bytes has room
+   for N elements. */
 static int
-run_recovery (GDBM_FILE dbf, GDBM_FILE new_dbf, gdbm_recovery *rcvr, int flags)
+rcvr_reserve (void *pa, size_t *pmax, size_t n, size_t size)
 {
-  int bucket_dir, i;
-  int nbuckets = GDBM_DIR_COUNT (dbf);
+  void **pp = pa;
 
-  for (bucket_dir = 0; bucket_dir < nbuckets;
-       bucket_dir = _gdbm_next_bucket_dir (dbf, bucket_dir))
+  if (n > *pmax)
     {
-      if (_gdbm_get_bucket (dbf, bucket_dir))
+      size_t max = *pmax ? *pmax : 16;
+      void *p;
+
+      while (max < n)
+	max *= 2;
+      p = realloc (*pp, max * size);
+      if (!p)
+	return -1;
+      *pp = p;
+      *pmax = max;
+    }
+  return 0;
+}
+
+/* Read the record of the bucket element ELEM into PART. */
+static int
+rcvr_read_record (struct rcvr_part *part, int elem_loc, bucket_element *elem)
+{
+  GDBM_FILE dbf = part->dbf;
+  struct rcvr_record *rec;
+  size_t size;
+
+  if (rcvr_reserve (&part->rec, &part->maxrec, part->nrec + 1,
+		    sizeof (part->rec[0])))
+    return -1;
+  rec = &part->rec[part->nrec++];
+  rec->elem = elem_loc;
+  rec->adr = elem->data_pointer;
+  rec->key_size = elem->key_size;
+  rec->data_size = elem->data_size;
+  rec->encoded = bucket_element_encoded_p (dbf, elem);
+  rec->off = part->len;
+  rec->ec = GDBM_NO_ERROR;
+  rec->syserror = 0;
+
+  if (bucket_element_inline_p (dbf, elem))
+    {
+      size = elem->key_size + elem->data_size;
+      if (rcvr_reserve (&part->buf, &part->size, part->len + size, 1))
+	return -1;
+      bucket_element_inline_get (elem, part->buf + part->len);
+    }
+  else if (elem->key_size < 0 || elem->data_size < 0
+	   || !off_t_sum_ok (elem->data_pointer,
+			     (off_t) elem->key_size + elem->data_size)
+	   || elem->data_pointer + elem->key_size + elem->data_size
+	        > part->file_size)
+    {
+      rec->ec = GDBM_BAD_HASH_TABLE;
+      return 0;
+    }
+  else
+    {
+      size = elem->key_size + elem->data_size;
+      if (rcvr_reserve (&part->buf, &part->size, part->len + size, 1))
+	return -1;
+      rec->ec = _gdbm_pread (dbf, elem->data_pointer, part->buf + part->len,
+			     size, &rec->syserror);
+      if (rec->ec != GDBM_NO_ERROR)
+	return 0;
+    }
+  part->len += size;
+  return 0;
+}
+
+/* Read the buckets whose first directory entry lies in the range of
+   PART, together with their records.  Stop early if the records take
+   more than RECOVER_BATCH_SIZE bytes. */
+static void
+rcvr_read_range (void *arg)
+{
+  struct rcvr_part *part = arg;
+  GDBM_FILE dbf = part->dbf;
+  int i, j;
+
+  for (i = part->start; i < part->end; i++)
+    {
+      struct rcvr_bucket *bkt;
+
+      if (i > 0 && gdbm_dir_entry (dbf, i) == gdbm_dir_entry (dbf, i-1))
+	continue;
+      if (part->len >= RECOVER_BATCH_SIZE)
+	break;
+
+      if (rcvr_reserve (&part->bkt, &part->maxbkt, part->nbkt + 1,
+			sizeof (part->bkt[0])))
 	{
+	  part->ec = GDBM_MALLOC_ERROR;
+	  break;
+	}
+      bkt = &part->bkt[part->nbkt++];
+      bkt->dir = i;
+      bkt->rec = part->nrec;
+      bkt->nrec = 0;
+      bkt->syserror = 0;
+
+      if (!gdbm_dir_entry_valid_p (dbf, i))
+	bkt->ec = GDBM_BAD_DIR_ENTRY;
+      else if ((bkt->ec = _gdbm_pread (dbf, gdbm_dir_entry (dbf, i),
+				       part->bucket_buf,
+				       dbf->header->bucket_size,
+				       &bkt->syserror)) == GDBM_NO_ERROR)
+	bkt->ec = _gdbm_bucket_decode (dbf, part->bucket_buf, part->bucket);
+      if (bkt->ec != GDBM_NO_ERROR)
+	continue;
+
+      for (j = 0; j < dbf->header->bucket_elems; j++)
+	{
+	  bucket_element *elem = &part->bucket->h_table[j];
+
+	  if (elem->hash_value == -1)
+	    continue;
+	  if (rcvr_read_record (part, j, elem))
+	    {
+	      part->ec = GDBM_MALLOC_ERROR;
+	      part->stop = i;
+	      return;
+	    }
+	  bkt->nrec++;
+	}
+    }
+  part->stop = i;
+}
+
+/* Set the error code of DBF to EC, with the system error SYSERROR. */
+static void
+rcvr_set_errno (GDBM_FILE dbf, int ec, int syserror)
+{
+  errno = syserror;
+  GDBM_SET_ERRNO (dbf, ec, TRUE);
+}
+
+/* Return -1 if the recovery must be aborted after a failure to read a
+   bucket (if BUCKET is true) or a record. */
+static int
+rcvr_failure (gdbm_recovery *rcvr, int flags, int bucket)
+{
+  if (bucket)
+    {
+      if ((flags & GDBM_RCVR_MAX_FAILED_BUCKETS)
+	  && rcvr->failed_buckets == rcvr->max_failed_buckets)
+	return -1;
+    }
+  else if ((flags & GDBM_RCVR_MAX_FAILED_KEYS)
+	   && rcvr->failed_keys == rcvr->max_failed_keys)
+    return -1;
+  if ((flags & GDBM_RCVR_MAX_FAILURES)
+      && (rcvr->failed_buckets + rcvr->failed_keys) == rcvr->max_failures)
+    return -1;
+  return 0;
+}
+
+/* Decode the record REC of PART into CA. */
+static int
+rcvr_decode (GDBM_FILE dbf, struct rcvr_part *part, struct rcvr_record *rec,
+	     data_cache_elem *ca)
+{
+  size_t size = (size_t) rec->key_size + rec->data_size;
+
+  ca->dptr = malloc (size ? size : 1);
+  if (!ca->dptr)
+    {
+      GDBM_SET_ERRNO (dbf, GDBM_MALLOC_ERROR, FALSE);
+      return -1;
+    }
+  ca->dsize = size ? size : 1;
+  _gdbm_cache_data_resized (dbf, 0, ca->dsize);
+  memcpy (ca->dptr, part->buf + rec->off, size);
+  ca->key_size = rec->key_size;
+  ca->data_size = rec->data_size;
+  return _gdbm_decode_data (dbf, ca);
+}
+
+/* Free the record decoded by rcvr_decode in CA. */
+static void
+rcvr_free_decoded (GDBM_FILE dbf, data_cache_elem *ca)
+{
+  if (ca->dptr)
+    {
+      _gdbm_cache_data_resized (dbf, ca->dsize, 0);
+      free (ca->dptr);
+      ca->dptr = NULL;
+      ca->dsize = 0;
+    }
+}
+
+/* Store the records read by PART in NEW_DBF, updating the statistics
+   in RCVR. */
+static int
+rcvr_store_part (GDBM_FILE dbf, GDBM_FILE new_dbf, struct rcvr_part *part,
+		 gdbm_recovery *rcvr, int flags)
+{
+  gdbm_store_item *items;
+  data_cache_elem *ca;
+  struct rcvr_record **recs;
+  size_t b, i, n = 0;
+  int rc = 0;
+
+  if (part->ec != GDBM_NO_ERROR)
+    {
+      GDBM_SET_ERRNO (dbf, part->ec, FALSE);
+      return -1;
+    }
+  items = calloc (part->nrec + 1, sizeof (items[0]));
+  ca = calloc (part->nrec + 1, sizeof (ca[0]));
+  recs = calloc (part->nrec + 1, sizeof (recs[0]));
+  if (!items || !ca || !recs)
+    {
+      free (items);
+      free (ca);
+      free (recs);
+      GDBM_SET_ERRNO (dbf, GDBM_MALLOC_ERROR, FALSE);
+      return -1;
+    }
+
+  for (b = 0; b < part->nbkt && rc == 0; b++)
+    {
+      struct rcvr_bucket *bkt = &part->bkt[b];
+
+      if (bkt->ec != GDBM_NO_ERROR)
+	{
+	  rcvr_set_errno (dbf, bkt->ec, bkt->syserror);
 	  if (flags & GDBM_RCVR_ERRFUN)
 	    rcvr->errfun (rcvr->data, _("can't read bucket #%d: %s"),
-			  bucket_dir,
+			  bkt->dir,
 			  gdbm_db_strerror (dbf));
 	  rcvr->failed_buckets++;
-	  if ((flags & GDBM_RCVR_MAX_FAILED_BUCKETS)
-	      && rcvr->failed_buckets == rcvr->max_failed_buckets)
-	    return -1;
-	  if ((flags & GDBM_RCVR_MAX_FAILURES)
-	      && (rcvr->failed_buckets + rcvr->failed_keys) == rcvr->max_failures)
-	    return -1;
+	  rc = rcvr_failure (rcvr, flags, TRUE);
+	  continue;
 	}
-      else
+
+      rcvr->recovered_buckets++;
+      for (i = bkt->rec; i < bkt->rec + bkt->nrec; i++)
 	{
-	  rcvr->recovered_buckets++;
-	  for (i = 0; i < dbf->header->bucket_elems; i++)
+	  struct rcvr_record *rec = &part->rec[i];
+	  char *dptr = part->buf + rec->off;
+	  size_t data_size = rec->data_size;
+
+	  if (rec->ec != GDBM_NO_ERROR)
+	    rcvr_set_errno (dbf, rec->ec, rec->syserror);
+	  else if (rec->encoded)
 	    {
-	      char *dptr;
-	      datum key, data;
-	    
-	      if (dbf->bucket->h_table[i].hash_value == -1)
-		continue;
-	      dptr = _gdbm_read_entry (dbf, i);
-	      if (dptr)
-		rcvr->recovered_keys++;
-	      else
+	      if (rcvr_decode (dbf, part, rec, &ca[n]))
 		{
-		  if (flags & GDBM_RCVR_ERRFUN)
-		    rcvr->errfun (rcvr->data,
-				  _("can't read key pair %d:%d (%lu:%d): %s"),
-				  bucket_dir, i,
-				  (unsigned long) dbf->bucket->h_table[i].data_pointer,
-				  dbf->bucket->h_table[i].key_size
-				    + dbf->bucket->h_table[i].data_size,
-				  gdbm_db_strerror (dbf));
-		  rcvr->failed_keys++;
-		  if ((flags & GDBM_RCVR_MAX_FAILED_KEYS)
-		      && rcvr->failed_keys == rcvr->max_failed_keys)
-		    return -1;
-		  if ((flags & GDBM_RCVR_MAX_FAILURES)
-		      && (rcvr->failed_buckets + rcvr->failed_keys) == rcvr->max_failures)
-		    return -1;
-		  continue;
+		  rec->ec = gdbm_last_errno (dbf);
+		  rcvr_free_decoded (dbf, &ca[n]);
 		}
+	      dptr = ca[n].dptr;
+	      data_size = ca[n].data_size;
+	    }
+	  if (rec->ec != GDBM_NO_ERROR)
+	    {
+	      if (flags & GDBM_RCVR_ERRFUN)
+		rcvr->errfun (rcvr->data,
+			      _("can't read key pair %d:%d (%lu:%d): %s"),
+			      bkt->dir, rec->elem,
+			      (unsigned long) rec->adr,
+			      rec->key_size + rec->data_size,
+			      gdbm_db_strerror (dbf));
+	      rcvr->failed_keys++;
+	      if ((rc = rcvr_failure (rcvr, flags, FALSE)) != 0)
+		break;
+	      continue;
+	    }
 
-	      key.dptr   = dptr;
-	      key.dsize  = dbf->bucket->h_table[i].key_size;
+	  rcvr->recovered_keys++;
+	  items[n].key.dptr = dptr;
+	  items[n].key.dsize = rec->key_size;
+	  items[n].content.dptr = dptr + rec->key_size;
+	  items[n].content.dsize = data_size;
+	  recs[n] = rec;
+	  n++;
+	}
+    }
 
-	      data.dptr  = dptr + key.dsize;
-	      data.dsize = dbf->bucket->h_table[i].data_size;
-	    
-	      if (gdbm_store (new_dbf, key, data, GDBM_INSERT) != 0)
-		{
-		  switch (gdbm_last_errno (new_dbf))
-		    {
-		    case GDBM_CANNOT_REPLACE:
-		      rcvr->duplicate_keys++;
-		      if (flags & GDBM_RCVR_ERRFUN)
-			rcvr->errfun (rcvr->data,
-		          _("ignoring duplicate key %d:%d (%lu:%d)"),
-			  bucket_dir, i,
-			  (unsigned long) dbf->bucket->h_table[i].data_pointer,
-			  dbf->bucket->h_table[i].key_size
-				      + dbf->bucket->h_table[i].data_size);
-		      break;
-		      
-		    default:
-		      if (flags & GDBM_RCVR_ERRFUN)
-			rcvr->errfun (rcvr->data,
-			  _("fatal: can't store element %d:%d (%lu:%d): %s"),
-			  bucket_dir, i,
-			  (unsigned long) dbf->bucket->h_table[i].data_pointer,
-			  dbf->bucket->h_table[i].key_size
-				    + dbf->bucket->h_table[i].data_size,
+  if (rc == 0)
+    {
+      switch (gdbm_store_many (new_dbf, items, n, GDBM_INSERT))
+	{
+	case 0:
+	  break;
+
+	case 1:
+	  for (i = 0, b = 0; i < n; i++)
+	    {
+	      if (items[i].result != 1)
+		continue;
+	      /* Find the bucket of the record, for the message. */
+	      while (recs[i] >= part->rec + part->bkt[b].rec + part->bkt[b].nrec)
+		b++;
+	      rcvr->duplicate_keys++;
+	      if (flags & GDBM_RCVR_ERRFUN)
+		rcvr->errfun (rcvr->data,
+			      _("ignoring duplicate key %d:%d (%lu:%d)"),
+			      part->bkt[b].dir, recs[i]->elem,
+			      (unsigned long) recs[i]->adr,
+			      recs[i]->key_size + recs[i]->data_size);
+	    }
+	  break;
+
+	default:
+	  if (flags & GDBM_RCVR_ERRFUN)
+	    rcvr->errfun (rcvr->data,
+			  _("fatal: can't store recovered records: %s"),
 			  gdbm_db_strerror (new_dbf));
-		      return -1;
-		    }
-		}	
+	  rc = -1;
+	}
+    }
+
+  for (i = 0; i < n; i++)
+    rcvr_free_decoded (dbf, &ca[i]);
+  free (items);
+  free (ca);
+  free (recs);
+  return rc;
+}
+
+static int
+run_recovery (GDBM_FILE dbf, GDBM_FILE new_dbf, gdbm_recovery *rcvr, int flags)
+{
+  int nparts = _gdbm_thread_count (dbf);
+  int dir_count = GDBM_DIR_COUNT (dbf);
+  struct rcvr_part *parts;
+  off_t file_size;
+  int bucket_dir = 0;
+  int i, n;
+  int rc = 0;
+
+  /* The threads read the disk: make sure it is up to date. */
+  if (_gdbm_cache_flush (dbf) || _gdbm_file_size (dbf, &file_size))
+    return -1;
+
+  parts = calloc (nparts, sizeof (parts[0]));
+  if (!parts)
+    {
+      GDBM_SET_ERRNO (dbf, GDBM_MALLOC_ERROR, FALSE);
+      return -1;
+    }
+  for (i = 0; i < nparts; i++)
+    {
+      parts[i].dbf = dbf;
+      parts[i].file_size = file_size;
+      parts[i].bucket_buf = malloc (dbf->header->bucket_size);
+      parts[i].bucket = gdbm_compact_buckets_p (dbf)
+	                  ? malloc (dbf->bucket_mem_size)
+	                  : (hash_bucket *) parts[i].bucket_buf;
+      if (!parts[i].bucket_buf || !parts[i].bucket)
+	{
+	  GDBM_SET_ERRNO (dbf, GDBM_MALLOC_ERROR, FALSE);
+	  rc = -1;
+	}
+    }
+
+  while (rc == 0 && bucket_dir < dir_count)
+    {
+      /* Give the next RECOVER_BATCH_BUCKETS buckets to each thread. */
+      for (n = 0; n < nparts && bucket_dir < dir_count; n++)
+	{
+	  struct rcvr_part *part = &parts[n];
+
+	  part->start = bucket_dir;
+	  for (i = 0; i < RECOVER_BATCH_BUCKETS && bucket_dir < dir_count; i++)
+	    bucket_dir = _gdbm_next_bucket_dir (dbf, bucket_dir);
+	  part->end = bucket_dir;
+	  part->nbkt = part->nrec = part->len = 0;
+	  part->ec = GDBM_NO_ERROR;
+	}
+
+      _gdbm_run_parts (rcvr_read_range, parts, sizeof (parts[0]), n);
+
+      for (i = 0; i < n; i++)
+	{
+	  if ((rc = rcvr_store_part (dbf, new_dbf, &parts[i], rcvr, flags)) != 0)
+	    break;
+	  if (parts[i].stop < parts[i].end)
+	    {
+	      /* The thread stopped early: the results of the following
+		 ones are discarded and their buckets read again. */
+	      bucket_dir = parts[i].stop;
+	      break;
 	    }
 	}
     }
-  
-  return 0;
+
+  for (i = 0; i < nparts; i++)
+    {
+      if ((char *) parts[i].bucket != parts[i].bucket_buf)
+	free (parts[i].bucket);
+      free (parts[i].bucket_buf);
+      free (parts[i].bkt);
+      free (parts[i].rec);
+      free (parts[i].buf);
+    }
+  free (parts);
+  return rc;
 }
 
-int
-gdbm_recover (GDBM_FILE dbf, gdbm_recovery *rcvr, int flags)
-{ 
+/* Copy the records of DBF into a new database in FORMAT (as returned by
+   GDBM_GETDBFORMAT) and replace DBF with it. */
+static int
+rebuild (GDBM_FILE dbf, gdbm_recovery *rcvr, int flags, int format)
+{
   GDBM_FILE new_dbf;	     /* The new file. */
   char *new_name;	     /* A temporary name. */
   size_t len;
   int fd;
   int rc;
+
+  len = strlen (dbf->name);
+  new_name = malloc (len + sizeof (TMPSUF));
+  if (!new_name)
+    {
+      GDBM_SET_ERRNO (NULL, GDBM_MALLOC_ERROR, FALSE);
+      return -1;
+    }
+  strcat (strcpy (new_name, dbf->name), TMPSUF);
+
+  fd = mkstemp (new_name);
+  if (fd == -1)
+    {
+      GDBM_SET_ERRNO (NULL, GDBM_FILE_OPEN_ERROR, FALSE);
+      free (new_name);
+      return -1;
+    }
+
+  new_dbf = gdbm_fd_open (fd, new_name, dbf->header->block_size,
+			  GDBM_WRCREAT
+			  | (dbf->cloexec ? GDBM_CLOEXEC : 0)
+			  | format
+			  | GDBM_CLOERROR, dbf->fatal_err);
+
+  SAVE_ERRNO (free (new_name));
+
+  if (new_dbf == NULL)
+    {
+      GDBM_SET_ERRNO (NULL, GDBM_REORGANIZE_FAILED, FALSE);
+      return -1;
+    }
+
+  rc = run_recovery (dbf, new_dbf, rcvr, flags);
+
+  if (rc == 0)
+    rc = _gdbm_finish_transfer (dbf, new_dbf, rcvr, flags);
+  else
+    gdbm_close (new_dbf);
+  return rc;
+}
+
+/* Convert DBF to FORMAT by copying all its records into a new
+   database.  Fail if any of them can't be copied. */
+int
+_gdbm_rebuild (GDBM_FILE dbf, int format)
+{
+  gdbm_recovery rcvr;
+
+  memset (&rcvr, 0, sizeof (rcvr));
+  rcvr.max_failures = 1;
+  return rebuild (dbf, &rcvr, GDBM_RCVR_MAX_FAILURES|GDBM_RCVR_FORCE,
+		  format);
+}
+
+int
+gdbm_recover (GDBM_FILE dbf, gdbm_recovery *rcvr, int flags)
+{ 
+  int rc;
   gdbm_recovery rs;
   
   /* Readers can not reorganize! */
@@ -385,43 +819,7 @@ gdbm_recover (GDBM_FILE dbf, gdbm_recovery *rcvr, int flags)
   if ((flags & GDBM_RCVR_FORCE) || check_db (dbf))
     {
       gdbm_clear_error (dbf);
-      len = strlen (dbf->name);
-      new_name = malloc (len + sizeof (TMPSUF));
-      if (!new_name)
-	{
-	  GDBM_SET_ERRNO (NULL, GDBM_MALLOC_ERROR, FALSE);
-	  return -1;
-	}
-      strcat (strcpy (new_name, dbf->name), TMPSUF);
-  
-      fd = mkstemp (new_name);
-      if (fd == -1)
-	{
-	  GDBM_SET_ERRNO (NULL, GDBM_FILE_OPEN_ERROR, FALSE);
-	  free (new_name);
-	  return -1;
-	}
-  
-      new_dbf = gdbm_fd_open (fd, new_name, dbf->header->block_size,
-			      GDBM_WRCREAT
-			      | (dbf->cloexec ? GDBM_CLOEXEC : 0)
-			      | (dbf->xheader ? GDBM_NUMSYNC : 0)
-			      | GDBM_CLOERROR, dbf->fatal_err);
-  
-      SAVE_ERRNO (free (new_name));
-  
-      if (new_dbf == NULL)
-	{
-	  GDBM_SET_ERRNO (NULL, GDBM_REORGANIZE_FAILED, FALSE);
-	  return -1;
-	}
-
-      rc = run_recovery (dbf, new_dbf, rcvr, flags);
-      
-      if (rc == 0)
-	rc = _gdbm_finish_transfer (dbf, new_dbf, rcvr, flags);
-      else
-	gdbm_close (new_dbf);
+      rc = rebuild (dbf, rcvr, flags, gdbm_db_format (dbf));
     }
 
   if (rc == 0)
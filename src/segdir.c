@@ -0,0 +1,440 @@
+/* segdir.c - Access the hash directory, which may be made of
+   segments. */
+
+/* This file is part of GDBM, the GNU data base manager.
+   Copyright (C) 2025 Free Software Foundation, Inc.
+
+   GDBM is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3, or (at your option)
+   any later version.
+
+   GDBM is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with GDBM. If not, see <http://www.gnu.org/licenses/>.   */
+
+/* Include system configuration before all else. */
+#include "autoconf.h"
+
+#include "gdbmdefs.h"
+
+/*
+ * The directory of a database with the GDBM_FEATURE_SEGDIR feature is
+ * made of segments (see the comment to dir_segment_header in gdbmdefs.h).
+ * When a bucket whose bits equal the depth of the directory is split,
+ * the directory of other databases is doubled: it is copied into a new
+ * array twice as large, which is written as a whole to new file space.
+ * With segments, the split only needs the segment holding the bucket
+ * to have one more bit.  A segment that is not full is doubled in place.
+ * A full one is split in two halves, one of which goes to a new
+ * segment.  Only when the segment covers a single entry of the segment
+ * table is that table doubled, which happens 2^GDBM_DIR_SEGMENT_BITS
+ * times less often than the doubling of a flat directory, and copies
+ * as many times less data.  Each segment keeps a changed flag, so that
+ * only the segments that were modified are written back.
+ */
+
+/* Size on the disk of a segment table of N entries for DBF.  It takes
+   at least a block. */
+off_t
+_gdbm_dir_top_disk_size (GDBM_FILE dbf, int n)
+{
+  off_t size = (off_t) n * sizeof (off_t);
+
+  return size < dbf->header->block_size ? dbf->header->block_size : size;
+}
+
+/* Return the number of entries of the segment table covered by SEG. */
+static inline int
+dir_segment_span (GDBM_FILE dbf, dir_segment const *seg)
+{
+  return 1 << (dbf->dir_top_bits - seg->hdr.prefix_bits);
+}
+
+static dir_segment *
+dir_segment_alloc (void)
+{
+  return calloc (1, DIR_SEGMENT_MEM_SIZE);
+}
+
+/* Free the directory segments of DBF. */
+void
+_gdbm_segdir_free (GDBM_FILE dbf)
+{
+  int i, n;
+
+  if (!dbf->dir_seg)
+    return;
+  n = 1 << dbf->dir_top_bits;
+  for (i = 0; i < n; )
+    {
+      dir_segment *seg = dbf->dir_seg[i];
+
+      if (!seg)
+	break;
+      i += dir_segment_span (dbf, seg);
+      free (seg);
+    }
+  free (dbf->dir_seg);
+  dbf->dir_seg = NULL;
+  dbf->dir_seg_count = 0;
+}
+
+/* Set up the directory segments of a new database DBF, whose header
+   gives the number of bits of the directory and the size of the segment
+   table.  All segments have the same prefix length.  They are given
+   consecutive file addresses starting at *PADR, which is advanced past
+   them.  Return 0 on success and -1 on error. */
+int
+_gdbm_segdir_create (GDBM_FILE dbf, off_t *padr)
+{
+  int n = dbf->header->dir_size;
+  int i;
+
+  for (dbf->dir_top_bits = 0; (1 << dbf->dir_top_bits) < n;
+       dbf->dir_top_bits++)
+    ;
+  dbf->dir_seg = calloc (n, sizeof (dbf->dir_seg[0]));
+  if (!dbf->dir_seg)
+    {
+      GDBM_SET_ERRNO (dbf, GDBM_MALLOC_ERROR, FALSE);
+      return -1;
+    }
+  for (i = 0; i < n; i++)
+    {
+      dir_segment *seg = dir_segment_alloc ();
+
+      if (!seg)
+	{
+	  GDBM_SET_ERRNO (dbf, GDBM_MALLOC_ERROR, FALSE);
+	  return -1;
+	}
+      seg->adr = *padr;
+      seg->changed = TRUE;
+      seg->hdr.prefix_bits = dbf->dir_top_bits;
+      seg->hdr.depth = dbf->header->dir_bits - dbf->dir_top_bits;
+      dbf->dir_seg[i] = seg;
+      dbf->dir_seg_count++;
+      *padr += DIR_SEGMENT_DISK_SIZE;
+    }
+  dbf->dir_top_changed = TRUE;
+  return 0;
+}
+
+/* Read the directory segments of DBF.  Return 0 on success and -1 on
+   error. */
+int
+_gdbm_segdir_read (GDBM_FILE dbf)
+{
+  int n = dbf->header->dir_size;
+  off_t adr[512];
+  off_t file_size;
+  int i, j, count;
+
+  if (_gdbm_file_size (dbf, &file_size))
+    return -1;
+  for (dbf->dir_top_bits = 0; (1 << dbf->dir_top_bits) < n;
+       dbf->dir_top_bits++)
+    ;
+  dbf->dir_seg = calloc (n, sizeof (dbf->dir_seg[0]));
+  if (!dbf->dir_seg)
+    {
+      GDBM_SET_ERRNO (dbf, GDBM_MALLOC_ERROR, FALSE);
+      return -1;
+    }
+
+  /* Read the segment table in chunks, and each segment at the first
+     entry that refers to it.  A segment must appear in as many
+     consecutive entries as its prefix implies, starting at an entry
+     aligned to that number. */
+  for (i = 0; i < n; i += count)
+    {
+      count = n - i;
+      if (count > ARRAY_SIZE (adr))
+	count = ARRAY_SIZE (adr);
+      if (gdbm_file_seek (dbf, dbf->header->dir + (off_t) i * sizeof (off_t),
+			  SEEK_SET)
+	    != dbf->header->dir + (off_t) i * sizeof (off_t))
+	{
+	  GDBM_SET_ERRNO (dbf, GDBM_FILE_SEEK_ERROR, TRUE);
+	  return -1;
+	}
+      if (_gdbm_full_read (dbf, adr, count * sizeof (adr[0])))
+	return -1;
+
+      for (j = 0; j < count; j++)
+	{
+	  int top = i + j;
+	  dir_segment *seg;
+
+	  if (top > 0 && dbf->dir_seg[top-1]
+	      && dbf->dir_seg[top-1]->adr == adr[j])
+	    {
+	      seg = dbf->dir_seg[top-1];
+	      if (top % dir_segment_span (dbf, seg) == 0)
+		{
+		  GDBM_SET_ERRNO (dbf, GDBM_BAD_DIR_ENTRY, TRUE);
+		  return -1;
+		}
+	      dbf->dir_seg[top] = seg;
+	      continue;
+	    }
+	  if (top > 0
+	      && (top % dir_segment_span (dbf, dbf->dir_seg[top-1])) != 0)
+	    {
+	      GDBM_SET_ERRNO (dbf, GDBM_BAD_DIR_ENTRY, TRUE);
+	      return -1;
+	    }
+	  if (adr[j] < dbf->header->block_size
+	      || !off_t_sum_ok (adr[j], DIR_SEGMENT_DISK_SIZE)
+	      || adr[j] + DIR_SEGMENT_DISK_SIZE > file_size)
+	    {
+	      GDBM_SET_ERRNO (dbf, GDBM_BAD_DIR_ENTRY, TRUE);
+	      return -1;
+	    }
+
+	  seg = dir_segment_alloc ();
+	  if (!seg)
+	    {
+	      GDBM_SET_ERRNO (dbf, GDBM_MALLOC_ERROR, FALSE);
+	      return -1;
+	    }
+	  dbf->dir_seg[top] = seg;
+	  dbf->dir_seg_count++;
+	  seg->adr = adr[j];
+	  if (gdbm_file_seek (dbf, seg->adr, SEEK_SET) != seg->adr)
+	    {
+	      GDBM_SET_ERRNO (dbf, GDBM_FILE_SEEK_ERROR, TRUE);
+	      return -1;
+	    }
+	  if (_gdbm_full_read (dbf, &seg->hdr, sizeof (seg->hdr)))
+	    return -1;
+	  if (!(seg->hdr.prefix_bits >= 0
+		&& seg->hdr.prefix_bits <= dbf->dir_top_bits
+		&& top % dir_segment_span (dbf, seg) == 0
+		&& seg->hdr.depth >= 0
+		&& seg->hdr.depth <= GDBM_DIR_SEGMENT_BITS
+		&& seg->hdr.prefix_bits + seg->hdr.depth
+		     <= dbf->header->dir_bits))
+	    {
+	      GDBM_SET_ERRNO (dbf, GDBM_BAD_DIR_ENTRY, TRUE);
+	      return -1;
+	    }
+	  if (_gdbm_full_read (dbf, seg->entry,
+			       sizeof (off_t) << seg->hdr.depth))
+	    return -1;
+	}
+    }
+  return 0;
+}
+
+/* Write the segment table of DBF, if it has changed, and the changed
+   segments.  Return 0 on success and -1 on error. */
+int
+_gdbm_segdir_write (GDBM_FILE dbf)
+{
+  int n = 1 << dbf->dir_top_bits;
+  int i, j;
+
+  if (dbf->dir_top_changed)
+    {
+      off_t adr[512];
+
+      if (gdbm_file_seek (dbf, dbf->header->dir, SEEK_SET)
+	  != dbf->header->dir)
+	{
+	  GDBM_SET_ERRNO (dbf, GDBM_FILE_SEEK_ERROR, TRUE);
+	  return -1;
+	}
+      for (i = 0; i < n; i += j)
+	{
+	  for (j = 0; j < ARRAY_SIZE (adr) && i + j < n; j++)
+	    adr[j] = dbf->dir_seg[i + j]->adr;
+	  if (_gdbm_full_write (dbf, adr, j * sizeof (adr[0])))
+	    return -1;
+	}
+      dbf->dir_top_changed = FALSE;
+    }
+
+  for (i = 0; i < n; i += dir_segment_span (dbf, dbf->dir_seg[i]))
+    {
+      dir_segment *seg = dbf->dir_seg[i];
+
+      if (!seg->changed)
+	continue;
+      if (gdbm_file_seek (dbf, seg->adr, SEEK_SET) != seg->adr)
+	{
+	  GDBM_SET_ERRNO (dbf, GDBM_FILE_SEEK_ERROR, TRUE);
+	  return -1;
+	}
+      if (_gdbm_full_write (dbf, &seg->hdr, sizeof (seg->hdr))
+	  || _gdbm_full_write (dbf, seg->entry,
+			       sizeof (off_t) << seg->hdr.depth))
+	return -1;
+      seg->changed = FALSE;
+    }
+  return 0;
+}
+
+/* Double the segment table of DBF.  Unless the new table fits in the
+   file space of the old one, the table is moved, and that space is
+   recorded in OLD_ADR[*OLD_COUNT] and OLD_SIZE[*OLD_COUNT], to be freed
+   by the caller, and *OLD_COUNT is incremented. */
+static int
+dir_top_double (GDBM_FILE dbf, off_t *old_adr, off_t *old_size,
+		int *old_count)
+{
+  int n = 1 << dbf->dir_top_bits;
+  dir_segment **top;
+  off_t adr = dbf->header->dir;
+  int i;
+
+  if (_gdbm_dir_top_disk_size (dbf, 2 * n)
+      > _gdbm_dir_top_disk_size (dbf, n))
+    {
+      adr = _gdbm_alloc_large (dbf, _gdbm_dir_top_disk_size (dbf, 2 * n));
+      if (adr == 0)
+	return -1;
+    }
+  top = malloc (2 * n * sizeof (top[0]));
+  if (!top)
+    {
+      GDBM_SET_ERRNO (dbf, GDBM_MALLOC_ERROR, TRUE);
+      _gdbm_fatal (dbf, _("malloc error"));
+      return -1;
+    }
+  for (i = 0; i < n; i++)
+    top[2*i] = top[2*i+1] = dbf->dir_seg[i];
+  free (dbf->dir_seg);
+  dbf->dir_seg = top;
+  dbf->dir_top_bits++;
+
+  if (adr != dbf->header->dir)
+    {
+      old_adr[*old_count] = dbf->header->dir;
+      old_size[*old_count] = _gdbm_dir_top_disk_size (dbf, n);
+      (*old_count)++;
+      dbf->header->dir = adr;
+    }
+  dbf->header->dir_size *= 2;
+  dbf->header_changed = TRUE;
+  dbf->dir_top_changed = TRUE;
+  return 0;
+}
+
+/* Make sure that the segment of the directory of DBF holding the entry
+   at DIR_INDEX distinguishes at least BITS bits of the directory
+   index, which must not exceed the directory depth.  The segment is
+   doubled, or split if it is full.  If the segment table has to be
+   doubled, the file space of the old one is recorded in OLD_ADR and
+   OLD_SIZE, as done by dir_top_double.  Return 0 on success and -1 on
+   error. */
+int
+_gdbm_segdir_deepen (GDBM_FILE dbf, int dir_index, int bits,
+		     off_t *old_adr, off_t *old_size, int *old_count)
+{
+  for (;;)
+    {
+      int top = dir_index >> (dbf->header->dir_bits - dbf->dir_top_bits);
+      dir_segment *seg = dbf->dir_seg[top];
+      int depth = seg->hdr.depth;
+
+      if (seg->hdr.prefix_bits + depth >= bits)
+	return 0;
+
+      if (depth < GDBM_DIR_SEGMENT_BITS)
+	{
+	  /* Double the segment in place. */
+	  int i;
+
+	  for (i = (1 << depth) - 1; i >= 0; i--)
+	    seg->entry[2*i] = seg->entry[2*i+1] = seg->entry[i];
+	  seg->hdr.depth++;
+	  seg->changed = TRUE;
+	}
+      else if (seg->hdr.prefix_bits == dbf->dir_top_bits)
+	{
+	  if (dir_top_double (dbf, old_adr, old_size, old_count))
+	    return -1;
+	}
+      else
+	{
+	  /* Move the upper half of the segment to a new one. */
+	  int half = 1 << (depth - 1);
+	  int span = dir_segment_span (dbf, seg) / 2;
+	  int first = top / (2 * span) * (2 * span);
+	  dir_segment *new_seg;
+	  off_t adr;
+	  int i;
+
+	  adr = _gdbm_alloc (dbf, DIR_SEGMENT_DISK_SIZE);
+	  if (adr == 0)
+	    return -1;
+	  new_seg = dir_segment_alloc ();
+	  if (!new_seg)
+	    {
+	      GDBM_SET_ERRNO (dbf, GDBM_MALLOC_ERROR, TRUE);
+	      _gdbm_fatal (dbf, _("malloc error"));
+	      return -1;
+	    }
+	  new_seg->adr = adr;
+	  new_seg->changed = TRUE;
+	  new_seg->hdr.prefix_bits = seg->hdr.prefix_bits + 1;
+	  new_seg->hdr.depth = depth - 1;
+	  memcpy (new_seg->entry, seg->entry + half, half * sizeof (off_t));
+
+	  seg->hdr.prefix_bits++;
+	  seg->hdr.depth--;
+	  seg->changed = TRUE;
+
+	  for (i = first + span; i < first + 2 * span; i++)
+	    dbf->dir_seg[i] = new_seg;
+	  dbf->dir_seg_count++;
+	  dbf->dir_top_changed = TRUE;
+	}
+      dbf->directory_changed = TRUE;
+    }
+}
+
+/* Point the entries of the directory of DBF from START up to END
+   (exclusive) to ADR.  In a segmented directory, the range must be
+   aligned to the entries of the segments. */
+void
+_gdbm_dir_set (GDBM_FILE dbf, int start, int end, off_t adr)
+{
+  if (gdbm_segdir_p (dbf))
+    {
+      while (start < end)
+	{
+	  int n;
+	  dir_segment *seg = gdbm_dir_segment (dbf, start, &n);
+	  int shift = dbf->header->dir_bits
+	              - seg->hdr.prefix_bits - seg->hdr.depth;
+
+	  seg->entry[n] = adr;
+	  seg->changed = TRUE;
+	  start = ((start >> shift) + 1) << shift;
+	}
+    }
+  else
+    {
+      for (; start < end; start++)
+	dbf->dir[start] = adr;
+    }
+  dbf->directory_changed = TRUE;
+}
+
+/* Return the number of bytes of memory taken by the directory of
+   DBF. */
+size_t
+_gdbm_dir_mem_size (GDBM_FILE dbf)
+{
+  if (gdbm_segdir_p (dbf))
+    return dbf->dir_seg_count * DIR_SEGMENT_MEM_SIZE
+           + (sizeof (dbf->dir_seg[0]) << dbf->dir_top_bits);
+  return GDBM_DIR_SIZE (dbf);
+}
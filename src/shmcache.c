@@ -0,0 +1,437 @@
+/* shmcache.c - Bucket cache shared among processes. */
+
+/* This file is part of GDBM, the GNU data base manager.
+   Copyright (C) 2025 Free Software Foundation, Inc.
+
+   GDBM is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3, or (at your option)
+   any later version.
+
+   GDBM is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with GDBM. If not, see <http://www.gnu.org/licenses/>.   */
+
+#include "autoconf.h"
+#include "gdbmdefs.h"
+
+#if HAVE_SHM_OPEN && HAVE_MMAP
+#include <stdint.h>
+#include <signal.h>
+#include <sys/mman.h>
+
+/*
+ * The shared cache is a POSIX shared memory object named after the
+ * device and inode numbers of the database file.  It consists of a
+ * header followed by an array of slots.  Each slot holds an image of a
+ * single bucket.  Slots are direct-mapped: the slot for a bucket is
+ * selected by hashing its address.
+ *
+ * A slot image is valid if its address matches the requested one and
+ * its generation number matches the generation of the database, as
+ * seen by the process when it opened it.  The generation is computed
+ * from the numsync counter of the extended header, modification time
+ * and size of the database file.
+ *
+ * Concurrent access to a slot is controlled by a sequence lock.  The
+ * lock word keeps the sequence number in its upper 32 bits and the PID
+ * of the process writing the slot, if any, in its lower 32 bits.  A
+ * reader copies the slot and discards the copy if the slot was being
+ * written or if the lock word has changed meanwhile.  A process that
+ * fails to acquire the slot for writing simply doesn't publish its
+ * bucket.  If the writer has died, the next process to write the slot
+ * takes the lock over.
+ *
+ * The segment is used only if it is owned by the owner of the database
+ * file or by the effective user, and if its permissions are not wider
+ * than those of the file.  The header counts the processes that have
+ * the segment attached.  The last of them to detach removes the
+ * segment.  The segment of the old file is also removed when the
+ * database is reorganized.
+ */
+
+#define SHM_CACHE_MAGIC 0x67646263 /* "gdbc" */
+
+struct shm_cache_header
+{
+  uint32_t magic;         /* SHM_CACHE_MAGIC */
+  uint32_t bucket_size;   /* Size of a bucket */
+  uint64_t nslots;        /* Number of slots (power of two) */
+  uint32_t nusers;        /* Number of attached processes */
+};
+
+/* Value of nusers after the last user has detached. */
+#define SHM_CACHE_DEAD UINT32_MAX
+
+/* Parts of the slot lock word. */
+#define SEQ_PID(w) ((pid_t) ((w) & 0xffffffff))
+#define SEQ_NEXT(w) ((((w) >> 32) + 1) << 32)
+
+struct shm_cache_slot
+{
+  uint64_t seq;           /* Lock word. */
+  uint64_t gen;           /* Generation number.  0 means empty slot. */
+  int64_t adr;            /* Bucket address. */
+  union
+  {
+    hash_bucket bucket;   /* Bucket image (dbf->bucket_mem_size bytes). */
+    uint64_t align;
+  } u;
+};
+
+/* Slots are aligned on this boundary. */
+#define SHM_CACHE_ALIGN 64
+
+struct shm_cache
+{
+  void *base;             /* Mapped segment. */
+  size_t size;            /* Size of the segment. */
+  size_t slot_size;       /* Size of a slot. */
+  size_t nslots;          /* Number of slots. */
+  int nbits;              /* log2 (nslots) */
+  uint64_t gen;           /* Database generation. */
+  dev_t dev;              /* Device and inode numbers of the */
+  ino_t ino;              /* database file. */
+};
+
+#define SHM_CACHE_SLOT(shm, n) \
+  ((struct shm_cache_slot *) \
+   ((char*)(shm)->base + SHM_CACHE_ALIGN + (n) * (shm)->slot_size))
+
+static inline size_t
+slot_size (GDBM_FILE dbf)
+{
+  size_t n = offsetof (struct shm_cache_slot, u) + dbf->bucket_mem_size;
+  return (n + SHM_CACHE_ALIGN - 1) / SHM_CACHE_ALIGN * SHM_CACHE_ALIGN;
+}
+
+/* Mix V into the hash value H (FNV-1a, 64-bit). */
+static uint64_t
+gen_mix (uint64_t h, uint64_t v)
+{
+  int i;
+
+  for (i = 0; i < 8; i++, v >>= 8)
+    {
+      h ^= v & 0xff;
+      h *= 0x100000001b3ULL;
+    }
+  return h;
+}
+
+static uint64_t
+db_generation (GDBM_FILE dbf, struct stat const *st)
+{
+  uint64_t h = 0xcbf29ce484222325ULL;
+
+  h = gen_mix (h, dbf->xheader ? dbf->xheader->numsync : 0);
+  h = gen_mix (h, st->st_size);
+  h = gen_mix (h, st->st_mtime);
+#if HAVE_STRUCT_STAT_ST_MTIM
+  h = gen_mix (h, st->st_mtim.tv_nsec);
+#endif
+  h = gen_mix (h, st->st_ctime);
+  h = gen_mix (h, dbf->header->next_block);
+  return h ? h : 1;
+}
+
+static inline size_t
+slot_index (struct shm_cache *shm, off_t adr)
+{
+  uint64_t h = gen_mix (0xcbf29ce484222325ULL, adr);
+  return h >> (64 - shm->nbits);
+}
+
+static void
+shm_cache_name (char *buf, size_t size, struct stat const *st)
+{
+  snprintf (buf, size, "/gdbm-%llx-%llx",
+	    (unsigned long long) st->st_dev, (unsigned long long) st->st_ino);
+}
+
+/* Return true if the segment with attributes SST can be trusted by the
+   readers of the database file with attributes ST. */
+static int
+shm_cache_trusted (struct stat const *sst, struct stat const *st)
+{
+  return (sst->st_uid == st->st_uid || sst->st_uid == geteuid ())
+	 && (sst->st_mode & 0777 & ~st->st_mode) == 0;
+}
+
+/* Register a new user of the segment HDR.  Return -1 if the segment is
+   being removed by its last user. */
+static int
+shm_cache_attach (struct shm_cache_header *hdr)
+{
+  uint32_t n = __atomic_load_n (&hdr->nusers, __ATOMIC_RELAXED);
+
+  do
+    {
+      if (n == SHM_CACHE_DEAD)
+	return -1;
+    }
+  while (!__atomic_compare_exchange_n (&hdr->nusers, &n, n + 1, FALSE,
+				       __ATOMIC_ACQ_REL, __ATOMIC_RELAXED));
+  return 0;
+}
+
+/* Unregister a user of the segment HDR.  Return true if it was the
+   last one. */
+static int
+shm_cache_detach (struct shm_cache_header *hdr)
+{
+  uint32_t n = __atomic_load_n (&hdr->nusers, __ATOMIC_RELAXED);
+  uint32_t m;
+
+  do
+    m = n > 1 ? n - 1 : SHM_CACHE_DEAD;
+  while (!__atomic_compare_exchange_n (&hdr->nusers, &n, m, FALSE,
+				       __ATOMIC_ACQ_REL, __ATOMIC_RELAXED));
+  return m == SHM_CACHE_DEAD;
+}
+
+/* Attach DBF to the shared bucket cache, creating it with the size of
+   SIZE bytes, if it does not exist.  Failure to attach is not an
+   error: the database will just not use the shared cache. */
+int
+_gdbm_shm_cache_open (GDBM_FILE dbf, size_t size)
+{
+  struct stat st, sst;
+  char name[64];
+  int fd;
+  struct shm_cache *shm;
+  struct shm_cache_header *hdr;
+  void *base;
+  size_t nslots, ssize;
+  int nbits;
+
+  if (fstat (dbf->desc, &st))
+    return 0;
+  shm_cache_name (name, sizeof name, &st);
+
+  ssize = slot_size (dbf);
+  fd = shm_open (name, O_RDWR | O_CREAT | O_EXCL, st.st_mode & 0666);
+  if (fd != -1)
+    {
+      /* Created new segment */
+      for (nbits = 0; SHM_CACHE_ALIGN + (ssize << (nbits + 1)) <= size;
+	   nbits++)
+	;
+      if (SHM_CACHE_ALIGN + (ssize << nbits) > size
+	  || fchmod (fd, st.st_mode & 0666)
+	  || ftruncate (fd, SHM_CACHE_ALIGN + (ssize << nbits)))
+	{
+	  GDBM_DEBUG (GDBM_DEBUG_OPEN, "%s: can't create shared cache: %s",
+		      dbf->name, strerror (errno));
+	  shm_unlink (name);
+	  close (fd);
+	  return 0;
+	}
+    }
+  else if (errno != EEXIST
+	   || (fd = shm_open (name, O_RDWR, 0)) == -1)
+    {
+      GDBM_DEBUG (GDBM_DEBUG_OPEN, "%s: can't open shared cache: %s",
+		  dbf->name, strerror (errno));
+      return 0;
+    }
+
+  if (fstat (fd, &sst))
+    {
+      close (fd);
+      return 0;
+    }
+  if (!shm_cache_trusted (&sst, &st))
+    {
+      GDBM_DEBUG (GDBM_DEBUG_OPEN, "%s: shared cache %s has wrong owner "
+		  "or permissions", dbf->name, name);
+      close (fd);
+      return 0;
+    }
+  if (sst.st_size < SHM_CACHE_ALIGN + ssize)
+    {
+      /* The segment is not yet initialized by its creator. */
+      close (fd);
+      return 0;
+    }
+
+  base = mmap (NULL, sst.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close (fd);
+  if (base == MAP_FAILED)
+    return 0;
+
+  hdr = base;
+  nslots = (sst.st_size - SHM_CACHE_ALIGN) / ssize;
+  for (nbits = 0; ((size_t)2 << nbits) <= nslots; nbits++)
+    ;
+  nslots = (size_t)1 << nbits;
+
+  /*
+   * A freshly created segment is filled with zeros.  Its creator and
+   * other processes initialize the header with the same values, so the
+   * race is harmless.
+   */
+  if (__atomic_load_n (&hdr->magic, __ATOMIC_ACQUIRE) == 0)
+    {
+      hdr->bucket_size = dbf->bucket_mem_size;
+      hdr->nslots = nslots;
+      __atomic_store_n (&hdr->magic, SHM_CACHE_MAGIC, __ATOMIC_RELEASE);
+    }
+  if (hdr->magic != SHM_CACHE_MAGIC
+      || hdr->bucket_size != dbf->bucket_mem_size
+      || hdr->nslots != nslots)
+    {
+      GDBM_DEBUG (GDBM_DEBUG_OPEN, "%s: shared cache %s is incompatible",
+		  dbf->name, name);
+      munmap (base, sst.st_size);
+      return 0;
+    }
+
+  shm = malloc (sizeof (*shm));
+  if (!shm)
+    {
+      munmap (base, sst.st_size);
+      GDBM_SET_ERRNO (dbf, GDBM_MALLOC_ERROR, FALSE);
+      return -1;
+    }
+
+  if (shm_cache_attach (hdr))
+    {
+      munmap (base, sst.st_size);
+      free (shm);
+      return 0;
+    }
+
+  shm->base = base;
+  shm->size = sst.st_size;
+  shm->slot_size = ssize;
+  shm->nslots = nslots;
+  shm->nbits = nbits;
+  shm->gen = db_generation (dbf, &st);
+  shm->dev = st.st_dev;
+  shm->ino = st.st_ino;
+  dbf->shm_cache = shm;
+  return 0;
+}
+
+/* Detach DBF from the shared cache.  Remove the segment if DBF was its
+   last user. */
+void
+_gdbm_shm_cache_close (GDBM_FILE dbf)
+{
+  struct shm_cache *shm = dbf->shm_cache;
+
+  if (shm)
+    {
+      if (shm_cache_detach (shm->base))
+	{
+	  struct stat st;
+	  char name[64];
+
+	  st.st_dev = shm->dev;
+	  st.st_ino = shm->ino;
+	  shm_cache_name (name, sizeof name, &st);
+	  shm_unlink (name);
+	}
+      munmap (shm->base, shm->size);
+      free (shm);
+      dbf->shm_cache = NULL;
+    }
+}
+
+/* Remove the shared cache segment of the database file of DBF.
+   Processes that have it attached continue to use it. */
+void
+_gdbm_shm_cache_remove (GDBM_FILE dbf)
+{
+  struct stat st;
+  char name[64];
+
+  if (fstat (dbf->desc, &st) == 0)
+    {
+      shm_cache_name (name, sizeof name, &st);
+      shm_unlink (name);
+    }
+}
+
+/* Look up the bucket at address ADR in the shared cache of DBF.  If
+   found, copy it to BUCKET and return 0.  Otherwise, return -1. */
+int
+_gdbm_shm_cache_get (GDBM_FILE dbf, off_t adr, hash_bucket *bucket)
+{
+  struct shm_cache *shm = dbf->shm_cache;
+  struct shm_cache_slot *slot = SHM_CACHE_SLOT (shm, slot_index (shm, adr));
+  uint64_t seq;
+
+  seq = __atomic_load_n (&slot->seq, __ATOMIC_ACQUIRE);
+  if (SEQ_PID (seq))
+    return -1;
+  if (__atomic_load_n (&slot->gen, __ATOMIC_RELAXED) != shm->gen
+      || __atomic_load_n (&slot->adr, __ATOMIC_RELAXED) != adr)
+    return -1;
+  memcpy (bucket, &slot->u.bucket, dbf->bucket_mem_size);
+  __atomic_thread_fence (__ATOMIC_ACQUIRE);
+  if (__atomic_load_n (&slot->seq, __ATOMIC_RELAXED) != seq)
+    return -1;
+  return 0;
+}
+
+/* Store the BUCKET read from address ADR in the shared cache of DBF. */
+void
+_gdbm_shm_cache_put (GDBM_FILE dbf, off_t adr, hash_bucket const *bucket)
+{
+  struct shm_cache *shm = dbf->shm_cache;
+  struct shm_cache_slot *slot = SHM_CACHE_SLOT (shm, slot_index (shm, adr));
+  uint64_t seq;
+  pid_t pid;
+
+  seq = __atomic_load_n (&slot->seq, __ATOMIC_RELAXED);
+  pid = SEQ_PID (seq);
+  /* Unless its writer has died, leave a locked slot alone. */
+  if (pid && !(kill (pid, 0) == -1 && errno == ESRCH))
+    return;
+  if (!__atomic_compare_exchange_n (&slot->seq, &seq,
+				    (seq & ~(uint64_t)0xffffffff) | getpid (),
+				    FALSE,
+				    __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+    return;
+  __atomic_thread_fence (__ATOMIC_RELEASE);
+  __atomic_store_n (&slot->gen, shm->gen, __ATOMIC_RELAXED);
+  __atomic_store_n (&slot->adr, adr, __ATOMIC_RELAXED);
+  memcpy (&slot->u.bucket, bucket, dbf->bucket_mem_size);
+  __atomic_store_n (&slot->seq, SEQ_NEXT (seq), __ATOMIC_RELEASE);
+}
+
+#else
+
+int
+_gdbm_shm_cache_open (GDBM_FILE dbf, size_t size)
+{
+  return 0;
+}
+
+void
+_gdbm_shm_cache_close (GDBM_FILE dbf)
+{
+}
+
+void
+_gdbm_shm_cache_remove (GDBM_FILE dbf)
+{
+}
+
+int
+_gdbm_shm_cache_get (GDBM_FILE dbf, off_t adr, hash_bucket *bucket)
+{
+  return -1;
+}
+
+void
+_gdbm_shm_cache_put (GDBM_FILE dbf, off_t adr, hash_bucket const *bucket)
+{
+}
+#endif
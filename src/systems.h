@@ -35,6 +35,10 @@
 #include <fcntl.h>
 #include <errno.h>
 #include <limits.h>
+#include <stdint.h>
+#if HAVE_PTHREAD_H
+# include <pthread.h>
+#endif
 
 #ifndef SEEK_SET
 # define SEEK_SET        0
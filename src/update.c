@@ -55,10 +55,9 @@ write_header (GDBM_FILE dbf)
 }
 
 
-/* After all changes have been made in memory, we now write them
-   all to disk. */
-int
-_gdbm_end_update (GDBM_FILE dbf)
+/* Write the changed buckets, directory and header to disk. */
+static int
+write_changes (GDBM_FILE dbf)
 {
   off_t file_pos;	/* Return value for lseek. */
   int rc;
@@ -66,8 +65,22 @@ _gdbm_end_update (GDBM_FILE dbf)
   /* Write the changed buckets if there are any. */
   _gdbm_cache_flush (dbf);
   
-  /* Write the directory. */
-  if (dbf->directory_changed)
+  /* Write the directory, or its changed segments. */
+  if (dbf->directory_changed && gdbm_segdir_p (dbf))
+    {
+      if (_gdbm_segdir_write (dbf))
+	{
+	  GDBM_DEBUG (GDBM_DEBUG_STORE|GDBM_DEBUG_ERR,
+		      "%s: error writing directory: %s",
+		      dbf->name, gdbm_db_strerror (dbf));
+	  _gdbm_fatal (dbf, gdbm_db_strerror (dbf));
+	  return -1;
+	}
+      dbf->directory_changed = FALSE;
+      if (!dbf->header_changed && dbf->fast_write == FALSE)
+	gdbm_file_sync (dbf);
+    }
+  else if (dbf->directory_changed)
     {
       file_pos = gdbm_file_seek (dbf, dbf->header->dir, SEEK_SET);
       if (file_pos != dbf->header->dir)
@@ -77,7 +90,7 @@ _gdbm_end_update (GDBM_FILE dbf)
 	  return -1;
 	}
 
-      rc = _gdbm_full_write (dbf, dbf->dir, dbf->header->dir_size);
+      rc = _gdbm_full_write (dbf, dbf->dir, GDBM_DIR_SIZE (dbf));
       if (rc)
 	{
 	  GDBM_DEBUG (GDBM_DEBUG_STORE|GDBM_DEBUG_ERR,
@@ -92,6 +105,13 @@ _gdbm_end_update (GDBM_FILE dbf)
 	gdbm_file_sync (dbf);
     }
 
+  /* Write back the avail index, which updates the header avail table. */
+  if (_gdbm_avail_index_flush (dbf))
+    {
+      _gdbm_fatal (dbf, gdbm_db_strerror (dbf));
+      return -1;
+    }
+
   /* Final write of the header. */
   if (dbf->header_changed)
     {
@@ -105,6 +125,25 @@ _gdbm_end_update (GDBM_FILE dbf)
   return 0;
 }
 
+/* After all changes have been made in memory, we now write them
+   all to disk. */
+int
+_gdbm_end_update (GDBM_FILE dbf)
+{
+  if (write_changes (dbf) || dbf->need_recovery)
+    return -1;
+
+  /* Now that the file no longer refers to them, drop the references to
+     shared values released by this update.  This may free file space,
+     so write the changes once more. */
+  if (_gdbm_dedup_flush (dbf))
+    {
+      _gdbm_fatal (dbf, gdbm_db_strerror (dbf));
+      return -1;
+    }
+  return write_changes (dbf);
+}
+
 
 /* For backward compatibility, if the caller defined fatal_err function,
    call it upon fatal error and exit. */
@@ -0,0 +1,321 @@
+/*
+  NAME
+    gtalloc - test caller-supplied allocator and cache slab allocation.
+
+  SYNOPSIS
+    gtalloc [-v]
+
+  DESCRIPTION
+    Operation:
+
+    1) Create new database and populate it.
+    2) Install an arena allocator.  Fetch all keys and iterate over
+       the database.  Verify that the returned data come from the arena
+       and are released through the allocator.
+    3) Dump the database.  Verify that the memory allocated for
+       internal iteration is released through the allocator.
+    4) Restore the default allocator and check that invalid
+       allocators are rejected.
+    5) Enable huge page allocation of cache elements, if supported,
+       and fetch all keys again with a large cache.
+
+  OPTIONS
+     -v   Verbosely print what's being done.
+
+  EXIT CODE
+     0    success
+     1    failure
+     2    usage error
+
+  LICENSE
+    This file is part of GDBM test suite.
+    Copyright (C) 2025 Free Software Foundation, Inc.
+
+    GDBM is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2, or (at your option)
+    any later version.
+
+    GDBM is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GDBM. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "autoconf.h"
+#include "gdbmdefs.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+char dbname[] = "a.db";
+int verbose = 0;
+
+#define NKEYS 2048
+
+/* A trivial arena: memory is allocated sequentially and released all
+   at once. */
+struct arena
+{
+  char buf[64*1024];
+  size_t pos;
+  size_t nalloc;
+  size_t nfree;
+};
+
+static void *
+arena_alloc (size_t size, void *data)
+{
+  struct arena *a = data;
+  void *p;
+
+  size = (size + 7) & ~7;
+  if (a->pos + size > sizeof (a->buf))
+    return NULL;
+  p = a->buf + a->pos;
+  a->pos += size;
+  a->nalloc++;
+  return p;
+}
+
+static void
+arena_free (void *ptr, void *data)
+{
+  struct arena *a = data;
+
+  if ((char*)ptr < a->buf || (char*)ptr >= a->buf + sizeof (a->buf))
+    {
+      fprintf (stderr, "freeing memory not from arena\n");
+      exit (1);
+    }
+  a->nfree++;
+}
+
+static void
+arena_reset (struct arena *a)
+{
+  a->pos = 0;
+}
+
+static int
+in_arena (struct arena *a, void *ptr)
+{
+  return (char*)ptr >= a->buf && (char*)ptr < a->buf + sizeof (a->buf);
+}
+
+static void
+fetch_all (GDBM_FILE dbf, struct arena *a)
+{
+  datum key, content;
+  int i;
+
+  key.dsize = sizeof (i);
+  key.dptr = (char*) &i;
+  for (i = 0; i < NKEYS; i++)
+    {
+      content = gdbm_fetch (dbf, key);
+      if (content.dptr == NULL)
+	{
+	  fprintf (stderr, "%d: fetch failed: %s\n", i,
+		   gdbm_db_strerror (dbf));
+	  exit (1);
+	}
+      if (content.dsize != sizeof (int) || *(int*)content.dptr != i)
+	{
+	  fprintf (stderr, "%d: wrong content\n", i);
+	  exit (1);
+	}
+      if (a)
+	{
+	  if (!in_arena (a, content.dptr))
+	    {
+	      fprintf (stderr, "%d: data not allocated from arena\n", i);
+	      exit (1);
+	    }
+	  arena_reset (a);
+	}
+      else
+	free (content.dptr);
+    }
+}
+
+int
+main (int argc, char **argv)
+{
+  GDBM_FILE dbf;
+  datum key, content;
+  struct arena *arena;
+  gdbm_allocator alloc, ret;
+  int i, n;
+  size_t size;
+
+  while ((i = getopt (argc, argv, "v")) != EOF)
+    {
+      switch (i)
+	{
+	case 'v':
+	  verbose++;
+	  break;
+
+	default:
+	  return 2;
+	}
+    }
+
+  /*
+   * 1) Create and populate the database.
+   */
+  if (verbose)
+    printf ("creating database\n");
+  dbf = gdbm_open (dbname, GDBM_MIN_BLOCK_SIZE, GDBM_NEWDB, 0644, NULL);
+  if (!dbf)
+    {
+      fprintf (stderr, "gdbm_open: %s\n", gdbm_strerror (gdbm_errno));
+      return 1;
+    }
+  key.dsize = sizeof (i);
+  key.dptr = (char*) &i;
+  content.dsize = sizeof (i);
+  content.dptr = (char*) &i;
+  for (i = 0; i < NKEYS; i++)
+    {
+      if (gdbm_store (dbf, key, content, 0) != 0)
+	{
+	  fprintf (stderr, "%d: item not inserted: %s\n",
+		   i, gdbm_db_strerror (dbf));
+	  return 1;
+	}
+    }
+
+  /*
+   * 2) Arena allocator.
+   */
+  if (verbose)
+    printf ("using arena allocator\n");
+  arena = calloc (1, sizeof (*arena));
+  if (!arena)
+    {
+      perror ("calloc");
+      return 1;
+    }
+  alloc.alloc = arena_alloc;
+  alloc.free = arena_free;
+  alloc.data = arena;
+  if (gdbm_setopt (dbf, GDBM_SETALLOCATOR, &alloc, sizeof (alloc)))
+    {
+      fprintf (stderr, "GDBM_SETALLOCATOR: %s\n", gdbm_strerror (gdbm_errno));
+      return 1;
+    }
+  if (gdbm_setopt (dbf, GDBM_GETALLOCATOR, &ret, sizeof (ret))
+      || memcmp (&ret, &alloc, sizeof (ret)))
+    {
+      fprintf (stderr, "GDBM_GETALLOCATOR returned wrong value\n");
+      return 1;
+    }
+  fetch_all (dbf, arena);
+
+  n = 0;
+  for (key = gdbm_firstkey (dbf); key.dptr; )
+    {
+      datum next;
+
+      if (!in_arena (arena, key.dptr))
+	{
+	  fprintf (stderr, "key not allocated from arena\n");
+	  return 1;
+	}
+      next = gdbm_nextkey (dbf, key);
+      arena_free (key.dptr, arena);
+      arena_reset (arena);
+      key = next;
+      n++;
+    }
+  if (n != NKEYS)
+    {
+      fprintf (stderr, "iterated over %d keys\n", n);
+      return 1;
+    }
+  if (verbose)
+    printf ("allocated %zu, freed %zu\n", arena->nalloc, arena->nfree);
+  if (arena->nalloc != NKEYS + NKEYS || arena->nfree != NKEYS)
+    {
+      fprintf (stderr, "unexpected number of allocations\n");
+      return 1;
+    }
+
+  /*
+   * 3) Internal iteration.
+   */
+  if (verbose)
+    printf ("dumping database\n");
+  arena->nalloc = arena->nfree = 0;
+  /* The arena is reset only when the dump is complete. */
+  if (gdbm_export (dbf, "a.dump", GDBM_NEWDB, 0600) == -1)
+    {
+      fprintf (stderr, "gdbm_export: %s\n", gdbm_db_strerror (dbf));
+      return 1;
+    }
+  arena_reset (arena);
+  if (verbose)
+    printf ("allocated %zu, freed %zu\n", arena->nalloc, arena->nfree);
+  if (arena->nalloc == 0 || arena->nalloc != arena->nfree)
+    {
+      fprintf (stderr, "allocations not balanced\n");
+      return 1;
+    }
+
+  /*
+   * 4) Default allocator.
+   */
+  alloc.free = NULL;
+  if (gdbm_setopt (dbf, GDBM_SETALLOCATOR, &alloc, sizeof (alloc)) == 0
+      || gdbm_errno != GDBM_OPT_BADVAL)
+    {
+      fprintf (stderr, "GDBM_SETALLOCATOR accepted invalid allocator\n");
+      return 1;
+    }
+  memset (&alloc, 0, sizeof (alloc));
+  if (gdbm_setopt (dbf, GDBM_SETALLOCATOR, &alloc, sizeof (alloc)))
+    {
+      fprintf (stderr, "GDBM_SETALLOCATOR: %s\n", gdbm_strerror (gdbm_errno));
+      return 1;
+    }
+  fetch_all (dbf, NULL);
+  free (arena);
+
+  /*
+   * 5) Huge pages.
+   */
+  n = TRUE;
+  if (gdbm_setopt (dbf, GDBM_SETCACHEHUGEPAGES, &n, sizeof (n)) == 0)
+    {
+      if (verbose)
+	printf ("using huge pages\n");
+      if (gdbm_setopt (dbf, GDBM_GETCACHEHUGEPAGES, &n, sizeof (n))
+	  || n != TRUE)
+	{
+	  fprintf (stderr, "GDBM_GETCACHEHUGEPAGES returned wrong value\n");
+	  return 1;
+	}
+    }
+  else if (verbose)
+    printf ("huge pages not supported\n");
+  size = 1024;
+  if (gdbm_setopt (dbf, GDBM_SETCACHESIZE, &size, sizeof (size)))
+    {
+      fprintf (stderr, "GDBM_SETCACHESIZE: %s\n", gdbm_strerror (gdbm_errno));
+      return 1;
+    }
+  fetch_all (dbf, NULL);
+  fetch_all (dbf, NULL);
+
+  if (gdbm_close (dbf))
+    {
+      fprintf (stderr, "gdbm_close: %s\n", gdbm_strerror (gdbm_errno));
+      return 1;
+    }
+  return 0;
+}
@@ -0,0 +1,346 @@
+/*
+  NAME
+    gtavailidx - test in-memory index of available space.
+
+  SYNOPSIS
+    gtavailidx [-v]
+
+  DESCRIPTION
+    Operation:
+
+    1) Create new database, enable the avail index and populate it
+       with records of varying size.
+    2) Delete every other record and store them back.  Verify that the
+       freed space has been reused and the file has not grown.
+    3) Delete every other record and close the database.  The avail
+       index must be written back to the avail stack.
+    4) Reopen the database without avail index.  Verify the avail
+       stack and the remaining records.
+    5) Store the deleted records back using the default allocator and
+       verify all records.
+    6) In a child process, enable the avail index, delete every other
+       record and exit without closing the database.
+    7) Reopen the database.  Verify that the avail stack has been kept
+       up to date, and that storing the records back with the avail
+       index reuses the freed space.
+
+  OPTIONS
+     -v   Verbosely print what's being done.
+
+  EXIT CODE
+     0    success
+     1    failure
+     2    usage error
+
+  LICENSE
+    This file is part of GDBM test suite.
+    Copyright (C) 2025 Free Software Foundation, Inc.
+
+    GDBM is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2, or (at your option)
+    any later version.
+
+    GDBM is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GDBM. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "autoconf.h"
+#include "gdbmdefs.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+char dbname[] = "a.db";
+int verbose = 0;
+
+#define NKEYS 2048
+#define MAXDATA 128
+
+static int
+data_size (int i)
+{
+  return 8 + (i * 37) % (MAXDATA - 8);
+}
+
+static void
+store (GDBM_FILE dbf, int i)
+{
+  datum key, content;
+  char data[MAXDATA];
+
+  memset (data, i & 0xff, sizeof (data));
+  key.dsize = sizeof (i);
+  key.dptr = (char*) &i;
+  content.dsize = data_size (i);
+  content.dptr = data;
+  if (gdbm_store (dbf, key, content, GDBM_REPLACE) != 0)
+    {
+      fprintf (stderr, "%d: item not inserted: %s\n",
+	       i, gdbm_db_strerror (dbf));
+      exit (1);
+    }
+}
+
+static void
+delete (GDBM_FILE dbf, int i)
+{
+  datum key;
+
+  key.dsize = sizeof (i);
+  key.dptr = (char*) &i;
+  if (gdbm_delete (dbf, key))
+    {
+      fprintf (stderr, "%d: item not deleted: %s\n",
+	       i, gdbm_db_strerror (dbf));
+      exit (1);
+    }
+}
+
+/* Verify that keys with (i % mod) != 0 exist and others don't. */
+static void
+verify (GDBM_FILE dbf, int mod)
+{
+  datum key, content;
+  int i, j;
+
+  key.dsize = sizeof (i);
+  key.dptr = (char*) &i;
+  for (i = 0; i < NKEYS; i++)
+    {
+      content = gdbm_fetch (dbf, key);
+      if (mod && i % mod == 0)
+	{
+	  if (content.dptr)
+	    {
+	      fprintf (stderr, "%d: deleted key found\n", i);
+	      exit (1);
+	    }
+	  continue;
+	}
+      if (content.dptr == NULL)
+	{
+	  fprintf (stderr, "%d: fetch failed: %s\n", i,
+		   gdbm_db_strerror (dbf));
+	  exit (1);
+	}
+      if (content.dsize != data_size (i))
+	{
+	  fprintf (stderr, "%d: wrong size\n", i);
+	  exit (1);
+	}
+      for (j = 0; j < content.dsize; j++)
+	if ((unsigned char) content.dptr[j] != (i & 0xff))
+	  {
+	    fprintf (stderr, "%d: wrong content\n", i);
+	    exit (1);
+	  }
+      free (content.dptr);
+    }
+}
+
+static void
+setopt (GDBM_FILE dbf, int opt, char const *optname, int val)
+{
+  if (gdbm_setopt (dbf, opt, &val, sizeof (val)))
+    {
+      fprintf (stderr, "%s: %s\n", optname, gdbm_strerror (gdbm_errno));
+      exit (1);
+    }
+}
+
+#define SETOPT(dbf, opt, val) setopt (dbf, opt, #opt, val)
+
+static GDBM_FILE
+reopen (void)
+{
+  GDBM_FILE dbf = gdbm_open (dbname, 0, GDBM_WRITER, 0, NULL);
+  if (!dbf)
+    {
+      fprintf (stderr, "gdbm_open: %s\n", gdbm_strerror (gdbm_errno));
+      exit (1);
+    }
+  return dbf;
+}
+
+int
+main (int argc, char **argv)
+{
+  GDBM_FILE dbf;
+  int i, n;
+  off_t size;
+  pid_t pid;
+  int status;
+
+  while ((i = getopt (argc, argv, "v")) != EOF)
+    {
+      switch (i)
+	{
+	case 'v':
+	  verbose++;
+	  break;
+
+	default:
+	  return 2;
+	}
+    }
+
+  /*
+   * 1) Create and populate the database.
+   */
+  if (verbose)
+    printf ("creating database\n");
+  dbf = gdbm_open (dbname, GDBM_MIN_BLOCK_SIZE, GDBM_NEWDB, 0644, NULL);
+  if (!dbf)
+    {
+      fprintf (stderr, "gdbm_open: %s\n", gdbm_strerror (gdbm_errno));
+      return 1;
+    }
+  SETOPT (dbf, GDBM_SETAVAILINDEX, TRUE);
+  SETOPT (dbf, GDBM_SETCENTFREE, TRUE);
+  if (gdbm_setopt (dbf, GDBM_GETAVAILINDEX, &n, sizeof (n)) || n != TRUE)
+    {
+      fprintf (stderr, "GDBM_GETAVAILINDEX returned wrong value\n");
+      return 1;
+    }
+  for (i = 0; i < NKEYS; i++)
+    store (dbf, i);
+
+  /*
+   * 2) Churn: freed space must be reused.
+   */
+  size = dbf->header->next_block;
+  for (n = 0; n < 4; n++)
+    {
+      if (verbose)
+	printf ("pass %d: deleting and storing back\n", n);
+      for (i = 0; i < NKEYS; i += 2)
+	delete (dbf, i);
+      verify (dbf, 2);
+      for (i = 0; i < NKEYS; i += 2)
+	store (dbf, i);
+      verify (dbf, 0);
+    }
+  if (verbose)
+    printf ("next_block: %lu -> %lu\n",
+	    (unsigned long) size, (unsigned long) dbf->header->next_block);
+  if (dbf->header->next_block > size)
+    {
+      fprintf (stderr, "file has grown\n");
+      return 1;
+    }
+
+  /*
+   * 3) Write back the index.
+   */
+  if (verbose)
+    printf ("deleting every other record\n");
+  for (i = 0; i < NKEYS; i += 2)
+    delete (dbf, i);
+  if (gdbm_close (dbf))
+    {
+      fprintf (stderr, "gdbm_close: %s\n", gdbm_strerror (gdbm_errno));
+      return 1;
+    }
+
+  /*
+   * 4) Verify the written avail stack.
+   */
+  if (verbose)
+    printf ("reopening database\n");
+  dbf = reopen ();
+  if (dbf->avail->next_block == 0)
+    {
+      fprintf (stderr, "avail stack was not written\n");
+      return 1;
+    }
+  if (gdbm_avail_verify (dbf))
+    {
+      fprintf (stderr, "gdbm_avail_verify: %s\n", gdbm_db_strerror (dbf));
+      return 1;
+    }
+  verify (dbf, 2);
+
+  /*
+   * 5) Use the default allocator.
+   */
+  if (verbose)
+    printf ("storing back with default allocator\n");
+  for (i = 0; i < NKEYS; i += 2)
+    store (dbf, i);
+  verify (dbf, 0);
+  if (gdbm_close (dbf))
+    {
+      fprintf (stderr, "gdbm_close: %s\n", gdbm_strerror (gdbm_errno));
+      return 1;
+    }
+
+  /*
+   * 6) Delete records and exit without closing the database.
+   */
+  if (verbose)
+    printf ("deleting records in child process\n");
+  pid = fork ();
+  if (pid == -1)
+    {
+      perror ("fork");
+      return 1;
+    }
+  if (pid == 0)
+    {
+      dbf = reopen ();
+      SETOPT (dbf, GDBM_SETAVAILINDEX, TRUE);
+      for (i = 0; i < NKEYS; i += 2)
+	delete (dbf, i);
+      _exit (0);
+    }
+  if (waitpid (pid, &status, 0) != pid
+      || !WIFEXITED (status) || WEXITSTATUS (status) != 0)
+    {
+      fprintf (stderr, "child process failed\n");
+      return 1;
+    }
+
+  /*
+   * 7) Verify that the freed space is on record.
+   */
+  if (verbose)
+    printf ("reopening database\n");
+  dbf = reopen ();
+  if (dbf->avail->count == 0 && dbf->avail->next_block == 0)
+    {
+      fprintf (stderr, "free space lost\n");
+      return 1;
+    }
+  if (gdbm_avail_verify (dbf))
+    {
+      fprintf (stderr, "gdbm_avail_verify: %s\n", gdbm_db_strerror (dbf));
+      return 1;
+    }
+  verify (dbf, 2);
+  SETOPT (dbf, GDBM_SETAVAILINDEX, TRUE);
+  size = dbf->header->next_block;
+  for (i = 0; i < NKEYS; i += 2)
+    store (dbf, i);
+  verify (dbf, 0);
+  if (verbose)
+    printf ("next_block: %lu -> %lu\n",
+	    (unsigned long) size, (unsigned long) dbf->header->next_block);
+  if (dbf->header->next_block > size)
+    {
+      fprintf (stderr, "file has grown\n");
+      return 1;
+    }
+  if (gdbm_close (dbf))
+    {
+      fprintf (stderr, "gdbm_close: %s\n", gdbm_strerror (gdbm_errno));
+      return 1;
+    }
+  return 0;
+}
@@ -0,0 +1,250 @@
+/*
+  NAME
+    gtcachemem - test cache memory budget and automatic cache sizing.
+
+  SYNOPSIS
+    gtcachemem [-v]
+
+  DESCRIPTION
+    Checks that the automatically sized cache grows when the hit ratio
+    is low and shrinks when a small working set yields a high hit ratio,
+    and that the memory used by the cache stays within the budget set
+    by GDBM_SETCACHEMEM.
+
+    Operation:
+
+    1) Create new database and populate it with NKEYS keys.
+    2) Set cache size to 16 and then enable automatic sizing.
+    3) Fetch all keys twice.  Verify that the cache has grown.
+    4) Fetch a single key repeatedly.  Verify that the cache has shrunk.
+    5) Set memory budget and fetch all keys.  Verify that the memory
+       usage stays within the budget.
+    6) Check the GDBM_GETCACHEMEM and GDBM_SETCACHEMEMCG options.
+
+  OPTIONS
+     -v   Verbosely print what's being done.
+
+  EXIT CODE
+     0    success
+     1    failure
+     2    usage error
+
+  LICENSE
+    This file is part of GDBM test suite.
+    Copyright (C) 2025 Free Software Foundation, Inc.
+
+    GDBM is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2, or (at your option)
+    any later version.
+
+    GDBM is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GDBM. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "autoconf.h"
+#include "gdbmdefs.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+
+char dbname[] = "a.db";
+int verbose = 0;
+
+#define NKEYS 32768
+#define DATASIZE 8
+#define INIT_CACHE_SIZE 16
+#define CACHE_BUDGET (64*1024)
+
+static size_t
+get_size_opt (GDBM_FILE dbf, int opt, char const *optname)
+{
+  size_t size;
+
+  if (gdbm_setopt (dbf, opt, &size, sizeof (size)))
+    {
+      fprintf (stderr, "%s: %s\n", optname, gdbm_strerror (gdbm_errno));
+      exit (1);
+    }
+  if (verbose)
+    printf ("%s = %zu\n", optname, size);
+  return size;
+}
+
+#define GET_SIZE_OPT(dbf, opt) get_size_opt (dbf, opt, #opt)
+
+static void
+set_size_opt (GDBM_FILE dbf, int opt, char const *optname, size_t size)
+{
+  if (gdbm_setopt (dbf, opt, &size, sizeof (size)))
+    {
+      fprintf (stderr, "%s: %s\n", optname, gdbm_strerror (gdbm_errno));
+      exit (1);
+    }
+}
+
+#define SET_SIZE_OPT(dbf, opt, size) set_size_opt (dbf, opt, #opt, size)
+
+static void
+fetch_key (GDBM_FILE dbf, int i)
+{
+  datum key, content;
+
+  key.dsize = sizeof (i);
+  key.dptr = (char*) &i;
+  content = gdbm_fetch (dbf, key);
+  if (content.dptr == NULL)
+    {
+      fprintf (stderr, "%d: fetch failed: %s\n", i, gdbm_db_strerror (dbf));
+      exit (1);
+    }
+  if (content.dsize != DATASIZE || *(int*)content.dptr != i)
+    {
+      fprintf (stderr, "%d: wrong content\n", i);
+      exit (1);
+    }
+  free (content.dptr);
+}
+
+int
+main (int argc, char **argv)
+{
+  GDBM_FILE dbf;
+  datum key, content;
+  char data[DATASIZE];
+  int i, n;
+  size_t size, budget;
+
+  while ((i = getopt (argc, argv, "v")) != EOF)
+    {
+      switch (i)
+	{
+	case 'v':
+	  verbose++;
+	  break;
+
+	default:
+	  return 2;
+	}
+    }
+
+  /*
+   * 1) Create and populate new database.
+   */
+  if (verbose)
+    printf ("creating database\n");
+
+  dbf = gdbm_open (dbname, GDBM_MIN_BLOCK_SIZE, GDBM_NEWDB, 0644, NULL);
+  if (!dbf)
+    {
+      fprintf (stderr, "gdbm_open: %s\n", gdbm_strerror (gdbm_errno));
+      return 1;
+    }
+
+  if (verbose)
+    printf ("populating database (%d keys)\n", NKEYS);
+  memset (data, 0, sizeof (data));
+  content.dsize = DATASIZE;
+  content.dptr = data;
+  key.dsize = sizeof (i);
+  key.dptr = (char*) &i;
+  for (i = 0; i < NKEYS; i++)
+    {
+      *(int*)data = i;
+      if (gdbm_store (dbf, key, content, 0) != 0)
+	{
+	  fprintf (stderr, "%d: item not inserted: %s\n",
+		   i, gdbm_db_strerror (dbf));
+	  gdbm_close (dbf);
+	  return 1;
+	}
+    }
+
+  /*
+   * 2) Start with a small cache and enable automatic sizing.
+   */
+  SET_SIZE_OPT (dbf, GDBM_SETCACHESIZE, INIT_CACHE_SIZE);
+  SET_SIZE_OPT (dbf, GDBM_SETCACHESIZE, GDBM_CACHE_AUTO);
+
+  /*
+   * 3) Low hit ratio: the cache must grow.
+   */
+  if (verbose)
+    printf ("fetching all keys\n");
+  for (n = 0; n < 2; n++)
+    for (i = 0; i < NKEYS; i++)
+      fetch_key (dbf, i);
+  size = GET_SIZE_OPT (dbf, GDBM_GETCACHESIZE);
+  if (size <= INIT_CACHE_SIZE)
+    {
+      fprintf (stderr, "cache has not grown\n");
+      return 1;
+    }
+
+  /*
+   * 4) Small working set: the cache must shrink.
+   */
+  if (verbose)
+    printf ("fetching single key\n");
+  for (n = 0; n < 16 * NKEYS; n++)
+    fetch_key (dbf, n % 2);
+  if (GET_SIZE_OPT (dbf, GDBM_GETCACHESIZE) >= size)
+    {
+      fprintf (stderr, "cache has not shrunk\n");
+      return 1;
+    }
+
+  /*
+   * 5) Memory budget.
+   */
+  budget = dbf->header->dir_size + CACHE_BUDGET;
+  SET_SIZE_OPT (dbf, GDBM_SETCACHEMEM, budget);
+  if (verbose)
+    printf ("fetching all keys with budget %zu\n", budget);
+  for (i = 0; i < NKEYS; i++)
+    {
+      fetch_key (dbf, i);
+      /* The data cache of the current bucket can be enlarged after
+	 the bucket has been looked up. */
+      if (GET_SIZE_OPT (dbf, GDBM_GETCACHEMEMUSAGE)
+	  > budget + DATASIZE + sizeof (i))
+	{
+	  fprintf (stderr, "%d: memory budget exceeded\n", i);
+	  return 1;
+	}
+    }
+
+  /*
+   * 6) Other options.
+   */
+  if (GET_SIZE_OPT (dbf, GDBM_GETCACHEMEM) != budget)
+    {
+      fprintf (stderr, "GDBM_GETCACHEMEM returned wrong value\n");
+      return 1;
+    }
+
+  n = 0;
+  if (gdbm_setopt (dbf, GDBM_SETCACHEMEMCG, &n, sizeof (n)) == 0
+      || gdbm_errno != GDBM_OPT_BADVAL)
+    {
+      fprintf (stderr, "GDBM_SETCACHEMEMCG accepted invalid value\n");
+      return 1;
+    }
+  n = 50;
+  if (gdbm_setopt (dbf, GDBM_SETCACHEMEMCG, &n, sizeof (n)))
+    {
+      fprintf (stderr, "GDBM_SETCACHEMEMCG: %s\n", gdbm_strerror (gdbm_errno));
+      return 1;
+    }
+
+  if (gdbm_close (dbf))
+    {
+      fprintf (stderr, "gdbm_close: %s\n", gdbm_strerror (gdbm_errno));
+      return 1;
+    }
+  return 0;
+}
@@ -0,0 +1,280 @@
+/*
+  NAME
+    gtcachepool - test shared bucket cache pool.
+
+  SYNOPSIS
+    gtcachepool [-v]
+
+  DESCRIPTION
+    Opens several databases attached to the same cache pool and checks
+    that the memory used by their caches stays within the pool budget,
+    and that the cache memory migrates to the database in use.
+
+    Operation:
+
+    1) Create cache pool.
+    2) Create NDB databases attached to the pool and populate them.
+    3) Fetch all keys from all databases.  Verify that the pool memory
+       usage stays within the budget.
+    4) Fetch all keys from the first database.  Verify that it
+       holds more cached buckets than any other database.
+    5) If threads are supported, update and fetch all keys in all
+       databases simultaneously, using a separate thread for each
+       database.
+
+  OPTIONS
+     -v   Verbosely print what's being done.
+
+  EXIT CODE
+     0    success
+     1    failure
+     2    usage error
+
+  LICENSE
+    This file is part of GDBM test suite.
+    Copyright (C) 2025 Free Software Foundation, Inc.
+
+    GDBM is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2, or (at your option)
+    any later version.
+
+    GDBM is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GDBM. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "autoconf.h"
+#include "gdbmdefs.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#if HAVE_PTHREAD_H
+# include <pthread.h>
+#endif
+
+int verbose = 0;
+
+#define NDB 3
+#define NKEYS 8192
+#define DATASIZE 8
+#define POOL_SIZE (128*1024)
+
+/* Data cache of the current bucket can be enlarged after the bucket
+   has been looked up. */
+#define POOL_SLACK (NDB * (DATASIZE + sizeof (int)))
+
+static void
+fetch_key (GDBM_FILE dbf, int i)
+{
+  datum key, content;
+
+  key.dsize = sizeof (i);
+  key.dptr = (char*) &i;
+  content = gdbm_fetch (dbf, key);
+  if (content.dptr == NULL)
+    {
+      fprintf (stderr, "%d: fetch failed: %s\n", i, gdbm_db_strerror (dbf));
+      exit (1);
+    }
+  if (content.dsize != DATASIZE || *(int*)content.dptr != i)
+    {
+      fprintf (stderr, "%d: wrong content\n", i);
+      exit (1);
+    }
+  free (content.dptr);
+}
+
+#if HAVE_PTHREAD_H
+static void *
+thread_main (void *arg)
+{
+  GDBM_FILE dbf = arg;
+  datum key, content;
+  char data[DATASIZE];
+  int i;
+
+  memset (data, 0, sizeof (data));
+  content.dsize = DATASIZE;
+  content.dptr = data;
+  key.dsize = sizeof (i);
+  key.dptr = (char*) &i;
+  for (i = 0; i < NKEYS; i++)
+    {
+      *(int*)data = i;
+      if (gdbm_store (dbf, key, content, GDBM_REPLACE) != 0)
+	{
+	  fprintf (stderr, "%d: item not replaced: %s\n",
+		   i, gdbm_db_strerror (dbf));
+	  exit (1);
+	}
+      fetch_key (dbf, NKEYS - i - 1);
+    }
+  return NULL;
+}
+#endif
+
+static void
+check_usage (gdbm_cache_pool *pool)
+{
+  size_t n = gdbm_cache_pool_usage (pool);
+  if (n > POOL_SIZE + POOL_SLACK)
+    {
+      fprintf (stderr, "pool budget exceeded: %zu\n", n);
+      exit (1);
+    }
+}
+
+int
+main (int argc, char **argv)
+{
+  gdbm_cache_pool *pool;
+  GDBM_FILE dbf[NDB];
+  struct gdbm_open_spec spec = GDBM_OPEN_SPEC_INITIALIZER;
+  datum key, content;
+  char data[DATASIZE];
+  char dbname[16];
+  int i, n;
+  size_t count[NDB];
+
+  while ((i = getopt (argc, argv, "v")) != EOF)
+    {
+      switch (i)
+	{
+	case 'v':
+	  verbose++;
+	  break;
+
+	default:
+	  return 2;
+	}
+    }
+
+  /*
+   * 1) Create cache pool.
+   */
+  if (gdbm_cache_pool_create (0) != NULL)
+    {
+      fprintf (stderr, "gdbm_cache_pool_create accepted 0 size\n");
+      return 1;
+    }
+  pool = gdbm_cache_pool_create (POOL_SIZE);
+  if (!pool)
+    {
+      fprintf (stderr, "gdbm_cache_pool_create: %s\n",
+	       gdbm_strerror (gdbm_errno));
+      return 1;
+    }
+
+  /*
+   * 2) Create and populate databases.
+   */
+  spec.block_size = GDBM_MIN_BLOCK_SIZE;
+  spec.mode = 0644;
+  spec.cache_pool = pool;
+
+  memset (data, 0, sizeof (data));
+  content.dsize = DATASIZE;
+  content.dptr = data;
+  key.dsize = sizeof (i);
+  key.dptr = (char*) &i;
+  for (n = 0; n < NDB; n++)
+    {
+      snprintf (dbname, sizeof dbname, "%d.db", n);
+      if (verbose)
+	printf ("creating database %s\n", dbname);
+      dbf[n] = gdbm_open_ext (dbname, GDBM_NEWDB, &spec);
+      if (!dbf[n])
+	{
+	  fprintf (stderr, "gdbm_open_ext: %s\n", gdbm_strerror (gdbm_errno));
+	  return 1;
+	}
+      for (i = 0; i < NKEYS; i++)
+	{
+	  *(int*)data = i;
+	  if (gdbm_store (dbf[n], key, content, 0) != 0)
+	    {
+	      fprintf (stderr, "%d: item not inserted: %s\n",
+		       i, gdbm_db_strerror (dbf[n]));
+	      return 1;
+	    }
+	  check_usage (pool);
+	}
+    }
+
+  /*
+   * 3) Fetch all keys from all databases.
+   */
+  if (verbose)
+    printf ("fetching keys from all databases\n");
+  for (i = 0; i < NKEYS; i++)
+    for (n = 0; n < NDB; n++)
+      {
+	fetch_key (dbf[n], i);
+	check_usage (pool);
+      }
+
+  /*
+   * 4) Fetch all keys from the first database.
+   */
+  if (verbose)
+    printf ("fetching keys from %d.db\n", 0);
+  for (i = 0; i < NKEYS; i++)
+    {
+      fetch_key (dbf[0], i);
+      check_usage (pool);
+    }
+
+  for (n = 0; n < NDB; n++)
+    {
+      gdbm_get_cache_stats (dbf[n], NULL, NULL, &count[n], NULL, 0);
+      if (verbose)
+	printf ("%d.db: %zu cached buckets\n", n, count[n]);
+    }
+  for (n = 1; n < NDB; n++)
+    if (count[n] >= count[0])
+      {
+	fprintf (stderr, "%d.db: cache memory not reclaimed\n", n);
+	return 1;
+      }
+
+#if HAVE_PTHREAD_H
+  /*
+   * 5) Use all databases simultaneously.
+   */
+  if (verbose)
+    printf ("using databases in %d threads\n", NDB);
+  {
+    pthread_t tid[NDB];
+
+    for (n = 0; n < NDB; n++)
+      {
+	int rc = pthread_create (&tid[n], NULL, thread_main, dbf[n]);
+	if (rc)
+	  {
+	    fprintf (stderr, "pthread_create: %s\n", strerror (rc));
+	    return 1;
+	  }
+      }
+    for (n = 0; n < NDB; n++)
+      pthread_join (tid[n], NULL);
+  }
+  check_usage (pool);
+#endif
+
+  /* The pool remains valid until the last database is closed. */
+  gdbm_cache_pool_destroy (pool);
+  for (n = 0; n < NDB; n++)
+    {
+      if (gdbm_close (dbf[n]))
+	{
+	  fprintf (stderr, "gdbm_close: %s\n", gdbm_strerror (gdbm_errno));
+	  return 1;
+	}
+    }
+  return 0;
+}
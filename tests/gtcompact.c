@@ -0,0 +1,238 @@
+/*
+  NAME
+    gtcompact - test compact bucket encoding.
+
+  SYNOPSIS
+    gtcompact [-iv]
+
+  DESCRIPTION
+    Operation:
+
+    1) Create two databases with the same block size, one of them with
+       GDBM_COMPACT, and populate them with the same records.  Verify
+       that buckets of the compact database hold more elements and that
+       it uses fewer buckets.
+    2) Reopen the compact database with a small bucket cache, so that
+       buckets are frequently written and read back, and check its
+       format and contents.
+    3) Replace records with larger ones, append to records, and delete
+       some records.
+    4) Check that the database cannot be converted to another format.
+    5) Reorganize the database.
+
+    After each step the contents of the database is verified and
+    the available space is checked.
+
+  OPTIONS
+     -i   Keep tiny records inline (GDBM_INLINE).
+     -v   Verbosely print what's being done.
+
+  EXIT CODE
+     0    success
+     1    failure
+     2    usage error
+
+  LICENSE
+    This file is part of GDBM test suite.
+    Copyright (C) 2025 Free Software Foundation, Inc.
+
+    GDBM is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2, or (at your option)
+    any later version.
+
+    GDBM is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GDBM. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "autoconf.h"
+#include "gdbmdefs.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "records.h"
+
+char dbname[] = "a.db";
+char stdname[] = "b.db";
+int verbose = 0;
+
+#define BLOCK_SIZE 1024
+#define NKEYS 5000
+#define MAXSIZE 100
+
+static GDBM_FILE
+open_db (char *name, int flags)
+{
+  GDBM_FILE dbf = gdbm_open (name, BLOCK_SIZE, flags | GDBM_BSEXACT,
+			     0644, NULL);
+  if (!dbf)
+    {
+      fprintf (stderr, "gdbm_open: %s\n", gdbm_strerror (gdbm_errno));
+      exit (1);
+    }
+  return dbf;
+}
+
+static void
+verify (GDBM_FILE dbf)
+{
+  rec_verify (dbf);
+  if (gdbm_avail_verify (dbf))
+    {
+      fprintf (stderr, "gdbm_avail_verify: %s\n", gdbm_db_strerror (dbf));
+      exit (1);
+    }
+}
+
+/* Return the number of buckets in DBF. */
+static int
+bucket_count (GDBM_FILE dbf)
+{
+  int i, n = 0;
+
+  for (i = 0; i < GDBM_DIR_COUNT (dbf); i = _gdbm_next_bucket_dir (dbf, i))
+    n++;
+  return n;
+}
+
+int
+main (int argc, char **argv)
+{
+  GDBM_FILE dbf, stddbf;
+  int i, n;
+  int flags = GDBM_COMPACT;
+  int elems, nbuckets, stdbuckets;
+
+  while ((i = getopt (argc, argv, "iv")) != EOF)
+    {
+      switch (i)
+	{
+	case 'i':
+	  flags |= GDBM_INLINE;
+	  break;
+
+	case 'v':
+	  verbose++;
+	  break;
+
+	default:
+	  return 2;
+	}
+    }
+
+  /*
+   * 1) Create and populate the databases.
+   */
+  if (verbose)
+    printf ("creating databases\n");
+  dbf = open_db (dbname, GDBM_NEWDB | flags);
+  stddbf = open_db (stdname, GDBM_NEWDB);
+  rec_init (NKEYS);
+  for (i = 0; i < NKEYS; i++)
+    {
+      rec_store (dbf, i, i % 5 == 0 ? MAXSIZE - i % 7 : i % 13);
+      rec_write (stddbf, i);
+    }
+  verify (dbf);
+
+  if (gdbm_setopt (dbf, GDBM_GETBUCKETSIZE, &elems, sizeof (elems)))
+    {
+      fprintf (stderr, "GDBM_GETBUCKETSIZE: %s\n", gdbm_db_strerror (dbf));
+      return 1;
+    }
+  nbuckets = bucket_count (dbf);
+  stdbuckets = bucket_count (stddbf);
+  if (verbose)
+    printf ("bucket elements: %d (standard %d), buckets: %d (standard %d)\n",
+	    elems, stddbf->header->bucket_elems, nbuckets, stdbuckets);
+  if (elems <= stddbf->header->bucket_elems || nbuckets >= stdbuckets)
+    {
+      fprintf (stderr, "compact encoding doesn't save space\n");
+      return 1;
+    }
+  gdbm_close (stddbf);
+  gdbm_close (dbf);
+
+  /*
+   * 2) Reopen the database.
+   */
+  if (verbose)
+    printf ("reopening database\n");
+  dbf = open_db (dbname, GDBM_WRITER);
+  n = 4;
+  if (gdbm_setopt (dbf, GDBM_SETCACHESIZE, &n, sizeof (n)))
+    {
+      fprintf (stderr, "GDBM_SETCACHESIZE: %s\n", gdbm_db_strerror (dbf));
+      return 1;
+    }
+  if (gdbm_setopt (dbf, GDBM_GETDBFORMAT, &n, sizeof (n))
+      || n != (GDBM_NUMSYNC | flags))
+    {
+      fprintf (stderr, "wrong database format\n");
+      return 1;
+    }
+  verify (dbf);
+
+  /*
+   * 3) Modify the database.
+   */
+  if (verbose)
+    printf ("modifying database\n");
+  for (i = 0; i < NKEYS; i += 3)
+    rec_store (dbf, i, MAXSIZE - i % 11);
+  verify (dbf);
+
+  for (i = 1; i < NKEYS; i += 3)
+    if (rec_size[i] <= MAXSIZE - 20)
+      rec_append (dbf, i, 20);
+  verify (dbf);
+
+  for (i = 0; i < NKEYS; i += 4)
+    rec_delete (dbf, i);
+  verify (dbf);
+
+  /*
+   * 4) Conversion must fail.
+   */
+  if (gdbm_convert (dbf, GDBM_NUMSYNC) == 0
+      || gdbm_last_errno (dbf) != GDBM_ERR_USAGE)
+    {
+      fprintf (stderr, "gdbm_convert succeeded\n");
+      return 1;
+    }
+  gdbm_clear_error (dbf);
+  if (gdbm_convert (dbf, GDBM_NUMSYNC | flags))
+    {
+      fprintf (stderr, "gdbm_convert: %s\n", gdbm_db_strerror (dbf));
+      return 1;
+    }
+
+  /*
+   * 5) Reorganize the database.
+   */
+  if (verbose)
+    printf ("reorganizing database\n");
+  if (gdbm_reorganize (dbf))
+    {
+      fprintf (stderr, "gdbm_reorganize: %s\n", gdbm_db_strerror (dbf));
+      return 1;
+    }
+  if (!gdbm_compact_buckets_p (dbf))
+    {
+      fprintf (stderr, "reorganized database is not compact\n");
+      return 1;
+    }
+  verify (dbf);
+
+  if (gdbm_close (dbf))
+    {
+      fprintf (stderr, "gdbm_close: %s\n", gdbm_strerror (gdbm_errno));
+      return 1;
+    }
+  return 0;
+}
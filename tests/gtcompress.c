@@ -0,0 +1,445 @@
+/*
+  NAME
+    gtcompress - test compression of record data.
+
+  SYNOPSIS
+    gtcompress [-cilv]
+
+  DESCRIPTION
+    Operation:
+
+    1) Check that the built-in codec restores the compressed data.
+    2) Create two databases, one of them with GDBM_COMPRESS, and
+       populate them with the same records: compressible text,
+       incompressible data and runs of equal bytes, of various sizes.
+       Verify that the compressed database takes less file space.
+    3) Replace records, append to them, update them with gdbm_update,
+       write ranges, stream records through a file descriptor and
+       delete some records.  Fetch ranges of records.
+    4) Reopen the database and check its format and contents.
+    5) Convert the database to the uncompressed format and back.
+    6) Reorganize the database.
+
+    After each step the contents of the database is verified and
+    the available space is checked.
+
+  OPTIONS
+     -c   Use compact buckets (GDBM_COMPACT).
+     -i   Keep tiny records inline (GDBM_INLINE).
+     -l   Use the large format (GDBM_LARGE).
+     -v   Verbosely print what's being done.
+
+  EXIT CODE
+     0    success
+     1    failure
+     2    usage error
+
+  LICENSE
+    This file is part of GDBM test suite.
+    Copyright (C) 2025 Free Software Foundation, Inc.
+
+    GDBM is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2, or (at your option)
+    any later version.
+
+    GDBM is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GDBM. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "autoconf.h"
+#include "gdbmdefs.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "records.h"
+#include <fcntl.h>
+
+char dbname[] = "a.db";
+char stdname[] = "b.db";
+char tmpname[] = "c.tmp";
+int verbose = 0;
+
+#define NKEYS 3000
+#define MAXSIZE 8192
+
+/* Fill BUF with LEN bytes of data of the given KIND, generation GEN. */
+static void
+fill_data (char *buf, size_t len, int kind, unsigned gen)
+{
+  static char const *words[] = {
+    "{\"name\": ", "\"value\", ", "\"enabled\": true, ", "\"items\": [",
+    "1, 2, 3], ", "\"template\": \"default\", ", "null, ", "}\n"
+  };
+  unsigned x = gen * 2654435761u + 1;
+  size_t i = 0;
+
+  switch (kind)
+    {
+    case 0:
+      /* Text */
+      while (i < len)
+	{
+	  char const *w = words[(x >> 16) % 8];
+
+	  x = x * 1103515245 + 12345;
+	  while (*w && i < len)
+	    buf[i++] = *w++;
+	}
+      break;
+
+    case 1:
+      /* Incompressible data */
+      for (; i < len; i++)
+	{
+	  x ^= x << 13;
+	  x ^= x >> 17;
+	  x ^= x << 5;
+	  buf[i] = x >> 3;
+	}
+      break;
+
+    default:
+      /* Runs */
+      for (; i < len; i++)
+	buf[i] = 'a' + (i / 100 + gen) % 3;
+    }
+}
+
+static void
+record_pattern (char *buf, int size, int i, int gen)
+{
+  fill_data (buf, size, i % 3, i + gen * 7);
+}
+
+static void
+verify (GDBM_FILE dbf)
+{
+  char ibuf[MAXSIZE];
+  size_t needed;
+  int i;
+
+  rec_verify (dbf);
+  for (i = 0; i < NKEYS; i += 7)
+    if (rec_size[i] != -1
+	&& (gdbm_fetch_into (dbf, rec_key (i), ibuf, sizeof (ibuf), &needed)
+	    || needed != rec_size[i]
+	    || memcmp (ibuf, rec_data (i), rec_size[i])))
+      {
+	fprintf (stderr, "%d: gdbm_fetch_into failed\n", i);
+	exit (1);
+      }
+
+  if (gdbm_avail_verify (dbf))
+    {
+      fprintf (stderr, "gdbm_avail_verify: %s\n", gdbm_db_strerror (dbf));
+      exit (1);
+    }
+}
+
+/* Check that the codec restores the data of the given KIND and LEN. */
+static void
+check_codec (int kind, size_t len)
+{
+  static unsigned char src[MAXSIZE], dst[MAXSIZE + 64], out[MAXSIZE];
+  size_t n;
+
+  fill_data ((char*) src, len, kind, len);
+  n = _gdbm_lz_compress (src, len, dst, sizeof (dst));
+  if (n == 0)
+    {
+      fprintf (stderr, "codec: kind %d, size %zu: compression failed\n",
+	       kind, len);
+      exit (1);
+    }
+  if (_gdbm_lz_decompress (dst, n, out, len) || memcmp (src, out, len))
+    {
+      fprintf (stderr, "codec: kind %d, size %zu: wrong data\n", kind, len);
+      exit (1);
+    }
+  if (kind != 1 && len >= 1024 && n > len / 2)
+    {
+      fprintf (stderr, "codec: kind %d, size %zu: poor compression (%zu)\n",
+	       kind, len, n);
+      exit (1);
+    }
+  /* Truncated data must be detected. */
+  if (n > 1 && _gdbm_lz_decompress (dst, n / 2, out, len) == 0)
+    {
+      fprintf (stderr, "codec: kind %d, size %zu: truncation not detected\n",
+	       kind, len);
+      exit (1);
+    }
+}
+
+static int
+shrink (datum key, datum *content, void *data)
+{
+  content->dsize = *(int*)data;
+  return GDBM_UPDATE_STORE;
+}
+
+int
+main (int argc, char **argv)
+{
+  GDBM_FILE dbf, stddbf;
+  int i, n;
+  int flags = GDBM_COMPRESS;
+  char *data;
+  datum content;
+  int fd, rc;
+
+  while ((i = getopt (argc, argv, "cilv")) != EOF)
+    {
+      switch (i)
+	{
+	case 'c':
+	  flags |= GDBM_COMPACT;
+	  break;
+
+	case 'i':
+	  flags |= GDBM_INLINE;
+	  break;
+
+	case 'l':
+	  flags |= GDBM_LARGE;
+	  break;
+
+	case 'v':
+	  verbose++;
+	  break;
+
+	default:
+	  return 2;
+	}
+    }
+
+  /*
+   * 1) Check the codec.
+   */
+  if (verbose)
+    printf ("checking codec\n");
+  for (i = 0; i < 3; i++)
+    {
+      size_t len;
+
+      for (len = 1; len <= MAXSIZE; len = len * 3 / 2 + 1)
+	check_codec (i, len);
+    }
+
+  /*
+   * 2) Create and populate the databases.
+   */
+  if (verbose)
+    printf ("creating databases\n");
+  dbf = gdbm_open (dbname, 0, GDBM_NEWDB | flags, 0644, NULL);
+  stddbf = gdbm_open (stdname, 0, GDBM_NEWDB, 0644, NULL);
+  if (!dbf || !stddbf)
+    {
+      fprintf (stderr, "gdbm_open: %s\n", gdbm_strerror (gdbm_errno));
+      return 1;
+    }
+  rec_init (NKEYS);
+  rec_pattern = record_pattern;
+  for (i = 0; i < NKEYS; i++)
+    {
+      rec_store (dbf, i, (i * 37) % (i % 10 == 0 ? MAXSIZE : 200));
+      rec_write (stddbf, i);
+    }
+  verify (dbf);
+  if (verbose)
+    printf ("file size: %lu (uncompressed %lu)\n",
+	    (unsigned long) dbf->header->next_block,
+	    (unsigned long) stddbf->header->next_block);
+  if (dbf->header->next_block > stddbf->header->next_block * 3 / 4)
+    {
+      fprintf (stderr, "compression doesn't save space\n");
+      return 1;
+    }
+  gdbm_close (stddbf);
+
+  /*
+   * 3) Modify the database.
+   */
+  if (verbose)
+    printf ("modifying database\n");
+  for (i = 0; i < NKEYS; i += 3)
+    rec_store (dbf, i, rec_size[i] > 100 ? i % 50 : 100 + i % MAXSIZE / 2);
+  verify (dbf);
+
+  /* Append to records, crossing the compression threshold. */
+  for (i = 1; i < NKEYS; i += 3)
+    if (rec_size[i] + 40 <= MAXSIZE)
+      rec_append (dbf, i, 40);
+  verify (dbf);
+
+  /* Shrink records.  The data become a prefix of the old ones. */
+  for (i = 2; i < NKEYS; i += 6)
+    if (rec_size[i] > 0)
+      {
+	datum slice;
+
+	n = rec_size[i] / 2;
+	if (gdbm_update (dbf, rec_key (i), shrink, &n))
+	  {
+	    fprintf (stderr, "%d: gdbm_update: %s\n", i,
+		     gdbm_db_strerror (dbf));
+	    return 1;
+	  }
+	/* Check a range of the new data. */
+	slice = gdbm_fetch_range (dbf, rec_key (i), n / 3, n);
+	if (slice.dptr == NULL || slice.dsize != n - n / 3
+	    || memcmp (slice.dptr, rec_data (i) + n / 3, slice.dsize))
+	  {
+	    fprintf (stderr, "%d: gdbm_fetch_range failed\n", i);
+	    return 1;
+	  }
+	free (slice.dptr);
+	rec_size[i] = n;
+      }
+  verify (dbf);
+
+  /* Rewrite records by halves. */
+  for (i = 5; i < NKEYS; i += 9)
+    if (rec_size[i] > 1)
+      {
+	n = rec_size[i] / 2;
+	rec_gen[i]++;
+	data = rec_data (i);
+	content.dptr = data;
+	content.dsize = n;
+	if (gdbm_store_range (dbf, rec_key (i), 0, content) == 0)
+	  {
+	    content.dptr = data + n;
+	    content.dsize = rec_size[i] - n;
+	    rc = gdbm_store_range (dbf, rec_key (i), n, content);
+	  }
+	else
+	  rc = -1;
+	if (rc)
+	  {
+	    fprintf (stderr, "%d: gdbm_store_range: %s\n", i,
+		     gdbm_db_strerror (dbf));
+	    return 1;
+	  }
+      }
+  verify (dbf);
+
+  /* Pass records through a file. */
+  for (i = 10; i < NKEYS; i += 50)
+    if (rec_size[i] != -1)
+      {
+	fd = open (tmpname, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (fd == -1)
+	  {
+	    perror (tmpname);
+	    return 1;
+	  }
+	if (gdbm_fetch_to_fd (dbf, rec_key (i), fd))
+	  {
+	    fprintf (stderr, "%d: gdbm_fetch_to_fd: %s\n", i,
+		     gdbm_db_strerror (dbf));
+	    return 1;
+	  }
+	if (lseek (fd, 0, SEEK_END) != rec_size[i])
+	  {
+	    fprintf (stderr, "%d: gdbm_fetch_to_fd: wrong size\n", i);
+	    return 1;
+	  }
+	lseek (fd, 0, SEEK_SET);
+	if (gdbm_delete (dbf, rec_key (i))
+	    || gdbm_store_from_fd (dbf, rec_key (i), fd, rec_size[i]))
+	  {
+	    fprintf (stderr, "%d: gdbm_store_from_fd: %s\n", i,
+		     gdbm_db_strerror (dbf));
+	    return 1;
+	  }
+	close (fd);
+      }
+  unlink (tmpname);
+  verify (dbf);
+
+  for (i = 0; i < NKEYS; i += 4)
+    rec_delete (dbf, i);
+  verify (dbf);
+  gdbm_close (dbf);
+
+  /*
+   * 4) Reopen the database.
+   */
+  if (verbose)
+    printf ("reopening database\n");
+  dbf = gdbm_open (dbname, 0, GDBM_WRITER, 0, NULL);
+  if (!dbf)
+    {
+      fprintf (stderr, "gdbm_open: %s\n", gdbm_strerror (gdbm_errno));
+      return 1;
+    }
+  if (gdbm_setopt (dbf, GDBM_GETDBFORMAT, &n, sizeof (n))
+      || n != (GDBM_NUMSYNC | flags))
+    {
+      fprintf (stderr, "wrong database format\n");
+      return 1;
+    }
+  verify (dbf);
+
+  /*
+   * 5) Convert the database.
+   */
+  if (verbose)
+    printf ("converting to uncompressed format\n");
+  if (gdbm_convert (dbf, GDBM_NUMSYNC | (flags & ~GDBM_COMPRESS)))
+    {
+      fprintf (stderr, "gdbm_convert: %s\n", gdbm_db_strerror (dbf));
+      return 1;
+    }
+  if (gdbm_compressed_p (dbf))
+    {
+      fprintf (stderr, "database not converted\n");
+      return 1;
+    }
+  verify (dbf);
+
+  if (verbose)
+    printf ("converting to compressed format\n");
+  if (gdbm_convert (dbf, GDBM_NUMSYNC | flags))
+    {
+      fprintf (stderr, "gdbm_convert: %s\n", gdbm_db_strerror (dbf));
+      return 1;
+    }
+  if (!gdbm_compressed_p (dbf))
+    {
+      fprintf (stderr, "database not converted\n");
+      return 1;
+    }
+  verify (dbf);
+
+  /*
+   * 6) Reorganize the database.
+   */
+  if (verbose)
+    printf ("reorganizing database\n");
+  if (gdbm_reorganize (dbf))
+    {
+      fprintf (stderr, "gdbm_reorganize: %s\n", gdbm_db_strerror (dbf));
+      return 1;
+    }
+  if (!gdbm_compressed_p (dbf))
+    {
+      fprintf (stderr, "reorganized database lost compression\n");
+      return 1;
+    }
+  verify (dbf);
+
+  if (gdbm_close (dbf))
+    {
+      fprintf (stderr, "gdbm_close: %s\n", gdbm_strerror (gdbm_errno));
+      return 1;
+    }
+  return 0;
+}
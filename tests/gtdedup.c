@@ -0,0 +1,546 @@
+/*
+  NAME
+    gtdedup - test sharing of identical record data.
+
+  SYNOPSIS
+    gtdedup [-clvz]
+
+  DESCRIPTION
+    Operation:
+
+    1) Create two databases, one of them with GDBM_DEDUP, and populate
+       them with the same records.  Most records hold one of a few
+       values, others hold unique values, small or large.  Verify that
+       the database with shared values takes less file space.
+    2) Replace records, modify records in place, append to records and
+       delete some records.
+    3) Reopen the database and check its format and contents.  Store
+       new copies of existing values and check that they are shared.
+    4) Convert the database to the standard format and back.
+    5) Reorganize the database.
+    6) In a child process, purge all records, keeping few buckets in
+       the cache, and exit in the middle of the purge, as if the
+       program crashed.  Reopen the database and check that the
+       records that were not removed are intact and that no shared
+       value is referenced more times than its header says.  Then
+       reorganize the database.
+
+    After each step the contents of the database is verified, each
+    shared value is checked to be referenced as many times as its
+    header says, and the available space is checked.
+
+  OPTIONS
+     -c   Use compact buckets (GDBM_COMPACT).
+     -l   Use the large format (GDBM_LARGE).
+     -v   Verbosely print what's being done.
+     -z   Compress record data (GDBM_COMPRESS).
+
+  EXIT CODE
+     0    success
+     1    failure
+     2    usage error
+
+  LICENSE
+    This file is part of GDBM test suite.
+    Copyright (C) 2025 Free Software Foundation, Inc.
+
+    GDBM is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2, or (at your option)
+    any later version.
+
+    GDBM is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GDBM. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "autoconf.h"
+#include "gdbmdefs.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "records.h"
+
+char dbname[] = "a.db";
+char stdname[] = "b.db";
+int verbose = 0;
+
+#define NKEYS 4000
+#define NVALUES 16
+#define MAXSIZE 4096
+#define ABORTAFTER 1000
+
+/* Whether the reference counts must be exact.  After a crash they may
+   exceed the number of references, but never fall below it. */
+int exact_refcount = 1;
+
+/* The value of each record is identified by its generation number.
+   Values below NVALUES are held by many records, others are unique. */
+int next_value = NVALUES;
+
+static size_t
+value_size (int v)
+{
+  if (v < NVALUES)
+    return 64 + v * 263 % (MAXSIZE - 64);
+  return v % 5 == 0 ? v % 40 : 64 + v % 1000;
+}
+
+/* Fill BUF with the value V.  The records holding it are not told
+   apart. */
+static void
+value_pattern (char *buf, int size, int i, int v)
+{
+  int j;
+
+  for (j = 0; j < size; j++)
+    buf[j] = "{\"key\": \"value\", \"list\": [1, 2, 3]}\n"[(j + v) % 37]
+             + (j / 37 + v) % 3;
+}
+
+/* Store the value V as the record I. */
+static void
+store (GDBM_FILE dbf, int i, int v)
+{
+  rec_gen[i] = v;
+  rec_size[i] = value_size (v);
+  rec_write (dbf, i);
+}
+
+static void
+read_at (GDBM_FILE dbf, off_t adr, void *buf, size_t size)
+{
+  if (pread (dbf->desc, buf, size, adr) != size)
+    {
+      perror ("pread");
+      exit (1);
+    }
+}
+
+struct shared
+{
+  off_t adr;
+  unsigned refcount;
+  unsigned nref;
+};
+
+/* Check that the reference counts of shared values match the number of
+   records referring to them.  Return the number of shared values. */
+static int
+check_shared (GDBM_FILE dbf)
+{
+  static struct shared tab[NKEYS];
+  int i, j, n = 0;
+
+  if (!gdbm_dedup_p (dbf))
+    return 0;
+  for (i = 0; i < NKEYS; i++)
+    {
+      bucket_element *elem;
+      unsigned char ref[1 + sizeof (off_t)];
+      gdbm_shared_value hdr;
+      off_t adr;
+      int elem_loc;
+
+      if (rec_size[i] == -1)
+	continue;
+      elem_loc = _gdbm_findkey_loc (dbf, rec_key (i), NULL);
+      if (elem_loc == -1)
+	{
+	  fprintf (stderr, "%d: not found\n", i);
+	  exit (1);
+	}
+      elem = &dbf->bucket->h_table[elem_loc];
+      if (elem->data_size != dbf->xheader->encode_min)
+	{
+	  if (value_size (rec_gen[i]) >= GDBM_DEDUP_THRESHOLD
+	      && (rec_gen[i] < NVALUES || !gdbm_compressed_p (dbf)))
+	    {
+	      fprintf (stderr, "%d: value not shared\n", i);
+	      exit (1);
+	    }
+	  continue;
+	}
+      read_at (dbf, elem->data_pointer + elem->key_size, ref, sizeof (ref));
+      if (ref[0] != GDBM_VALUE_REF)
+	continue;
+      memcpy (&adr, ref + 1, sizeof (adr));
+      for (j = 0; j < n; j++)
+	if (tab[j].adr == adr)
+	  break;
+      if (j == n)
+	{
+	  read_at (dbf, adr, &hdr, sizeof (hdr));
+	  tab[n].adr = adr;
+	  tab[n].refcount = hdr.refcount;
+	  tab[n].nref = 0;
+	  n++;
+	}
+      tab[j].nref++;
+    }
+
+  for (j = 0; j < n; j++)
+    if (exact_refcount ? tab[j].refcount != tab[j].nref
+	: tab[j].refcount < tab[j].nref)
+      {
+	fprintf (stderr, "shared value at %lu: refcount %u, %u references\n",
+		 (unsigned long) tab[j].adr, tab[j].refcount, tab[j].nref);
+	exit (1);
+      }
+  return n;
+}
+
+/* Return the number of distinct shared values that should be in the
+   database. */
+static int
+count_shared (GDBM_FILE dbf)
+{
+  char seen[NVALUES];
+  int i, n = 0;
+
+  memset (seen, 0, sizeof (seen));
+  for (i = 0; i < NKEYS; i++)
+    {
+      if (rec_size[i] == -1
+	  || value_size (rec_gen[i]) < GDBM_DEDUP_THRESHOLD)
+	continue;
+      if (rec_gen[i] >= NVALUES)
+	n++;
+      else if (!seen[rec_gen[i]])
+	{
+	  seen[rec_gen[i]] = 1;
+	  n++;
+	}
+    }
+  return n;
+}
+
+static void
+verify (GDBM_FILE dbf)
+{
+  int n;
+
+  rec_verify (dbf);
+  n = check_shared (dbf);
+  /* Unique compressed values may be too short to be shared. */
+  if (gdbm_dedup_p (dbf)
+      && (gdbm_compressed_p (dbf) ? n > count_shared (dbf)
+	  : n != count_shared (dbf)))
+    {
+      fprintf (stderr, "%d shared values, expected %d\n", n,
+	       count_shared (dbf));
+      exit (1);
+    }
+
+  if (gdbm_avail_verify (dbf))
+    {
+      fprintf (stderr, "gdbm_avail_verify: %s\n", gdbm_db_strerror (dbf));
+      exit (1);
+    }
+}
+
+static int
+shrink (datum key, datum *content, void *data)
+{
+  content->dsize = *(int*)data;
+  return GDBM_UPDATE_STORE;
+}
+
+/* Remove all records, but terminate the program after ABORTAFTER
+   calls. */
+static int
+purge_abort (datum key, datum content, void *data)
+{
+  int *ncalls = data;
+
+  if (++*ncalls == ABORTAFTER)
+    _exit (0);
+  return 1;
+}
+
+static GDBM_FILE
+reopen (void)
+{
+  GDBM_FILE dbf = gdbm_open (dbname, 0, GDBM_WRITER, 0, NULL);
+  if (!dbf)
+    {
+      fprintf (stderr, "gdbm_open: %s\n", gdbm_strerror (gdbm_errno));
+      exit (1);
+    }
+  return dbf;
+}
+
+int
+main (int argc, char **argv)
+{
+  GDBM_FILE dbf, stddbf;
+  int i, n;
+  int flags = GDBM_DEDUP;
+  char buf[MAXSIZE];
+  datum content;
+  pid_t pid;
+  int status;
+
+  while ((i = getopt (argc, argv, "clvz")) != EOF)
+    {
+      switch (i)
+	{
+	case 'c':
+	  flags |= GDBM_COMPACT;
+	  break;
+
+	case 'l':
+	  flags |= GDBM_LARGE;
+	  break;
+
+	case 'v':
+	  verbose++;
+	  break;
+
+	case 'z':
+	  flags |= GDBM_COMPRESS;
+	  break;
+
+	default:
+	  return 2;
+	}
+    }
+
+  /*
+   * 1) Create and populate the databases.
+   */
+  if (verbose)
+    printf ("creating databases\n");
+  dbf = gdbm_open (dbname, 0, GDBM_NEWDB | flags, 0644, NULL);
+  stddbf = gdbm_open (stdname, 0, GDBM_NEWDB, 0644, NULL);
+  if (!dbf || !stddbf)
+    {
+      fprintf (stderr, "gdbm_open: %s\n", gdbm_strerror (gdbm_errno));
+      return 1;
+    }
+  rec_init (NKEYS);
+  rec_pattern = value_pattern;
+  for (i = 0; i < NKEYS; i++)
+    {
+      n = i % 4 == 0 ? next_value++ : i * 7 % NVALUES;
+      store (dbf, i, n);
+      store (stddbf, i, n);
+    }
+  verify (dbf);
+  if (verbose)
+    printf ("file size: %lu (standard %lu)\n",
+	    (unsigned long) dbf->header->next_block,
+	    (unsigned long) stddbf->header->next_block);
+  if (dbf->header->next_block > stddbf->header->next_block / 2)
+    {
+      fprintf (stderr, "sharing doesn't save space\n");
+      return 1;
+    }
+  gdbm_close (stddbf);
+
+  /*
+   * 2) Modify the database.
+   */
+  if (verbose)
+    printf ("modifying database\n");
+  /* Replace shared values with other ones, or with unique values. */
+  for (i = 0; i < NKEYS; i += 3)
+    store (dbf, i, i % 2 ? (rec_gen[i] + 1) % NVALUES : next_value++);
+  /* Store the same value again. */
+  for (i = 1; i < NKEYS; i += 10)
+    store (dbf, i, rec_gen[i]);
+  verify (dbf);
+
+  /* Shrink some records.  The result is a new value. */
+  for (i = 2; i < NKEYS; i += 30)
+    {
+      n = value_size (rec_gen[i]) / 2;
+      if (gdbm_update (dbf, rec_key (i), shrink, &n))
+	{
+	  fprintf (stderr, "%d: gdbm_update: %s\n", i,
+		   gdbm_db_strerror (dbf));
+	  return 1;
+	}
+      /* Replace it with a known value. */
+      store (dbf, i, next_value++);
+    }
+  verify (dbf);
+
+  /* Append to a shared value.  Other records keep the old one. */
+  for (i = 5; i < NKEYS; i += 50)
+    if (rec_gen[i] < NVALUES)
+      {
+	content.dptr = buf;
+	content.dsize = 10;
+	memset (buf, 'x', 10);
+	if (gdbm_append (dbf, rec_key (i), content))
+	  {
+	    fprintf (stderr, "%d: gdbm_append: %s\n", i,
+		     gdbm_db_strerror (dbf));
+	    return 1;
+	  }
+	content = gdbm_fetch (dbf, rec_key (i));
+	if (!content.dptr
+	    || content.dsize != value_size (rec_gen[i]) + 10
+	    || memcmp (content.dptr + value_size (rec_gen[i]), buf, 10))
+	  {
+	    fprintf (stderr, "%d: wrong content after gdbm_append\n", i);
+	    return 1;
+	  }
+	free (content.dptr);
+	store (dbf, i, next_value++);
+      }
+  verify (dbf);
+
+  /* Delete records, including all holders of some shared values. */
+  for (i = 0; i < NKEYS; i++)
+    if (i % 4 == 1 || (rec_size[i] != -1 && rec_gen[i] < 3))
+      rec_delete (dbf, i);
+  verify (dbf);
+  gdbm_close (dbf);
+
+  /*
+   * 3) Reopen the database.
+   */
+  if (verbose)
+    printf ("reopening database\n");
+  dbf = reopen ();
+  if (gdbm_setopt (dbf, GDBM_GETDBFORMAT, &n, sizeof (n))
+      || n != (GDBM_NUMSYNC | flags))
+    {
+      fprintf (stderr, "wrong database format\n");
+      return 1;
+    }
+  verify (dbf);
+  /* New copies of existing values must be shared. */
+  for (i = 1; i < NKEYS; i += 4)
+    store (dbf, i, i % (NVALUES - 3) + 3);
+  verify (dbf);
+
+  /*
+   * 4) Convert the database.
+   */
+  if (verbose)
+    printf ("converting to standard format\n");
+  if (gdbm_convert (dbf, 0))
+    {
+      fprintf (stderr, "gdbm_convert: %s\n", gdbm_db_strerror (dbf));
+      return 1;
+    }
+  if (gdbm_dedup_p (dbf))
+    {
+      fprintf (stderr, "database not converted\n");
+      return 1;
+    }
+  verify (dbf);
+
+  if (verbose)
+    printf ("converting to shared format\n");
+  if (gdbm_convert (dbf, GDBM_NUMSYNC | flags))
+    {
+      fprintf (stderr, "gdbm_convert: %s\n", gdbm_db_strerror (dbf));
+      return 1;
+    }
+  if (!gdbm_dedup_p (dbf))
+    {
+      fprintf (stderr, "database not converted\n");
+      return 1;
+    }
+  verify (dbf);
+
+  /*
+   * 5) Reorganize the database.
+   */
+  if (verbose)
+    printf ("reorganizing database\n");
+  if (gdbm_reorganize (dbf))
+    {
+      fprintf (stderr, "gdbm_reorganize: %s\n", gdbm_db_strerror (dbf));
+      return 1;
+    }
+  if (!gdbm_dedup_p (dbf))
+    {
+      fprintf (stderr, "reorganized database lost shared values\n");
+      return 1;
+    }
+  verify (dbf);
+
+  if (gdbm_close (dbf))
+    {
+      fprintf (stderr, "gdbm_close: %s\n", gdbm_strerror (gdbm_errno));
+      return 1;
+    }
+
+  /*
+   * 6) Terminate the program in the middle of a purge.
+   */
+  if (verbose)
+    printf ("purging records in child process\n");
+  pid = fork ();
+  if (pid == -1)
+    {
+      perror ("fork");
+      return 1;
+    }
+  if (pid == 0)
+    {
+      dbf = reopen ();
+      n = 4;
+      if (gdbm_setopt (dbf, GDBM_SETCACHESIZE, &n, sizeof (n)))
+	{
+	  fprintf (stderr, "GDBM_SETCACHESIZE: %s\n",
+		   gdbm_db_strerror (dbf));
+	  _exit (1);
+	}
+      n = 0;
+      gdbm_purge (dbf, purge_abort, &n, NULL);
+      fprintf (stderr, "gdbm_purge returned\n");
+      _exit (1);
+    }
+  if (waitpid (pid, &status, 0) != pid
+      || !WIFEXITED (status) || WEXITSTATUS (status) != 0)
+    {
+      fprintf (stderr, "child process failed\n");
+      return 1;
+    }
+
+  if (verbose)
+    printf ("reopening database\n");
+  dbf = reopen ();
+  /* Any record may have been removed. */
+  for (i = n = 0; i < NKEYS; i++)
+    {
+      if (rec_size[i] == -1)
+	continue;
+      if (gdbm_exists (dbf, rec_key (i)))
+	n++;
+      else
+	rec_size[i] = -1;
+    }
+  if (verbose)
+    printf ("%d records left\n", n);
+  exact_refcount = 0;
+  verify (dbf);
+
+  if (verbose)
+    printf ("reorganizing database\n");
+  if (gdbm_reorganize (dbf))
+    {
+      fprintf (stderr, "gdbm_reorganize: %s\n", gdbm_db_strerror (dbf));
+      return 1;
+    }
+  exact_refcount = 1;
+  verify (dbf);
+
+  if (gdbm_close (dbf))
+    {
+      fprintf (stderr, "gdbm_close: %s\n", gdbm_strerror (gdbm_errno));
+      return 1;
+    }
+  return 0;
+}
@@ -0,0 +1,283 @@
+/*
+  NAME
+    gtextent - test allocation of large records in aligned extents.
+
+  SYNOPSIS
+    gtextent [-v]
+
+  DESCRIPTION
+    Operation:
+
+    1) Create new database.  Check that the GDBM_SETEXTENTTHRESHOLD
+       option rejects values smaller than the block size, and set the
+       threshold.
+    2) Store small and large records alternately.  Verify that large
+       records start on a block boundary.
+    3) Delete every other large record and replace the rest with
+       records of another size.  Store new large records.  Verify
+       their alignment.
+    4) Verify the content of all records and the available space.
+
+    The test is run twice: without and with the avail index.
+
+  OPTIONS
+     -v   Verbosely print what's being done.
+
+  EXIT CODE
+     0    success
+     1    failure
+     2    usage error
+
+  LICENSE
+    This file is part of GDBM test suite.
+    Copyright (C) 2025 Free Software Foundation, Inc.
+
+    GDBM is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2, or (at your option)
+    any later version.
+
+    GDBM is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GDBM. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "autoconf.h"
+#include "gdbmdefs.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+char dbname[] = "a.db";
+int verbose = 0;
+
+#define NKEYS 64
+#define THRESHOLD 1024
+#define SMALLSIZE 16
+#define MAXSIZE 8192
+
+static char buf[MAXSIZE];
+
+/* Size of the record K in the given ROUND. */
+static int
+record_size (int k, int round)
+{
+  if (k % 2)
+    return SMALLSIZE;
+  return THRESHOLD + (k * 97 + round * 1013) % (MAXSIZE - THRESHOLD);
+}
+
+static void
+fill (int k, int size)
+{
+  int i;
+
+  for (i = 0; i < size; i++)
+    buf[i] = k + i;
+}
+
+static void
+store (GDBM_FILE dbf, int k, int size)
+{
+  datum key, content;
+  int elem_loc;
+
+  key.dptr = (char*) &k;
+  key.dsize = sizeof (k);
+  fill (k, size);
+  content.dptr = buf;
+  content.dsize = size;
+  if (gdbm_store (dbf, key, content, GDBM_REPLACE))
+    {
+      fprintf (stderr, "%d: item not inserted: %s\n",
+	       k, gdbm_db_strerror (dbf));
+      exit (1);
+    }
+  if (size + key.dsize < THRESHOLD)
+    return;
+
+  elem_loc = _gdbm_findkey_loc (dbf, key, NULL);
+  if (elem_loc < 0)
+    {
+      fprintf (stderr, "%d: can't locate: %s\n", k, gdbm_db_strerror (dbf));
+      exit (1);
+    }
+  if (dbf->bucket->h_table[elem_loc].data_pointer
+      % dbf->header->block_size)
+    {
+      fprintf (stderr, "%d: record is not aligned\n", k);
+      exit (1);
+    }
+}
+
+static void
+check (GDBM_FILE dbf, int k, int size)
+{
+  datum key, content;
+
+  key.dptr = (char*) &k;
+  key.dsize = sizeof (k);
+  content = gdbm_fetch (dbf, key);
+  if (size == 0)
+    {
+      if (content.dptr != NULL)
+	{
+	  fprintf (stderr, "%d: deleted key found\n", k);
+	  exit (1);
+	}
+      return;
+    }
+  if (content.dptr == NULL)
+    {
+      fprintf (stderr, "%d: fetch failed: %s\n", k, gdbm_db_strerror (dbf));
+      exit (1);
+    }
+  fill (k, size);
+  if (content.dsize != size || memcmp (content.dptr, buf, size))
+    {
+      fprintf (stderr, "%d: wrong content\n", k);
+      exit (1);
+    }
+  free (content.dptr);
+}
+
+static void
+run (int avail_index)
+{
+  GDBM_FILE dbf;
+  int k;
+  size_t n;
+  int sizes[2 * NKEYS];
+
+  /*
+   * 1) Create the database.
+   */
+  if (verbose)
+    printf ("creating database (avail index %s)\n",
+	    avail_index ? "on" : "off");
+  dbf = gdbm_open (dbname, GDBM_MIN_BLOCK_SIZE, GDBM_NEWDB, 0644, NULL);
+  if (!dbf)
+    {
+      fprintf (stderr, "gdbm_open: %s\n", gdbm_strerror (gdbm_errno));
+      exit (1);
+    }
+  if (gdbm_setopt (dbf, GDBM_SETAVAILINDEX, &avail_index,
+		   sizeof (avail_index)))
+    {
+      fprintf (stderr, "GDBM_SETAVAILINDEX: %s\n",
+	       gdbm_strerror (gdbm_errno));
+      exit (1);
+    }
+
+  n = GDBM_MIN_BLOCK_SIZE - 1;
+  if (gdbm_setopt (dbf, GDBM_SETEXTENTTHRESHOLD, &n, sizeof (n)) == 0
+      || gdbm_errno != GDBM_OPT_BADVAL)
+    {
+      fprintf (stderr, "GDBM_SETEXTENTTHRESHOLD accepted invalid value\n");
+      exit (1);
+    }
+  n = THRESHOLD;
+  if (gdbm_setopt (dbf, GDBM_SETEXTENTTHRESHOLD, &n, sizeof (n)))
+    {
+      fprintf (stderr, "GDBM_SETEXTENTTHRESHOLD: %s\n",
+	       gdbm_strerror (gdbm_errno));
+      exit (1);
+    }
+  n = 0;
+  if (gdbm_setopt (dbf, GDBM_GETEXTENTTHRESHOLD, &n, sizeof (n))
+      || n != THRESHOLD)
+    {
+      fprintf (stderr, "GDBM_GETEXTENTTHRESHOLD returned wrong value\n");
+      exit (1);
+    }
+
+  /*
+   * 2) Store small and large records.
+   */
+  if (verbose)
+    printf ("storing records\n");
+  for (k = 0; k < NKEYS; k++)
+    {
+      sizes[k] = record_size (k, 0);
+      store (dbf, k, sizes[k]);
+    }
+
+  /*
+   * 3) Delete and replace large records and store new ones.
+   */
+  if (verbose)
+    printf ("replacing records\n");
+  for (k = 0; k < NKEYS; k += 2)
+    {
+      if (k % 4)
+	{
+	  datum key;
+
+	  key.dptr = (char*) &k;
+	  key.dsize = sizeof (k);
+	  if (gdbm_delete (dbf, key))
+	    {
+	      fprintf (stderr, "%d: gdbm_delete: %s\n", k,
+		       gdbm_db_strerror (dbf));
+	      exit (1);
+	    }
+	  sizes[k] = 0;
+	}
+      else
+	{
+	  sizes[k] = record_size (k, 1);
+	  store (dbf, k, sizes[k]);
+	}
+    }
+  for (k = NKEYS; k < 2 * NKEYS; k++)
+    {
+      sizes[k] = record_size (k, 2);
+      store (dbf, k, sizes[k]);
+    }
+
+  /*
+   * 4) Verify the database.
+   */
+  if (verbose)
+    printf ("verifying records\n");
+  for (k = 0; k < 2 * NKEYS; k++)
+    check (dbf, k, sizes[k]);
+
+  if (gdbm_avail_verify (dbf))
+    {
+      fprintf (stderr, "gdbm_avail_verify: %s\n", gdbm_db_strerror (dbf));
+      exit (1);
+    }
+  if (gdbm_close (dbf))
+    {
+      fprintf (stderr, "gdbm_close: %s\n", gdbm_strerror (gdbm_errno));
+      exit (1);
+    }
+}
+
+int
+main (int argc, char **argv)
+{
+  int i;
+
+  while ((i = getopt (argc, argv, "v")) != EOF)
+    {
+      switch (i)
+	{
+	case 'v':
+	  verbose++;
+	  break;
+
+	default:
+	  return 2;
+	}
+    }
+
+  run (FALSE);
+  run (TRUE);
+  return 0;
+}
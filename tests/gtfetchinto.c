@@ -0,0 +1,231 @@
+/*
+  NAME
+    gtfetchinto - test fetching into caller-provided buffers.
+
+  SYNOPSIS
+    gtfetchinto [-v]
+
+  DESCRIPTION
+    Operation:
+
+    1) Create new database and populate it with NKEYS records of
+       varying size.
+    2) Fetch all records using gdbm_fetch_into with a small buffer.
+       Verify that GDBM_BUFFER_TOO_SMALL is reported for large records
+       along with the needed size, and that retrying with a buffer of
+       that size succeeds.
+    3) Verify that a missing key yields GDBM_ITEM_NOT_FOUND.
+    4) Iterate over all keys using gdbm_firstkey_into and
+       gdbm_nextkey_into.  Verify that each key is visited once.
+
+  OPTIONS
+     -v   Verbosely print what's being done.
+
+  EXIT CODE
+     0    success
+     1    failure
+     2    usage error
+
+  LICENSE
+    This file is part of GDBM test suite.
+    Copyright (C) 2025 Free Software Foundation, Inc.
+
+    GDBM is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2, or (at your option)
+    any later version.
+
+    GDBM is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GDBM. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "autoconf.h"
+#include "gdbmdefs.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+char dbname[] = "a.db";
+int verbose = 0;
+
+#define NKEYS 1024
+#define SMALLBUF 16
+
+static size_t
+data_size (int i)
+{
+  return i % 64;
+}
+
+static int
+check_data (int i, char const *buf, size_t size)
+{
+  size_t j;
+
+  if (size != data_size (i))
+    return 1;
+  for (j = 0; j < size; j++)
+    if (buf[j] != (char) (i + j))
+      return 1;
+  return 0;
+}
+
+int
+main (int argc, char **argv)
+{
+  GDBM_FILE dbf;
+  datum key, content;
+  char data[64];
+  char buf[SMALLBUF];
+  char *bigbuf;
+  char seen[NKEYS];
+  int i, k, n;
+  size_t j, needed;
+
+  while ((i = getopt (argc, argv, "v")) != EOF)
+    {
+      switch (i)
+	{
+	case 'v':
+	  verbose++;
+	  break;
+
+	default:
+	  return 2;
+	}
+    }
+
+  /*
+   * 1) Create and populate the database.
+   */
+  if (verbose)
+    printf ("creating database\n");
+  dbf = gdbm_open (dbname, GDBM_MIN_BLOCK_SIZE, GDBM_NEWDB, 0644, NULL);
+  if (!dbf)
+    {
+      fprintf (stderr, "gdbm_open: %s\n", gdbm_strerror (gdbm_errno));
+      return 1;
+    }
+
+  key.dsize = sizeof (i);
+  key.dptr = (char*) &i;
+  content.dptr = data;
+  for (i = 0; i < NKEYS; i++)
+    {
+      content.dsize = data_size (i);
+      for (j = 0; j < content.dsize; j++)
+	data[j] = i + j;
+      if (gdbm_store (dbf, key, content, 0) != 0)
+	{
+	  fprintf (stderr, "%d: item not inserted: %s\n",
+		   i, gdbm_db_strerror (dbf));
+	  return 1;
+	}
+    }
+
+  /*
+   * 2) Fetch into a small buffer, growing it when needed.
+   */
+  if (verbose)
+    printf ("fetching records\n");
+  for (i = 0; i < NKEYS; i++)
+    {
+      needed = (size_t) -1;
+      if (gdbm_fetch_into (dbf, key, buf, sizeof (buf), &needed) == 0)
+	{
+	  if (check_data (i, buf, needed))
+	    {
+	      fprintf (stderr, "%d: wrong content\n", i);
+	      return 1;
+	    }
+	  continue;
+	}
+      if (gdbm_errno != GDBM_BUFFER_TOO_SMALL)
+	{
+	  fprintf (stderr, "%d: fetch failed: %s\n", i, gdbm_db_strerror (dbf));
+	  return 1;
+	}
+      if (needed != data_size (i) || needed <= sizeof (buf))
+	{
+	  fprintf (stderr, "%d: wrong needed size %zu\n", i, needed);
+	  return 1;
+	}
+      bigbuf = malloc (needed);
+      if (!bigbuf)
+	{
+	  perror ("malloc");
+	  return 1;
+	}
+      if (gdbm_fetch_into (dbf, key, bigbuf, needed, NULL))
+	{
+	  fprintf (stderr, "%d: second fetch failed: %s\n", i,
+		   gdbm_db_strerror (dbf));
+	  return 1;
+	}
+      if (check_data (i, bigbuf, needed))
+	{
+	  fprintf (stderr, "%d: wrong content\n", i);
+	  return 1;
+	}
+      free (bigbuf);
+    }
+
+  /*
+   * 3) Missing key.
+   */
+  i = NKEYS;
+  if (gdbm_fetch_into (dbf, key, buf, sizeof (buf), NULL) == 0
+      || gdbm_errno != GDBM_ITEM_NOT_FOUND)
+    {
+      fprintf (stderr, "missing key found\n");
+      return 1;
+    }
+
+  /*
+   * 4) Iterate over keys.
+   */
+  if (verbose)
+    printf ("iterating\n");
+  if (gdbm_firstkey_into (dbf, buf, 1, &needed) == 0
+      || gdbm_errno != GDBM_BUFFER_TOO_SMALL
+      || needed != sizeof (int))
+    {
+      fprintf (stderr, "gdbm_firstkey_into accepted short buffer\n");
+      return 1;
+    }
+  memset (seen, 0, sizeof (seen));
+  n = 0;
+  for (k = gdbm_firstkey_into (dbf, &i, sizeof (i), &needed); k == 0;
+       k = gdbm_nextkey_into (dbf, key, &i, sizeof (i), &needed))
+    {
+      if (needed != sizeof (i) || i < 0 || i >= NKEYS || seen[i])
+	{
+	  fprintf (stderr, "unexpected key\n");
+	  return 1;
+	}
+      seen[i] = 1;
+      n++;
+    }
+  if (gdbm_errno != GDBM_ITEM_NOT_FOUND)
+    {
+      fprintf (stderr, "iteration failed: %s\n", gdbm_db_strerror (dbf));
+      return 1;
+    }
+  if (n != NKEYS)
+    {
+      fprintf (stderr, "visited %d keys out of %d\n", n, NKEYS);
+      return 1;
+    }
+
+  if (gdbm_close (dbf))
+    {
+      fprintf (stderr, "gdbm_close: %s\n", gdbm_strerror (gdbm_errno));
+      return 1;
+    }
+  return 0;
+}
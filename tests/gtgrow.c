@@ -0,0 +1,238 @@
+/*
+  NAME
+    gtgrow - test in-place growth and shrinking of records.
+
+  SYNOPSIS
+    gtgrow [-v]
+
+  DESCRIPTION
+    Operation:
+
+    1) Create new database with a single record.
+    2) Grow the record in small steps using gdbm_store with
+       GDBM_REPLACE.  Verify that it stays at the same address.
+    3) Shrink the record.  Verify that it stays at the same address.
+    4) Populate the database with NKEYS records and replace them
+       NROUNDS times with values of pseudo-random size.  Verify the
+       records after each round.
+    5) Verify the available space.
+
+  OPTIONS
+     -v   Verbosely print what's being done.
+
+  EXIT CODE
+     0    success
+     1    failure
+     2    usage error
+
+  LICENSE
+    This file is part of GDBM test suite.
+    Copyright (C) 2025 Free Software Foundation, Inc.
+
+    GDBM is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2, or (at your option)
+    any later version.
+
+    GDBM is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GDBM. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "autoconf.h"
+#include "gdbmdefs.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+char dbname[] = "a.db";
+int verbose = 0;
+
+#define MAXSIZE 2048
+#define STEP 16
+#define NKEYS 512
+#define NROUNDS 16
+
+static char buf[MAXSIZE];
+
+static void
+fill (int k, int size)
+{
+  int i;
+
+  for (i = 0; i < size; i++)
+    buf[i] = k + i;
+}
+
+static void
+store (GDBM_FILE dbf, int k, int size)
+{
+  datum key, content;
+
+  key.dptr = (char*) &k;
+  key.dsize = sizeof (k);
+  fill (k, size);
+  content.dptr = buf;
+  content.dsize = size;
+  if (gdbm_store (dbf, key, content, GDBM_REPLACE))
+    {
+      fprintf (stderr, "%d: item not inserted: %s\n",
+	       k, gdbm_db_strerror (dbf));
+      exit (1);
+    }
+}
+
+static void
+check (GDBM_FILE dbf, int k, int size)
+{
+  datum key, content;
+
+  key.dptr = (char*) &k;
+  key.dsize = sizeof (k);
+  content = gdbm_fetch (dbf, key);
+  if (content.dptr == NULL)
+    {
+      fprintf (stderr, "%d: fetch failed: %s\n", k, gdbm_db_strerror (dbf));
+      exit (1);
+    }
+  fill (k, size);
+  if (content.dsize != size || memcmp (content.dptr, buf, size))
+    {
+      fprintf (stderr, "%d: wrong content\n", k);
+      exit (1);
+    }
+  free (content.dptr);
+}
+
+/* Return the file address of the only record in DBF. */
+static off_t
+record_adr (GDBM_FILE dbf)
+{
+  int i;
+
+  for (i = 0; i < dbf->header->bucket_elems; i++)
+    if (dbf->bucket->h_table[i].hash_value != -1)
+      return dbf->bucket->h_table[i].data_pointer;
+  fprintf (stderr, "record not found\n");
+  exit (1);
+}
+
+static unsigned
+next_rand (unsigned *seed)
+{
+  *seed = *seed * 1103515245 + 12345;
+  return (*seed >> 16) & 0x7fff;
+}
+
+int
+main (int argc, char **argv)
+{
+  GDBM_FILE dbf;
+  int i, k, n;
+  off_t adr;
+  static int sizes[NKEYS];
+  unsigned seed = 1;
+
+  while ((i = getopt (argc, argv, "v")) != EOF)
+    {
+      switch (i)
+	{
+	case 'v':
+	  verbose++;
+	  break;
+
+	default:
+	  return 2;
+	}
+    }
+
+  /*
+   * 1) Create the database.
+   */
+  if (verbose)
+    printf ("creating database\n");
+  dbf = gdbm_open (dbname, GDBM_MIN_BLOCK_SIZE, GDBM_NEWDB, 0644, NULL);
+  if (!dbf)
+    {
+      fprintf (stderr, "gdbm_open: %s\n", gdbm_strerror (gdbm_errno));
+      return 1;
+    }
+  store (dbf, 0, 1);
+  adr = record_adr (dbf);
+
+  /*
+   * 2) Grow the record.
+   */
+  if (verbose)
+    printf ("growing record\n");
+  for (n = 1 + STEP; n < MAXSIZE; n += STEP)
+    {
+      store (dbf, 0, n);
+      if (record_adr (dbf) != adr)
+	{
+	  fprintf (stderr, "record moved when growing to %d bytes\n", n);
+	  return 1;
+	}
+      check (dbf, 0, n);
+    }
+
+  /*
+   * 3) Shrink it.
+   */
+  if (verbose)
+    printf ("shrinking record\n");
+  for (n -= STEP; n > 0; n -= 3 * STEP)
+    {
+      store (dbf, 0, n);
+      if (record_adr (dbf) != adr)
+	{
+	  fprintf (stderr, "record moved when shrinking to %d bytes\n", n);
+	  return 1;
+	}
+      check (dbf, 0, n);
+    }
+
+  /*
+   * 4) Replace records with values of varying size.
+   */
+  if (verbose)
+    printf ("replacing records\n");
+  for (k = 0; k < NKEYS; k++)
+    {
+      sizes[k] = next_rand (&seed) % 64;
+      store (dbf, k, sizes[k]);
+    }
+  for (n = 0; n < NROUNDS; n++)
+    {
+      for (k = 0; k < NKEYS; k++)
+	{
+	  i = next_rand (&seed) % 16;
+	  if (i < 12)
+	    sizes[k] += i;
+	  else if (sizes[k] > 8)
+	    sizes[k] -= 8;
+	  store (dbf, k, sizes[k]);
+	}
+      for (k = 0; k < NKEYS; k++)
+	check (dbf, k, sizes[k]);
+    }
+
+  /*
+   * 5) Verify the available space.
+   */
+  if (gdbm_avail_verify (dbf))
+    {
+      fprintf (stderr, "gdbm_avail_verify: %s\n", gdbm_db_strerror (dbf));
+      return 1;
+    }
+  if (gdbm_close (dbf))
+    {
+      fprintf (stderr, "gdbm_close: %s\n", gdbm_strerror (gdbm_errno));
+      return 1;
+    }
+  return 0;
+}
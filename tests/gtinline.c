@@ -0,0 +1,247 @@
+/*
+  NAME
+    gtinline - test inline storage of tiny records.
+
+  SYNOPSIS
+    gtinline [-v]
+
+  DESCRIPTION
+    Operation:
+
+    1) Create new database with GDBM_INLINE and populate it with
+       records of various sizes.  Verify that tiny records are kept in
+       their bucket elements and that they take no file space.
+    2) Replace tiny records with large ones and vice versa, shrink a
+       record with gdbm_update, append to a tiny record and delete
+       some records.
+    3) Reopen the database and check its format and contents.
+    4) Convert the database to standard format and back.
+    5) Reorganize the database.
+
+    After each step the contents of the database is verified and
+    the available space is checked.
+
+  OPTIONS
+     -v   Verbosely print what's being done.
+
+  EXIT CODE
+     0    success
+     1    failure
+     2    usage error
+
+  LICENSE
+    This file is part of GDBM test suite.
+    Copyright (C) 2025 Free Software Foundation, Inc.
+
+    GDBM is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2, or (at your option)
+    any later version.
+
+    GDBM is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GDBM. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "autoconf.h"
+#include "gdbmdefs.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "records.h"
+
+char dbname[] = "a.db";
+int verbose = 0;
+
+#define NKEYS 2000
+#define MAXSIZE 100
+
+/* Check the contents of the database.  If INLINE is true, verify that
+   tiny records are kept in bucket elements. */
+static void
+verify (GDBM_FILE dbf, int inline_p)
+{
+  int i;
+
+  rec_verify (dbf);
+  if (inline_p)
+    for (i = 0; i < NKEYS; i++)
+      if (rec_size[i] != -1
+	  && sizeof (i) + rec_size[i] <= INLINE_RECORD_SIZE)
+	{
+	  int elem_loc = _gdbm_findkey_loc (dbf, rec_key (i), NULL);
+	  if (elem_loc == -1
+	      || !bucket_element_inline_p (dbf,
+					   &dbf->bucket->h_table[elem_loc]))
+	    {
+	      fprintf (stderr, "%d: record not inline\n", i);
+	      exit (1);
+	    }
+	}
+
+  if (gdbm_avail_verify (dbf))
+    {
+      fprintf (stderr, "gdbm_avail_verify: %s\n", gdbm_db_strerror (dbf));
+      exit (1);
+    }
+}
+
+static int
+shrink (datum key, datum *content, void *data)
+{
+  content->dsize = *(int*)data;
+  return GDBM_UPDATE_STORE;
+}
+
+int
+main (int argc, char **argv)
+{
+  GDBM_FILE dbf;
+  int i, n;
+  off_t next_block;
+
+  while ((i = getopt (argc, argv, "v")) != EOF)
+    {
+      switch (i)
+	{
+	case 'v':
+	  verbose++;
+	  break;
+
+	default:
+	  return 2;
+	}
+    }
+
+  /*
+   * 1) Create and populate the database.
+   */
+  if (verbose)
+    printf ("creating database\n");
+  dbf = gdbm_open (dbname, GDBM_MIN_BLOCK_SIZE, GDBM_NEWDB | GDBM_INLINE,
+		   0644, NULL);
+  if (!dbf)
+    {
+      fprintf (stderr, "gdbm_open: %s\n", gdbm_strerror (gdbm_errno));
+      return 1;
+    }
+  rec_init (NKEYS);
+  for (i = 0; i < NKEYS; i++)
+    rec_store (dbf, i, i % 5 == 0 ? MAXSIZE - i % 7 : i % 9);
+  verify (dbf, 1);
+
+  /* Tiny records take no file space. */
+  next_block = dbf->header->next_block;
+  for (i = 0; i < NKEYS; i += 5)
+    rec_store (dbf, i, 8);
+  if (dbf->header->next_block != next_block)
+    {
+      fprintf (stderr, "tiny records allocated file space\n");
+      return 1;
+    }
+  verify (dbf, 1);
+
+  /*
+   * 2) Modify the database.
+   */
+  if (verbose)
+    printf ("modifying database\n");
+  for (i = 0; i < NKEYS; i += 3)
+    rec_store (dbf, i, rec_size[i] > 8 ? 4 : MAXSIZE);
+  verify (dbf, 1);
+
+  /* Shrink large records. */
+  n = 2;
+  for (i = 1; i < NKEYS; i += 3)
+    if (rec_size[i] > 8)
+      {
+	if (gdbm_update (dbf, rec_key (i), shrink, &n))
+	  {
+	    fprintf (stderr, "%d: gdbm_update: %s\n", i,
+		     gdbm_db_strerror (dbf));
+	    return 1;
+	  }
+	rec_size[i] = n;
+      }
+  verify (dbf, 1);
+
+  /* Append to tiny records. */
+  for (i = 2; i < NKEYS; i += 3)
+    if (rec_size[i] <= 8)
+      rec_append (dbf, i, 20);
+  verify (dbf, 1);
+
+  /* Delete some records. */
+  for (i = 0; i < NKEYS; i += 4)
+    rec_delete (dbf, i);
+  verify (dbf, 1);
+  gdbm_close (dbf);
+
+  /*
+   * 3) Reopen the database.
+   */
+  if (verbose)
+    printf ("reopening database\n");
+  dbf = gdbm_open (dbname, 0, GDBM_WRITER, 0, NULL);
+  if (!dbf)
+    {
+      fprintf (stderr, "gdbm_open: %s\n", gdbm_strerror (gdbm_errno));
+      return 1;
+    }
+  if (gdbm_setopt (dbf, GDBM_GETDBFORMAT, &n, sizeof (n))
+      || n != (GDBM_NUMSYNC | GDBM_INLINE))
+    {
+      fprintf (stderr, "wrong database format\n");
+      return 1;
+    }
+  verify (dbf, 1);
+
+  /*
+   * 4) Convert the database.
+   */
+  if (verbose)
+    printf ("converting to standard format\n");
+  if (gdbm_convert (dbf, 0))
+    {
+      fprintf (stderr, "gdbm_convert: %s\n", gdbm_db_strerror (dbf));
+      return 1;
+    }
+  if (gdbm_inline_records_p (dbf) || dbf->xheader)
+    {
+      fprintf (stderr, "database not converted\n");
+      return 1;
+    }
+  verify (dbf, 0);
+
+  if (verbose)
+    printf ("converting to inline format\n");
+  if (gdbm_convert (dbf, GDBM_INLINE))
+    {
+      fprintf (stderr, "gdbm_convert: %s\n", gdbm_db_strerror (dbf));
+      return 1;
+    }
+  verify (dbf, 1);
+
+  /*
+   * 5) Reorganize the database.
+   */
+  if (verbose)
+    printf ("reorganizing database\n");
+  if (gdbm_reorganize (dbf))
+    {
+      fprintf (stderr, "gdbm_reorganize: %s\n", gdbm_db_strerror (dbf));
+      return 1;
+    }
+  verify (dbf, 1);
+
+  if (gdbm_close (dbf))
+    {
+      fprintf (stderr, "gdbm_close: %s\n", gdbm_strerror (gdbm_errno));
+      return 1;
+    }
+  return 0;
+}
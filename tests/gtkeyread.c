@@ -0,0 +1,312 @@
+/*
+  NAME
+    gtkeyread - test that key lookups and iteration read only keys.
+
+  SYNOPSIS
+    gtkeyread [-cdiv]
+
+  DESCRIPTION
+    Operation:
+
+    1) Create new database and populate it with records, some of which
+       have large values.  Reopen it, so that no data are cached.
+    2) Iterate over the keys.  Check that all keys are returned and
+       that the data cache never grows to the size of a large value.
+    3) Check the existence of all keys and of some missing ones, again
+       watching the size of the data cache.
+    4) Fetch each record, in whole or in part, right after its key has
+       been looked up or returned by gdbm_nextkey.
+    5) Replace and delete records after checking their existence.
+
+    After steps 4 and 5 the contents of the database is verified and
+    the available space is checked.
+
+  OPTIONS
+     -c   Compress record data (GDBM_COMPRESS).
+     -d   Share identical record data (GDBM_DEDUP).
+     -i   Keep tiny records inline (GDBM_INLINE).
+     -v   Verbosely print what's being done.
+
+  EXIT CODE
+     0    success
+     1    failure
+     2    usage error
+
+  LICENSE
+    This file is part of GDBM test suite.
+    Copyright (C) 2025 Free Software Foundation, Inc.
+
+    GDBM is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2, or (at your option)
+    any later version.
+
+    GDBM is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GDBM. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "autoconf.h"
+#include "gdbmdefs.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "records.h"
+
+char dbname[] = "a.db";
+int verbose = 0;
+
+#define NKEYS 500
+/* Size of large values.  The data cache must stay smaller than that
+   as long as only keys are looked up. */
+#define LARGE 4096
+
+static datum
+make_key (int i)
+{
+  static char buf[32];
+  datum key;
+
+  key.dsize = snprintf (buf, sizeof (buf), "key%d", i);
+  key.dptr = buf;
+  return key;
+}
+
+static int
+key_index (datum key)
+{
+  char buf[32];
+  int i;
+
+  if (key.dsize < 4 || key.dsize >= sizeof (buf))
+    return -1;
+  memcpy (buf, key.dptr, key.dsize);
+  buf[key.dsize] = 0;
+  if (sscanf (buf, "key%d", &i) != 1 || i < 0 || i >= NKEYS)
+    return -1;
+  return i;
+}
+
+/* Fail if the data cache of the current bucket holds a large value. */
+static void
+check_cache (GDBM_FILE dbf, char const *what)
+{
+  if (dbf->cache_mru->ca_data.dsize >= LARGE)
+    {
+      fprintf (stderr, "%s: data read (cache size %zu)\n", what,
+	       dbf->cache_mru->ca_data.dsize);
+      exit (1);
+    }
+}
+
+static void
+check_exists (GDBM_FILE dbf, int i)
+{
+  if (!gdbm_exists (dbf, make_key (i)))
+    {
+      fprintf (stderr, "%d: gdbm_exists failed: %s\n", i,
+	       gdbm_db_strerror (dbf));
+      exit (1);
+    }
+}
+
+static void
+check_content (int i, datum content)
+{
+  rec_check (i, content);
+  free (content.dptr);
+}
+
+static void
+verify (GDBM_FILE dbf)
+{
+  rec_verify (dbf);
+  if (gdbm_avail_verify (dbf))
+    {
+      fprintf (stderr, "gdbm_avail_verify: %s\n", gdbm_db_strerror (dbf));
+      exit (1);
+    }
+}
+
+int
+main (int argc, char **argv)
+{
+  GDBM_FILE dbf;
+  int i, n;
+  int flags = 0;
+  datum key, next, content;
+  char *seen;
+
+  while ((i = getopt (argc, argv, "cdiv")) != EOF)
+    {
+      switch (i)
+	{
+	case 'c':
+	  flags |= GDBM_COMPRESS;
+	  break;
+
+	case 'd':
+	  flags |= GDBM_DEDUP;
+	  break;
+
+	case 'i':
+	  flags |= GDBM_INLINE;
+	  break;
+
+	case 'v':
+	  verbose++;
+	  break;
+
+	default:
+	  return 2;
+	}
+    }
+
+  /*
+   * 1) Create and populate the database.
+   */
+  if (verbose)
+    printf ("creating database\n");
+  dbf = gdbm_open (dbname, 0, GDBM_NEWDB | flags, 0644, NULL);
+  if (!dbf)
+    {
+      fprintf (stderr, "gdbm_open: %s\n", gdbm_strerror (gdbm_errno));
+      return 1;
+    }
+  rec_init (NKEYS);
+  rec_key = make_key;
+  /* Make the data compressible. */
+  rec_run = 64;
+  for (i = 0; i < NKEYS; i++)
+    rec_store (dbf, i, i % 3 == 0 ? LARGE + i : i % 20);
+  gdbm_close (dbf);
+
+  dbf = gdbm_open (dbname, 0, GDBM_WRITER, 0, NULL);
+  if (!dbf)
+    {
+      fprintf (stderr, "gdbm_open: %s\n", gdbm_strerror (gdbm_errno));
+      return 1;
+    }
+
+  /*
+   * 2) Iterate over the keys.
+   */
+  if (verbose)
+    printf ("iterating over keys\n");
+  seen = calloc (NKEYS, 1);
+  if (!seen)
+    abort ();
+  n = 0;
+  for (key = gdbm_firstkey (dbf); key.dptr; key = next)
+    {
+      check_cache (dbf, "gdbm_nextkey");
+      i = key_index (key);
+      if (i == -1 || seen[i])
+	{
+	  fprintf (stderr, "unexpected key %.*s\n", key.dsize, key.dptr);
+	  return 1;
+	}
+      seen[i] = 1;
+      n++;
+      next = gdbm_nextkey (dbf, key);
+      free (key.dptr);
+    }
+  if (gdbm_errno != GDBM_ITEM_NOT_FOUND)
+    {
+      fprintf (stderr, "gdbm_nextkey: %s\n", gdbm_db_strerror (dbf));
+      return 1;
+    }
+  if (n != NKEYS)
+    {
+      fprintf (stderr, "%d keys returned instead of %d\n", n, NKEYS);
+      return 1;
+    }
+  free (seen);
+
+  /*
+   * 3) Check the existence of keys.
+   */
+  if (verbose)
+    printf ("checking existence\n");
+  for (i = 0; i < NKEYS; i++)
+    {
+      check_exists (dbf, i);
+      check_cache (dbf, "gdbm_exists");
+    }
+  for (i = NKEYS; i < 2 * NKEYS; i++)
+    {
+      if (gdbm_exists (dbf, make_key (i)))
+	{
+	  fprintf (stderr, "%d: missing key exists\n", i);
+	  return 1;
+	}
+      check_cache (dbf, "gdbm_exists");
+    }
+
+  /*
+   * 4) Read data of the records whose keys are cached.
+   */
+  if (verbose)
+    printf ("fetching records\n");
+  for (i = 0; i < NKEYS; i++)
+    {
+      check_exists (dbf, i);
+      switch (i % 3)
+	{
+	case 0:
+	  check_content (i, gdbm_fetch (dbf, make_key (i)));
+	  break;
+
+	case 1:
+	  /* The whole record is read here. */
+	  content = gdbm_fetch_range (dbf, make_key (i), 0, rec_size[i]);
+	  check_content (i, content);
+	  break;
+
+	case 2:
+	  /* Fetching a record right after gdbm_nextkey. */
+	  key = make_key (i);
+	  next = gdbm_nextkey (dbf, key);
+	  if (next.dptr)
+	    {
+	      n = key_index (next);
+	      if (n == -1)
+		{
+		  fprintf (stderr, "unexpected key %.*s\n", next.dsize,
+			   next.dptr);
+		  return 1;
+		}
+	      check_content (n, gdbm_fetch (dbf, next));
+	      free (next.dptr);
+	    }
+	  break;
+	}
+    }
+  verify (dbf);
+
+  /*
+   * 5) Modify records whose keys are cached.
+   */
+  if (verbose)
+    printf ("modifying records\n");
+  for (i = 0; i < NKEYS; i += 2)
+    {
+      check_exists (dbf, i);
+      if (i % 4 == 0)
+	rec_delete (dbf, i);
+      else
+	rec_store (dbf, i, i % 3 == 0 ? i % 20 : LARGE + i / 2);
+    }
+  verify (dbf);
+
+  if (gdbm_close (dbf))
+    {
+      fprintf (stderr, "gdbm_close: %s\n", gdbm_strerror (gdbm_errno));
+      return 1;
+    }
+  return 0;
+}
@@ -0,0 +1,260 @@
+/*
+  NAME
+    gtlarge - test large database format.
+
+  SYNOPSIS
+    gtlarge [-crv]
+
+  DESCRIPTION
+    Operation:
+
+    1) Check that GDBM_LARGE cannot be combined with GDBM_INLINE.
+    2) Create new database with GDBM_LARGE and populate it with records
+       having short and long keys.
+    3) Replace some records and delete others.
+    4) Reopen the database and check its format and contents.
+    5) Convert the database to standard format and back.
+    6) Reorganize the database.
+
+    After each step the contents of the database is verified, the
+    directory size is checked and the available space is checked.
+
+  OPTIONS
+     -c   Use compact buckets (GDBM_COMPACT).
+     -r   Use Robin Hood placement (GDBM_ROBINHOOD).
+     -v   Verbosely print what's being done.
+
+  EXIT CODE
+     0    success
+     1    failure
+     2    usage error
+
+  LICENSE
+    This file is part of GDBM test suite.
+    Copyright (C) 2025 Free Software Foundation, Inc.
+
+    GDBM is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2, or (at your option)
+    any later version.
+
+    GDBM is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GDBM. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "autoconf.h"
+#include "gdbmdefs.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "records.h"
+
+char dbname[] = "a.db";
+int verbose = 0;
+
+#define NKEYS 20000
+#define MAXSIZE 64
+#define MAXKEY 32
+
+/* Make the key for record I.  Every other key is short enough to fit
+   into the key_start field of the bucket element. */
+static datum
+make_key (int i)
+{
+  static char buf[MAXKEY];
+  datum key;
+
+  key.dptr = buf;
+  if (i % 2)
+    key.dsize = snprintf (buf, MAXKEY, "%x", i);
+  else
+    key.dsize = snprintf (buf, MAXKEY, "long key number %d", i);
+  return key;
+}
+
+static void
+verify (GDBM_FILE dbf)
+{
+  rec_verify (dbf);
+
+  if (gdbm_large_p (dbf)
+      && dbf->header->dir_size != 1 << dbf->header->dir_bits)
+    {
+      fprintf (stderr, "wrong directory size: %d, bits %d\n",
+	       dbf->header->dir_size, dbf->header->dir_bits);
+      exit (1);
+    }
+
+  if (gdbm_avail_verify (dbf))
+    {
+      fprintf (stderr, "gdbm_avail_verify: %s\n", gdbm_db_strerror (dbf));
+      exit (1);
+    }
+}
+
+int
+main (int argc, char **argv)
+{
+  GDBM_FILE dbf;
+  int i, n;
+  int flags = GDBM_LARGE;
+
+  while ((i = getopt (argc, argv, "crv")) != EOF)
+    {
+      switch (i)
+	{
+	case 'c':
+	  flags |= GDBM_COMPACT;
+	  break;
+
+	case 'r':
+	  flags |= GDBM_ROBINHOOD;
+	  break;
+
+	case 'v':
+	  verbose++;
+	  break;
+
+	default:
+	  return 2;
+	}
+    }
+
+  /*
+   * 1) Incompatible flags.
+   */
+  dbf = gdbm_open (dbname, GDBM_MIN_BLOCK_SIZE,
+		   GDBM_NEWDB | GDBM_LARGE | GDBM_INLINE, 0644, NULL);
+  if (dbf || gdbm_errno != GDBM_ERR_USAGE)
+    {
+      fprintf (stderr, "GDBM_LARGE combined with GDBM_INLINE\n");
+      return 1;
+    }
+
+  /*
+   * 2) Create and populate the database.
+   */
+  if (verbose)
+    printf ("creating database\n");
+  dbf = gdbm_open (dbname, GDBM_MIN_BLOCK_SIZE, GDBM_NEWDB | flags,
+		   0644, NULL);
+  if (!dbf)
+    {
+      fprintf (stderr, "gdbm_open: %s\n", gdbm_strerror (gdbm_errno));
+      return 1;
+    }
+  /* Records past NKEYS are never stored. */
+  rec_init (2 * NKEYS);
+  rec_key = make_key;
+  for (i = 0; i < NKEYS; i++)
+    rec_store (dbf, i, 1 + i % MAXSIZE);
+  verify (dbf);
+
+  /*
+   * 3) Modify the database.
+   */
+  if (verbose)
+    printf ("modifying database\n");
+  for (i = 0; i < NKEYS; i += 3)
+    rec_store (dbf, i, MAXSIZE - i % 5);
+  for (i = 0; i < NKEYS; i += 4)
+    rec_delete (dbf, i);
+  verify (dbf);
+  /* Reinsert some of the deleted records. */
+  for (i = 0; i < NKEYS; i += 8)
+    rec_store (dbf, i, 1 + i % 7);
+  verify (dbf);
+  gdbm_close (dbf);
+
+  /*
+   * 4) Reopen the database.
+   */
+  if (verbose)
+    printf ("reopening database\n");
+  dbf = gdbm_open (dbname, 0, GDBM_WRITER, 0, NULL);
+  if (!dbf)
+    {
+      fprintf (stderr, "gdbm_open: %s\n", gdbm_strerror (gdbm_errno));
+      return 1;
+    }
+  if (gdbm_setopt (dbf, GDBM_GETDBFORMAT, &n, sizeof (n))
+      || n != (GDBM_NUMSYNC | flags))
+    {
+      fprintf (stderr, "wrong database format\n");
+      return 1;
+    }
+  verify (dbf);
+
+  /*
+   * 5) Convert the database.
+   */
+  if (verbose)
+    printf ("converting to standard format\n");
+  if (gdbm_convert (dbf, GDBM_NUMSYNC | (flags & ~GDBM_LARGE)))
+    {
+      fprintf (stderr, "gdbm_convert: %s\n", gdbm_db_strerror (dbf));
+      return 1;
+    }
+  if (gdbm_large_p (dbf))
+    {
+      fprintf (stderr, "database not converted\n");
+      return 1;
+    }
+  verify (dbf);
+  for (i = 1; i < NKEYS; i += 6)
+    rec_delete (dbf, i);
+  for (i = NKEYS - 1; i >= 0; i -= 6)
+    rec_store (dbf, i, 1 + i % 11);
+  verify (dbf);
+
+  if (verbose)
+    printf ("converting to large format\n");
+  if (gdbm_convert (dbf, GDBM_LARGE | GDBM_INLINE) == 0
+      || gdbm_last_errno (dbf) != GDBM_ERR_USAGE)
+    {
+      fprintf (stderr, "GDBM_LARGE combined with GDBM_INLINE\n");
+      return 1;
+    }
+  gdbm_clear_error (dbf);
+  if (gdbm_convert (dbf, GDBM_NUMSYNC | flags))
+    {
+      fprintf (stderr, "gdbm_convert: %s\n", gdbm_db_strerror (dbf));
+      return 1;
+    }
+  if (gdbm_setopt (dbf, GDBM_GETDBFORMAT, &n, sizeof (n))
+      || n != (GDBM_NUMSYNC | flags))
+    {
+      fprintf (stderr, "wrong database format after conversion\n");
+      return 1;
+    }
+  verify (dbf);
+
+  /*
+   * 6) Reorganize the database.
+   */
+  if (verbose)
+    printf ("reorganizing database\n");
+  if (gdbm_reorganize (dbf))
+    {
+      fprintf (stderr, "gdbm_reorganize: %s\n", gdbm_db_strerror (dbf));
+      return 1;
+    }
+  if (!gdbm_large_p (dbf))
+    {
+      fprintf (stderr, "reorganized database lost large format\n");
+      return 1;
+    }
+  verify (dbf);
+
+  if (gdbm_close (dbf))
+    {
+      fprintf (stderr, "gdbm_close: %s\n", gdbm_strerror (gdbm_errno));
+      return 1;
+    }
+  return 0;
+}
@@ -0,0 +1,247 @@
+/*
+  NAME
+    gtparcheck - test multi-threaded bucket checks.
+
+  SYNOPSIS
+    gtparcheck [-bilv]
+
+  DESCRIPTION
+    Operation:
+
+    1) Create new database and populate it with records of various
+       sizes.
+    2) With one, several and the default number of check threads, count
+       the records and run gdbm_recover.  The count must be right, and
+       the consistency check of gdbm_recover must find no problems, so
+       that the database is not rebuilt.
+    3) Alter the key of a record on the disk.  The consistency check
+       must detect that, and the database must be rebuilt.
+    4) Damage the header of a bucket on the disk.  Counting the records
+       must fail with GDBM_BAD_BUCKET.
+
+  OPTIONS
+     -b   Use compact buckets (GDBM_COMPACT).
+     -i   Keep tiny records inline (GDBM_INLINE).
+     -l   Use the large database format (GDBM_LARGE).
+     -v   Verbosely print what's being done.
+
+  EXIT CODE
+     0    success
+     1    failure
+     2    usage error
+
+  LICENSE
+    This file is part of GDBM test suite.
+    Copyright (C) 2025 Free Software Foundation, Inc.
+
+    GDBM is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2, or (at your option)
+    any later version.
+
+    GDBM is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GDBM. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "autoconf.h"
+#include "gdbmdefs.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "records.h"
+
+char dbname[] = "a.db";
+int verbose = 0;
+
+#define NKEYS 5000
+#define MAXSIZE 300
+#define NTHREADS 4
+/* The record whose key is altered on the disk. */
+#define BADKEY 1234
+
+static void
+set_threads (GDBM_FILE dbf, int n)
+{
+  if (verbose)
+    printf ("using %d threads\n", n);
+  if (gdbm_setopt (dbf, GDBM_SETCHECKTHREADS, &n, sizeof (n)))
+    {
+      fprintf (stderr, "GDBM_SETCHECKTHREADS: %s\n", gdbm_db_strerror (dbf));
+      exit (1);
+    }
+}
+
+static void
+check_count (GDBM_FILE dbf)
+{
+  gdbm_count_t count;
+
+  if (gdbm_count (dbf, &count))
+    {
+      fprintf (stderr, "gdbm_count: %s\n", gdbm_db_strerror (dbf));
+      exit (1);
+    }
+  if (count != NKEYS)
+    {
+      fprintf (stderr, "gdbm_count returned %lu instead of %d\n",
+	       (unsigned long) count, NKEYS);
+      exit (1);
+    }
+}
+
+/* Run gdbm_recover and return the number of recovered keys, which is 0
+   if the database was found consistent. */
+static size_t
+recover (GDBM_FILE dbf)
+{
+  gdbm_recovery rcvr;
+
+  if (gdbm_recover (dbf, &rcvr, 0))
+    {
+      fprintf (stderr, "gdbm_recover: %s\n", gdbm_db_strerror (dbf));
+      exit (1);
+    }
+  return rcvr.recovered_keys;
+}
+
+int
+main (int argc, char **argv)
+{
+  GDBM_FILE dbf;
+  int i, n;
+  int flags = 0;
+  static int threads[] = { 1, NTHREADS, 0 };
+  int elem_loc;
+  bucket_element *elem;
+  off_t adr;
+  gdbm_count_t count;
+
+  while ((i = getopt (argc, argv, "bilv")) != EOF)
+    {
+      switch (i)
+	{
+	case 'b':
+	  flags |= GDBM_COMPACT;
+	  break;
+
+	case 'i':
+	  flags |= GDBM_INLINE;
+	  break;
+
+	case 'l':
+	  flags |= GDBM_LARGE;
+	  break;
+
+	case 'v':
+	  verbose++;
+	  break;
+
+	default:
+	  return 2;
+	}
+    }
+
+  /*
+   * 1) Create and populate the database.
+   */
+  if (verbose)
+    printf ("creating database\n");
+  dbf = gdbm_open (dbname, 0, GDBM_NEWDB | flags, 0644, NULL);
+  if (!dbf)
+    {
+      fprintf (stderr, "gdbm_open: %s\n", gdbm_strerror (gdbm_errno));
+      return 1;
+    }
+  rec_init (NKEYS);
+  for (i = 0; i < NKEYS; i++)
+    rec_store (dbf, i, i % 5 == 0 ? i % 3 : i % MAXSIZE);
+
+  /*
+   * 2) Check the consistent database.
+   */
+  for (n = 0; n < ARRAY_SIZE (threads); n++)
+    {
+      set_threads (dbf, threads[n]);
+      check_count (dbf);
+      if (recover (dbf) != 0)
+	{
+	  fprintf (stderr, "consistent database rebuilt\n");
+	  return 1;
+	}
+    }
+
+  /*
+   * 3) Alter a key.
+   */
+  if (verbose)
+    printf ("altering a key\n");
+  set_threads (dbf, NTHREADS);
+  i = BADKEY;
+  elem_loc = _gdbm_findkey_loc (dbf, rec_key (i), NULL);
+  if (elem_loc < 0)
+    {
+      fprintf (stderr, "%d: key not found: %s\n", i, gdbm_db_strerror (dbf));
+      return 1;
+    }
+  elem = &dbf->bucket->h_table[elem_loc];
+  if (bucket_element_inline_p (dbf, elem))
+    {
+      fprintf (stderr, "%d: record is inline\n", i);
+      return 1;
+    }
+  adr = elem->data_pointer;
+  if (gdbm_sync (dbf))
+    {
+      fprintf (stderr, "gdbm_sync: %s\n", gdbm_db_strerror (dbf));
+      return 1;
+    }
+  i = -i;
+  if (pwrite (gdbm_fdesc (dbf), &i, sizeof (i), adr) != sizeof (i))
+    {
+      perror ("pwrite");
+      return 1;
+    }
+  if (recover (dbf) != NKEYS)
+    {
+      fprintf (stderr, "altered key not detected\n");
+      return 1;
+    }
+  check_count (dbf);
+
+  /*
+   * 4) Damage a bucket.
+   */
+  if (verbose)
+    printf ("damaging a bucket\n");
+  if (gdbm_sync (dbf))
+    {
+      fprintf (stderr, "gdbm_sync: %s\n", gdbm_db_strerror (dbf));
+      return 1;
+    }
+  i = dbf->header->bucket_elems + 1;
+  adr = dbf->dir[GDBM_DIR_COUNT (dbf) - 1] + offsetof (hash_bucket, count);
+  if (pwrite (gdbm_fdesc (dbf), &i, sizeof (i), adr) != sizeof (i))
+    {
+      perror ("pwrite");
+      return 1;
+    }
+  if (gdbm_count (dbf, &count) == 0)
+    {
+      fprintf (stderr, "damaged bucket not detected\n");
+      return 1;
+    }
+  if (gdbm_last_errno (dbf) != GDBM_BAD_BUCKET)
+    {
+      fprintf (stderr, "gdbm_count: unexpected error: %s\n",
+	       gdbm_db_strerror (dbf));
+      return 1;
+    }
+
+  gdbm_close (dbf);
+  return 0;
+}
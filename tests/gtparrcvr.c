@@ -0,0 +1,278 @@
+/*
+  NAME
+    gtparrcvr - test recovery of damaged databases in several threads.
+
+  SYNOPSIS
+    gtparrcvr [-bcdiv] [-t NTHREADS]
+
+  DESCRIPTION
+    Operation:
+
+    1) Create new database with a small block size and populate it with
+       records of various sizes, so that the recovery has to read the
+       buckets in several rounds.
+    2) Damage the header of a bucket and, unless the buckets are compact,
+       the location of a record in another bucket.
+    3) Run gdbm_recover with a limit on failed buckets that is reached.
+       It must fail.
+    4) Run gdbm_recover again without limits.  Check its statistics, and
+       check that all records but the lost ones are kept intact.
+
+  OPTIONS
+     -b   Use compact buckets (GDBM_COMPACT).
+     -c   Compress record data (GDBM_COMPRESS).
+     -d   Share identical record data (GDBM_DEDUP).
+     -i   Keep tiny records inline (GDBM_INLINE).
+     -t NTHREADS
+	  Use that many threads (GDBM_SETCHECKTHREADS).  Default is 1.
+     -v   Verbosely print what's being done.
+
+  EXIT CODE
+     0    success
+     1    failure
+     2    usage error
+
+  LICENSE
+    This file is part of GDBM test suite.
+    Copyright (C) 2025 Free Software Foundation, Inc.
+
+    GDBM is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2, or (at your option)
+    any later version.
+
+    GDBM is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GDBM. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "autoconf.h"
+#include "gdbmdefs.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "records.h"
+
+char dbname[] = "a.db";
+int verbose = 0;
+
+#define NKEYS 20000
+#define MAXSIZE 1000
+#define BLOCK_SIZE 512
+
+/* Return the directory index of the bucket of the record I. */
+static int
+bucket_of (GDBM_FILE dbf, int i, int *elem_loc)
+{
+  int hash, dir, off;
+
+  *elem_loc = _gdbm_findkey_loc (dbf, rec_key (i), NULL);
+  if (*elem_loc < 0)
+    {
+      fprintf (stderr, "%d: key not found: %s\n", i, gdbm_db_strerror (dbf));
+      exit (1);
+    }
+  _gdbm_hash_key (dbf, rec_key (i), &hash, &dir, &off);
+  return dir;
+}
+
+static void
+damage (GDBM_FILE dbf, off_t adr, void *buf, size_t len)
+{
+  if (pwrite (gdbm_fdesc (dbf), buf, len, adr) != len)
+    {
+      perror ("pwrite");
+      exit (1);
+    }
+}
+
+static size_t nerrors;
+
+static void
+errfun (void *data, char const *fmt, ...)
+{
+  nerrors++;
+}
+
+int
+main (int argc, char **argv)
+{
+  GDBM_FILE dbf;
+  int i, n;
+  int flags = 0;
+  int nthreads = 1;
+  datum content;
+  gdbm_recovery rcvr;
+  int bad_dir, bad_elem, elem_loc;
+  size_t lost;
+  off_t adr, elem_adr;
+
+  while ((i = getopt (argc, argv, "bcdit:v")) != EOF)
+    {
+      switch (i)
+	{
+	case 'b':
+	  flags |= GDBM_COMPACT;
+	  break;
+
+	case 'c':
+	  flags |= GDBM_COMPRESS;
+	  break;
+
+	case 'd':
+	  flags |= GDBM_DEDUP;
+	  break;
+
+	case 'i':
+	  flags |= GDBM_INLINE;
+	  break;
+
+	case 't':
+	  nthreads = atoi (optarg);
+	  break;
+
+	case 'v':
+	  verbose++;
+	  break;
+
+	default:
+	  return 2;
+	}
+    }
+
+  /*
+   * 1) Create and populate the database.
+   */
+  if (verbose)
+    printf ("creating database\n");
+  dbf = gdbm_open (dbname, BLOCK_SIZE, GDBM_NEWDB | flags, 0644, NULL);
+  if (!dbf)
+    {
+      fprintf (stderr, "gdbm_open: %s\n", gdbm_strerror (gdbm_errno));
+      return 1;
+    }
+  if (gdbm_setopt (dbf, GDBM_SETCHECKTHREADS, &nthreads, sizeof (nthreads)))
+    {
+      fprintf (stderr, "GDBM_SETCHECKTHREADS: %s\n", gdbm_db_strerror (dbf));
+      return 1;
+    }
+  rec_init (NKEYS);
+  /* Make the data compressible. */
+  rec_run = 64;
+  for (i = 0; i < NKEYS; i++)
+    rec_store (dbf, i, i % 5 == 0 ? i % 3 : i % 7 == 0 ? MAXSIZE : i % 300);
+  if (gdbm_sync (dbf))
+    {
+      fprintf (stderr, "gdbm_sync: %s\n", gdbm_db_strerror (dbf));
+      return 1;
+    }
+
+  /*
+   * 2) Damage a bucket and a record.
+   */
+  if (verbose)
+    printf ("damaging database\n");
+  i = 0;
+  bad_dir = bucket_of (dbf, i, &elem_loc);
+  lost = dbf->bucket->count;
+  n = dbf->header->bucket_elems + 1;
+  damage (dbf, dbf->dir[bad_dir] + offsetof (hash_bucket, count),
+	  &n, sizeof (n));
+
+  bad_elem = -1;
+  if (!(flags & GDBM_COMPACT))
+    {
+      /* Pick a record stored out of line in another bucket. */
+      for (i = 7; i < NKEYS; i += 7)
+	{
+	  int dir = bucket_of (dbf, i, &elem_loc);
+
+	  if (dbf->dir[dir] != dbf->dir[bad_dir])
+	    break;
+	}
+      bad_elem = i;
+      /* Point it past the end of the file. */
+      elem_adr = dbf->dir[bucket_of (dbf, i, &elem_loc)]
+	         + offsetof (hash_bucket, h_table)
+	         + elem_loc * sizeof (bucket_element)
+	         + offsetof (bucket_element, data_pointer);
+      adr = dbf->header->next_block + dbf->header->block_size;
+      damage (dbf, elem_adr, &adr, sizeof (adr));
+      lost++;
+    }
+
+  /*
+   * 3) Recover with a limit on failed buckets.
+   */
+  if (verbose)
+    printf ("recovering with limits\n");
+  rcvr.max_failed_buckets = 1;
+  if (gdbm_recover (dbf, &rcvr, GDBM_RCVR_FORCE|GDBM_RCVR_MAX_FAILED_BUCKETS)
+      == 0)
+    {
+      fprintf (stderr, "gdbm_recover succeeded despite the limit\n");
+      return 1;
+    }
+
+  /*
+   * 4) Recover.
+   */
+  if (verbose)
+    printf ("recovering\n");
+  rcvr.errfun = errfun;
+  if (gdbm_recover (dbf, &rcvr, GDBM_RCVR_FORCE|GDBM_RCVR_ERRFUN))
+    {
+      fprintf (stderr, "gdbm_recover: %s\n", gdbm_db_strerror (dbf));
+      return 1;
+    }
+  if (verbose)
+    printf ("recovered %zu keys in %zu buckets, failed %zu keys and %zu buckets\n",
+	    rcvr.recovered_keys, rcvr.recovered_buckets, rcvr.failed_keys,
+	    rcvr.failed_buckets);
+  if (rcvr.failed_buckets != 1
+      || rcvr.failed_keys != (bad_elem != -1)
+      || rcvr.recovered_keys != NKEYS - lost
+      || rcvr.duplicate_keys != 0
+      || nerrors != rcvr.failed_buckets + rcvr.failed_keys)
+    {
+      fprintf (stderr, "wrong recovery statistics\n");
+      return 1;
+    }
+
+  n = 0;
+  for (i = 0; i < NKEYS; i++)
+    {
+      content = gdbm_fetch (dbf, rec_key (i));
+      if (content.dptr == NULL)
+	{
+	  if (gdbm_errno != GDBM_ITEM_NOT_FOUND)
+	    {
+	      fprintf (stderr, "%d: gdbm_fetch: %s\n", i,
+		       gdbm_db_strerror (dbf));
+	      return 1;
+	    }
+	  if (i == bad_elem)
+	    bad_elem = -1;
+	  n++;
+	  continue;
+	}
+      rec_check (i, content);
+      free (content.dptr);
+    }
+  if (n != lost || bad_elem != -1)
+    {
+      fprintf (stderr, "%d records lost instead of %zu\n", n, lost);
+      return 1;
+    }
+
+  if (gdbm_close (dbf))
+    {
+      fprintf (stderr, "gdbm_close: %s\n", gdbm_strerror (gdbm_errno));
+      return 1;
+    }
+  return 0;
+}
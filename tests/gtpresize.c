@@ -0,0 +1,216 @@
+/*
+  NAME
+    gtpresize - test presizing of new databases.
+
+  SYNOPSIS
+    gtpresize [-bilnv]
+
+  DESCRIPTION
+    Operation:
+
+    1) Create new database with gdbm_open_ext, giving the expected
+       number of records and their average key and value sizes.  Check
+       that enough buckets are created.
+    2) Populate the database with that many records.  The directory
+       must not grow and, unless -n is given, the records must mostly
+       fit in the preallocated file space.
+    3) Check the records, their count and the consistency of the
+       database, then reopen it and check the records again.
+
+  OPTIONS
+     -b   Use compact buckets (GDBM_COMPACT).
+     -i   Keep tiny records inline (GDBM_INLINE).
+     -l   Use the large database format (GDBM_LARGE).
+     -n   Don't give the record sizes, so that no file space is
+	  preallocated.
+     -v   Verbosely print what's being done.
+
+  EXIT CODE
+     0    success
+     1    failure
+     2    usage error
+
+  LICENSE
+    This file is part of GDBM test suite.
+    Copyright (C) 2025 Free Software Foundation, Inc.
+
+    GDBM is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2, or (at your option)
+    any later version.
+
+    GDBM is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GDBM. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "autoconf.h"
+#include "gdbmdefs.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "records.h"
+
+char dbname[] = "a.db";
+int verbose = 0;
+
+#define NKEYS 20000
+#define MAXSIZE 300
+/* Average value size given to gdbm_open_ext, a bit above the actual
+   one. */
+#define AVGSIZE 160
+
+int
+main (int argc, char **argv)
+{
+  GDBM_FILE dbf;
+  int i;
+  int flags = 0;
+  int sizes = 1;
+  struct gdbm_open_spec spec = GDBM_OPEN_SPEC_INITIALIZER;
+  size_t nbuckets;
+  gdbm_count_t count;
+  gdbm_recovery rcvr;
+  int dir_bits;
+  off_t next_block;
+
+  while ((i = getopt (argc, argv, "bilnv")) != EOF)
+    {
+      switch (i)
+	{
+	case 'b':
+	  flags |= GDBM_COMPACT;
+	  break;
+
+	case 'i':
+	  flags |= GDBM_INLINE;
+	  break;
+
+	case 'l':
+	  flags |= GDBM_LARGE;
+	  break;
+
+	case 'n':
+	  sizes = 0;
+	  break;
+
+	case 'v':
+	  verbose++;
+	  break;
+
+	default:
+	  return 2;
+	}
+    }
+
+  /*
+   * 1) Create the database.
+   */
+  if (verbose)
+    printf ("creating database\n");
+  spec.mode = 0644;
+  spec.expected_entries = NKEYS;
+  if (sizes)
+    {
+      spec.avg_key_size = sizeof (int);
+      spec.avg_value_size = AVGSIZE;
+    }
+  dbf = gdbm_open_ext (dbname, GDBM_NEWDB | flags, &spec);
+  if (!dbf)
+    {
+      fprintf (stderr, "gdbm_open_ext: %s\n", gdbm_strerror (gdbm_errno));
+      return 1;
+    }
+  if (gdbm_bucket_count (dbf, &nbuckets))
+    {
+      fprintf (stderr, "gdbm_bucket_count: %s\n", gdbm_db_strerror (dbf));
+      return 1;
+    }
+  if (verbose)
+    printf ("%zu buckets of %d elements, dir_bits=%d\n", nbuckets,
+	    dbf->header->bucket_elems, dbf->header->dir_bits);
+  if (nbuckets * dbf->header->bucket_elems < NKEYS)
+    {
+      fprintf (stderr, "too few buckets: %zu\n", nbuckets);
+      return 1;
+    }
+  dir_bits = dbf->header->dir_bits;
+  next_block = dbf->header->next_block;
+
+  /*
+   * 2) Populate the database.
+   */
+  if (verbose)
+    printf ("populating database\n");
+  rec_init (NKEYS);
+  for (i = 0; i < NKEYS; i++)
+    rec_store (dbf, i, i % 5 == 0 ? i % 3 : i % MAXSIZE);
+  if (dbf->header->dir_bits != dir_bits)
+    {
+      fprintf (stderr, "directory grew from %d to %d bits\n", dir_bits,
+	       dbf->header->dir_bits);
+      return 1;
+    }
+  /* Buckets that get more records than others may need more space. */
+  if (sizes && dbf->header->next_block > next_block + next_block / 10)
+    {
+      fprintf (stderr, "file grew from %lu to %lu bytes\n",
+	       (unsigned long) next_block,
+	       (unsigned long) dbf->header->next_block);
+      return 1;
+    }
+
+  /*
+   * 3) Check the database.
+   */
+  if (verbose)
+    printf ("checking database\n");
+  rec_verify (dbf);
+  if (gdbm_count (dbf, &count))
+    {
+      fprintf (stderr, "gdbm_count: %s\n", gdbm_db_strerror (dbf));
+      return 1;
+    }
+  if (count != NKEYS)
+    {
+      fprintf (stderr, "gdbm_count returned %lu instead of %d\n",
+	       (unsigned long) count, NKEYS);
+      return 1;
+    }
+  if (gdbm_recover (dbf, &rcvr, 0))
+    {
+      fprintf (stderr, "gdbm_recover: %s\n", gdbm_db_strerror (dbf));
+      return 1;
+    }
+  if (rcvr.recovered_keys != 0)
+    {
+      fprintf (stderr, "consistent database rebuilt\n");
+      return 1;
+    }
+  if (gdbm_close (dbf))
+    {
+      fprintf (stderr, "gdbm_close: %s\n", gdbm_strerror (gdbm_errno));
+      return 1;
+    }
+
+  if (verbose)
+    printf ("reopening database\n");
+  dbf = gdbm_open (dbname, 0, GDBM_READER, 0, NULL);
+  if (!dbf)
+    {
+      fprintf (stderr, "gdbm_open: %s\n", gdbm_strerror (gdbm_errno));
+      return 1;
+    }
+  if (gdbm_needs_recovery (dbf))
+    {
+      fprintf (stderr, "reopened database needs recovery\n");
+      return 1;
+    }
+  rec_verify (dbf);
+  gdbm_close (dbf);
+  return 0;
+}
@@ -0,0 +1,282 @@
+/*
+  NAME
+    gtpurge - test batch delete and purge.
+
+  SYNOPSIS
+    gtpurge [-lv]
+
+  DESCRIPTION
+    Operation:
+
+    1) Create new database and populate it with NKEYS records.  The
+       content of each record is its key.
+    2) Delete all keys divisible by 3 using gdbm_delete_many.  The
+       array of keys includes keys that are not in the database.
+    3) Purge all records with even content using gdbm_purge.  The
+       predicate reads other records from the database.
+    4) Purge with a predicate that stops after STOPAFTER calls.
+       Verify that only the records seen before the stop are removed.
+    5) Verify the remaining records and the available space.
+
+  OPTIONS
+     -l   Use the large database format (GDBM_LARGE).
+     -v   Verbosely print what's being done.
+
+  EXIT CODE
+     0    success
+     1    failure
+     2    usage error
+
+  LICENSE
+    This file is part of GDBM test suite.
+    Copyright (C) 2025 Free Software Foundation, Inc.
+
+    GDBM is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2, or (at your option)
+    any later version.
+
+    GDBM is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GDBM. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "autoconf.h"
+#include "gdbmdefs.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+char dbname[] = "a.db";
+int verbose = 0;
+
+#define NKEYS 30000
+#define STOPAFTER 100
+
+static char state[NKEYS];
+enum { PRESENT, DELETED, PURGED };
+
+static int
+purge_even (datum key, datum content, void *data)
+{
+  GDBM_FILE dbf = data;
+  int k = *(int*)key.dptr;
+  int other = (int) ((long) k * 7919 % NKEYS);
+  datum okey, ocontent;
+
+  if (content.dsize != sizeof (int) || *(int*)content.dptr != k)
+    {
+      fprintf (stderr, "%d: wrong content\n", k);
+      exit (1);
+    }
+
+  /* Read another record, most probably from another bucket. */
+  okey.dptr = (char*) &other;
+  okey.dsize = sizeof (other);
+  ocontent = gdbm_fetch (dbf, okey);
+  if (ocontent.dptr)
+    {
+      if (ocontent.dsize != sizeof (int) || *(int*)ocontent.dptr != other)
+	{
+	  fprintf (stderr, "%d: wrong content\n", other);
+	  exit (1);
+	}
+      free (ocontent.dptr);
+    }
+  else if (gdbm_errno != GDBM_ITEM_NOT_FOUND)
+    {
+      fprintf (stderr, "%d: fetch failed: %s\n", other,
+	       gdbm_db_strerror (dbf));
+      exit (1);
+    }
+  if (*(int*)key.dptr != k || *(int*)content.dptr != k)
+    {
+      fprintf (stderr, "%d: record changed by fetch\n", k);
+      exit (1);
+    }
+
+  if (k % 2 == 0)
+    {
+      state[k] = PURGED;
+      return 1;
+    }
+  return 0;
+}
+
+static int
+purge_limited (datum key, datum content, void *data)
+{
+  int *ncalls = data;
+  int k = *(int*)key.dptr;
+
+  if (++*ncalls > STOPAFTER)
+    return -1;
+  state[k] = PURGED;
+  return 1;
+}
+
+int
+main (int argc, char **argv)
+{
+  GDBM_FILE dbf;
+  datum key, content;
+  static datum keys[NKEYS];
+  static int keyval[NKEYS];
+  int i, n;
+  size_t ndel;
+  gdbm_count_t count, expect;
+  int flags = 0;
+
+  while ((i = getopt (argc, argv, "lv")) != EOF)
+    {
+      switch (i)
+	{
+	case 'l':
+	  flags |= GDBM_LARGE;
+	  break;
+
+	case 'v':
+	  verbose++;
+	  break;
+
+	default:
+	  return 2;
+	}
+    }
+
+  /*
+   * 1) Create and populate the database.
+   */
+  if (verbose)
+    printf ("creating database\n");
+  dbf = gdbm_open (dbname, GDBM_MIN_BLOCK_SIZE, GDBM_NEWDB | flags, 0644,
+		   NULL);
+  if (!dbf)
+    {
+      fprintf (stderr, "gdbm_open: %s\n", gdbm_strerror (gdbm_errno));
+      return 1;
+    }
+  key.dptr = (char*) &i;
+  key.dsize = sizeof (i);
+  content = key;
+  for (i = 0; i < NKEYS; i++)
+    {
+      if (gdbm_store (dbf, key, content, 0) != 0)
+	{
+	  fprintf (stderr, "%d: item not inserted: %s\n",
+		   i, gdbm_db_strerror (dbf));
+	  return 1;
+	}
+    }
+
+  /*
+   * 2) Delete keys divisible by 3.  Every other of them is given
+   *    twice, the second time with a key outside the database.
+   */
+  if (verbose)
+    printf ("deleting keys\n");
+  n = 0;
+  for (i = 0; i < NKEYS; i += 3)
+    {
+      keyval[n] = i;
+      keys[n].dptr = (char*) &keyval[n];
+      keys[n].dsize = sizeof (keyval[n]);
+      n++;
+      state[i] = DELETED;
+      if (i % 2)
+	{
+	  keyval[n] = NKEYS + i;
+	  keys[n].dptr = (char*) &keyval[n];
+	  keys[n].dsize = sizeof (keyval[n]);
+	  n++;
+	}
+    }
+  if (gdbm_delete_many (dbf, keys, n, &ndel))
+    {
+      fprintf (stderr, "gdbm_delete_many: %s\n", gdbm_db_strerror (dbf));
+      return 1;
+    }
+  if (ndel != (NKEYS + 2) / 3)
+    {
+      fprintf (stderr, "gdbm_delete_many deleted %zu keys\n", ndel);
+      return 1;
+    }
+
+  /*
+   * 3) Purge records with even content.
+   */
+  if (verbose)
+    printf ("purging records\n");
+  if (gdbm_purge (dbf, purge_even, dbf, &count))
+    {
+      fprintf (stderr, "gdbm_purge: %s\n", gdbm_db_strerror (dbf));
+      return 1;
+    }
+  expect = 0;
+  for (i = 0; i < NKEYS; i++)
+    if (state[i] == PURGED)
+      expect++;
+  if (count != expect)
+    {
+      fprintf (stderr, "gdbm_purge removed %llu records, expected %llu\n",
+	       (unsigned long long) count, (unsigned long long) expect);
+      return 1;
+    }
+
+  /*
+   * 4) Stop the purge after STOPAFTER records.
+   */
+  if (verbose)
+    printf ("stopping purge\n");
+  n = 0;
+  if (gdbm_purge (dbf, purge_limited, &n, &count))
+    {
+      fprintf (stderr, "gdbm_purge: %s\n", gdbm_db_strerror (dbf));
+      return 1;
+    }
+  if (count != STOPAFTER)
+    {
+      fprintf (stderr, "gdbm_purge removed %llu records, expected %d\n",
+	       (unsigned long long) count, STOPAFTER);
+      return 1;
+    }
+
+  /*
+   * 5) Verify the database.
+   */
+  if (verbose)
+    printf ("verifying\n");
+  expect = 0;
+  for (i = 0; i < NKEYS; i++)
+    {
+      int rc = gdbm_exists (dbf, key);
+      if (rc != (state[i] == PRESENT))
+	{
+	  fprintf (stderr, "%d: %s\n", i,
+		   rc ? "not deleted" : "deleted by mistake");
+	  return 1;
+	}
+      if (rc)
+	expect++;
+    }
+  if (gdbm_count (dbf, &count) || count != expect)
+    {
+      fprintf (stderr, "wrong number of keys\n");
+      return 1;
+    }
+  if (gdbm_avail_verify (dbf))
+    {
+      fprintf (stderr, "gdbm_avail_verify: %s\n", gdbm_db_strerror (dbf));
+      return 1;
+    }
+  if (gdbm_close (dbf))
+    {
+      fprintf (stderr, "gdbm_close: %s\n", gdbm_strerror (gdbm_errno));
+      return 1;
+    }
+  return 0;
+}
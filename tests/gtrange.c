@@ -0,0 +1,308 @@
+/*
+  NAME
+    gtrange - test range reads and writes of stored values.
+
+  SYNOPSIS
+    gtrange [-v]
+
+  DESCRIPTION
+    Operation:
+
+    1) Create new database and store a large record in it.
+    2) Reopen the database and fetch several slices of the record
+       using gdbm_fetch_range.  Verify that the record is not read as
+       a whole.
+    3) Modify parts of the record with gdbm_store_range, including
+       writes past the end of its data.
+    4) Append data to the record and to a record that is followed by
+       another one, forcing relocation.
+    5) Create new records with gdbm_store_range and gdbm_append.
+    6) Verify the available space.
+
+    After each modification the record is compared with its expected
+    content.
+
+  OPTIONS
+     -v   Verbosely print what's being done.
+
+  EXIT CODE
+     0    success
+     1    failure
+     2    usage error
+
+  LICENSE
+    This file is part of GDBM test suite.
+    Copyright (C) 2025 Free Software Foundation, Inc.
+
+    GDBM is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2, or (at your option)
+    any later version.
+
+    GDBM is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GDBM. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "autoconf.h"
+#include "gdbmdefs.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+char dbname[] = "a.db";
+int verbose = 0;
+
+#define DATASIZE (256*1024)
+
+/* Expected content of a record. */
+struct model
+{
+  char *name;
+  char *buf;
+  size_t size;
+};
+
+static datum
+key_of (struct model *m)
+{
+  datum key;
+
+  key.dptr = m->name;
+  key.dsize = strlen (m->name);
+  return key;
+}
+
+static GDBM_FILE
+open_db (int flags)
+{
+  GDBM_FILE dbf = gdbm_open (dbname, GDBM_MIN_BLOCK_SIZE, flags, 0644, NULL);
+  if (!dbf)
+    {
+      fprintf (stderr, "gdbm_open: %s\n", gdbm_strerror (gdbm_errno));
+      exit (1);
+    }
+  return dbf;
+}
+
+static void
+check (GDBM_FILE dbf, struct model *m)
+{
+  datum content = gdbm_fetch (dbf, key_of (m));
+
+  if (content.dptr == NULL)
+    {
+      fprintf (stderr, "%s: fetch failed: %s\n", m->name,
+	       gdbm_db_strerror (dbf));
+      exit (1);
+    }
+  if (content.dsize != m->size || memcmp (content.dptr, m->buf, m->size))
+    {
+      fprintf (stderr, "%s: wrong content\n", m->name);
+      exit (1);
+    }
+  free (content.dptr);
+}
+
+static void
+check_range (GDBM_FILE dbf, struct model *m, size_t off, size_t len)
+{
+  datum content = gdbm_fetch_range (dbf, key_of (m), off, len);
+  size_t n;
+
+  if (verbose)
+    printf ("fetching %zu bytes at %zu\n", len, off);
+  if (content.dptr == NULL)
+    {
+      fprintf (stderr, "%s: fetch_range failed: %s\n", m->name,
+	       gdbm_db_strerror (dbf));
+      exit (1);
+    }
+  n = off < m->size ? m->size - off : 0;
+  if (n > len)
+    n = len;
+  if (content.dsize != n || memcmp (content.dptr, m->buf + off, n))
+    {
+      fprintf (stderr, "%s: wrong content of range %zu,%zu\n", m->name,
+	       off, len);
+      exit (1);
+    }
+  free (content.dptr);
+}
+
+/* Modify the model M as gdbm_store_range would do. */
+static void
+model_write (struct model *m, size_t off, char const *buf, size_t len)
+{
+  if (off + len > m->size)
+    {
+      m->buf = realloc (m->buf, off + len);
+      if (!m->buf)
+	abort ();
+      if (off > m->size)
+	memset (m->buf + m->size, 0, off - m->size);
+      m->size = off + len;
+    }
+  memcpy (m->buf + off, buf, len);
+}
+
+static void
+store_range (GDBM_FILE dbf, struct model *m, size_t off, size_t len, int c)
+{
+  char buf[4096];
+  datum content;
+
+  if (verbose)
+    printf ("storing %zu bytes at %zu\n", len, off);
+  memset (buf, c, len);
+  content.dptr = buf;
+  content.dsize = len;
+  if (gdbm_store_range (dbf, key_of (m), off, content))
+    {
+      fprintf (stderr, "%s: gdbm_store_range: %s\n", m->name,
+	       gdbm_db_strerror (dbf));
+      exit (1);
+    }
+  model_write (m, off, buf, len);
+  check (dbf, m);
+}
+
+static void
+append (GDBM_FILE dbf, struct model *m, size_t len, int c)
+{
+  char buf[4096];
+  datum content;
+
+  if (verbose)
+    printf ("appending %zu bytes to %s\n", len, m->name);
+  memset (buf, c, len);
+  content.dptr = buf;
+  content.dsize = len;
+  if (gdbm_append (dbf, key_of (m), content))
+    {
+      fprintf (stderr, "%s: gdbm_append: %s\n", m->name,
+	       gdbm_db_strerror (dbf));
+      exit (1);
+    }
+  model_write (m, m->size, buf, len);
+  check (dbf, m);
+}
+
+int
+main (int argc, char **argv)
+{
+  GDBM_FILE dbf;
+  struct model big = { "a rather long key", NULL, DATASIZE };
+  struct model a = { "a", NULL, 0 };
+  struct model b = { "b", NULL, 0 };
+  struct model c = { "c", NULL, 0 };
+  struct model d = { "another long key", NULL, 0 };
+  datum content;
+  size_t i;
+
+  while ((i = getopt (argc, argv, "v")) != EOF)
+    {
+      switch (i)
+	{
+	case 'v':
+	  verbose++;
+	  break;
+
+	default:
+	  return 2;
+	}
+    }
+
+  /*
+   * 1) Create the database.
+   */
+  if (verbose)
+    printf ("creating database\n");
+  dbf = open_db (GDBM_NEWDB);
+  big.buf = malloc (big.size);
+  if (!big.buf)
+    abort ();
+  for (i = 0; i < big.size; i++)
+    big.buf[i] = i * 7;
+  content.dptr = big.buf;
+  content.dsize = big.size;
+  if (gdbm_store (dbf, key_of (&big), content, GDBM_INSERT))
+    {
+      fprintf (stderr, "gdbm_store: %s\n", gdbm_db_strerror (dbf));
+      return 1;
+    }
+  gdbm_close (dbf);
+
+  /*
+   * 2) Fetch slices.
+   */
+  dbf = open_db (GDBM_WRITER);
+  check_range (dbf, &big, 0, 16);
+  check_range (dbf, &big, 1000, 500);
+  check_range (dbf, &big, big.size - 10, 100);
+  check_range (dbf, &big, big.size + 5, 10);
+  if (dbf->cache_mru->ca_data.elem_loc != -1)
+    {
+      fprintf (stderr, "gdbm_fetch_range read the whole record\n");
+      return 1;
+    }
+  content = gdbm_fetch_range (dbf, key_of (&a), 0, 1);
+  if (content.dptr != NULL || gdbm_errno != GDBM_ITEM_NOT_FOUND)
+    {
+      fprintf (stderr, "gdbm_fetch_range found missing key\n");
+      return 1;
+    }
+
+  /*
+   * 3) Modify the record.
+   */
+  store_range (dbf, &big, 100, 50, 'x');
+  store_range (dbf, &big, big.size - 10, 100, 'y');
+  store_range (dbf, &big, big.size + 1000, 10, 'z');
+  check_range (dbf, &big, 90, 100);
+
+  /*
+   * 4) Append to records.
+   */
+  append (dbf, &big, 3000, 'w');
+  append (dbf, &a, 10, 'a');
+  append (dbf, &b, 10, 'b');
+  for (i = 0; i < 64; i++)
+    {
+      append (dbf, &a, 100, 'A' + i % 26);
+      append (dbf, &b, 10, 'B');
+    }
+  check (dbf, &big);
+
+  /*
+   * 5) Create records.
+   */
+  store_range (dbf, &c, 10, 5, 'c');
+  append (dbf, &d, 5, 'd');
+  check (dbf, &a);
+  check (dbf, &b);
+
+  /*
+   * 6) Verify the available space.
+   */
+  if (gdbm_avail_verify (dbf))
+    {
+      fprintf (stderr, "gdbm_avail_verify: %s\n", gdbm_db_strerror (dbf));
+      return 1;
+    }
+  if (gdbm_close (dbf))
+    {
+      fprintf (stderr, "gdbm_close: %s\n", gdbm_strerror (gdbm_errno));
+      return 1;
+    }
+  free (big.buf);
+  free (a.buf);
+  free (b.buf);
+  free (c.buf);
+  free (d.buf);
+  return 0;
+}
@@ -0,0 +1,240 @@
+/*
+  NAME
+    gtrobinhood - test Robin Hood placement of bucket elements.
+
+  SYNOPSIS
+    gtrobinhood [-cv]
+
+  DESCRIPTION
+    Operation:
+
+    1) Create new database with GDBM_ROBINHOOD and populate it.  Look
+       up existing and missing keys.
+    2) Replace some records and delete others.
+    3) Reopen the database and check its format and contents.
+    4) Convert the database to standard placement and back.
+    5) Reorganize the database.
+
+    After each step the contents of the database is verified, the
+    Robin Hood invariant is checked in every bucket and the available
+    space is checked.
+
+  OPTIONS
+     -c   Use compact buckets (GDBM_COMPACT).
+     -v   Verbosely print what's being done.
+
+  EXIT CODE
+     0    success
+     1    failure
+     2    usage error
+
+  LICENSE
+    This file is part of GDBM test suite.
+    Copyright (C) 2025 Free Software Foundation, Inc.
+
+    GDBM is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2, or (at your option)
+    any later version.
+
+    GDBM is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GDBM. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "autoconf.h"
+#include "gdbmdefs.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "records.h"
+
+char dbname[] = "a.db";
+int verbose = 0;
+
+#define NKEYS 5000
+#define MAXSIZE 64
+
+/* Check that in each bucket of DBF an element is never farther from
+   its home slot than the preceding one by more than one slot. */
+static void
+check_placement (GDBM_FILE dbf)
+{
+  int i, elem_loc;
+  int bucket_elems = dbf->header->bucket_elems;
+
+  for (i = 0; i < GDBM_DIR_COUNT (dbf); i = _gdbm_next_bucket_dir (dbf, i))
+    {
+      if (_gdbm_get_bucket (dbf, i))
+	{
+	  fprintf (stderr, "_gdbm_get_bucket: %s\n", gdbm_db_strerror (dbf));
+	  exit (1);
+	}
+      for (elem_loc = 0; elem_loc < bucket_elems; elem_loc++)
+	{
+	  int prev = (elem_loc + bucket_elems - 1) % bucket_elems;
+	  int dist;
+
+	  if (dbf->bucket->h_table[elem_loc].hash_value == -1)
+	    continue;
+	  dist = bucket_element_distance (dbf, dbf->bucket, elem_loc);
+	  if (dbf->bucket->h_table[prev].hash_value == -1
+	      ? dist != 0
+	      : dist > bucket_element_distance (dbf, dbf->bucket, prev) + 1)
+	    {
+	      fprintf (stderr, "bucket %d: element %d misplaced\n", i,
+		       elem_loc);
+	      exit (1);
+	    }
+	}
+    }
+}
+
+static void
+verify (GDBM_FILE dbf)
+{
+  rec_verify (dbf);
+  check_placement (dbf);
+
+  if (gdbm_avail_verify (dbf))
+    {
+      fprintf (stderr, "gdbm_avail_verify: %s\n", gdbm_db_strerror (dbf));
+      exit (1);
+    }
+}
+
+int
+main (int argc, char **argv)
+{
+  GDBM_FILE dbf;
+  int i, n;
+  int flags = GDBM_ROBINHOOD;
+
+  while ((i = getopt (argc, argv, "cv")) != EOF)
+    {
+      switch (i)
+	{
+	case 'c':
+	  flags |= GDBM_COMPACT;
+	  break;
+
+	case 'v':
+	  verbose++;
+	  break;
+
+	default:
+	  return 2;
+	}
+    }
+
+  /*
+   * 1) Create and populate the database.
+   */
+  if (verbose)
+    printf ("creating database\n");
+  dbf = gdbm_open (dbname, GDBM_MIN_BLOCK_SIZE, GDBM_NEWDB | flags,
+		   0644, NULL);
+  if (!dbf)
+    {
+      fprintf (stderr, "gdbm_open: %s\n", gdbm_strerror (gdbm_errno));
+      return 1;
+    }
+  /* Records past NKEYS are never stored. */
+  rec_init (2 * NKEYS);
+  for (i = 0; i < NKEYS; i++)
+    rec_store (dbf, i, 1 + i % MAXSIZE);
+  verify (dbf);
+
+  /*
+   * 2) Modify the database.
+   */
+  if (verbose)
+    printf ("modifying database\n");
+  for (i = 0; i < NKEYS; i += 3)
+    rec_store (dbf, i, MAXSIZE - i % 5);
+  for (i = 0; i < NKEYS; i += 4)
+    rec_delete (dbf, i);
+  verify (dbf);
+  /* Reinsert some of the deleted records. */
+  for (i = 0; i < NKEYS; i += 8)
+    rec_store (dbf, i, 1 + i % 7);
+  verify (dbf);
+  gdbm_close (dbf);
+
+  /*
+   * 3) Reopen the database.
+   */
+  if (verbose)
+    printf ("reopening database\n");
+  dbf = gdbm_open (dbname, 0, GDBM_WRITER, 0, NULL);
+  if (!dbf)
+    {
+      fprintf (stderr, "gdbm_open: %s\n", gdbm_strerror (gdbm_errno));
+      return 1;
+    }
+  if (gdbm_setopt (dbf, GDBM_GETDBFORMAT, &n, sizeof (n))
+      || n != (GDBM_NUMSYNC | flags))
+    {
+      fprintf (stderr, "wrong database format\n");
+      return 1;
+    }
+  verify (dbf);
+
+  /*
+   * 4) Convert the database.
+   */
+  if (verbose)
+    printf ("converting to standard placement\n");
+  if (gdbm_convert (dbf, GDBM_NUMSYNC | (flags & ~GDBM_ROBINHOOD)))
+    {
+      fprintf (stderr, "gdbm_convert: %s\n", gdbm_db_strerror (dbf));
+      return 1;
+    }
+  if (gdbm_robin_hood_p (dbf))
+    {
+      fprintf (stderr, "database not converted\n");
+      return 1;
+    }
+  /* Shuffle the placement using ordinary linear probing. */
+  for (i = 1; i < NKEYS; i += 6)
+    rec_delete (dbf, i);
+  for (i = NKEYS - 1; i >= 0; i -= 6)
+    rec_store (dbf, i, 1 + i % 11);
+
+  if (verbose)
+    printf ("converting to Robin Hood placement\n");
+  if (gdbm_convert (dbf, GDBM_NUMSYNC | flags))
+    {
+      fprintf (stderr, "gdbm_convert: %s\n", gdbm_db_strerror (dbf));
+      return 1;
+    }
+  verify (dbf);
+
+  /*
+   * 5) Reorganize the database.
+   */
+  if (verbose)
+    printf ("reorganizing database\n");
+  if (gdbm_reorganize (dbf))
+    {
+      fprintf (stderr, "gdbm_reorganize: %s\n", gdbm_db_strerror (dbf));
+      return 1;
+    }
+  if (!gdbm_robin_hood_p (dbf))
+    {
+      fprintf (stderr, "reorganized database lost Robin Hood placement\n");
+      return 1;
+    }
+  verify (dbf);
+
+  if (gdbm_close (dbf))
+    {
+      fprintf (stderr, "gdbm_close: %s\n", gdbm_strerror (gdbm_errno));
+      return 1;
+    }
+  return 0;
+}
@@ -0,0 +1,231 @@
+/*
+  NAME
+    gtscan - test gdbm_scan_physical.
+
+  SYNOPSIS
+    gtscan [-cdiv]
+
+  DESCRIPTION
+    Operation:
+
+    1) Create new database and populate it with records of various
+       sizes, one of which is larger than a single scan read.  Replace
+       and delete some of the records, so that their order in the file
+       differs from the order of insertion.
+    2) Scan the database.  Check that each record is visited once, with
+       the right content, and that records are visited in the order of
+       their file addresses.  The scan function also fetches each record,
+       to check that reading the database while scanning works.
+    3) Scan the database again, stopping after a number of records.
+
+  OPTIONS
+     -c   Compress record data (GDBM_COMPRESS).
+     -d   Share identical record data (GDBM_DEDUP).
+     -i   Keep tiny records inline (GDBM_INLINE).
+     -v   Verbosely print what's being done.
+
+  EXIT CODE
+     0    success
+     1    failure
+     2    usage error
+
+  LICENSE
+    This file is part of GDBM test suite.
+    Copyright (C) 2025 Free Software Foundation, Inc.
+
+    GDBM is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2, or (at your option)
+    any later version.
+
+    GDBM is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GDBM. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "autoconf.h"
+#include "gdbmdefs.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "records.h"
+
+char dbname[] = "a.db";
+int verbose = 0;
+
+#define NKEYS 3000
+/* Index and size of the record that takes more than one read. */
+#define BIGKEY 1000
+#define BIGSIZE (SCAN_READ_SIZE + 12345)
+#define MAXSIZE 600
+#define STOP_AFTER 100
+
+/* Number of times each record was visited. */
+int visited[NKEYS];
+
+struct scan_state
+{
+  GDBM_FILE dbf;
+  off_t last_adr;     /* Address of the last record visited */
+  int count;          /* Number of records visited */
+  int stop;           /* Stop after that many records, unless 0 */
+};
+
+static int
+scan_func (datum key, datum content, void *data)
+{
+  struct scan_state *st = data;
+  GDBM_FILE dbf = st->dbf;
+  bucket_element *elem;
+  datum fetched;
+  int i, elem_loc;
+
+  if (key.dsize != sizeof (i))
+    {
+      fprintf (stderr, "bad key size %d\n", key.dsize);
+      exit (1);
+    }
+  memcpy (&i, key.dptr, sizeof (i));
+  if (i < 0 || i >= NKEYS || rec_size[i] == -1)
+    {
+      fprintf (stderr, "%d: unexpected key\n", i);
+      exit (1);
+    }
+  visited[i]++;
+  rec_check (i, content);
+
+  /* Check the order of the records. */
+  elem_loc = _gdbm_findkey_loc (dbf, key, NULL);
+  if (elem_loc < 0)
+    {
+      fprintf (stderr, "%d: key not found: %s\n", i, gdbm_db_strerror (dbf));
+      exit (1);
+    }
+  elem = &dbf->bucket->h_table[elem_loc];
+  if (!bucket_element_inline_p (dbf, elem))
+    {
+      if (elem->data_pointer < st->last_adr)
+	{
+	  fprintf (stderr, "%d: record out of order\n", i);
+	  exit (1);
+	}
+      st->last_adr = elem->data_pointer;
+    }
+
+  /* Read the database while scanning. */
+  fetched = gdbm_fetch (dbf, key);
+  rec_check (i, fetched);
+  free (fetched.dptr);
+
+  return ++st->count == st->stop;
+}
+
+int
+main (int argc, char **argv)
+{
+  GDBM_FILE dbf;
+  int i;
+  int flags = 0;
+  struct scan_state st;
+
+  while ((i = getopt (argc, argv, "cdiv")) != EOF)
+    {
+      switch (i)
+	{
+	case 'c':
+	  flags |= GDBM_COMPRESS;
+	  break;
+
+	case 'd':
+	  flags |= GDBM_DEDUP;
+	  break;
+
+	case 'i':
+	  flags |= GDBM_INLINE;
+	  break;
+
+	case 'v':
+	  verbose++;
+	  break;
+
+	default:
+	  return 2;
+	}
+    }
+
+  /*
+   * 1) Create and populate the database.
+   */
+  if (verbose)
+    printf ("creating database\n");
+  dbf = gdbm_open (dbname, 0, GDBM_NEWDB | flags, 0644, NULL);
+  if (!dbf)
+    {
+      fprintf (stderr, "gdbm_open: %s\n", gdbm_strerror (gdbm_errno));
+      return 1;
+    }
+  rec_init (NKEYS);
+  /* Make the data compressible. */
+  rec_run = 128;
+  for (i = 0; i < NKEYS; i++)
+    rec_store (dbf, i, i == BIGKEY ? BIGSIZE : i % 4 == 0 ? i % 10 : i % MAXSIZE);
+  for (i = 0; i < NKEYS; i += 3)
+    {
+      if (i == BIGKEY)
+	continue;
+      if (i % 2)
+	rec_store (dbf, i, MAXSIZE - i % 7);
+      else
+	rec_delete (dbf, i);
+    }
+
+  /*
+   * 2) Scan the database.
+   */
+  if (verbose)
+    printf ("scanning database\n");
+  memset (&st, 0, sizeof (st));
+  st.dbf = dbf;
+  if (gdbm_scan_physical (dbf, scan_func, &st))
+    {
+      fprintf (stderr, "gdbm_scan_physical: %s\n", gdbm_db_strerror (dbf));
+      return 1;
+    }
+  for (i = 0; i < NKEYS; i++)
+    if (visited[i] != (rec_size[i] != -1))
+      {
+	fprintf (stderr, "%d: visited %d times\n", i, visited[i]);
+	return 1;
+      }
+
+  /*
+   * 3) Stop the scan early.
+   */
+  if (verbose)
+    printf ("stopping scan\n");
+  memset (&st, 0, sizeof (st));
+  st.dbf = dbf;
+  st.stop = STOP_AFTER;
+  if (gdbm_scan_physical (dbf, scan_func, &st))
+    {
+      fprintf (stderr, "gdbm_scan_physical: %s\n", gdbm_db_strerror (dbf));
+      return 1;
+    }
+  if (st.count != STOP_AFTER)
+    {
+      fprintf (stderr, "scan visited %d records instead of %d\n", st.count,
+	       STOP_AFTER);
+      return 1;
+    }
+
+  if (gdbm_close (dbf))
+    {
+      fprintf (stderr, "gdbm_close: %s\n", gdbm_strerror (gdbm_errno));
+      return 1;
+    }
+  return 0;
+}
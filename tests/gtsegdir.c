@@ -0,0 +1,267 @@
+/*
+  NAME
+    gtsegdir - test databases with a segmented directory.
+
+  SYNOPSIS
+    gtsegdir [-bilpv]
+
+  DESCRIPTION
+    Operation:
+
+    1) Create new database with GDBM_SEGDIR and a small block size, and
+       populate it with enough records for the directory to be split in
+       several segments.  The segment table must be replaced only a few
+       times.
+    2) Check the records, their count and the consistency of the
+       database.  Then reopen it and check that the directory read back
+       is the same and that the records are intact.
+    3) Convert the database to the flat directory and back, checking
+       the records after each conversion.
+
+  OPTIONS
+     -b   Use compact buckets (GDBM_COMPACT).
+     -i   Keep tiny records inline (GDBM_INLINE).
+     -l   Use the large database format (GDBM_LARGE).
+     -p   Presize the database for the records (see gdbm_open_spec).
+     -v   Verbosely print what's being done.
+
+  EXIT CODE
+     0    success
+     1    failure
+     2    usage error
+
+  LICENSE
+    This file is part of GDBM test suite.
+    Copyright (C) 2025 Free Software Foundation, Inc.
+
+    GDBM is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2, or (at your option)
+    any later version.
+
+    GDBM is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GDBM. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "autoconf.h"
+#include "gdbmdefs.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "records.h"
+
+char dbname[] = "a.db";
+int verbose = 0;
+
+#define NKEYS 60000
+#define MAXSIZE 40
+#define BLOCK_SIZE 512
+
+static void
+check_format (GDBM_FILE dbf, int expected)
+{
+  int format;
+
+  if (gdbm_setopt (dbf, GDBM_GETDBFORMAT, &format, sizeof (format)))
+    {
+      fprintf (stderr, "GDBM_GETDBFORMAT: %s\n", gdbm_db_strerror (dbf));
+      exit (1);
+    }
+  if (format != expected)
+    {
+      fprintf (stderr, "format %#x instead of %#x\n", format, expected);
+      exit (1);
+    }
+}
+
+static void
+convert (GDBM_FILE dbf, int format)
+{
+  if (verbose)
+    printf ("converting to format %#x\n", format);
+  if (gdbm_convert (dbf, format))
+    {
+      fprintf (stderr, "gdbm_convert: %s\n", gdbm_db_strerror (dbf));
+      exit (1);
+    }
+  check_format (dbf, format);
+  rec_verify (dbf);
+}
+
+int
+main (int argc, char **argv)
+{
+  GDBM_FILE dbf;
+  int i;
+  int flags = GDBM_SEGDIR;
+  int format;
+  struct gdbm_open_spec spec = GDBM_OPEN_SPEC_INITIALIZER;
+  gdbm_count_t count;
+  gdbm_recovery rcvr;
+  off_t top_adr;
+  int top_moves = 0;
+  int dir_count;
+  off_t *dir;
+
+  while ((i = getopt (argc, argv, "bilpv")) != EOF)
+    {
+      switch (i)
+	{
+	case 'b':
+	  flags |= GDBM_COMPACT;
+	  break;
+
+	case 'i':
+	  flags |= GDBM_INLINE;
+	  break;
+
+	case 'l':
+	  flags |= GDBM_LARGE;
+	  break;
+
+	case 'p':
+	  spec.expected_entries = NKEYS;
+	  break;
+
+	case 'v':
+	  verbose++;
+	  break;
+
+	default:
+	  return 2;
+	}
+    }
+  format = flags | GDBM_NUMSYNC;
+
+  /*
+   * 1) Create and populate the database.
+   */
+  if (verbose)
+    printf ("creating database\n");
+  spec.mode = 0644;
+  spec.block_size = BLOCK_SIZE;
+  dbf = gdbm_open_ext (dbname, GDBM_NEWDB | flags, &spec);
+  if (!dbf)
+    {
+      fprintf (stderr, "gdbm_open_ext: %s\n", gdbm_strerror (gdbm_errno));
+      return 1;
+    }
+  check_format (dbf, format);
+  top_adr = dbf->header->dir;
+  rec_init (NKEYS);
+  for (i = 0; i < NKEYS; i++)
+    {
+      rec_store (dbf, i, i % 5 == 0 ? i % 3 : i % MAXSIZE);
+      if (dbf->header->dir != top_adr)
+	{
+	  top_adr = dbf->header->dir;
+	  top_moves++;
+	}
+    }
+  if (verbose)
+    printf ("dir_bits=%d, %zu segments, %d table entries, "
+	    "table moved %d times\n",
+	    dbf->header->dir_bits, dbf->dir_seg_count, 1 << dbf->dir_top_bits,
+	    top_moves);
+  if (dbf->header->dir_bits <= GDBM_DIR_SEGMENT_BITS
+      || dbf->dir_seg_count < 2)
+    {
+      fprintf (stderr, "directory not split in segments\n");
+      return 1;
+    }
+  if (top_moves > dbf->dir_top_bits)
+    {
+      fprintf (stderr, "segment table replaced %d times\n", top_moves);
+      return 1;
+    }
+
+  /*
+   * 2) Check the database.
+   */
+  if (verbose)
+    printf ("checking database\n");
+  rec_verify (dbf);
+  if (gdbm_count (dbf, &count))
+    {
+      fprintf (stderr, "gdbm_count: %s\n", gdbm_db_strerror (dbf));
+      return 1;
+    }
+  if (count != NKEYS)
+    {
+      fprintf (stderr, "gdbm_count returned %lu instead of %d\n",
+	       (unsigned long) count, NKEYS);
+      return 1;
+    }
+  if (gdbm_recover (dbf, &rcvr, 0))
+    {
+      fprintf (stderr, "gdbm_recover: %s\n", gdbm_db_strerror (dbf));
+      return 1;
+    }
+  if (rcvr.recovered_keys != 0)
+    {
+      fprintf (stderr, "consistent database rebuilt\n");
+      return 1;
+    }
+
+  dir_count = GDBM_DIR_COUNT (dbf);
+  dir = calloc (dir_count, sizeof (dir[0]));
+  if (!dir)
+    {
+      perror ("calloc");
+      return 1;
+    }
+  for (i = 0; i < dir_count; i++)
+    dir[i] = gdbm_dir_entry (dbf, i);
+  if (gdbm_close (dbf))
+    {
+      fprintf (stderr, "gdbm_close: %s\n", gdbm_strerror (gdbm_errno));
+      return 1;
+    }
+
+  if (verbose)
+    printf ("reopening database\n");
+  dbf = gdbm_open (dbname, 0, GDBM_WRITER, 0, NULL);
+  if (!dbf)
+    {
+      fprintf (stderr, "gdbm_open: %s\n", gdbm_strerror (gdbm_errno));
+      return 1;
+    }
+  if (gdbm_needs_recovery (dbf))
+    {
+      fprintf (stderr, "reopened database needs recovery\n");
+      return 1;
+    }
+  check_format (dbf, format);
+  if (GDBM_DIR_COUNT (dbf) != dir_count)
+    {
+      fprintf (stderr, "directory has %d entries instead of %d\n",
+	       (int) GDBM_DIR_COUNT (dbf), dir_count);
+      return 1;
+    }
+  for (i = 0; i < dir_count; i++)
+    if (gdbm_dir_entry (dbf, i) != dir[i])
+      {
+	fprintf (stderr, "%d: wrong directory entry\n", i);
+	return 1;
+      }
+  free (dir);
+  rec_verify (dbf);
+
+  /*
+   * 3) Convert the database.
+   */
+  convert (dbf, format & ~GDBM_SEGDIR);
+  convert (dbf, format);
+
+  if (gdbm_close (dbf))
+    {
+      fprintf (stderr, "gdbm_close: %s\n", gdbm_strerror (gdbm_errno));
+      return 1;
+    }
+  return 0;
+}
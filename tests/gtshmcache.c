@@ -0,0 +1,278 @@
+/*
+  NAME
+    gtshmcache - test bucket cache shared among processes.
+
+  SYNOPSIS
+    gtshmcache [-v]
+
+  DESCRIPTION
+    Operation:
+
+    1) Create new database in extended format and populate it.
+    2) Open the database for reading with shared cache enabled and
+       fetch all keys.
+    3) Open the database again and fetch all keys.  Verify that
+       buckets were obtained from the shared cache.  Close it and
+       check that the segment is kept for the first reader.
+    4) Modify a record and synchronize the database.
+    5) Open the database for reading and verify that the modified
+       record is returned.  Close both readers and check that the
+       segment has been removed.
+    6) Create a segment with permissions wider than those of the
+       database file and check that readers refuse to use it.
+
+  OPTIONS
+     -v   Verbosely print what's being done.
+
+  EXIT CODE
+     0    success
+     1    failure
+     2    usage error
+    77    shared cache is not supported
+
+  LICENSE
+    This file is part of GDBM test suite.
+    Copyright (C) 2025 Free Software Foundation, Inc.
+
+    GDBM is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2, or (at your option)
+    any later version.
+
+    GDBM is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GDBM. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "autoconf.h"
+#include "gdbmdefs.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <errno.h>
+#if HAVE_SHM_OPEN
+# include <sys/mman.h>
+#endif
+
+char dbname[] = "a.db";
+int verbose = 0;
+
+#define NKEYS 4096
+#define SHM_CACHE_SIZE (1024*1024)
+
+static GDBM_FILE
+open_db (int flags)
+{
+  struct gdbm_open_spec spec = GDBM_OPEN_SPEC_INITIALIZER;
+  GDBM_FILE dbf;
+
+  spec.block_size = GDBM_MIN_BLOCK_SIZE;
+  spec.mode = 0644;
+  spec.shm_cache_size = SHM_CACHE_SIZE;
+  dbf = gdbm_open_ext (dbname, flags, &spec);
+  if (!dbf)
+    {
+      fprintf (stderr, "gdbm_open_ext: %s\n", gdbm_strerror (gdbm_errno));
+      exit (1);
+    }
+  return dbf;
+}
+
+static void
+fetch_all (GDBM_FILE dbf, int modified)
+{
+  datum key, content;
+  int i;
+
+  key.dsize = sizeof (i);
+  key.dptr = (char*) &i;
+  for (i = 0; i < NKEYS; i++)
+    {
+      content = gdbm_fetch (dbf, key);
+      if (content.dptr == NULL)
+	{
+	  fprintf (stderr, "%d: fetch failed: %s\n", i,
+		   gdbm_db_strerror (dbf));
+	  exit (1);
+	}
+      if (content.dsize != sizeof (int)
+	  || *(int*)content.dptr != (i == modified ? -i : i))
+	{
+	  fprintf (stderr, "%d: wrong content\n", i);
+	  exit (1);
+	}
+      free (content.dptr);
+    }
+}
+
+static int
+shm_exists (char const *name)
+{
+  int fd = shm_open (name, O_RDONLY, 0);
+  if (fd == -1)
+    {
+      if (errno != ENOENT)
+	{
+	  perror ("shm_open");
+	  exit (1);
+	}
+      return 0;
+    }
+  close (fd);
+  return 1;
+}
+
+static void
+store (GDBM_FILE dbf, int i, int val)
+{
+  datum key, content;
+
+  key.dsize = sizeof (i);
+  key.dptr = (char*) &i;
+  content.dsize = sizeof (val);
+  content.dptr = (char*) &val;
+  if (gdbm_store (dbf, key, content, GDBM_REPLACE) != 0)
+    {
+      fprintf (stderr, "%d: item not inserted: %s\n",
+	       i, gdbm_db_strerror (dbf));
+      exit (1);
+    }
+}
+
+int
+main (int argc, char **argv)
+{
+#if HAVE_SHM_OPEN && HAVE_MMAP
+  GDBM_FILE dbf, dbf2;
+  int i;
+  struct stat st;
+  char shmname[64];
+
+  while ((i = getopt (argc, argv, "v")) != EOF)
+    {
+      switch (i)
+	{
+	case 'v':
+	  verbose++;
+	  break;
+
+	default:
+	  return 2;
+	}
+    }
+
+  /*
+   * 1) Create and populate the database.
+   */
+  if (verbose)
+    printf ("creating database\n");
+  dbf = open_db (GDBM_NEWDB | GDBM_NUMSYNC);
+  for (i = 0; i < NKEYS; i++)
+    store (dbf, i, i);
+  if (fstat (gdbm_fdesc (dbf), &st))
+    {
+      perror ("fstat");
+      return 1;
+    }
+  gdbm_close (dbf);
+
+  /* Remove leftovers from previous runs. */
+  snprintf (shmname, sizeof shmname, "/gdbm-%llx-%llx",
+	    (unsigned long long) st.st_dev, (unsigned long long) st.st_ino);
+  shm_unlink (shmname);
+
+  /*
+   * 2) Populate the shared cache.
+   */
+  if (verbose)
+    printf ("first reader\n");
+  dbf = open_db (GDBM_READER | GDBM_NOLOCK);
+  if (!dbf->shm_cache)
+    {
+      fprintf (stderr, "shared cache not available\n");
+      shm_unlink (shmname);
+      return 77;
+    }
+  fetch_all (dbf, -1);
+
+  /*
+   * 3) Second reader must obtain buckets from the shared cache.
+   */
+  if (verbose)
+    printf ("second reader\n");
+  dbf2 = open_db (GDBM_READER);
+  fetch_all (dbf2, -1);
+  if (verbose)
+    printf ("shared cache hits: %zu\n", dbf2->shm_hits);
+  if (dbf2->shm_hits == 0)
+    {
+      fprintf (stderr, "no hits in shared cache\n");
+      return 1;
+    }
+  gdbm_close (dbf2);
+  if (!shm_exists (shmname))
+    {
+      fprintf (stderr, "shared cache removed while in use\n");
+      return 1;
+    }
+
+  /*
+   * 4) Modify the database.
+   */
+  if (verbose)
+    printf ("modifying database\n");
+  dbf2 = open_db (GDBM_WRITER);
+  store (dbf2, 1, -1);
+  gdbm_sync (dbf2);
+  gdbm_close (dbf2);
+
+  /*
+   * 5) Stale bucket images must not be used.
+   */
+  if (verbose)
+    printf ("third reader\n");
+  dbf2 = open_db (GDBM_READER | GDBM_NOLOCK);
+  fetch_all (dbf2, 1);
+  gdbm_close (dbf2);
+  gdbm_close (dbf);
+  if (shm_exists (shmname))
+    {
+      fprintf (stderr, "shared cache not removed\n");
+      shm_unlink (shmname);
+      return 1;
+    }
+
+  /*
+   * 6) A segment with wider permissions must be refused.
+   */
+  if (verbose)
+    printf ("untrusted segment\n");
+  i = shm_open (shmname, O_RDWR | O_CREAT | O_EXCL, 0666);
+  if (i == -1)
+    {
+      perror ("shm_open");
+      return 1;
+    }
+  if (fchmod (i, 0666) || ftruncate (i, SHM_CACHE_SIZE))
+    {
+      perror ("shared cache setup");
+      shm_unlink (shmname);
+      return 1;
+    }
+  close (i);
+  dbf = open_db (GDBM_READER);
+  shm_unlink (shmname);
+  if (dbf->shm_cache)
+    {
+      fprintf (stderr, "untrusted shared cache used\n");
+      return 1;
+    }
+  gdbm_close (dbf);
+  return 0;
+#else
+  return 77;
+#endif
+}
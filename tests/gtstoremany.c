@@ -0,0 +1,250 @@
+/*
+  NAME
+    gtstoremany - test batched stores.
+
+  SYNOPSIS
+    gtstoremany [-lv]
+
+  DESCRIPTION
+    Operation:
+
+    1) Create new database.
+    2) Store NKEYS records in batches of BATCH items, using
+       gdbm_store_many with GDBM_REPLACE.  Each batch contains a
+       duplicate of one of its keys with a different value, which
+       must win over the previous one.
+    3) Verify the records and the number of keys.
+    4) Store a batch with GDBM_INSERT, half of its keys already in the
+       database.  Verify that 1 is returned and that the result
+       members are set properly.
+    5) Verify the database structure and the available space.
+
+  OPTIONS
+     -l   Use the large database format (GDBM_LARGE).
+     -v   Verbosely print what's being done.
+
+  EXIT CODE
+     0    success
+     1    failure
+     2    usage error
+
+  LICENSE
+    This file is part of GDBM test suite.
+    Copyright (C) 2025 Free Software Foundation, Inc.
+
+    GDBM is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2, or (at your option)
+    any later version.
+
+    GDBM is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GDBM. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "autoconf.h"
+#include "gdbmdefs.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+char dbname[] = "a.db";
+int verbose = 0;
+
+#define NKEYS 20000
+#define BATCH 1000
+
+/* Value stored for the key K: K repeated (K % 17 + 1) times.  The
+   duplicate key in each batch gets negated value. */
+struct value
+{
+  int size;
+  int buf[17];
+};
+
+static void
+make_value (struct value *val, int k, int v)
+{
+  int i;
+
+  val->size = k % 17 + 1;
+  for (i = 0; i < val->size; i++)
+    val->buf[i] = v;
+}
+
+static void
+check_value (GDBM_FILE dbf, int k, int v)
+{
+  datum key, content;
+  struct value val;
+
+  key.dptr = (char*) &k;
+  key.dsize = sizeof (k);
+  content = gdbm_fetch (dbf, key);
+  if (content.dptr == NULL)
+    {
+      fprintf (stderr, "%d: fetch failed: %s\n", k, gdbm_db_strerror (dbf));
+      exit (1);
+    }
+  make_value (&val, k, v);
+  if (content.dsize != val.size * sizeof (int)
+      || memcmp (content.dptr, val.buf, content.dsize))
+    {
+      fprintf (stderr, "%d: wrong content\n", k);
+      exit (1);
+    }
+  free (content.dptr);
+}
+
+int
+main (int argc, char **argv)
+{
+  GDBM_FILE dbf;
+  static gdbm_store_item items[BATCH + 1];
+  static int keys[BATCH + 1];
+  static struct value values[BATCH + 1];
+  gdbm_count_t count;
+  int i, k, n, rc;
+  int flags = 0;
+
+  while ((i = getopt (argc, argv, "lv")) != EOF)
+    {
+      switch (i)
+	{
+	case 'l':
+	  flags |= GDBM_LARGE;
+	  break;
+
+	case 'v':
+	  verbose++;
+	  break;
+
+	default:
+	  return 2;
+	}
+    }
+
+  /*
+   * 1) Create the database.
+   */
+  if (verbose)
+    printf ("creating database\n");
+  dbf = gdbm_open (dbname, GDBM_MIN_BLOCK_SIZE, GDBM_NEWDB | flags, 0644,
+		   NULL);
+  if (!dbf)
+    {
+      fprintf (stderr, "gdbm_open: %s\n", gdbm_strerror (gdbm_errno));
+      return 1;
+    }
+
+  /*
+   * 2) Store records in batches.
+   */
+  if (verbose)
+    printf ("storing %d keys\n", NKEYS);
+  for (k = 0; k < NKEYS; k += BATCH)
+    {
+      for (i = 0; i <= BATCH; i++)
+	{
+	  keys[i] = k + (i < BATCH ? i : BATCH / 2);
+	  make_value (&values[i], keys[i], i < BATCH ? keys[i] : -keys[i]);
+	  items[i].key.dptr = (char*) &keys[i];
+	  items[i].key.dsize = sizeof (keys[i]);
+	  items[i].content.dptr = (char*) values[i].buf;
+	  items[i].content.dsize = values[i].size * sizeof (int);
+	}
+      rc = gdbm_store_many (dbf, items, BATCH + 1, GDBM_REPLACE);
+      if (rc)
+	{
+	  fprintf (stderr, "gdbm_store_many: %d: %s\n", rc,
+		   gdbm_db_strerror (dbf));
+	  return 1;
+	}
+      for (i = 0; i <= BATCH; i++)
+	if (items[i].result != 0)
+	  {
+	    fprintf (stderr, "%d: wrong result %d\n", keys[i], items[i].result);
+	    return 1;
+	  }
+    }
+
+  /*
+   * 3) Verify records.
+   */
+  if (verbose)
+    printf ("verifying records\n");
+  for (k = 0; k < NKEYS; k++)
+    check_value (dbf, k, k % BATCH == BATCH / 2 ? -k : k);
+  if (gdbm_count (dbf, &count))
+    {
+      fprintf (stderr, "gdbm_count: %s\n", gdbm_db_strerror (dbf));
+      return 1;
+    }
+  if (count != NKEYS)
+    {
+      fprintf (stderr, "wrong number of keys: %llu\n",
+	       (unsigned long long) count);
+      return 1;
+    }
+
+  /*
+   * 4) Insert, half of the keys exist.
+   */
+  if (verbose)
+    printf ("inserting\n");
+  for (i = 0; i < BATCH; i++)
+    {
+      keys[i] = NKEYS - BATCH / 2 + i;
+      make_value (&values[i], keys[i], 0);
+      items[i].key.dptr = (char*) &keys[i];
+      items[i].key.dsize = sizeof (keys[i]);
+      items[i].content.dptr = (char*) values[i].buf;
+      items[i].content.dsize = values[i].size * sizeof (int);
+    }
+  rc = gdbm_store_many (dbf, items, BATCH, GDBM_INSERT);
+  if (rc != 1 || gdbm_errno != GDBM_CANNOT_REPLACE)
+    {
+      fprintf (stderr, "gdbm_store_many returned %d: %s\n", rc,
+	       gdbm_db_strerror (dbf));
+      return 1;
+    }
+  n = 0;
+  for (i = 0; i < BATCH; i++)
+    {
+      if (items[i].result != (keys[i] < NKEYS))
+	{
+	  fprintf (stderr, "%d: wrong result %d\n", keys[i], items[i].result);
+	  return 1;
+	}
+      if (keys[i] >= NKEYS)
+	check_value (dbf, keys[i], 0);
+      else
+	check_value (dbf, keys[i],
+		     keys[i] % BATCH == BATCH / 2 ? -keys[i] : keys[i]);
+      n += items[i].result;
+    }
+  if (n != BATCH / 2)
+    {
+      fprintf (stderr, "%d keys reported as existing\n", n);
+      return 1;
+    }
+
+  /*
+   * 5) Verify the structure.
+   */
+  if (gdbm_avail_verify (dbf))
+    {
+      fprintf (stderr, "gdbm_avail_verify: %s\n", gdbm_db_strerror (dbf));
+      return 1;
+    }
+  if (gdbm_close (dbf))
+    {
+      fprintf (stderr, "gdbm_close: %s\n", gdbm_strerror (gdbm_errno));
+      return 1;
+    }
+  return 0;
+}
@@ -0,0 +1,321 @@
+/*
+  NAME
+    gtstream - test transfer of values to and from file descriptors.
+
+  SYNOPSIS
+    gtstream [-v]
+
+  DESCRIPTION
+    Operation:
+
+    1) Create new database.  Store a record read from a regular file
+       with gdbm_store_from_fd and one read from a pipe.
+    2) Replace the first record with data read from a file.
+    3) Try to store a record from a file that is too short.  Verify
+       that the call fails and the old record is left intact.
+    4) Write the records to a regular file and to a pipe with
+       gdbm_fetch_to_fd and verify their content.
+    5) Verify the available space.
+
+  OPTIONS
+     -v   Verbosely print what's being done.
+
+  EXIT CODE
+     0    success
+     1    failure
+     2    usage error
+
+  LICENSE
+    This file is part of GDBM test suite.
+    Copyright (C) 2025 Free Software Foundation, Inc.
+
+    GDBM is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2, or (at your option)
+    any later version.
+
+    GDBM is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GDBM. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "autoconf.h"
+#include "gdbmdefs.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "records.h"
+#include <fcntl.h>
+#include <sys/wait.h>
+
+char dbname[] = "a.db";
+char tmpname[] = "a.tmp";
+int verbose = 0;
+
+#define BIGSIZE (300*1024)
+#define PIPESIZE (16*1024)
+
+/* Records used by the test. */
+enum { BIG_REC, SMALL_REC, MISSING_REC, NRECS };
+
+/* Create temporary file with the given content and return its
+   descriptor, positioned at its beginning. */
+static int
+tmpfile_fd (char const *buf, size_t size)
+{
+  int fd = open (tmpname, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd == -1)
+    {
+      perror (tmpname);
+      exit (1);
+    }
+  if (write (fd, buf, size) != size || lseek (fd, 0, SEEK_SET) != 0)
+    {
+      perror (tmpname);
+      exit (1);
+    }
+  return fd;
+}
+
+/* Read the whole content of FD into BUF of SIZE bytes.  Return the
+   number of bytes read. */
+static size_t
+read_all (int fd, char *buf, size_t size)
+{
+  size_t total = 0;
+  ssize_t n;
+
+  while (total < size && (n = read (fd, buf + total, size - total)) > 0)
+    total += n;
+  return total;
+}
+
+/* Store a new generation of the record I, of SIZE bytes, reading it
+   from a file. */
+static void
+store_file (GDBM_FILE dbf, int i, size_t size)
+{
+  int fd;
+
+  rec_size[i] = size;
+  rec_gen[i]++;
+  fd = tmpfile_fd (rec_data (i), size);
+  if (verbose)
+    printf ("storing %d from file\n", i);
+  if (gdbm_store_from_fd (dbf, rec_key (i), fd, size))
+    {
+      fprintf (stderr, "%d: gdbm_store_from_fd: %s\n", i,
+	       gdbm_db_strerror (dbf));
+      exit (1);
+    }
+  close (fd);
+}
+
+/* Store a new generation of the record I, of SIZE bytes, reading it
+   from a pipe. */
+static void
+store_pipe (GDBM_FILE dbf, int i, size_t size)
+{
+  int p[2];
+  pid_t pid;
+  int status;
+  char *buf;
+
+  rec_size[i] = size;
+  rec_gen[i]++;
+  buf = rec_data (i);
+  if (verbose)
+    printf ("storing %d from pipe\n", i);
+  if (pipe (p))
+    {
+      perror ("pipe");
+      exit (1);
+    }
+  pid = fork ();
+  if (pid == -1)
+    {
+      perror ("fork");
+      exit (1);
+    }
+  if (pid == 0)
+    {
+      close (p[0]);
+      _exit (write (p[1], buf, size) != size);
+    }
+  close (p[1]);
+  if (gdbm_store_from_fd (dbf, rec_key (i), p[0], size))
+    {
+      fprintf (stderr, "%d: gdbm_store_from_fd: %s\n", i,
+	       gdbm_db_strerror (dbf));
+      exit (1);
+    }
+  close (p[0]);
+  waitpid (pid, &status, 0);
+}
+
+static void
+check_file (GDBM_FILE dbf, int i)
+{
+  int fd = tmpfile_fd ("", 0);
+  size_t size = rec_size[i];
+  char *res = malloc (size + 1);
+
+  if (verbose)
+    printf ("fetching %d to file\n", i);
+  if (gdbm_fetch_to_fd (dbf, rec_key (i), fd))
+    {
+      fprintf (stderr, "%d: gdbm_fetch_to_fd: %s\n", i,
+	       gdbm_db_strerror (dbf));
+      exit (1);
+    }
+  lseek (fd, 0, SEEK_SET);
+  if (read_all (fd, res, size + 1) != size
+      || memcmp (res, rec_data (i), size))
+    {
+      fprintf (stderr, "%d: wrong content\n", i);
+      exit (1);
+    }
+  close (fd);
+  free (res);
+}
+
+static void
+check_pipe (GDBM_FILE dbf, int i)
+{
+  int p[2];
+  pid_t pid;
+  int status;
+  size_t size = rec_size[i];
+  char *res;
+
+  if (verbose)
+    printf ("fetching %d to pipe\n", i);
+  if (pipe (p))
+    {
+      perror ("pipe");
+      exit (1);
+    }
+  pid = fork ();
+  if (pid == -1)
+    {
+      perror ("fork");
+      exit (1);
+    }
+  if (pid == 0)
+    {
+      close (p[0]);
+      if (gdbm_fetch_to_fd (dbf, rec_key (i), p[1]))
+	{
+	  fprintf (stderr, "%d: gdbm_fetch_to_fd: %s\n", i,
+		   gdbm_db_strerror (dbf));
+	  _exit (1);
+	}
+      _exit (0);
+    }
+  close (p[1]);
+  res = malloc (size + 1);
+  if (read_all (p[0], res, size + 1) != size
+      || memcmp (res, rec_data (i), size))
+    {
+      fprintf (stderr, "%d: wrong content\n", i);
+      exit (1);
+    }
+  close (p[0]);
+  free (res);
+  if (waitpid (pid, &status, 0) != pid
+      || !WIFEXITED (status) || WEXITSTATUS (status))
+    {
+      fprintf (stderr, "%d: child failed\n", i);
+      exit (1);
+    }
+}
+
+int
+main (int argc, char **argv)
+{
+  GDBM_FILE dbf;
+  int i, fd;
+
+  while ((i = getopt (argc, argv, "v")) != EOF)
+    {
+      switch (i)
+	{
+	case 'v':
+	  verbose++;
+	  break;
+
+	default:
+	  return 2;
+	}
+    }
+
+  rec_init (NRECS);
+
+  /*
+   * 1) Create the database and store records.
+   */
+  if (verbose)
+    printf ("creating database\n");
+  dbf = gdbm_open (dbname, GDBM_MIN_BLOCK_SIZE, GDBM_NEWDB, 0644, NULL);
+  if (!dbf)
+    {
+      fprintf (stderr, "gdbm_open: %s\n", gdbm_strerror (gdbm_errno));
+      return 1;
+    }
+  store_file (dbf, BIG_REC, BIGSIZE);
+  store_pipe (dbf, SMALL_REC, PIPESIZE);
+
+  /*
+   * 2) Replace a record.
+   */
+  store_file (dbf, BIG_REC, BIGSIZE / 2);
+
+  /*
+   * 3) Short input.
+   */
+  if (verbose)
+    printf ("storing from short file\n");
+  fd = tmpfile_fd (rec_data (BIG_REC), 100);
+  if (gdbm_store_from_fd (dbf, rec_key (BIG_REC), fd, 200) == 0
+      || gdbm_errno != GDBM_FILE_EOF)
+    {
+      fprintf (stderr, "gdbm_store_from_fd succeeded on short input\n");
+      return 1;
+    }
+  close (fd);
+
+  /*
+   * 4) Fetch records.
+   */
+  check_file (dbf, BIG_REC);
+  check_pipe (dbf, BIG_REC);
+  check_file (dbf, SMALL_REC);
+  check_pipe (dbf, SMALL_REC);
+
+  if (gdbm_fetch_to_fd (dbf, rec_key (MISSING_REC), 1) == 0
+      || gdbm_errno != GDBM_ITEM_NOT_FOUND)
+    {
+      fprintf (stderr, "gdbm_fetch_to_fd found missing key\n");
+      return 1;
+    }
+
+  /*
+   * 5) Verify the available space.
+   */
+  if (gdbm_avail_verify (dbf))
+    {
+      fprintf (stderr, "gdbm_avail_verify: %s\n", gdbm_db_strerror (dbf));
+      return 1;
+    }
+  if (gdbm_close (dbf))
+    {
+      fprintf (stderr, "gdbm_close: %s\n", gdbm_strerror (gdbm_errno));
+      return 1;
+    }
+  unlink (tmpname);
+  return 0;
+}
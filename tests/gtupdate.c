@@ -0,0 +1,284 @@
+/*
+  NAME
+    gtupdate - test read-modify-write updates.
+
+  SYNOPSIS
+    gtupdate [-v]
+
+  DESCRIPTION
+    Operation:
+
+    1) Create new database.
+    2) Create NKEYS counters by calling gdbm_update on absent keys.
+    3) Increment each counter NROUNDS times, modifying the value in
+       place.  In the last round, the update function reads another
+       counter from the database.  Verify that the file does not grow.
+    4) Append to, shrink, delete and keep records.  Records are kept
+       after modifying the content passed to the update function.
+    5) Verify the records and the available space.
+
+  OPTIONS
+     -v   Verbosely print what's being done.
+
+  EXIT CODE
+     0    success
+     1    failure
+     2    usage error
+
+  LICENSE
+    This file is part of GDBM test suite.
+    Copyright (C) 2025 Free Software Foundation, Inc.
+
+    GDBM is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2, or (at your option)
+    any later version.
+
+    GDBM is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GDBM. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "autoconf.h"
+#include "gdbmdefs.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+char dbname[] = "a.db";
+int verbose = 0;
+
+#define NKEYS 4096
+#define NROUNDS 10
+
+static int
+counter_incr (datum key, datum *content, void *data)
+{
+  static int zero;
+
+  if (content->dptr == NULL)
+    {
+      content->dptr = (char*) &zero;
+      content->dsize = sizeof (zero);
+    }
+  else if (content->dsize != sizeof (int))
+    {
+      fprintf (stderr, "%d: wrong counter size\n", *(int*)key.dptr);
+      exit (1);
+    }
+  else
+    ++*(int*)content->dptr;
+  return GDBM_UPDATE_STORE;
+}
+
+/* Increment the counter, after reading another one from the database
+   DATA. */
+static int
+counter_incr_read (datum key, datum *content, void *data)
+{
+  GDBM_FILE dbf = data;
+  int other = (*(int*)key.dptr + NKEYS / 2) % NKEYS;
+  datum okey, ocontent;
+
+  okey.dptr = (char*) &other;
+  okey.dsize = sizeof (other);
+  ocontent = gdbm_fetch (dbf, okey);
+  if (ocontent.dptr == NULL || ocontent.dsize != sizeof (int))
+    {
+      fprintf (stderr, "%d: fetch failed: %s\n", other,
+	       gdbm_db_strerror (dbf));
+      exit (1);
+    }
+  free (ocontent.dptr);
+  return counter_incr (key, content, data);
+}
+
+/* Operations on the record, selected by key modulo 4. */
+static int
+modify (datum key, datum *content, void *data)
+{
+  static int buf[2];
+  int k = *(int*)key.dptr;
+
+  if (content->dptr == NULL)
+    {
+      fprintf (stderr, "%d: not found\n", k);
+      exit (1);
+    }
+  switch (k % 4)
+    {
+    case 0:
+      /* Append. */
+      buf[0] = *(int*)content->dptr;
+      buf[1] = -k;
+      content->dptr = (char*) buf;
+      content->dsize = sizeof (buf);
+      return GDBM_UPDATE_STORE;
+
+    case 1:
+      /* Shrink. */
+      content->dsize = 0;
+      return GDBM_UPDATE_STORE;
+
+    case 2:
+      return GDBM_UPDATE_DELETE;
+    }
+  /* Keep.  The modified copy must be discarded. */
+  *(int*)content->dptr = -k;
+  return GDBM_UPDATE_KEEP;
+}
+
+static int
+update (GDBM_FILE dbf, int k, gdbm_update_func func)
+{
+  datum key;
+
+  key.dptr = (char*) &k;
+  key.dsize = sizeof (k);
+  if (gdbm_update (dbf, key, func, dbf))
+    {
+      fprintf (stderr, "%d: gdbm_update: %s\n", k, gdbm_db_strerror (dbf));
+      exit (1);
+    }
+  return 0;
+}
+
+int
+main (int argc, char **argv)
+{
+  GDBM_FILE dbf;
+  datum key, content;
+  int i, n;
+  struct stat st;
+  off_t size;
+
+  while ((i = getopt (argc, argv, "v")) != EOF)
+    {
+      switch (i)
+	{
+	case 'v':
+	  verbose++;
+	  break;
+
+	default:
+	  return 2;
+	}
+    }
+
+  /*
+   * 1) Create the database.
+   */
+  if (verbose)
+    printf ("creating database\n");
+  dbf = gdbm_open (dbname, GDBM_MIN_BLOCK_SIZE, GDBM_NEWDB, 0644, NULL);
+  if (!dbf)
+    {
+      fprintf (stderr, "gdbm_open: %s\n", gdbm_strerror (gdbm_errno));
+      return 1;
+    }
+
+  /*
+   * 2) Create counters.
+   */
+  for (i = 0; i < NKEYS; i++)
+    update (dbf, i, counter_incr);
+  if (fstat (gdbm_fdesc (dbf), &st))
+    {
+      perror ("fstat");
+      return 1;
+    }
+  size = st.st_size;
+
+  /*
+   * 3) Increment counters.
+   */
+  if (verbose)
+    printf ("incrementing counters\n");
+  for (n = 0; n < NROUNDS; n++)
+    for (i = 0; i < NKEYS; i++)
+      update (dbf, i, n < NROUNDS - 1 ? counter_incr : counter_incr_read);
+  if (fstat (gdbm_fdesc (dbf), &st))
+    {
+      perror ("fstat");
+      return 1;
+    }
+  if (st.st_size != size)
+    {
+      fprintf (stderr, "file size changed: %lld -> %lld\n",
+	       (long long) size, (long long) st.st_size);
+      return 1;
+    }
+
+  /*
+   * 4) Other modifications.
+   */
+  if (verbose)
+    printf ("modifying records\n");
+  for (i = 0; i < NKEYS; i++)
+    update (dbf, i, modify);
+
+  /*
+   * 5) Verify.
+   */
+  if (verbose)
+    printf ("verifying\n");
+  key.dptr = (char*) &i;
+  key.dsize = sizeof (i);
+  for (i = 0; i < NKEYS; i++)
+    {
+      content = gdbm_fetch (dbf, key);
+      if (i % 4 == 2)
+	{
+	  if (content.dptr != NULL || gdbm_errno != GDBM_ITEM_NOT_FOUND)
+	    {
+	      fprintf (stderr, "%d: not deleted\n", i);
+	      return 1;
+	    }
+	  continue;
+	}
+      if (content.dptr == NULL)
+	{
+	  fprintf (stderr, "%d: fetch failed: %s\n", i,
+		   gdbm_db_strerror (dbf));
+	  return 1;
+	}
+      switch (i % 4)
+	{
+	case 0:
+	  n = content.dsize == 2 * sizeof (int)
+	      && ((int*)content.dptr)[0] == NROUNDS
+	      && ((int*)content.dptr)[1] == -i;
+	  break;
+
+	case 1:
+	  n = content.dsize == 0;
+	  break;
+
+	case 3:
+	  n = content.dsize == sizeof (int) && *(int*)content.dptr == NROUNDS;
+	  break;
+	}
+      if (!n)
+	{
+	  fprintf (stderr, "%d: wrong content\n", i);
+	  return 1;
+	}
+      free (content.dptr);
+    }
+
+  if (gdbm_avail_verify (dbf))
+    {
+      fprintf (stderr, "gdbm_avail_verify: %s\n", gdbm_db_strerror (dbf));
+      return 1;
+    }
+  if (gdbm_close (dbf))
+    {
+      fprintf (stderr, "gdbm_close: %s\n", gdbm_strerror (gdbm_errno));
+      return 1;
+    }
+  return 0;
+}
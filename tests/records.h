@@ -0,0 +1,203 @@
+/* This file is part of GDBM test suite.
+   Copyright (C) 2025 Free Software Foundation, Inc.
+
+   GDBM is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2, or (at your option)
+   any later version.
+
+   GDBM is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with GDBM. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* Generator and checker of test records.
+
+   Records are numbered from 0 to rec_count - 1.  The data of a record
+   are computed from its number and its generation number, which is
+   incremented each time the record is rewritten, so that the test
+   programs need only remember the size of each record. */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "gdbm.h"
+
+/* Number of records. */
+int rec_count;
+/* Expected sizes of the records.  -1 means absent record. */
+int *rec_size;
+/* Generation numbers of the records. */
+int *rec_gen;
+/* Number of consecutive data bytes that have the same value.  Values
+   above 1 make the data compressible. */
+int rec_run = 1;
+
+/* Fill BUF with SIZE bytes of data of the record I of generation GEN. */
+void
+rec_default_pattern (char *buf, int size, int i, int gen)
+{
+  int j;
+
+  for (j = 0; j < size; j++)
+    buf[j] = i + gen * 7 + j / rec_run;
+}
+
+/* Return the key of the record I, which is I itself. */
+datum
+rec_int_key (int i)
+{
+  static int keybuf;
+  datum key;
+
+  keybuf = i;
+  key.dptr = (char*) &keybuf;
+  key.dsize = sizeof (keybuf);
+  return key;
+}
+
+/* Functions that make the key and the data of a record.  The key
+   may be kept in a static buffer. */
+datum (*rec_key) (int i) = rec_int_key;
+void (*rec_pattern) (char *buf, int size, int i, int gen) =
+  rec_default_pattern;
+
+/* Allocate COUNT records, all absent. */
+void
+rec_init (int count)
+{
+  int i;
+
+  rec_count = count;
+  rec_size = calloc (count, sizeof (rec_size[0]));
+  rec_gen = calloc (count, sizeof (rec_gen[0]));
+  if (!rec_size || !rec_gen)
+    {
+      perror ("calloc");
+      exit (1);
+    }
+  for (i = 0; i < count; i++)
+    rec_size[i] = -1;
+}
+
+/* Return the expected data of the record I.  They are kept in a static
+   buffer. */
+char *
+rec_data (int i)
+{
+  static char *buf;
+  static size_t bufsize;
+
+  if (bufsize <= (size_t) rec_size[i])
+    {
+      bufsize = rec_size[i] + 1;
+      buf = realloc (buf, bufsize);
+      if (!buf)
+	{
+	  perror ("realloc");
+	  exit (1);
+	}
+    }
+  rec_pattern (buf, rec_size[i], i, rec_gen[i]);
+  return buf;
+}
+
+/* Store the record I in DBF, as described by its size and generation. */
+void
+rec_write (GDBM_FILE dbf, int i)
+{
+  datum content;
+
+  content.dptr = rec_data (i);
+  content.dsize = rec_size[i];
+  if (gdbm_store (dbf, rec_key (i), content, GDBM_REPLACE))
+    {
+      fprintf (stderr, "%d: item not inserted: %s\n", i,
+	       gdbm_db_strerror (dbf));
+      exit (1);
+    }
+}
+
+/* Store a new generation of the record I, of SIZE bytes, in DBF. */
+void
+rec_store (GDBM_FILE dbf, int i, int size)
+{
+  rec_size[i] = size;
+  rec_gen[i]++;
+  rec_write (dbf, i);
+}
+
+/* Append the next N bytes of its data to the record I. */
+void
+rec_append (GDBM_FILE dbf, int i, int n)
+{
+  datum content;
+
+  rec_size[i] += n;
+  content.dptr = rec_data (i) + rec_size[i] - n;
+  content.dsize = n;
+  if (gdbm_append (dbf, rec_key (i), content))
+    {
+      fprintf (stderr, "%d: gdbm_append: %s\n", i, gdbm_db_strerror (dbf));
+      exit (1);
+    }
+}
+
+/* Delete the record I from DBF. */
+void
+rec_delete (GDBM_FILE dbf, int i)
+{
+  if (gdbm_delete (dbf, rec_key (i)))
+    {
+      fprintf (stderr, "%d: gdbm_delete: %s\n", i, gdbm_db_strerror (dbf));
+      exit (1);
+    }
+  rec_size[i] = -1;
+}
+
+/* Check that CONTENT, as returned by a fetch, holds the data of the
+   record I. */
+void
+rec_check (int i, datum content)
+{
+  if (content.dptr == NULL)
+    {
+      fprintf (stderr, "%d: fetch failed: %s\n", i,
+	       gdbm_strerror (gdbm_errno));
+      exit (1);
+    }
+  if (content.dsize != rec_size[i]
+      || memcmp (content.dptr, rec_data (i), rec_size[i]))
+    {
+      fprintf (stderr, "%d: wrong content\n", i);
+      exit (1);
+    }
+}
+
+/* Check that DBF holds the present records and only them. */
+void
+rec_verify (GDBM_FILE dbf)
+{
+  int i;
+
+  for (i = 0; i < rec_count; i++)
+    {
+      datum content = gdbm_fetch (dbf, rec_key (i));
+
+      if (rec_size[i] == -1)
+	{
+	  if (content.dptr || gdbm_errno != GDBM_ITEM_NOT_FOUND)
+	    {
+	      fprintf (stderr, "%d: absent record found\n", i);
+	      exit (1);
+	    }
+	  continue;
+	}
+      rec_check (i, content);
+      free (content.dptr);
+    }
+}
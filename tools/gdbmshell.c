@@ -170,6 +170,10 @@ opendb (char *dbname, int fd)
     {
       gdbmshell_setopt ("GDBM_SETCENTFREE", GDBM_SETCENTFREE, 1);
     }
+  if (variable_get ("threads", VART_INT, (void**) &n) == VAR_OK)
+    {
+      gdbmshell_setopt ("GDBM_SETCHECKTHREADS", GDBM_SETCHECKTHREADS, n);
+    }
 
   return GDBMSHELL_OK;
 }
@@ -236,7 +240,7 @@ print_bucket (PAGERFILE *pager)
 {
   int index;
   int hash_prefix;
-  off_t adr = gdbm_file->dir[gdbm_file->bucket_dir];
+  off_t adr = gdbm_dir_entry (gdbm_file, gdbm_file->bucket_dir);
   hash_bucket *bucket = gdbm_file->bucket;
   int start = bucket_dir_start ();
   int dircount = bucket_refcount ();
@@ -272,11 +276,17 @@ print_bucket (PAGERFILE *pager)
 		_("    #    hash value     key size    data size     data adr home  key start\n"));
   for (index = 0; index < gdbm_file->header->bucket_elems; index++)
     {
-      pager_printf (pager, " %4d  %12x  %11d  %11d  %11lu %4d", index,
+      pager_printf (pager, " %4d  %12x  %11d  %11d", index,
 		    bucket->h_table[index].hash_value,
 		    bucket->h_table[index].key_size,
-		    bucket->h_table[index].data_size,
-		    (unsigned long) bucket->h_table[index].data_pointer,
+		    bucket->h_table[index].data_size);
+      if (bucket->h_table[index].hash_value != -1
+	  && bucket_element_inline_p (gdbm_file, &bucket->h_table[index]))
+	pager_printf (pager, "  %11s", "inline");
+      else
+	pager_printf (pager, "  %11lu",
+		      (unsigned long) bucket->h_table[index].data_pointer);
+      pager_printf (pager, " %4d",
 		    bucket->h_table[index].hash_value %
 		    gdbm_file->header->bucket_elems);
       if (bucket->h_table[index].key_size)
@@ -926,8 +936,8 @@ print_dir_handler (struct command_param *param GDBM_ARG_UNUSED,
 
   pager_writeln (cenv->pager, _("Hash table directory."));
   pager_printf (cenv->pager,
-		_("  Size =  %d.  Capacity = %lu.  Bits = %d,  Buckets = %zu.\n\n"),
-		gdbm_file->header->dir_size,
+		_("  Size =  %zu.  Capacity = %lu.  Bits = %d,  Buckets = %zu.\n\n"),
+		GDBM_DIR_SIZE (gdbm_file),
 		GDBM_DIR_COUNT (gdbm_file),
 		gdbm_file->header->dir_bits,
 		bucket_count ());
@@ -937,8 +947,10 @@ print_dir_handler (struct command_param *param GDBM_ARG_UNUSED,
   for (i = 0; i < GDBM_DIR_COUNT (gdbm_file); i++)
     pager_printf (cenv->pager, "  %10d: %08x %12lu\n",
 		  i,
-		  i << (GDBM_HASH_BITS - gdbm_file->header->dir_bits),
-		  (unsigned long) gdbm_file->dir[i]);
+		  (unsigned) i << ((gdbm_large_p (gdbm_file)
+				    ? GDBM_DIR_HASH_BITS : GDBM_HASH_BITS)
+				   - gdbm_file->header->dir_bits),
+		  (unsigned long) gdbm_dir_entry (gdbm_file, i));
 
   return GDBMSHELL_OK;
 }
@@ -965,6 +977,10 @@ print_header_handler (struct command_param *param GDBM_ARG_UNUSED,
       type = "GDBM (numsync)";
       break;
 
+    case GDBM_FEATURE_MAGIC:
+      type = "GDBM (numsync with features)";
+      break;
+
     default:
       abort ();
     }
@@ -973,7 +989,7 @@ print_header_handler (struct command_param *param GDBM_ARG_UNUSED,
   pager_printf (pager, _("  type            = %s\n"), type);
   pager_printf (pager, _("  directory start = %lu\n"),
 		(unsigned long) gdbm_file->header->dir);
-  pager_printf (pager, _("  directory size  = %d\n"), gdbm_file->header->dir_size);
+  pager_printf (pager, _("  directory size  = %zu\n"), GDBM_DIR_SIZE (gdbm_file));
   pager_printf (pager, _("  directory depth = %d\n"), gdbm_file->header->dir_bits);
   pager_printf (pager, _("  block size      = %d\n"), gdbm_file->header->block_size);
   pager_printf (pager, _("  bucket elems    = %d\n"), gdbm_file->header->bucket_elems);
@@ -992,6 +1008,9 @@ print_header_handler (struct command_param *param GDBM_ARG_UNUSED,
       pager_printf (pager, _("\nExtended Header: \n\n"));
       pager_printf (pager, _("      version = %d\n"), gdbm_file->xheader->version);
       pager_printf (pager, _("      numsync = %u\n"), gdbm_file->xheader->numsync);
+      if (gdbm_file->header->header_magic == GDBM_FEATURE_MAGIC)
+	pager_printf (pager, _("     features = %#x\n"),
+		      gdbm_file->xheader->features);
     }
 
   return GDBMSHELL_OK;
@@ -1268,9 +1287,7 @@ hash_handler (struct command_param *param GDBM_ARG_UNUSED,
       _gdbm_hash_key (gdbm_file, PARAM_DATUM (param, 0),
 		       &hashval, &bucket, &off);
       pager_printf (cenv->pager, _("hash value = %x, bucket #%u, slot %u"),
-		    hashval,
-		    hashval >> (GDBM_HASH_BITS - gdbm_file->header->dir_bits),
-		    hashval % gdbm_file->header->bucket_elems);
+		    hashval, bucket, off);
     }
   else
     pager_printf (cenv->pager, _("hash value = %x"),
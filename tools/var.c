@@ -52,6 +52,7 @@ static int fd_sethook (struct variable *, union value *);
 static int centfree_sethook (struct variable *var, union value *v);
 static int coalesce_sethook (struct variable *var, union value *v);
 static int cachesize_sethook (struct variable *var, union value *v);
+static int threads_sethook (struct variable *var, union value *v);
 static int errormask_sethook (struct variable *var, union value *v);
 static int errormask_typeconv (struct variable *var, int type, void **retptr);
 static void errormask_freehook (void *);
@@ -142,6 +143,12 @@ static struct variable vartab[] = {
     .init = { .b = 0 },
     .sethook = centfree_sethook
   },
+  {
+    .name = "threads",
+    .type = VART_INT,
+    .flags = VARF_DFL,
+    .sethook = threads_sethook
+  },
   {
     .name = "filemode",
     .type = VART_INT,
@@ -645,6 +652,19 @@ cachesize_sethook (struct variable *var, union value *v)
 	 ? VAR_OK : VAR_ERR_GDBM;
 }
 
+static int
+threads_sethook (struct variable *var, union value *v)
+{
+  if (!v)
+    return gdbmshell_setopt ("GDBM_SETCHECKTHREADS", GDBM_SETCHECKTHREADS, 1)
+	   == 0 ? VAR_OK : VAR_ERR_GDBM;
+  if (v->num < 0)
+    return VAR_ERR_BADVALUE;
+  return gdbmshell_setopt ("GDBM_SETCHECKTHREADS", GDBM_SETCHECKTHREADS,
+			   v->num) == 0
+	 ? VAR_OK : VAR_ERR_GDBM;
+}
+
 static int
 centfree_sethook (struct variable *var, union value *v)
 {
@@ -709,6 +729,7 @@ const char * const errname[_GDBM_MAX_ERRNO+1] = {
   [GDBM_ERR_SNAPSHOT_CLONE]     = "GDBM_ERR_SNAPSHOT_CLONE",
   [GDBM_ERR_REALPATH]           = "GDBM_ERR_REALPATH",
   [GDBM_ERR_USAGE]              = "GDBM_ERR_USAGE",
+  [GDBM_BUFFER_TOO_SMALL]       = "GDBM_BUFFER_TOO_SMALL",
 };
 
 static int